@@ -0,0 +1,174 @@
+﻿#include "Animation.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <new>
+
+AnimationFramePool animation_frame_pool;
+
+void AnimationFramePool::init(const std::size_t blocks_count)
+{
+    blocks.resize(blocks_count);
+    // Thread the free list through all blocks.
+    free_first = nullptr;
+    for (auto i = blocks_count; i != 0; --i)
+    {
+        blocks[i - 1].next = free_first;
+        free_first = &blocks[i - 1];
+    }
+    blocks_used = 0;
+    heap_allocations = 0;
+}
+
+void AnimationFramePool::destroy()
+{
+    blocks.clear();
+    blocks.shrink_to_fit();
+    free_first = nullptr;
+}
+
+void* AnimationFramePool::allocate(const std::size_t size)
+{
+    if (size > block_size || free_first == nullptr)
+    {
+        ++heap_allocations;
+        return ::operator new(size);
+    }
+    const auto block = free_first;
+    free_first = block->next;
+    ++blocks_used;
+    return block;
+}
+
+void AnimationFramePool::deallocate(void* const p)
+{
+    const auto block = static_cast<Block*>(p);
+    if (blocks.empty() || block < blocks.data() || block >= blocks.data() + blocks.size())
+    {
+        ::operator delete(p);
+        return;
+    }
+    block->next = free_first;
+    free_first = block;
+    --blocks_used;
+}
+
+std::coroutine_handle<> AnimationScript::FinalAwaiter::await_suspend(const Handle handle) noexcept
+{
+    const auto waiter = handle.promise().waiter;
+    if (waiter)
+    {
+        return waiter;
+    }
+    return std::noop_coroutine();
+}
+
+void AnimationScript::promise_type::unhandled_exception() noexcept
+{
+    std::cout << "Unhandled exception in an animation script" << std::endl;
+    std::abort();
+}
+
+AnimationScript::Handle AnimationScript::ChildAwaiter::await_suspend(const Handle parent) noexcept
+{
+    auto& parent_promise = parent.promise();
+    const auto scheduler = parent_promise.scheduler;
+    // The parent is resumed only by the child when it finishes.
+    parent_promise.wake_time_s = std::numeric_limits<double>::infinity();
+    parent_promise.suspend_frame = scheduler->frame;
+
+    child.promise().waiter = parent;
+    // The scheduler owns the child from now on and destroys it when it finishes.
+    // The child starts right away (the handle is resumed by symmetric transfer),
+    // so it's marked as already resumed on this frame.
+    scheduler->spawn(AnimationScript{ child });
+    child.promise().suspend_frame = scheduler->frame;
+    return child;
+}
+
+void AnimationWait::await_suspend(const AnimationScript::Handle handle) noexcept
+{
+    auto& promise = handle.promise();
+    scheduler = promise.scheduler;
+    promise.wake_time_s = scheduler->time_s + duration_s;
+    promise.suspend_frame = scheduler->frame;
+}
+
+float AnimationWait::await_resume() noexcept
+{
+    return scheduler->time_delta_s;
+}
+
+AnimationScript tween(float& value, const float target, const float duration_s)
+{
+    const auto start = value;
+    auto elapsed_s = 0.0f;
+    while (elapsed_s < duration_s)
+    {
+        elapsed_s += co_await next_frame();
+        value = start + (target - start) * std::min(elapsed_s / duration_s, 1.0f);
+    }
+    // A tween of zero length never enters the loop, and start + (target - start) may differ from target
+    // in the last bit, so the end value is set exactly.
+    value = target;
+}
+
+void AnimationScheduler::init(const std::size_t scripts_max)
+{
+    scripts.reserve(scripts_max);
+    time_s = 0.0;
+    time_delta_s = 0.0f;
+    frame = 0;
+    resumed_count = 0;
+}
+
+void AnimationScheduler::destroy()
+{
+    // A script may be destroyed in the middle of awaiting a child, which is destroyed separately.
+    for (const auto script : scripts)
+    {
+        script.destroy();
+    }
+    scripts.clear();
+}
+
+void AnimationScheduler::spawn(AnimationScript script)
+{
+    auto& promise = script.handle.promise();
+    promise.scheduler = this;
+    promise.wake_time_s = time_s;
+    promise.suspend_frame = frame;
+    scripts.push_back(std::exchange(script.handle, { }));
+}
+
+void AnimationScheduler::update(const float time_delta)
+{
+    time_delta_s = time_delta;
+    time_s += time_delta;
+    ++frame;
+    resumed_count = 0;
+    // Scripts spawned during the loop are appended and are visited in the same loop
+    // (indices stay valid even if the array grows).
+    // Finished scripts are replaced by the last one, which is then visited at the same index.
+    for (std::size_t i = 0; i < scripts.size();)
+    {
+        const auto script = scripts[i];
+        const auto& promise = script.promise();
+        if (!script.done() && promise.suspend_frame != frame && promise.wake_time_s <= time_s)
+        {
+            script.resume();
+            ++resumed_count;
+        }
+        if (script.done())
+        {
+            script.destroy();
+            scripts[i] = scripts.back();
+            scripts.pop_back();
+            continue;
+        }
+        ++i;
+    }
+}
@@ -0,0 +1,205 @@
+﻿#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Animation scripts are C++20 coroutines that describe a sequence of animations as straight-line code:
+//
+//     AnimationScript turns(float& angle)
+//     {
+//         co_await tween(angle, angle + glm::radians(90.0f), 0.5f);
+//         co_await wait(0.25f);
+//         co_await tween(angle, angle - glm::radians(90.0f), 0.5f);
+//     }
+//
+// Without coroutines, the same sequence needs a hand-written state machine
+// (which step is running, how much time is left, and so on).
+// The compiler generates this state machine and stores it in a coroutine frame.
+//
+// A script is run by AnimationScheduler, which resumes every script whose wait is over once per frame.
+// co_await of another script starts it and resumes the awaiting script when it finishes.
+
+// Pool of fixed size blocks for coroutine frames.
+// A coroutine frame is allocated when a script is called and freed when it finishes,
+// so scripts that await short child scripts allocate all the time. The pool turns it into a free list pop.
+// Frames that are larger than a block (or don't fit into the pool) fall back to the heap and are counted.
+// It's not thread-safe: all scripts run on the main thread.
+struct AnimationFramePool
+{
+    static constexpr std::size_t block_size{ 512 };
+
+    std::size_t blocks_used;
+    std::size_t heap_allocations;
+
+    void init(std::size_t blocks_count);
+    void destroy();
+
+    void* allocate(std::size_t size);
+    void deallocate(void* p);
+
+private:
+    union Block
+    {
+        Block* next;
+        alignas(std::max_align_t) unsigned char bytes[block_size];
+    };
+
+    std::vector<Block> blocks;
+    Block* free_first;
+};
+
+extern AnimationFramePool animation_frame_pool;
+
+struct AnimationScheduler;
+
+// Return type of animation scripts. Owns the coroutine until it's started.
+struct AnimationScript
+{
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    // Resumes the awaiting script (if any) right away, so that the next step of a sequence starts on the same frame.
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept;
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    struct promise_type
+    {
+        AnimationScheduler* scheduler{ nullptr };
+        // Scheduler time when the script should be resumed.
+        double wake_time_s{ 0.0 };
+        // Scheduler frame when the script was suspended last time. It's not resumed again on the same frame.
+        std::uint64_t suspend_frame{ 0 };
+        // The script that awaits this one.
+        Handle waiter{ };
+
+        AnimationScript get_return_object() noexcept
+        {
+            return AnimationScript{ Handle::from_promise(*this) };
+        }
+        // Scripts don't run until they are spawned or awaited.
+        std::suspend_always initial_suspend() noexcept
+        {
+            return { };
+        }
+        FinalAwaiter final_suspend() noexcept
+        {
+            return { };
+        }
+        void return_void() noexcept
+        {
+        }
+        void unhandled_exception() noexcept;
+
+        static void* operator new(const std::size_t size)
+        {
+            return animation_frame_pool.allocate(size);
+        }
+        static void operator delete(void* const p)
+        {
+            animation_frame_pool.deallocate(p);
+        }
+    };
+
+    // Starts the child script and suspends until it finishes.
+    struct ChildAwaiter
+    {
+        Handle child;
+
+        bool await_ready() noexcept
+        {
+            return !child;
+        }
+        Handle await_suspend(Handle parent) noexcept;
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    Handle handle;
+
+    explicit AnimationScript(const Handle h) noexcept
+        : handle{ h }
+    {
+    }
+    AnimationScript(AnimationScript&& other) noexcept
+        : handle{ std::exchange(other.handle, { }) }
+    {
+    }
+    AnimationScript(const AnimationScript&) = delete;
+    AnimationScript& operator=(const AnimationScript&) = delete;
+    AnimationScript& operator=(AnimationScript&&) = delete;
+    ~AnimationScript()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    ChildAwaiter operator co_await() && noexcept
+    {
+        return ChildAwaiter{ std::exchange(handle, { }) };
+    }
+};
+
+// Suspends the script for the given time. co_await returns the time step of the frame it's resumed on.
+// wait(0.0f) resumes on the next frame.
+struct AnimationWait
+{
+    float duration_s;
+    const AnimationScheduler* scheduler;
+
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+    void await_suspend(AnimationScript::Handle handle) noexcept;
+    float await_resume() noexcept;
+};
+
+inline AnimationWait wait(const float duration_s)
+{
+    return AnimationWait{ duration_s, nullptr };
+}
+
+inline AnimationWait next_frame()
+{
+    return AnimationWait{ 0.0f, nullptr };
+}
+
+// Changes value to target linearly over the duration.
+AnimationScript tween(float& value, float target, float duration_s);
+
+// Runs scripts. All scripts are kept in one array, and update() walks it once per frame,
+// resuming scripts whose wait is over. Nothing is allocated per frame as long as the count of
+// scripts stays below the reserved capacity and coroutine frames fit into the pool.
+struct AnimationScheduler
+{
+    std::vector<AnimationScript::Handle> scripts;
+    double time_s;
+    float time_delta_s;
+    std::uint64_t frame;
+
+    // Count of resumed scripts during the last update.
+    std::size_t resumed_count;
+
+    void init(std::size_t scripts_max);
+    // Destroys all scripts.
+    void destroy();
+
+    // Starts the script on the next update.
+    void spawn(AnimationScript script);
+    void update(float time_delta_s);
+};
@@ -0,0 +1,470 @@
+﻿#include "City.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
+
+#include <glm/gtc/type_ptr.hpp>
+
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec4 aColor;
+out vec3 vColor;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(aPosition, 1.0);
+    vColor = aColor.rgb;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// Layout of the file: the header, then sets of all cells.
+// The version has to be bumped whenever the city, the sampling or the layout change, so that stale files are rebaked.
+struct CityVisibilityHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t cells_count;
+    std::uint32_t buildings_count;
+    std::uint32_t words_per_cell;
+};
+
+static constexpr char visibility_magic[8] = { 'G', 'T', 'C', 'I', 'T', 'Y', 'V', 'S' };
+static constexpr std::uint32_t visibility_version{ 2 };
+
+void City::init()
+{
+    // Lots have random buildings, a few of them are empty squares, and a few are towers.
+    std::mt19937 random{ 5 };
+    std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+    buildings.clear();
+    for (std::size_t z = 0; z != lots_per_side; ++z)
+    {
+        for (std::size_t x = 0; x != lots_per_side; ++x)
+        {
+            const auto lot = z * lots_per_side + x;
+            if (unit(random) < 0.1f)
+            {
+                lot_buildings[lot] = no_building;
+                continue;
+            }
+            const glm::vec2 center{
+                origin.x + lot_size * (static_cast<float>(x) + 0.5f),
+                origin.y + lot_size * (static_cast<float>(z) + 0.5f),
+            };
+            // Streets are from 0.8 to 2.4 units wide.
+            const glm::vec2 half_size{ 1.8f + 0.8f * unit(random), 1.8f + 0.8f * unit(random) };
+            const auto height = unit(random) < 0.1f ? 14.0f + 10.0f * unit(random) : 2.0f + 8.0f * unit(random);
+            lot_buildings[lot] = static_cast<std::int32_t>(buildings.size());
+            buildings.push_back({
+                { center.x - half_size.x, ground_height, center.y - half_size.y },
+                { center.x + half_size.x, ground_height + height, center.y + half_size.y },
+            });
+        }
+    }
+
+    // Faces are shaded by their direction, and buildings have slightly different shades of gray.
+    std::vector<CityVertex> vertices;
+    vertices.reserve(buildings.size() * vertices_per_building);
+    const auto push_face = [&vertices](const glm::vec3& corner, const glm::vec3& u, const glm::vec3& v, const std::uint32_t color)
+        {
+            const glm::vec3 positions[6] = { corner, corner + u, corner + v, corner + u + v, corner + v, corner + u };
+            for (const auto& position : positions)
+            {
+                vertices.push_back({ position, color });
+            }
+        };
+    for (const auto& building : buildings)
+    {
+        const auto tint = glm::vec3{ 0.75f, 0.72f, 0.68f } * (0.8f + 0.2f * unit(random));
+        const auto size = building.max - building.min;
+        const glm::vec3 x{ size.x, 0.0f, 0.0f };
+        const glm::vec3 y{ 0.0f, size.y, 0.0f };
+        const glm::vec3 z{ 0.0f, 0.0f, size.z };
+        push_face(building.min + y, z, x, pack_color(tint));
+        push_face(building.min, x, y, pack_color(tint * 0.55f));
+        push_face(building.min + z + x, -x, y, pack_color(tint * 0.8f));
+        push_face(building.min + z, -z, y, pack_color(tint * 0.65f));
+        push_face(building.min + x, z, y, pack_color(tint * 0.9f));
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(CityVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CityVertex), reinterpret_cast<void*>(offsetof(CityVertex, position)));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CityVertex), reinterpret_cast<void*>(offsetof(CityVertex, color)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+
+    shader_program = create_program(shader_vertex_source, shader_fragment_source, "city program");
+    gpu_timer.init();
+
+    visibility_words = (buildings.size() + 31) / 32;
+    cell = cells_count;
+    buildings_drawn = 0;
+    ranges_drawn = 0;
+}
+
+void City::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    file.close();
+    visibility_baked.clear();
+    visibility_baked.shrink_to_fit();
+    visibility = nullptr;
+}
+
+void City::load_visibility(const char* const path)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+    const auto milliseconds = [&time_start]()
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+        };
+
+    if (file.open(path))
+    {
+        CityVisibilityHeader header{ };
+        if (file.size == sizeof(header) + visibility_bytes())
+        {
+            std::memcpy(&header, file.data, sizeof(header));
+        }
+        if (std::memcmp(header.magic, visibility_magic, sizeof(visibility_magic)) == 0 && header.version == visibility_version
+            && header.cells_count == cells_count && header.buildings_count == buildings.size() && header.words_per_cell == visibility_words)
+        {
+            visibility = reinterpret_cast<const std::uint32_t*>(file.data + sizeof(header));
+            std::cout << "City: visibility sets mapped from " << path << " in " << milliseconds() << " ms" << std::endl;
+            return;
+        }
+        std::cout << "City: visibility sets in " << path << " are stale" << std::endl;
+        file.close();
+    }
+
+    bake();
+    std::size_t visible_count = 0;
+    std::size_t runs_count = 0;
+    for (std::size_t c = 0; c != cells_count; ++c)
+    {
+        auto previous = false;
+        for (std::size_t building = 0; building != buildings.size(); ++building)
+        {
+            const auto bit = ((visibility[c * visibility_words + building / 32] >> (building % 32)) & 1) != 0;
+            visible_count += bit ? 1 : 0;
+            runs_count += bit != previous ? 1 : 0;
+            previous = bit;
+        }
+        runs_count += previous ? 1 : 0;
+    }
+    // Lists of indices would take 2 bytes per visible building, run-length coding a byte per run of visible
+    // or hidden buildings. Both are larger than bitsets for a city of a few hundred buildings, so sets stay bitsets.
+    std::cout << "City: visibility of " << buildings.size() << " buildings from " << cells_count << " cells baked in " << milliseconds() << " ms"
+        << ", " << static_cast<double>(visible_count) / static_cast<double>(cells_count) << " visible on average"
+        << ", " << visibility_bytes() / 1024.0 << " KB as bitsets (" << visible_count * sizeof(std::uint16_t) / 1024.0 << " KB as index lists, "
+        << runs_count / 1024.0 << " KB as run lengths)" << std::endl;
+
+    CityVisibilityHeader header{ };
+    std::memcpy(header.magic, visibility_magic, sizeof(visibility_magic));
+    header.version = visibility_version;
+    header.cells_count = static_cast<std::uint32_t>(cells_count);
+    header.buildings_count = static_cast<std::uint32_t>(buildings.size());
+    header.words_per_cell = static_cast<std::uint32_t>(visibility_words);
+    const auto output = std::fopen(path, "wb");
+    const auto written = output != nullptr
+        && std::fwrite(&header, sizeof(header), 1, output) == 1
+        && std::fwrite(visibility_baked.data(), 1, visibility_baked.size(), output) == visibility_baked.size();
+    if (output != nullptr)
+    {
+        std::fclose(output);
+    }
+    if (!written)
+    {
+        std::cout << "City: can't write visibility sets to " << path << std::endl;
+        // A partially written file is removed, otherwise it would be rebaked every time anyway.
+        std::remove(path);
+    }
+}
+
+// Whether the segment from + t * direction, t in [0, t_max), intersects the box (slab test).
+static bool segment_intersects_box(const glm::vec3& from, const glm::vec3& direction, const float t_max, const CityBuilding& box)
+{
+    auto t_enter = 0.0f;
+    auto t_exit = t_max;
+    for (glm::length_t axis = 0; axis != 3; ++axis)
+    {
+        if (std::abs(direction[axis]) < 1e-7f)
+        {
+            if (from[axis] < box.min[axis] || from[axis] > box.max[axis])
+            {
+                return false;
+            }
+            continue;
+        }
+        auto t_near = (box.min[axis] - from[axis]) / direction[axis];
+        auto t_far = (box.max[axis] - from[axis]) / direction[axis];
+        if (t_near > t_far)
+        {
+            std::swap(t_near, t_far);
+        }
+        t_enter = std::max(t_enter, t_near);
+        t_exit = std::min(t_exit, t_far);
+        if (t_enter > t_exit)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool City::segment_blocked(const glm::vec3& from, const glm::vec3& to, const std::int32_t building_ignored) const
+{
+    // Lots are visited in the order the segment crosses them (Amanatides and Woo), only their buildings can block it.
+    const auto direction = to - from;
+    const glm::vec2 start{ (from.x - origin.x) / lot_size, (from.z - origin.y) / lot_size };
+    const glm::vec2 end{ (to.x - origin.x) / lot_size, (to.z - origin.y) / lot_size };
+    const auto delta = end - start;
+    glm::ivec2 lot{ static_cast<int>(std::floor(start.x)), static_cast<int>(std::floor(start.y)) };
+    const glm::ivec2 lot_end{ static_cast<int>(std::floor(end.x)), static_cast<int>(std::floor(end.y)) };
+    glm::ivec2 step{ };
+    glm::vec2 t_next{ };
+    glm::vec2 t_delta{ };
+    for (glm::length_t axis = 0; axis != 2; ++axis)
+    {
+        if (delta[axis] > 0.0f)
+        {
+            step[axis] = 1;
+            t_delta[axis] = 1.0f / delta[axis];
+            t_next[axis] = (static_cast<float>(lot[axis]) + 1.0f - start[axis]) * t_delta[axis];
+        }
+        else if (delta[axis] < 0.0f)
+        {
+            step[axis] = -1;
+            t_delta[axis] = -1.0f / delta[axis];
+            t_next[axis] = (start[axis] - static_cast<float>(lot[axis])) * t_delta[axis];
+        }
+        else
+        {
+            t_delta[axis] = std::numeric_limits<float>::infinity();
+            t_next[axis] = std::numeric_limits<float>::infinity();
+        }
+    }
+    constexpr auto side = static_cast<int>(lots_per_side);
+    // The end is on the target, so the segment stops a bit short of it.
+    constexpr float t_max{ 0.999f };
+    while (true)
+    {
+        if (lot.x >= 0 && lot.x < side && lot.y >= 0 && lot.y < side)
+        {
+            const auto building = lot_buildings[lot.y * side + lot.x];
+            if (building != no_building && building != building_ignored
+                && segment_intersects_box(from, direction, t_max, buildings[static_cast<std::size_t>(building)]))
+            {
+                return true;
+            }
+        }
+        if (lot == lot_end)
+        {
+            return false;
+        }
+        const glm::length_t axis = t_next.x < t_next.y ? 0 : 1;
+        if (t_next[axis] > 1.0f)
+        {
+            return false;
+        }
+        lot[axis] += step[axis];
+        t_next[axis] += t_delta[axis];
+    }
+}
+
+void City::bake()
+{
+    // Samples of a cell are on its border, where the streets are: corners and middles of the sides, low and high.
+    // A cell without a building (a square) is walkable inside too, so it also has samples inside, where the border
+    // samples are the farthest from. Interiors of other cells are taken by their buildings.
+    constexpr glm::vec2 cell_samples[13] = {
+        { 0.0f, 0.0f }, { 0.5f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 0.5f },
+        { 1.0f, 1.0f }, { 0.5f, 1.0f }, { 0.0f, 1.0f }, { 0.0f, 0.5f },
+        { 0.25f, 0.25f }, { 0.75f, 0.25f }, { 0.5f, 0.5f }, { 0.25f, 0.75f }, { 0.75f, 0.75f },
+    };
+    constexpr std::size_t cell_samples_border_count{ 8 };
+    constexpr float sample_heights[2] = { 0.3f, eye_height_max };
+    // Samples of a face of a building, as fractions of its sides.
+    constexpr float face_samples[3] = { 0.1f, 0.5f, 0.9f };
+
+    const auto visible_from = [this, &face_samples](const glm::vec3& eye, const std::size_t building)
+        {
+            const auto& box = buildings[building];
+            const auto size = box.max - box.min;
+            // Each face that faces the eye, given by its constant axis, its coordinate and 2 other axes.
+            for (glm::length_t axis = 0; axis != 3; ++axis)
+            {
+                float coordinate;
+                if (eye[axis] < box.min[axis] && axis != 1)
+                {
+                    coordinate = box.min[axis];
+                }
+                else if (eye[axis] > box.max[axis])
+                {
+                    coordinate = box.max[axis];
+                }
+                else
+                {
+                    continue;
+                }
+                const auto axis_u = (axis + 1) % 3;
+                const auto axis_v = (axis + 2) % 3;
+                for (const auto u : face_samples)
+                {
+                    for (const auto v : face_samples)
+                    {
+                        glm::vec3 target{ };
+                        target[axis] = coordinate;
+                        target[axis_u] = box.min[axis_u] + u * size[axis_u];
+                        target[axis_v] = box.min[axis_v] + v * size[axis_v];
+                        if (!segment_blocked(eye, target, static_cast<std::int32_t>(building)))
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        };
+
+    // Cells take very different time (open squares see much more), so threads take cells one by one.
+    // Each cell has its own words, so threads don't write to the same memory.
+    visibility_baked.assign(visibility_bytes(), std::byte{ 0 });
+    const auto words = reinterpret_cast<std::uint32_t*>(visibility_baked.data());
+    std::atomic<std::size_t> next{ 0 };
+    const auto work = [&]()
+        {
+            for (auto c = next.fetch_add(1, std::memory_order_relaxed); c < cells_count; c = next.fetch_add(1, std::memory_order_relaxed))
+            {
+                const glm::vec2 cell_origin{
+                    origin.x + lot_size * static_cast<float>(c % lots_per_side),
+                    origin.y + lot_size * static_cast<float>(c / lots_per_side),
+                };
+                const auto samples_count = lot_buildings[c] == no_building ? std::size(cell_samples) : cell_samples_border_count;
+                for (std::size_t building = 0; building != buildings.size(); ++building)
+                {
+                    for (std::size_t s = 0; s != samples_count * std::size(sample_heights); ++s)
+                    {
+                        const auto sample = cell_origin + lot_size * cell_samples[s % samples_count];
+                        const glm::vec3 eye{ sample.x, ground_height + sample_heights[s / samples_count], sample.y };
+                        if (visible_from(eye, building))
+                        {
+                            words[c * visibility_words + building / 32] |= std::uint32_t{ 1 } << (building % 32);
+                            break;
+                        }
+                    }
+                }
+            }
+        };
+    const auto threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count);
+    for (std::size_t i = 0; i != threads_count; ++i)
+    {
+        threads.emplace_back(work);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    visibility = words;
+}
+
+std::size_t City::cell_of(const glm::vec3& position) const
+{
+    const auto x = std::floor((position.x - origin.x) / lot_size);
+    const auto z = std::floor((position.z - origin.y) / lot_size);
+    constexpr auto side = static_cast<float>(lots_per_side);
+    if (x < 0.0f || x >= side || z < 0.0f || z >= side || position.y < ground_height || position.y > ground_height + eye_height_max)
+    {
+        return cells_count;
+    }
+    return static_cast<std::size_t>(z) * lots_per_side + static_cast<std::size_t>(x);
+}
+
+void City::render(const glm::mat4& view_projection, const glm::vec3& camera_position)
+{
+    gpu_timer.begin();
+    use_program(shader_program);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    bind_vertex_array(vao);
+
+    // Culling is a lookup of the set of the cell.
+    cell = visibility_ready() ? cell_of(camera_position) : cells_count;
+    buildings_drawn = 0;
+    ranges_drawn = 0;
+    const auto draw_range = [this](const std::size_t first, const std::size_t count)
+        {
+            draw_arrays(GL_TRIANGLES, static_cast<GLint>(first * vertices_per_building), static_cast<GLsizei>(count * vertices_per_building));
+            buildings_drawn += count;
+            ++ranges_drawn;
+        };
+    if (cell == cells_count)
+    {
+        draw_range(0, buildings.size());
+    }
+    else
+    {
+        // Runs of set bits are found a word at a time, skipping zero bits with countr_zero and set bits with countr_one.
+        const auto set = visibility + cell * visibility_words;
+        std::size_t run_first = 0;
+        std::size_t run_count = 0;
+        for (std::size_t w = 0; w != visibility_words; ++w)
+        {
+            const auto word = set[w];
+            std::size_t bit = 0;
+            while (bit != 32)
+            {
+                const auto zeros = static_cast<std::size_t>(std::countr_zero(word >> bit));
+                if (zeros != 0 && run_count != 0)
+                {
+                    draw_range(run_first, run_count);
+                    run_count = 0;
+                }
+                bit = std::min<std::size_t>(bit + zeros, 32);
+                if (bit == 32)
+                {
+                    break;
+                }
+                const auto ones = static_cast<std::size_t>(std::countr_one(word >> bit));
+                run_first = run_count == 0 ? w * 32 + bit : run_first;
+                run_count += ones;
+                bit += ones;
+            }
+        }
+        if (run_count != 0)
+        {
+            draw_range(run_first, run_count);
+        }
+    }
+    gpu_timer.end();
+}
@@ -0,0 +1,111 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+#include "MappedFile.hpp"
+
+struct CityBuilding
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct CityVertex
+{
+    glm::vec3 position;
+    std::uint32_t color;
+};
+
+// A static city of box buildings on a grid of lots, with precomputed visibility sets (PVS).
+//
+// The camera is expected to walk the streets, so the navigable space is the city footprint up to a few units
+// above the ground, and it's partitioned into cells, one per lot. An offline bake finds buildings
+// visible from each cell: segments from sample points on the border of the cell (street corners and middles
+// of the streets, low and high), and inside cells without buildings, to sample points on faces of a building
+// that face them are traced through the grid of lots, and the building is visible if any segment isn't blocked
+// by another building. Sampling may miss a building seen only from between the samples or through a gap narrower
+// than their spacing, which is the usual trade-off of sampled PVS.
+//
+// Each set is stored as a bit per building, uncompressed: with a few hundred buildings it's several times smaller
+// than a list of indices of visible buildings (about a third of the buildings is visible from a street), and smaller
+// than run-length coding too (the bake prints all 3 sizes). All sets have the same size. So, culling at runtime
+// is a single fetch of the set at the index of the cell under the camera. Buildings are numbered row by row,
+// so the set is mostly runs of neighbours along the street, and each run of set bits is one draw call.
+// Outside of the navigable space, everything is drawn.
+//
+// Sets are baked on the first run (on threads) and written to a file, which is memory mapped on later runs.
+struct City
+{
+    static constexpr std::size_t lots_per_side{ 16 };
+    static constexpr std::size_t lots_count{ lots_per_side * lots_per_side };
+    static constexpr std::size_t cells_count{ lots_count };
+    static constexpr float lot_size{ 6.0f };
+    // The city is in front of the first camera, the corner of the footprint with the least x and z.
+    static constexpr glm::vec2 origin{ -48.0f, -110.0f };
+    static constexpr float ground_height{ -1.5f };
+    // The camera has to be below this height above the ground to be in the navigable space.
+    static constexpr float eye_height_max{ 5.0f };
+    // Boxes without the bottom face.
+    static constexpr std::size_t vertices_per_building{ 30 };
+    static constexpr std::int32_t no_building{ -1 };
+
+    std::vector<CityBuilding> buildings;
+    // Index of the building on each lot, or no_building for squares.
+    std::int32_t lot_buildings[lots_count];
+
+    // Bit b of word visibility[c * visibility_words + b / 32] is set if building b is visible from cell c.
+    const std::uint32_t* visibility{ nullptr };
+    std::size_t visibility_words;
+
+    unsigned vbo, vao;
+    unsigned shader_program;
+
+    // The latest frame. The cell is cells_count when the camera is outside of the navigable space.
+    std::size_t cell;
+    std::size_t buildings_drawn;
+    std::size_t ranges_drawn;
+
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Maps visibility sets from the file, or bakes them and writes the file if it's missing or stale.
+    // If the file can't be written, it's printed, and the baked sets are used anyway.
+    void load_visibility(const char* path);
+
+    bool visibility_ready() const
+    {
+        return visibility != nullptr;
+    }
+
+    // Returns cells_count if the position is outside of the navigable space.
+    std::size_t cell_of(const glm::vec3& position) const;
+
+    // Draws buildings visible from the cell of the camera (or all of them before the sets are loaded).
+    void render(const glm::mat4& view_projection, const glm::vec3& camera_position);
+
+    std::size_t visibility_bytes() const
+    {
+        return cells_count * visibility_words * sizeof(std::uint32_t);
+    }
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return buildings.size() * vertices_per_building * sizeof(CityVertex);
+    }
+
+private:
+    void bake();
+    // Whether the segment is blocked by any building except the one given.
+    bool segment_blocked(const glm::vec3& from, const glm::vec3& to, std::int32_t building_ignored) const;
+
+    MappedFile file;
+    // Sets baked by this process, when they aren't mapped.
+    std::vector<std::byte> visibility_baked;
+};
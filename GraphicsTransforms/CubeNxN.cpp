@@ -0,0 +1,277 @@
+﻿#include "CubeNxN.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+// Applies the finished turn. Directions are rotated as vectors, coordinates are rotated around
+// the center of the cube (doubled, so that the center is an integer even for even N).
+static const auto shader_vertex_commit_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in uvec2 aSticker;
+flat out uvec2 outSticker;
+uniform int n;
+uniform int turn_axis;
+uniform int turn_layer;
+uniform int quarter_turns;
+const ivec3 directions[6] = ivec3[6](
+    ivec3(1, 0, 0), ivec3(-1, 0, 0), ivec3(0, 1, 0), ivec3(0, -1, 0), ivec3(0, 0, 1), ivec3(0, 0, -1)
+);
+ivec3 rotate_quarter(ivec3 v)
+{
+    if (turn_axis == 0)
+    {
+        return ivec3(v.x, -v.z, v.y);
+    }
+    if (turn_axis == 1)
+    {
+        return ivec3(v.z, v.y, -v.x);
+    }
+    return ivec3(-v.y, v.x, v.z);
+}
+void main()
+{
+    ivec3 cubie = ivec3(int(aSticker.x & 0xffffu), int(aSticker.x >> 16), int(aSticker.y & 0xffffu));
+    int direction = int((aSticker.y >> 16) & 0xffu);
+    uint color = aSticker.y >> 24;
+    if (cubie[turn_axis] == turn_layer)
+    {
+        ivec3 doubled = 2 * cubie - (n - 1);
+        ivec3 normal = directions[direction];
+        for (int i = 0; i != quarter_turns; ++i)
+        {
+            doubled = rotate_quarter(doubled);
+            normal = rotate_quarter(normal);
+        }
+        cubie = (doubled + (n - 1)) / 2;
+        int axis = normal.x != 0 ? 0 : (normal.y != 0 ? 1 : 2);
+        direction = 2 * axis + (normal[axis] < 0 ? 1 : 0);
+    }
+    outSticker = uvec2(uint(cubie.x) | (uint(cubie.y) << 16), uint(cubie.z) | (uint(direction) << 16) | (color << 24));
+}
+)SHADER_SOURCE";
+
+// A sticker is a quad in front of its cubie. Stickers of the turning layer are rotated by the turn angle.
+static const auto shader_vertex_render_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in uvec2 aSticker;
+out vec3 vColor;
+uniform mat4 view_projection;
+uniform vec3 cube_position;
+uniform float cubie_size;
+uniform int n;
+uniform int turn_axis;
+uniform int turn_layer;
+uniform float turn_angle;
+const vec3 directions[6] = vec3[6](
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0)
+);
+const vec3 tangents[6] = vec3[6](
+    vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0)
+);
+// Red right, orange left, white up, yellow down, green front, blue back.
+const vec3 colors[6] = vec3[6](
+    vec3(0.8, 0.05, 0.05), vec3(1.0, 0.45, 0.0), vec3(1.0, 1.0, 1.0), vec3(1.0, 0.85, 0.0), vec3(0.0, 0.6, 0.2), vec3(0.0, 0.25, 0.8)
+);
+const vec2 corners[6] = vec2[6](
+    vec2(-0.45, -0.45),
+    vec2(0.45, -0.45),
+    vec2(-0.45, 0.45),
+    vec2(0.45, 0.45),
+    vec2(-0.45, 0.45),
+    vec2(0.45, -0.45)
+);
+mat3 rotation(int axis, float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    if (axis == 0)
+    {
+        return mat3(1.0, 0.0, 0.0, 0.0, c, s, 0.0, -s, c);
+    }
+    if (axis == 1)
+    {
+        return mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    }
+    return mat3(c, s, 0.0, -s, c, 0.0, 0.0, 0.0, 1.0);
+}
+void main()
+{
+    ivec3 cubie = ivec3(int(aSticker.x & 0xffffu), int(aSticker.x >> 16), int(aSticker.y & 0xffffu));
+    int direction = int((aSticker.y >> 16) & 0xffu);
+    int color = int(aSticker.y >> 24);
+    vec3 normal = directions[direction];
+    vec3 tangent = tangents[direction];
+    vec3 bitangent = cross(normal, tangent);
+    vec3 position = vec3(cubie) - 0.5 * float(n - 1) + 0.5 * normal
+        + tangent * corners[gl_VertexID].x + bitangent * corners[gl_VertexID].y;
+    if (cubie[turn_axis] == turn_layer)
+    {
+        mat3 r = rotation(turn_axis, turn_angle);
+        position = r * position;
+        normal = r * normal;
+    }
+    gl_Position = view_projection * vec4(cube_position + position * cubie_size, 1.0);
+    float light = 0.55 + 0.45 * max(dot(normal, normalize(vec3(0.4, 0.8, 0.6))), 0.0);
+    vColor = colors[color] * light;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_render_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// xorshift32 is enough to pick turns.
+static std::uint32_t next_random(std::uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+void CubeNxN::init(const std::size_t n_initial)
+{
+    glGenBuffers(2, vbos);
+    glGenVertexArrays(2, vaos_commit);
+    glGenVertexArrays(2, vaos_render);
+    for (std::size_t i = 0; i != 2; ++i)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
+
+        // Integer attributes are set with glVertexAttribIPointer, otherwise they would be converted to floats.
+        glBindVertexArray(vaos_commit[i]);
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(CubeNxNSticker), nullptr);
+        glEnableVertexAttribArray(0);
+
+        glBindVertexArray(vaos_render[i]);
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(CubeNxNSticker), nullptr);
+        glEnableVertexAttribArray(0);
+        glVertexAttribDivisor(0, 1);
+    }
+
+    const char* const varyings[1] = { "outSticker" };
+    shader_program_commit = create_program_transform_feedback(shader_vertex_commit_source, varyings, 1, "nxn cube commit program");
+    shader_program_render = create_program(shader_vertex_render_source, shader_fragment_render_source, "nxn cube render program");
+    gpu_timer.init();
+
+    random_state = 2463534242u;
+    turn_axis = 0;
+    turn_layer = 0;
+    turn_angle = 0.0f;
+    generate(n_initial);
+    // The scheduler has only one script, which awaits one tween at a time.
+    scheduler.init(2);
+    scheduler.spawn(turns());
+}
+
+void CubeNxN::destroy()
+{
+    scheduler.destroy();
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program_render);
+    glDeleteProgram(shader_program_commit);
+    glDeleteVertexArrays(2, vaos_render);
+    glDeleteVertexArrays(2, vaos_commit);
+    glDeleteBuffers(2, vbos);
+}
+
+void CubeNxN::generate(const std::size_t n_new)
+{
+    n = n_new;
+    stickers_count = 6 * n * n;
+    current = 0;
+
+    // Stickers of the direction d are on the cubies with coordinate 0 or n-1 along the axis d / 2,
+    // and the other 2 coordinates go over the whole face.
+    std::vector<CubeNxNSticker> stickers(stickers_count);
+    std::size_t k = 0;
+    for (std::uint32_t direction = 0; direction != 6; ++direction)
+    {
+        const auto axis = direction / 2;
+        const auto layer = direction % 2 == 0 ? static_cast<std::uint32_t>(n - 1) : 0u;
+        for (std::uint32_t i = 0; i != n; ++i)
+        {
+            for (std::uint32_t j = 0; j != n; ++j)
+            {
+                std::uint32_t cubie[3];
+                cubie[axis] = layer;
+                cubie[(axis + 1) % 3] = i;
+                cubie[(axis + 2) % 3] = j;
+                stickers[k++] = CubeNxNSticker{
+                    .xy = cubie[0] | (cubie[1] << 16),
+                    .z_direction_color = cubie[2] | (direction << 16) | (direction << 24),
+                };
+            }
+        }
+    }
+    // Both buffers are written by GPU on every turn, GL_DYNAMIC_COPY hints that.
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
+    glBufferData(GL_ARRAY_BUFFER, stickers_count * sizeof(CubeNxNSticker), stickers.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
+    glBufferData(GL_ARRAY_BUFFER, stickers_count * sizeof(CubeNxNSticker), nullptr, GL_DYNAMIC_COPY);
+}
+
+void CubeNxN::commit(const int quarter_turns)
+{
+    const auto next = 1 - current;
+    use_program(shader_program_commit);
+    glUniform1i(glGetUniformLocation(shader_program_commit, "n"), static_cast<int>(n));
+    glUniform1i(glGetUniformLocation(shader_program_commit, "turn_axis"), turn_axis);
+    glUniform1i(glGetUniformLocation(shader_program_commit, "turn_layer"), turn_layer);
+    glUniform1i(glGetUniformLocation(shader_program_commit, "quarter_turns"), quarter_turns);
+
+    bind_vertex_array(vaos_commit[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbos[next]);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    draw_arrays(GL_POINTS, 0, static_cast<GLsizei>(stickers_count));
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+    current = next;
+}
+
+AnimationScript CubeNxN::turns()
+{
+    constexpr auto quarter = 1.5707963f;
+    for (;;)
+    {
+        turn_axis = static_cast<int>(next_random(random_state) % 3);
+        turn_layer = static_cast<int>(next_random(random_state) % n);
+        const auto quarter_turns = static_cast<int>(next_random(random_state) % 3) + 1;
+        turn_angle = 0.0f;
+        co_await tween(turn_angle, quarter * static_cast<float>(quarter_turns), turn_duration_s);
+        commit(quarter_turns);
+        turn_angle = 0.0f;
+        co_await wait(0.05f);
+    }
+}
+
+void CubeNxN::update(const float time_delta_s)
+{
+    scheduler.update(time_delta_s);
+}
+
+void CubeNxN::render(const glm::mat4& view_projection)
+{
+    gpu_timer.begin();
+    use_program(shader_program_render);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_render, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    glUniform3f(glGetUniformLocation(shader_program_render, "cube_position"), position.x, position.y, position.z);
+    glUniform1f(glGetUniformLocation(shader_program_render, "cubie_size"), size / static_cast<float>(n));
+    glUniform1i(glGetUniformLocation(shader_program_render, "n"), static_cast<int>(n));
+    // The turn in progress is all that changes between frames.
+    glUniform1i(glGetUniformLocation(shader_program_render, "turn_axis"), turn_axis);
+    glUniform1i(glGetUniformLocation(shader_program_render, "turn_layer"), turn_layer);
+    glUniform1f(glGetUniformLocation(shader_program_render, "turn_angle"), turn_angle);
+    bind_vertex_array(vaos_render[current]);
+    draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(stickers_count));
+    gpu_timer.end();
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Animation.hpp"
+#include "GlUtils.hpp"
+
+// One sticker of CubeNxN, packed into 8 bytes. It lives only on GPU, this struct just describes the layout.
+struct CubeNxNSticker
+{
+    // Bits 0..15 are x, bits 16..31 are y of the cubie the sticker is on (in the grid of N x N x N cubies).
+    std::uint32_t xy;
+    // Bits 0..15 are z of the cubie, bits 16..23 are the direction the sticker faces (+x, -x, +y, -y, +z, -z),
+    // bits 24..31 are its color (the direction it faced on the solved cube).
+    std::uint32_t z_direction_color;
+};
+
+// An N x N x N Rubik's cube with N up to several hundred (millions of stickers), turning random layers.
+//
+// The turn of a layer is the same idea as model_base * model_local in the triplet demo:
+// every sticker has its place on the cube, and the turning layer is rotated as a whole on top of it.
+// Here, the place of a sticker (cubie coordinates and direction) is stored once in an instance buffer,
+// and the vertex shader rotates stickers whose coordinate along the turn axis equals the turning layer.
+// The turn is described by 3 uniforms (axis, layer and angle), so animating a turn costs
+// the same few bytes per frame no matter how large N is.
+//
+// When a turn ends, it's applied to the instance buffer on GPU with transform feedback
+// (as the simulation of particles): a vertex shader rotates coordinates of the stickers of the layer
+// by whole quarter turns (in integers, so that there are no rounding errors) and writes them into the other buffer.
+// So, the stickers never travel between CPU and GPU after they are generated.
+struct CubeNxN
+{
+    static constexpr std::size_t n_max{ 512 };
+    // Edge of the cube and its center in world space (within the far plane of the first camera).
+    static constexpr float size{ 3.0f };
+    static constexpr glm::vec3 position{ 0.0f, 0.0f, -7.0f };
+    static constexpr float turn_duration_s{ 0.3f };
+
+    std::size_t n;
+    std::size_t stickers_count;
+
+    // Ping-pong buffers with stickers, current is the index of the latest one.
+    unsigned vbos[2];
+    std::size_t current;
+    // vaos_commit[i] reads vbos[i] per vertex, vaos_render[i] reads vbos[i] per instance.
+    unsigned vaos_commit[2], vaos_render[2];
+    unsigned shader_program_commit, shader_program_render;
+
+    // The turn in progress: axis (0 is x, 1 is y, 2 is z), layer (0..n-1) and the angle in radians
+    // (anti-clockwise around the axis looking from its positive end).
+    int turn_axis;
+    int turn_layer;
+    float turn_angle;
+    AnimationScheduler scheduler;
+
+    GpuTimer gpu_timer;
+
+    void init(std::size_t n);
+    void destroy();
+
+    // Recreates the buffers for the solved n x n x n cube.
+    void generate(std::size_t n);
+
+    void update(float time_delta_s);
+    void render(const glm::mat4& view_projection);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return 2 * stickers_count * sizeof(CubeNxNSticker);
+    }
+
+private:
+    // Turns random layers one after another, forever.
+    AnimationScript turns();
+    // Applies the turn of the layer by the count of quarter turns to the stickers.
+    void commit(int quarter_turns);
+
+    std::uint32_t random_state;
+};
@@ -0,0 +1,605 @@
+﻿#include "CubeSolver.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+static constexpr std::size_t twist_count{ 2187 };
+static constexpr std::size_t flip_count{ 2048 };
+static constexpr std::size_t slice_count{ 495 };
+static constexpr std::size_t slice_order_count{ 24 };
+static constexpr std::size_t slice_sorted_count{ slice_count * slice_order_count };
+static constexpr std::size_t corners_count{ 40320 };
+static constexpr std::size_t ud_edges_count{ 40320 };
+
+static constexpr std::size_t phase2_length_max{ 12 };
+
+// Layout of the file: the header, then move tables, then pruning tables, in the order of the members of CubeSolver.
+// The version has to be bumped whenever coordinates or the layout change, so that stale files are regenerated.
+struct CubeSolverTablesHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t size;
+};
+
+static constexpr char tables_magic[8] = { 'G', 'T', 'C', 'U', 'B', 'E', '2', 'P' };
+static constexpr std::uint32_t tables_version{ 1 };
+
+static constexpr std::size_t move_tables_entries{
+    (twist_count + flip_count + slice_sorted_count + slice_count + corners_count + ud_edges_count) * cube_moves_count };
+static constexpr std::size_t prune_tables_entries{
+    slice_count * twist_count + slice_count * flip_count + slice_order_count * corners_count + slice_order_count * ud_edges_count };
+static constexpr std::size_t tables_size{ move_tables_entries * sizeof(std::uint16_t) + prune_tables_entries };
+
+// Moves of G1: quarter and half turns of U and D, half turns of other faces.
+static bool is_g1_move(const std::size_t move)
+{
+    const auto face = cube_move_face(move);
+    return face == CubeFace::up || face == CubeFace::down || cube_move_quarter_turns(move) == 2;
+}
+
+// Permutations and orientations of the state, unpacked from bytes.
+struct Cubies
+{
+    std::uint8_t corners[CubeState::corners_count];
+    std::uint8_t corners_orientation[CubeState::corners_count];
+    std::uint8_t edges[CubeState::edges_count];
+    std::uint8_t edges_orientation[CubeState::edges_count];
+};
+
+static Cubies unpack(const CubeState& state)
+{
+    Cubies cubies;
+    for (std::size_t slot = 0; slot != CubeState::corners_count; ++slot)
+    {
+        cubies.corners[slot] = state.corner(slot) & 0xf;
+        cubies.corners_orientation[slot] = state.corner(slot) >> 4;
+    }
+    for (std::size_t slot = 0; slot != CubeState::edges_count; ++slot)
+    {
+        cubies.edges[slot] = state.edge(slot) & 0xf;
+        cubies.edges_orientation[slot] = state.edge(slot) >> 4;
+    }
+    return cubies;
+}
+
+// Orientation of the last corner (edge) follows from the others, since the sum of twists is 0 modulo 3 (of flips modulo 2).
+static std::uint16_t twist(const Cubies& cubies)
+{
+    std::uint16_t result = 0;
+    for (std::size_t slot = 0; slot + 1 != CubeState::corners_count; ++slot)
+    {
+        result = static_cast<std::uint16_t>(3 * result + cubies.corners_orientation[slot]);
+    }
+    return result;
+}
+
+static std::uint16_t flip(const Cubies& cubies)
+{
+    std::uint16_t result = 0;
+    for (std::size_t slot = 0; slot + 1 != CubeState::edges_count; ++slot)
+    {
+        result = static_cast<std::uint16_t>(2 * result + cubies.edges_orientation[slot]);
+    }
+    return result;
+}
+
+// Rank of a permutation in lexicographic order (Lehmer code), the identity is 0.
+static std::uint16_t permutation_rank(const std::uint8_t* permutation, const std::size_t size)
+{
+    std::uint32_t result = 0;
+    for (std::size_t i = 0; i != size; ++i)
+    {
+        std::uint32_t smaller = 0;
+        for (std::size_t j = i + 1; j != size; ++j)
+        {
+            smaller += permutation[j] < permutation[i];
+        }
+        result = result * static_cast<std::uint32_t>(size - i) + smaller;
+    }
+    return static_cast<std::uint16_t>(result);
+}
+
+static std::uint16_t corners(const Cubies& cubies)
+{
+    return permutation_rank(cubies.corners, CubeState::corners_count);
+}
+
+// Permutation of the 8 edges of U and D layers. Valid only in G1, where they stay in slots 0..7.
+static std::uint16_t ud_edges(const Cubies& cubies)
+{
+    return permutation_rank(cubies.edges, 8);
+}
+
+static std::uint32_t binomial(const std::uint32_t n, const std::uint32_t k)
+{
+    if (n < k)
+    {
+        return 0;
+    }
+    std::uint32_t result = 1;
+    for (std::uint32_t i = 1; i <= k; ++i)
+    {
+        result = result * (n - k + i) / i;
+    }
+    return result;
+}
+
+// Places of the slice edges FR, FL, BL, BR as a combination (0 when they are in slots 8..11),
+// times 24, plus the order of them in these places (0 when they are sorted).
+static std::uint16_t slice_sorted(const Cubies& cubies)
+{
+    std::uint32_t places = 0;
+    std::uint32_t found = 0;
+    std::uint8_t slice_edges[4];
+    for (std::size_t slot = CubeState::edges_count; slot-- != 0;)
+    {
+        if (cubies.edges[slot] >= 8)
+        {
+            places += binomial(static_cast<std::uint32_t>(11 - slot), found + 1);
+            slice_edges[3 - found] = cubies.edges[slot];
+            ++found;
+        }
+    }
+    for (auto& edge : slice_edges)
+    {
+        edge = static_cast<std::uint8_t>(edge - 8);
+    }
+    return static_cast<std::uint16_t>(places * slice_order_count + permutation_rank(slice_edges, 4));
+}
+
+// A move table is filled by a breadth-first search from the solved cube. Any cube with the given coordinate
+// is turned into the same coordinate by a move, so one representative cube is kept for each coordinate,
+// and there is no need to build a cube from a coordinate.
+template <typename Coordinate>
+static void generate_move_table(std::uint16_t* table, const std::size_t size, const Coordinate coordinate, const bool g1_only)
+{
+    std::vector<CubeState> representatives(size);
+    std::vector<std::uint8_t> found(size, 0);
+    std::vector<std::uint16_t> queue;
+    queue.reserve(size);
+    const auto solved = CubeState::solved();
+    const auto start = coordinate(unpack(solved));
+    representatives[start] = solved;
+    found[start] = 1;
+    queue.push_back(start);
+    for (std::size_t i = 0; i != queue.size(); ++i)
+    {
+        const auto current = queue[i];
+        for (std::size_t move = 0; move != cube_moves_count; ++move)
+        {
+            // Moves out of G1 are never looked up.
+            if (g1_only && !is_g1_move(move))
+            {
+                table[current * cube_moves_count + move] = current;
+                continue;
+            }
+            const auto state = cube_apply_move(representatives[current], move);
+            const auto next = coordinate(unpack(state));
+            table[current * cube_moves_count + move] = next;
+            if (!found[next])
+            {
+                found[next] = 1;
+                representatives[next] = state;
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+// A pruning table is a breadth-first search over pairs of coordinates, layer by layer.
+// The index is outer * inner_size + inner, and the goal is 0 for both coordinates.
+// Once most of the table is filled, it's faster to search backwards: an empty entry is at depth + 1
+// if any of its neighbours is at depth (moves are reversible).
+static void generate_prune_table(std::uint8_t* table, const std::uint16_t* outer_move, const std::size_t outer_size,
+    const std::uint16_t* inner_move, const std::size_t inner_size, const bool g1_only)
+{
+    constexpr std::uint8_t empty{ 0xff };
+    const auto size = outer_size * inner_size;
+    std::fill(table, table + size, empty);
+    table[0] = 0;
+    std::size_t filled = 1;
+    for (std::uint8_t depth = 0; filled != size; ++depth)
+    {
+        const auto backwards = filled > size / 2;
+        for (std::size_t index = 0; index != size; ++index)
+        {
+            if (backwards ? table[index] != empty : table[index] != depth)
+            {
+                continue;
+            }
+            const auto outer = index / inner_size;
+            const auto inner = index % inner_size;
+            for (std::size_t move = 0; move != cube_moves_count; ++move)
+            {
+                if (g1_only && !is_g1_move(move))
+                {
+                    continue;
+                }
+                const auto next = outer_move[outer * cube_moves_count + move] * inner_size + inner_move[inner * cube_moves_count + move];
+                if (backwards)
+                {
+                    if (table[next] == depth)
+                    {
+                        table[index] = static_cast<std::uint8_t>(depth + 1);
+                        ++filled;
+                        break;
+                    }
+                }
+                else if (table[next] == empty)
+                {
+                    table[next] = static_cast<std::uint8_t>(depth + 1);
+                    ++filled;
+                }
+            }
+        }
+    }
+}
+
+void CubeSolver::bind(const std::byte* tables)
+{
+    const auto move_table = [&tables](const std::size_t size)
+        {
+            const auto table = reinterpret_cast<const std::uint16_t*>(tables);
+            tables += size * cube_moves_count * sizeof(std::uint16_t);
+            return table;
+        };
+    const auto prune_table = [&tables](const std::size_t size)
+        {
+            const auto table = reinterpret_cast<const std::uint8_t*>(tables);
+            tables += size;
+            return table;
+        };
+    twist_move = move_table(twist_count);
+    flip_move = move_table(flip_count);
+    slice_sorted_move = move_table(slice_sorted_count);
+    slice_move = move_table(slice_count);
+    corners_move = move_table(corners_count);
+    ud_edges_move = move_table(ud_edges_count);
+    slice_twist_prune = prune_table(slice_count * twist_count);
+    slice_flip_prune = prune_table(slice_count * flip_count);
+    slice_corners_prune = prune_table(slice_order_count * corners_count);
+    slice_ud_edges_prune = prune_table(slice_order_count * ud_edges_count);
+}
+
+void CubeSolver::generate()
+{
+    tables_generated.assign(tables_size, std::byte{ 0 });
+    bind(tables_generated.data());
+    // Tables are written only here, through the same pointers that are read later.
+    const auto writable = [](const auto* table)
+        {
+            return const_cast<std::remove_const_t<std::remove_pointer_t<decltype(table)>>*>(table);
+        };
+
+    // Tables of each step don't depend on each other, so each of them is generated on its own thread.
+    {
+        std::thread threads[] = {
+            std::thread{ [&]() { generate_move_table(writable(twist_move), twist_count, twist, false); } },
+            std::thread{ [&]() { generate_move_table(writable(flip_move), flip_count, flip, false); } },
+            std::thread{ [&]() { generate_move_table(writable(slice_sorted_move), slice_sorted_count, slice_sorted, false); } },
+            std::thread{ [&]() { generate_move_table(writable(corners_move), corners_count, corners, false); } },
+            std::thread{ [&]() { generate_move_table(writable(ud_edges_move), ud_edges_count, ud_edges, true); } },
+        };
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+    // Places of the slice edges don't depend on their order.
+    for (std::size_t slice = 0; slice != slice_count; ++slice)
+    {
+        for (std::size_t move = 0; move != cube_moves_count; ++move)
+        {
+            writable(slice_move)[slice * cube_moves_count + move] = static_cast<std::uint16_t>(
+                slice_sorted_move[slice * slice_order_count * cube_moves_count + move] / slice_order_count);
+        }
+    }
+    {
+        // In G1 the slice edges stay in the slice, so slice_sorted is just their order (below 24).
+        std::thread threads[] = {
+            std::thread{ [&]() { generate_prune_table(writable(slice_twist_prune), slice_move, slice_count, twist_move, twist_count, false); } },
+            std::thread{ [&]() { generate_prune_table(writable(slice_flip_prune), slice_move, slice_count, flip_move, flip_count, false); } },
+            std::thread{ [&]() { generate_prune_table(writable(slice_corners_prune), slice_sorted_move, slice_order_count, corners_move, corners_count, true); } },
+            std::thread{ [&]() { generate_prune_table(writable(slice_ud_edges_prune), slice_sorted_move, slice_order_count, ud_edges_move, ud_edges_count, true); } },
+        };
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+void CubeSolver::init(const char* path)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+    const auto milliseconds = [&time_start]()
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+        };
+
+    if (file.open(path))
+    {
+        CubeSolverTablesHeader header{ };
+        if (file.size == sizeof(header) + tables_size)
+        {
+            std::memcpy(&header, file.data, sizeof(header));
+        }
+        if (std::memcmp(header.magic, tables_magic, sizeof(tables_magic)) == 0 && header.version == tables_version && header.size == tables_size)
+        {
+            bind(file.data + sizeof(header));
+            std::cout << "Cube solver: tables mapped from " << path << " in " << milliseconds() << " ms" << std::endl;
+            return;
+        }
+        std::cout << "Cube solver: tables in " << path << " are stale" << std::endl;
+        file.close();
+    }
+
+    generate();
+    std::cout << "Cube solver: tables generated in " << milliseconds() << " ms" << std::endl;
+
+    CubeSolverTablesHeader header{ };
+    std::memcpy(header.magic, tables_magic, sizeof(tables_magic));
+    header.version = tables_version;
+    header.size = static_cast<std::uint32_t>(tables_size);
+    const auto output = std::fopen(path, "wb");
+    const auto written = output != nullptr
+        && std::fwrite(&header, sizeof(header), 1, output) == 1
+        && std::fwrite(tables_generated.data(), 1, tables_generated.size(), output) == tables_generated.size();
+    if (output != nullptr)
+    {
+        std::fclose(output);
+    }
+    if (!written)
+    {
+        std::cout << "Cube solver: can't write tables to " << path << std::endl;
+        // A partially written file is removed, otherwise it would be regenerated every time anyway.
+        std::remove(path);
+    }
+}
+
+void CubeSolver::destroy()
+{
+    file.close();
+    tables_generated.clear();
+    tables_generated.shrink_to_fit();
+    twist_move = nullptr;
+    flip_move = nullptr;
+    slice_sorted_move = nullptr;
+    slice_move = nullptr;
+    corners_move = nullptr;
+    ud_edges_move = nullptr;
+    slice_twist_prune = nullptr;
+    slice_flip_prune = nullptr;
+    slice_corners_prune = nullptr;
+    slice_ud_edges_prune = nullptr;
+}
+
+namespace
+{
+
+// State of one solve. Moves of both phases are collected in one array, phase 2 continues after phase 1.
+struct CubeSearch
+{
+    const CubeSolver& solver;
+    CubeState state;
+    std::size_t length_limit;
+    std::uint8_t moves[CubeSolution::length_max];
+    CubeSolution solution;
+
+    // Turning the same face twice in a row is never needed, and of two opposite faces
+    // (which commute) only one order is searched: U before D, R before L, F before B.
+    bool allowed(const std::size_t move, const std::size_t depth) const
+    {
+        if (depth == 0)
+        {
+            return true;
+        }
+        const auto face = move / 3;
+        const auto face_previous = std::size_t{ moves[depth - 1] } / 3;
+        return face != face_previous && face + 3 != face_previous;
+    }
+
+    std::uint8_t phase1_distance(const std::size_t twist, const std::size_t flip, const std::size_t slice_sorted) const
+    {
+        const auto slice = slice_sorted / slice_order_count;
+        return std::max(solver.slice_twist_prune[slice * twist_count + twist], solver.slice_flip_prune[slice * flip_count + flip]);
+    }
+
+    std::uint8_t phase2_distance(const std::size_t corners, const std::size_t ud_edges, const std::size_t slice_order) const
+    {
+        return std::max(solver.slice_corners_prune[slice_order * corners_count + corners], solver.slice_ud_edges_prune[slice_order * ud_edges_count + ud_edges]);
+    }
+
+    bool phase1(const std::size_t twist, const std::size_t flip, const std::size_t slice_sorted, const std::size_t depth, const std::size_t remaining)
+    {
+        if (remaining == 0)
+        {
+            // A phase 1 solution that ends with a move of G1 was already tried without this move.
+            if (twist != 0 || flip != 0 || slice_sorted >= slice_order_count || (depth != 0 && is_g1_move(moves[depth - 1])))
+            {
+                return false;
+            }
+            return phase2_start(depth);
+        }
+        for (std::size_t move = 0; move != cube_moves_count; ++move)
+        {
+            if (!allowed(move, depth))
+            {
+                continue;
+            }
+            const auto twist_next = solver.twist_move[twist * cube_moves_count + move];
+            const auto flip_next = solver.flip_move[flip * cube_moves_count + move];
+            const auto slice_sorted_next = solver.slice_sorted_move[slice_sorted * cube_moves_count + move];
+            if (phase1_distance(twist_next, flip_next, slice_sorted_next) >= remaining)
+            {
+                continue;
+            }
+            moves[depth] = static_cast<std::uint8_t>(move);
+            if (phase1(twist_next, flip_next, slice_sorted_next, depth + 1, remaining - 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Phase 2 coordinates are taken from the cube turned by the phase 1 moves.
+    // Long phase 2 searches rarely pay off: a slightly longer phase 1 solution usually leads to a short phase 2.
+    bool phase2_start(const std::size_t phase1_length)
+    {
+        auto phase2_state = state;
+        for (std::size_t i = 0; i != phase1_length; ++i)
+        {
+            phase2_state = cube_apply_move(phase2_state, moves[i]);
+        }
+        const auto cubies = unpack(phase2_state);
+        const auto corners_coordinate = corners(cubies);
+        const auto ud_edges_coordinate = ud_edges(cubies);
+        const auto slice_order = slice_sorted(cubies);
+        for (std::size_t length = phase2_distance(corners_coordinate, ud_edges_coordinate, slice_order); phase1_length + length <= length_limit && length <= phase2_length_max; ++length)
+        {
+            if (phase2(corners_coordinate, ud_edges_coordinate, slice_order, phase1_length, length))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool phase2(const std::size_t corners, const std::size_t ud_edges, const std::size_t slice_order, const std::size_t depth, const std::size_t remaining)
+    {
+        if (remaining == 0)
+        {
+            if (corners != 0 || ud_edges != 0 || slice_order != 0)
+            {
+                return false;
+            }
+            std::copy(moves, moves + depth, solution.moves);
+            solution.length = static_cast<std::uint8_t>(depth);
+            solution.found = true;
+            return true;
+        }
+        for (std::size_t move = 0; move != cube_moves_count; ++move)
+        {
+            if (!is_g1_move(move) || !allowed(move, depth))
+            {
+                continue;
+            }
+            const auto corners_next = solver.corners_move[corners * cube_moves_count + move];
+            const auto ud_edges_next = solver.ud_edges_move[ud_edges * cube_moves_count + move];
+            const auto slice_order_next = solver.slice_sorted_move[slice_order * cube_moves_count + move];
+            if (phase2_distance(corners_next, ud_edges_next, slice_order_next) >= remaining)
+            {
+                continue;
+            }
+            moves[depth] = static_cast<std::uint8_t>(move);
+            if (phase2(corners_next, ud_edges_next, slice_order_next, depth + 1, remaining - 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+}
+
+CubeSolution CubeSolver::solve(const CubeState& state, std::size_t length_limit) const
+{
+    length_limit = std::min(length_limit, CubeSolution::length_max);
+    CubeSearch search{ *this, state, length_limit, { }, { } };
+    const auto cubies = unpack(state);
+    const auto twist_coordinate = twist(cubies);
+    const auto flip_coordinate = flip(cubies);
+    const auto slice_sorted_coordinate = slice_sorted(cubies);
+    for (std::size_t length = search.phase1_distance(twist_coordinate, flip_coordinate, slice_sorted_coordinate); length <= length_limit; ++length)
+    {
+        if (search.phase1(twist_coordinate, flip_coordinate, slice_sorted_coordinate, 0, length))
+        {
+            break;
+        }
+    }
+    return search.solution;
+}
+
+void CubeSolver::solve_batch(const CubeState* states, const std::size_t count, CubeSolution* solutions,
+    std::size_t threads_count, const std::size_t length_limit) const
+{
+    if (threads_count == 0)
+    {
+        threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads_count = std::min(threads_count, count);
+    // Solve times vary a lot, so threads take cubes one by one instead of equal ranges.
+    std::atomic<std::size_t> next{ 0 };
+    const auto work = [&]()
+        {
+            for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
+            {
+                solutions[i] = solve(states[i], length_limit);
+            }
+        };
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count);
+    for (std::size_t i = 0; i != threads_count; ++i)
+    {
+        threads.emplace_back(work);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void cube_solver_benchmark(const char* tables_path)
+{
+    CubeSolver solver;
+    solver.init(tables_path);
+
+    constexpr std::size_t count{ 1000 };
+    std::mt19937 random{ 42 };
+    std::uniform_int_distribution<std::size_t> move_distribution{ 0, cube_moves_count - 1 };
+    std::vector<CubeState> states(count, CubeState::solved());
+    for (auto& state : states)
+    {
+        for (std::size_t i = 0; i != 100; ++i)
+        {
+            state = cube_apply_move(state, move_distribution(random));
+        }
+    }
+    std::vector<CubeSolution> solutions(count);
+
+    const auto threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+    const auto time_start = std::chrono::steady_clock::now();
+    solver.solve_batch(states.data(), count, solutions.data(), threads_count);
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+
+    std::size_t failed = 0;
+    std::size_t length_total = 0;
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        auto state = states[i];
+        for (std::size_t j = 0; j != solutions[i].length; ++j)
+        {
+            state = cube_apply_move(state, solutions[i].moves[j]);
+        }
+        failed += !solutions[i].found || state != CubeState::solved();
+        length_total += solutions[i].length;
+    }
+    std::cout << "Cube solver: " << count << " solves in " << seconds << " s on " << threads_count << " threads, "
+        << static_cast<double>(count) / seconds << " solves/s, average length "
+        << static_cast<double>(length_total) / static_cast<double>(count) << " moves, "
+        << (failed == 0 ? "all solutions checked" : "some solutions FAILED") << std::endl;
+    solver.destroy();
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "RubiksCube.hpp"
+
+// Moves that solve a cube, see cube_move_name for the numbering of moves.
+struct CubeSolution
+{
+    static constexpr std::size_t length_max{ 32 };
+
+    std::uint8_t moves[length_max];
+    std::uint8_t length;
+    bool found;
+};
+
+// Kociemba's two-phase algorithm.
+//
+// Phase 1 brings the cube into the subgroup G1 = <U, D, R2, F2, L2, B2>, where all corners and edges are oriented
+// and the 4 edges of the middle (UD) slice are in the slice. Phase 2 solves the cube using only moves of G1.
+// Each phase is an IDA* search over coordinates (small integers that describe a part of the state), which are
+// turned by move tables instead of moving cubies, and pruned by tables of distances to the goal of the phase:
+// phase 1: twist of corners (3^7), flip of edges (2^11), and places of the slice edges (12 choose 4),
+// phase 2: permutation of corners (8!), permutation of U and D edges (8!), and permutation of the slice edges (4!).
+// Every phase 1 solution of a growing length is tried with phase 2, until the total fits into the limit.
+//
+// Tables take ~8 MB and a couple of seconds to generate. They are generated on threads on the first run
+// and written to a file, which is memory mapped on later runs, so that startup is instant.
+struct CubeSolver
+{
+    // Solutions of random cubes are found in a few milliseconds for this limit,
+    // while a couple of moves less take several times longer (optimal solutions are 18 moves on average).
+    static constexpr std::size_t length_limit_default{ 23 };
+
+    // Maps the tables from the file, or generates them and writes the file if it's missing or stale.
+    // If the file can't be written, it's printed, and the generated tables are used anyway.
+    void init(const char* path);
+    void destroy();
+
+    bool ready() const
+    {
+        return twist_move != nullptr;
+    }
+
+    // Thread-safe, tables are only read.
+    CubeSolution solve(const CubeState& state, std::size_t length_limit = length_limit_default) const;
+    // Solves cubes on threads_count threads (0 is a thread per core), and blocks until all of them are solved.
+    void solve_batch(const CubeState* states, std::size_t count, CubeSolution* solutions,
+        std::size_t threads_count = 0, std::size_t length_limit = length_limit_default) const;
+
+    // Move tables: the coordinate after each of 18 moves, coordinate * 18 + move.
+    const std::uint16_t* twist_move{ nullptr };
+    const std::uint16_t* flip_move{ nullptr };
+    // Places and order of the slice edges (places * 24 + order), so it's both a phase 1 and a phase 2 coordinate.
+    const std::uint16_t* slice_sorted_move{ nullptr };
+    const std::uint16_t* slice_move{ nullptr };
+    const std::uint16_t* corners_move{ nullptr };
+    // Only moves of G1 are valid.
+    const std::uint16_t* ud_edges_move{ nullptr };
+
+    // Pruning tables: count of moves to the goal of the phase, ignoring other coordinates.
+    const std::uint8_t* slice_twist_prune{ nullptr };
+    const std::uint8_t* slice_flip_prune{ nullptr };
+    const std::uint8_t* slice_corners_prune{ nullptr };
+    const std::uint8_t* slice_ud_edges_prune{ nullptr };
+
+private:
+    // Points the tables into a block of the file layout.
+    void bind(const std::byte* tables);
+    void generate();
+
+    MappedFile file;
+    // Tables generated by this process, when they aren't mapped.
+    std::vector<std::byte> tables_generated;
+};
+
+// Solves random cubes with the solver and prints solves per second, time to load tables and the average length.
+// Every solution is checked by applying it to the cube.
+void cube_solver_benchmark(const char* tables_path);
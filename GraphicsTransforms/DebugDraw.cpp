@@ -0,0 +1,126 @@
+﻿#include "DebugDraw.hpp"
+
+#include <cstddef>
+#include <algorithm>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Frustum.hpp"
+#include "GlUtils.hpp"
+
+static const auto shader_vertex_debug_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aColor;
+out vec4 vColor;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(aPos, 1.0);
+    vColor = aColor;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_debug_source = R"SHADER_SOURCE(#version 330 core
+in vec4 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vColor;
+}
+)SHADER_SOURCE";
+
+void DebugDraw::init()
+{
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugDrawVertex), reinterpret_cast<void*>(offsetof(DebugDrawVertex, position)));
+    glEnableVertexAttribArray(0);
+    // 4 unsigned bytes are normalized into [0, 1] on access (the fourth argument is GL_TRUE).
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugDrawVertex), reinterpret_cast<void*>(offsetof(DebugDrawVertex, color)));
+    glEnableVertexAttribArray(1);
+    vbo_capacity = 0;
+
+    shader_program = create_program(shader_vertex_debug_source, shader_fragment_debug_source, "debug draw program");
+
+    lines_flushed = 0;
+    triangles_flushed = 0;
+}
+
+void DebugDraw::destroy()
+{
+    glDeleteProgram(shader_program);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+}
+
+void DebugDraw::box(const glm::vec3& min, const glm::vec3& max, const glm::vec3& color)
+{
+    const glm::vec3 corners[8] = {
+        { min.x, min.y, min.z },
+        { max.x, min.y, min.z },
+        { max.x, max.y, min.z },
+        { min.x, max.y, min.z },
+        { min.x, min.y, max.z },
+        { max.x, min.y, max.z },
+        { max.x, max.y, max.z },
+        { min.x, max.y, max.z },
+    };
+    for (std::size_t i = 0; i != 4; ++i)
+    {
+        line(corners[i], corners[(i + 1) % 4], color);
+        line(corners[4 + i], corners[4 + (i + 1) % 4], color);
+        line(corners[i], corners[4 + i], color);
+    }
+}
+
+void DebugDraw::frustum(const glm::mat4& view_projection, const glm::vec3& color)
+{
+    glm::vec3 corners[8];
+    calculate_frustum_corners(view_projection, corners);
+    for (std::size_t i = 0; i != 4; ++i)
+    {
+        line(corners[i], corners[(i + 1) % 4], color);
+        line(corners[4 + i], corners[4 + (i + 1) % 4], color);
+        line(corners[i], corners[4 + i], color);
+    }
+}
+
+void DebugDraw::flush(const glm::mat4& view_projection)
+{
+    lines_flushed = lines.size() / 2;
+    triangles_flushed = triangles.size() / 3;
+    if (lines.empty() && triangles.empty())
+    {
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // Lines go first, then triangles.
+    // The buffer grows when needed, and it's never shrunk.
+    // Calling glBufferData with nullptr every frame is so-called orphaning:
+    // the driver gives a fresh piece of memory, so that writing to it doesn't
+    // have to wait until GPU finishes drawing the previous frame from the old one.
+    const auto vertices_count = lines.size() + triangles.size();
+    vbo_capacity = std::max(vbo_capacity, vertices_count);
+    buffer_data(GL_ARRAY_BUFFER, vbo_capacity * sizeof(DebugDrawVertex), nullptr, GL_STREAM_DRAW);
+    buffer_sub_data(GL_ARRAY_BUFFER, 0, lines.size() * sizeof(DebugDrawVertex), lines.data());
+    buffer_sub_data(GL_ARRAY_BUFFER, lines.size() * sizeof(DebugDrawVertex), triangles.size() * sizeof(DebugDrawVertex), triangles.data());
+
+    use_program(shader_program);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    bind_vertex_array(vao);
+    if (!lines.empty())
+    {
+        draw_arrays(GL_LINES, 0, static_cast<GLsizei>(lines.size()));
+    }
+    if (!triangles.empty())
+    {
+        draw_arrays(GL_TRIANGLES, static_cast<GLsizei>(lines.size()), static_cast<GLsizei>(triangles.size()));
+    }
+
+    // clear() keeps the memory, so the next frame doesn't allocate.
+    lines.clear();
+    triangles.clear();
+}
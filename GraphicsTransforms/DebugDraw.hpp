@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+// Vertex of a debug primitive. Color is packed into 4 bytes (RGBA),
+// so that a vertex takes 16 bytes.
+struct DebugDrawVertex
+{
+    glm::vec3 position;
+    std::uint32_t color;
+};
+
+// Immediate-mode renderer for debug visualization (frustums, bounds, rays, etc.).
+// Any code may append lines and triangles during the frame, which only costs
+// a couple of stores into a CPU array per vertex.
+// flush() uploads everything into one streaming buffer and issues one draw call
+// for lines and one for triangles, no matter how many primitives were appended.
+struct DebugDraw
+{
+    std::vector<DebugDrawVertex> lines;
+    std::vector<DebugDrawVertex> triangles;
+
+    unsigned vbo, vao, shader_program;
+    // Size of vbo in vertices.
+    std::size_t vbo_capacity;
+
+    // Counts of primitives rendered by the last flush (for statistics).
+    std::size_t lines_flushed, triangles_flushed;
+
+    void init();
+    void destroy();
+
+    void line(const glm::vec3& a, const glm::vec3& b, const glm::vec3& color)
+    {
+        const auto c = pack_color(color);
+        lines.push_back({ a, c });
+        lines.push_back({ b, c });
+    }
+
+    void triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& color)
+    {
+        const auto packed = pack_color(color);
+        triangles.push_back({ a, packed });
+        triangles.push_back({ b, packed });
+        triangles.push_back({ c, packed });
+    }
+
+    // 12 edges of an axis-aligned box.
+    void box(const glm::vec3& min, const glm::vec3& max, const glm::vec3& color);
+    // 12 edges of a frustum of the camera with the given view-projection matrix.
+    void frustum(const glm::mat4& view_projection, const glm::vec3& color);
+
+    // Renders and forgets all appended primitives.
+    void flush(const glm::mat4& view_projection);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return vbo_capacity * sizeof(DebugDrawVertex);
+    }
+};
@@ -0,0 +1,248 @@
+﻿#include "DepthSort.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <utility>
+
+const char* depth_sort_algorithm_name(const DepthSortAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case DepthSortAlgorithm::none:
+        return "none";
+    case DepthSortAlgorithm::insertion:
+        return "insertion";
+    case DepthSortAlgorithm::merge:
+        return "merge";
+    case DepthSortAlgorithm::radix:
+        return "radix";
+    }
+    return "unknown";
+}
+
+void DepthSorter::reset(const std::size_t count)
+{
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0u);
+    keys.resize(count);
+    order_scratch.resize(count);
+    keys_scratch.resize(count);
+    radix_keys.resize(count);
+    radix_keys_scratch.resize(count);
+    algorithm = DepthSortAlgorithm::none;
+    descents = 0;
+    sort_ms = 0.0;
+}
+
+void DepthSorter::sort(const float* const depths)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+
+    // Arrange new depths in the order of the previous frame.
+    const auto count = order.size();
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        keys[i] = depths[order[i]];
+    }
+    find_runs();
+
+    // Turning the camera around reverses the order. That's the worst case for
+    // insertion and merge sorts, but it's almost sorted after reversing.
+    if (descents > ascents && ascents <= count / 256)
+    {
+        std::reverse(keys.begin(), keys.end());
+        std::reverse(order.begin(), order.end());
+        find_runs();
+    }
+
+    // Thresholds are empirical.
+    // Insertion sort is the fastest when there are few descents, but
+    // it degrades to O(n^2) when objects move far, so it has a budget of shifts.
+    // After exceeding the budget, the order is still a permutation (just partially sorted),
+    // so another algorithm picks up from there.
+    if (descents == 0)
+    {
+        algorithm = DepthSortAlgorithm::none;
+    }
+    else if (descents <= count / 256 + 8 && sort_insertion(4 * count))
+    {
+        algorithm = DepthSortAlgorithm::insertion;
+    }
+    else if (descents <= count / 32)
+    {
+        algorithm = DepthSortAlgorithm::merge;
+        sort_merge();
+    }
+    else
+    {
+        algorithm = DepthSortAlgorithm::radix;
+        sort_radix();
+    }
+
+    const auto time_end = std::chrono::steady_clock::now();
+    sort_ms = std::chrono::duration<double, std::milli>(time_end - time_start).count();
+}
+
+void DepthSorter::find_runs()
+{
+    // A run ends where a descent is. The last run ends at the end of the array.
+    const auto count = keys.size();
+    runs.clear();
+    ascents = 0;
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        if (keys[i] < keys[i - 1])
+        {
+            runs.push_back(i);
+        }
+        else if (keys[i - 1] < keys[i])
+        {
+            ++ascents;
+        }
+    }
+    descents = runs.size();
+    runs.push_back(count);
+}
+
+bool DepthSorter::sort_insertion(const std::size_t shifts_budget)
+{
+    std::size_t shifts = 0;
+    const auto count = order.size();
+    for (std::size_t i = 1; i != count; ++i)
+    {
+        const auto key = keys[i];
+        if (!(key < keys[i - 1]))
+        {
+            continue;
+        }
+        const auto index = order[i];
+        auto j = i;
+        while (j != 0 && key < keys[j - 1])
+        {
+            keys[j] = keys[j - 1];
+            order[j] = order[j - 1];
+            --j;
+        }
+        keys[j] = key;
+        order[j] = index;
+        shifts += i - j;
+        if (shifts > shifts_budget)
+        {
+            // Runs found before are no longer valid.
+            find_runs();
+            return false;
+        }
+    }
+    return true;
+}
+
+void DepthSorter::sort_merge()
+{
+    // Bottom-up merge of neighbouring runs.
+    // runs contains the end of each run, the first run starts at 0.
+    // Each pass halves the count of runs, moving data between keys/order and the scratch buffers.
+    while (runs.size() > 1)
+    {
+        std::size_t runs_merged = 0;
+        std::size_t begin = 0;
+        for (std::size_t r = 0; r < runs.size(); r += 2)
+        {
+            const auto middle = runs[r];
+            const auto end = r + 1 < runs.size() ? runs[r + 1] : middle;
+            auto a = begin;
+            auto b = middle;
+            auto out = begin;
+            while (a != middle && b != end)
+            {
+                // Taking from the left run on equal keys keeps the sort stable.
+                if (keys[b] < keys[a])
+                {
+                    keys_scratch[out] = keys[b];
+                    order_scratch[out] = order[b];
+                    ++b;
+                }
+                else
+                {
+                    keys_scratch[out] = keys[a];
+                    order_scratch[out] = order[a];
+                    ++a;
+                }
+                ++out;
+            }
+            for (; a != middle; ++a, ++out)
+            {
+                keys_scratch[out] = keys[a];
+                order_scratch[out] = order[a];
+            }
+            for (; b != end; ++b, ++out)
+            {
+                keys_scratch[out] = keys[b];
+                order_scratch[out] = order[b];
+            }
+            runs[runs_merged++] = end;
+            begin = end;
+        }
+        runs.resize(runs_merged);
+        keys.swap(keys_scratch);
+        order.swap(order_scratch);
+    }
+}
+
+void DepthSorter::sort_radix()
+{
+    // Floats are mapped to unsigned integers that compare the same way:
+    // positive floats get their sign bit set, negative floats get all bits flipped
+    // (negative floats with bigger magnitude have bigger bit patterns).
+    const auto count = order.size();
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &keys[i], sizeof(bits));
+        const std::uint32_t mask = (bits >> 31) != 0 ? 0xFFFFFFFFu : 0x80000000u;
+        radix_keys[i] = bits ^ mask;
+    }
+
+    // 3 passes of 11 bits each (the last one has 10 bits).
+    // Each pass is a stable counting sort by the corresponding digit.
+    constexpr std::uint32_t digit_bits = 11;
+    constexpr std::uint32_t buckets_count = 1u << digit_bits;
+    std::size_t histogram[buckets_count];
+    for (std::uint32_t shift = 0; shift < 32; shift += digit_bits)
+    {
+        std::fill(std::begin(histogram), std::end(histogram), 0);
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            ++histogram[(radix_keys[i] >> shift) & (buckets_count - 1)];
+        }
+        // If all keys have the same digit, the pass wouldn't change anything.
+        if (std::find(std::begin(histogram), std::end(histogram), count) != std::end(histogram))
+        {
+            continue;
+        }
+        std::size_t offset = 0;
+        for (auto& bucket : histogram)
+        {
+            const auto bucket_count = bucket;
+            bucket = offset;
+            offset += bucket_count;
+        }
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            const auto position = histogram[(radix_keys[i] >> shift) & (buckets_count - 1)]++;
+            radix_keys_scratch[position] = radix_keys[i];
+            order_scratch[position] = order[i];
+        }
+        radix_keys.swap(radix_keys_scratch);
+        order.swap(order_scratch);
+    }
+
+    // Keys are not used after sorting, but keep them consistent with order.
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const auto mask = (radix_keys[i] >> 31) != 0 ? 0x80000000u : 0xFFFFFFFFu;
+        const auto bits = radix_keys[i] ^ mask;
+        std::memcpy(&keys[i], &bits, sizeof(bits));
+    }
+}
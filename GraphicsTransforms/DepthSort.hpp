@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Algorithms that DepthSorter chooses from.
+enum struct DepthSortAlgorithm
+{
+    // The order of the previous frame is still valid.
+    none,
+    // Few objects changed their places, and they moved not far.
+    // Insertion sort takes O(n + inversions) time, which is close to O(n) here.
+    insertion,
+    // The order is a concatenation of a few sorted runs.
+    // Merging them takes O(n * log(runs)) time.
+    merge,
+    // The order changed a lot (for example, the camera jumped or turned around).
+    // LSD radix sort takes O(n) time regardless of the input, but with a big constant.
+    radix,
+};
+
+// Returns a human-readable name of the algorithm.
+const char* depth_sort_algorithm_name(DepthSortAlgorithm algorithm);
+
+// Sorts objects by depth every frame, exploiting that the order barely changes between frames.
+// The order of the previous frame is kept, and the new depths are arranged in that order.
+// Then the sorter counts descents (neighbours that are out of order) and picks the cheapest
+// algorithm that repairs the order. See DepthSortAlgorithm.
+struct DepthSorter
+{
+    // Indices of objects sorted by depth in ascending order.
+    std::vector<unsigned> order;
+    // keys[i] is the depth of the object order[i].
+    std::vector<float> keys;
+
+    // Algorithm used during the last sort.
+    DepthSortAlgorithm algorithm;
+    // Count of descents found during the last sort.
+    std::size_t descents;
+    // Time spent on the last sort in milliseconds.
+    double sort_ms;
+
+    // Forgets the previous order and prepares to sort count objects.
+    void reset(std::size_t count);
+
+    // depths[i] is the depth of the object i. There must be order.size() depths.
+    // After the call, order lists objects from the lowest depth to the highest.
+    void sort(const float* depths);
+
+private:
+    std::vector<unsigned> order_scratch;
+    std::vector<float> keys_scratch;
+    std::vector<std::uint32_t> radix_keys, radix_keys_scratch;
+    // Ends of sorted runs in keys.
+    std::vector<std::size_t> runs;
+
+    // Count of neighbours that are strictly in order (equal keys are neither ascents nor descents).
+    std::size_t ascents;
+
+    // Fills runs, descents and ascents.
+    void find_runs();
+    // Returns false if the input turned out to be not sorted enough, and the budget was exceeded.
+    bool sort_insertion(std::size_t shifts_budget);
+    void sort_merge();
+    void sort_radix();
+};
@@ -0,0 +1,42 @@
+﻿#include "DirtyRanges.hpp"
+
+#include <algorithm>
+
+void DirtyRanges::coalesce(const std::size_t count, const std::size_t gap_max)
+{
+    ranges.clear();
+    if (all)
+    {
+        ranges.push_back({ 0, count });
+        return;
+    }
+
+    // Few elements are marked, so sorting the marks is cheaper than scanning a bit per element.
+    std::sort(marked.begin(), marked.end());
+    std::size_t covered = 0;
+    for (const auto index : marked)
+    {
+        if (!ranges.empty())
+        {
+            auto& last = ranges.back();
+            const auto end = last.first + last.count;
+            if (index < end)
+            {
+                continue;
+            }
+            if (index - end <= gap_max)
+            {
+                covered += index + 1 - end;
+                last.count = index + 1 - last.first;
+                continue;
+            }
+        }
+        ranges.push_back({ index, 1 });
+        ++covered;
+    }
+
+    if (2 * covered > count)
+    {
+        ranges.assign(1, { 0, count });
+    }
+}
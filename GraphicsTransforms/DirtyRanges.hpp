@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A run of consecutive dirty elements [first, first + count).
+struct DirtyRange
+{
+    std::size_t first;
+    std::size_t count;
+};
+
+// Tracks which elements of an array changed since the last upload, so that only they are uploaded.
+// Elements are marked one by one while they change, and before the upload the marks are coalesced into runs.
+struct DirtyRanges
+{
+    // Indices marked since the last clear, in any order and possibly repeated.
+    std::vector<std::size_t> marked;
+    // Result of the last coalesce.
+    std::vector<DirtyRange> ranges;
+    // The whole array is dirty (for example, it was resized), marks don't matter.
+    bool all;
+
+    void mark(const std::size_t index)
+    {
+        if (!all)
+        {
+            marked.push_back(index);
+        }
+    }
+
+    void mark_all()
+    {
+        all = true;
+        marked.clear();
+    }
+
+    bool empty() const
+    {
+        return !all && marked.empty();
+    }
+
+    // Fills ranges from the marks of an array of count elements.
+    // Runs separated by at most gap_max clean elements are merged, since uploading a few clean elements
+    // is cheaper than a separate call. If the runs cover most of the array, they become one run over all of it.
+    void coalesce(std::size_t count, std::size_t gap_max);
+
+    void clear()
+    {
+        all = false;
+        marked.clear();
+        ranges.clear();
+    }
+};
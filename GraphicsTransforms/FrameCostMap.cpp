@@ -0,0 +1,264 @@
+﻿#include "FrameCostMap.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+static constexpr float two_pi = 2.0f * std::numbers::pi_v<float>;
+static constexpr float half_pi = 0.5f * std::numbers::pi_v<float>;
+
+static int yaw_bin_of(const float yaw)
+{
+    // Yaw isn't limited by the mouse callback, so it's wrapped into [0, 2 pi) first.
+    auto wrapped = std::fmod(yaw, two_pi);
+    if (wrapped < 0.0f)
+    {
+        wrapped += two_pi;
+    }
+    return static_cast<int>(std::lround(wrapped / two_pi * FrameCostMap::yaw_bins)) % FrameCostMap::yaw_bins;
+}
+
+static int pitch_bin_of(const float pitch)
+{
+    const auto t = (std::clamp(pitch, -half_pi, half_pi) + half_pi) / (2.0f * half_pi);
+    return std::min(static_cast<int>(t * FrameCostMap::pitch_bins), FrameCostMap::pitch_bins - 1);
+}
+
+static float yaw_of_bin(const int bin)
+{
+    return bin * two_pi / FrameCostMap::yaw_bins;
+}
+
+static float pitch_of_bin(const int bin)
+{
+    return (bin + 0.5f) / FrameCostMap::pitch_bins * 2.0f * half_pi - half_pi;
+}
+
+// Blue, cyan, green, yellow, red for t from 0 to 1.
+static glm::vec3 cost_color(const float t)
+{
+    constexpr glm::vec3 ramp[5] = {
+        { 0.0f, 0.0f, 1.0f },
+        { 0.0f, 1.0f, 1.0f },
+        { 0.0f, 1.0f, 0.0f },
+        { 1.0f, 1.0f, 0.0f },
+        { 1.0f, 0.0f, 0.0f },
+    };
+    const auto x = std::clamp(t, 0.0f, 1.0f) * 4.0f;
+    const auto i = std::min(static_cast<int>(x), 3);
+    return glm::mix(ramp[i], ramp[i + 1], x - i);
+}
+
+void FrameCostMap::init(const glm::vec3& min, const glm::vec3& max)
+{
+    bounds_min = min;
+    bounds_max = max;
+    cells.assign(static_cast<std::size_t>(cells_x) * cells_y * cells_z * yaw_bins * pitch_bins, FrameCostCell{ });
+    recording = false;
+    sweeping = false;
+    sweep_layer = 0;
+    sweep_viewpoint = 0;
+    sweep_frame = 0;
+}
+
+void FrameCostMap::clear()
+{
+    std::fill(cells.begin(), cells.end(), FrameCostCell{ });
+}
+
+void FrameCostMap::record(const glm::vec3& position, const float yaw, const float pitch, const double cpu_ms, const double gpu_ms)
+{
+    const auto t = (position - bounds_min) / (bounds_max - bounds_min);
+    if (t.x < 0.0f || t.y < 0.0f || t.z < 0.0f || t.x >= 1.0f || t.y >= 1.0f || t.z >= 1.0f)
+    {
+        return;
+    }
+    const auto x = static_cast<int>(t.x * cells_x);
+    const auto y = static_cast<int>(t.y * cells_y);
+    const auto z = static_cast<int>(t.z * cells_z);
+    auto& cell = cells[cell_index(x, y, z, yaw_bin_of(yaw), pitch_bin_of(pitch))];
+    ++cell.samples;
+    cell.cpu_ms_sum += static_cast<float>(cpu_ms);
+    cell.gpu_ms_sum += static_cast<float>(gpu_ms);
+}
+
+glm::vec3 FrameCostMap::cell_center(const int x, const int y, const int z) const
+{
+    const auto t = (glm::vec3{ static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) } + 0.5f)
+        / glm::vec3{ static_cast<float>(cells_x), static_cast<float>(cells_y), static_cast<float>(cells_z) };
+    return bounds_min + t * (bounds_max - bounds_min);
+}
+
+void FrameCostMap::sweep_start(const glm::vec3& position)
+{
+    const auto t = (position.y - bounds_min.y) / (bounds_max.y - bounds_min.y);
+    sweep_layer = std::clamp(static_cast<int>(t * cells_y), 0, cells_y - 1);
+    sweep_viewpoint = 0;
+    // The first frame is rendered from wherever the camera was, so it's never recorded.
+    sweep_frame = sweep_settle_frames + sweep_measure_frames;
+    sweeping = true;
+}
+
+bool FrameCostMap::sweep_update(const double cpu_ms, const double gpu_ms, glm::vec3& position, float& yaw, float& pitch)
+{
+    // Viewpoints go over yaw bins first, then over x and z.
+    constexpr auto viewpoints_count = static_cast<std::size_t>(cells_x) * cells_z * yaw_bins;
+    constexpr auto pitch_level = pitch_bins / 2;
+
+    if (sweep_frame >= sweep_settle_frames && sweep_frame < sweep_settle_frames + sweep_measure_frames)
+    {
+        record(position, yaw, pitch, cpu_ms, gpu_ms);
+    }
+    ++sweep_frame;
+    if (sweep_frame < sweep_settle_frames + sweep_measure_frames)
+    {
+        return true;
+    }
+
+    if (sweep_viewpoint == viewpoints_count)
+    {
+        sweeping = false;
+        return false;
+    }
+    const auto yaw_bin = static_cast<int>(sweep_viewpoint % yaw_bins);
+    const auto x = static_cast<int>(sweep_viewpoint / yaw_bins % cells_x);
+    const auto z = static_cast<int>(sweep_viewpoint / yaw_bins / cells_x);
+    position = cell_center(x, sweep_layer, z);
+    yaw = yaw_of_bin(yaw_bin);
+    pitch = pitch_of_bin(pitch_level);
+    ++sweep_viewpoint;
+    sweep_frame = 0;
+    return true;
+}
+
+float FrameCostMap::cost_ms_max() const
+{
+    auto result = 0.0f;
+    for (const auto& cell : cells)
+    {
+        result = std::max(result, cell.cost_ms());
+    }
+    return result;
+}
+
+bool FrameCostMap::export_heatmap(const char* const path) const
+{
+    constexpr int square_size = 8;
+    constexpr int cell_size = 3 * square_size;
+    constexpr int width = cells_x * cell_size;
+    constexpr int height = cells_z * cell_size;
+    // Offsets of the squares of yaw bins inside a cell, in the same order as bins.
+    // Yaw 0 looks along +x, and yaw grows towards +z (see WindowData::calculate_camera_front).
+    constexpr int yaw_offsets[yaw_bins][2] = {
+        { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 },
+    };
+
+    const auto file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    const auto cost_max = std::max(cost_ms_max(), 1e-6f);
+    std::vector<unsigned char> pixels(static_cast<std::size_t>(width) * height * 3, 32);
+    const auto fill_square = [&](const int x, const int z, const int column, const int row, const float cost, const bool measured)
+        {
+            const auto color = measured ? cost_color(cost / cost_max) : glm::vec3{ 0.125f };
+            for (int py = 0; py != square_size; ++py)
+            {
+                for (int px = 0; px != square_size; ++px)
+                {
+                    const auto image_x = x * cell_size + column * square_size + px;
+                    const auto image_y = z * cell_size + row * square_size + py;
+                    // Borders between cells are black.
+                    const auto border = image_x % cell_size == 0 || image_y % cell_size == 0;
+                    auto pixel = pixels.begin() + (static_cast<std::ptrdiff_t>(image_y) * width + image_x) * 3;
+                    pixel[0] = border ? 0 : static_cast<unsigned char>(color.x * 255.0f);
+                    pixel[1] = border ? 0 : static_cast<unsigned char>(color.y * 255.0f);
+                    pixel[2] = border ? 0 : static_cast<unsigned char>(color.z * 255.0f);
+                }
+            }
+        };
+    for (int z = 0; z != cells_z; ++z)
+    {
+        for (int x = 0; x != cells_x; ++x)
+        {
+            auto cell_cost = 0.0f;
+            auto cell_measured = false;
+            for (int yaw_bin = 0; yaw_bin != yaw_bins; ++yaw_bin)
+            {
+                auto cost = 0.0f;
+                auto measured = false;
+                for (int y = 0; y != cells_y; ++y)
+                {
+                    for (int pitch_bin = 0; pitch_bin != pitch_bins; ++pitch_bin)
+                    {
+                        const auto& cell = cells[cell_index(x, y, z, yaw_bin, pitch_bin)];
+                        cost = std::max(cost, cell.cost_ms());
+                        measured = measured || cell.samples != 0;
+                    }
+                }
+                fill_square(x, z, 1 + yaw_offsets[yaw_bin][0], 1 + yaw_offsets[yaw_bin][1], cost, measured);
+                cell_cost = std::max(cell_cost, cost);
+                cell_measured = cell_measured || measured;
+            }
+            fill_square(x, z, 1, 1, cell_cost, cell_measured);
+        }
+    }
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::fwrite(pixels.data(), 1, pixels.size(), file);
+    return std::fclose(file) == 0;
+}
+
+bool FrameCostMap::export_point_cloud(const char* const path) const
+{
+    const auto measured_count = std::count_if(cells.begin(), cells.end(), [](const FrameCostCell& cell)
+        {
+            return cell.samples != 0;
+        });
+    const auto file = std::fopen(path, "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::fprintf(file,
+        "ply\nformat ascii 1.0\nelement vertex %lld\n"
+        "property float x\nproperty float y\nproperty float z\n"
+        "property float nx\nproperty float ny\nproperty float nz\n"
+        "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+        "property float cpu_ms\nproperty float gpu_ms\nproperty uint samples\nend_header\n",
+        static_cast<long long>(measured_count));
+    const auto cost_max = std::max(cost_ms_max(), 1e-6f);
+    for (int y = 0; y != cells_y; ++y)
+    {
+        for (int z = 0; z != cells_z; ++z)
+        {
+            for (int x = 0; x != cells_x; ++x)
+            {
+                for (int yaw_bin = 0; yaw_bin != yaw_bins; ++yaw_bin)
+                {
+                    for (int pitch_bin = 0; pitch_bin != pitch_bins; ++pitch_bin)
+                    {
+                        const auto& cell = cells[cell_index(x, y, z, yaw_bin, pitch_bin)];
+                        if (cell.samples == 0)
+                        {
+                            continue;
+                        }
+                        const auto center = cell_center(x, y, z);
+                        const auto yaw = yaw_of_bin(yaw_bin);
+                        const auto pitch = pitch_of_bin(pitch_bin);
+                        const glm::vec3 direction{ std::cos(yaw) * std::cos(pitch), std::sin(pitch), std::sin(yaw) * std::cos(pitch) };
+                        const auto color = cost_color(cell.cost_ms() / cost_max) * 255.0f;
+                        std::fprintf(file, "%g %g %g %g %g %g %d %d %d %g %g %u\n",
+                            center.x, center.y, center.z, direction.x, direction.y, direction.z,
+                            static_cast<int>(color.x), static_cast<int>(color.y), static_cast<int>(color.z),
+                            cell.cpu_ms_sum / cell.samples, cell.gpu_ms_sum / cell.samples, cell.samples);
+                    }
+                }
+            }
+        }
+    }
+    return std::fclose(file) == 0;
+}
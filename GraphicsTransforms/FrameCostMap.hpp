@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Accumulated cost of frames rendered from viewpoints that fall into a cell.
+struct FrameCostCell
+{
+    std::uint32_t samples;
+    float cpu_ms_sum;
+    float gpu_ms_sum;
+
+    // Frame cost is the maximum of CPU and GPU time, since they work in parallel,
+    // and the slower one limits the frame rate.
+    float cost_ms() const
+    {
+        return samples == 0 ? 0.0f : glm::max(cpu_ms_sum, gpu_ms_sum) / samples;
+    }
+};
+
+// Profiling mode that answers "from where is the scene expensive to render".
+// Viewpoints are binned by camera position (a regular grid inside the bounds), yaw and pitch,
+// and each cell accumulates CPU and GPU time of frames rendered from its viewpoints.
+// The map can be filled by flying around manually, or by the sweep that visits every position
+// of a horizontal layer of the grid in every yaw direction.
+struct FrameCostMap
+{
+    static constexpr int cells_x{ 16 };
+    static constexpr int cells_y{ 4 };
+    static constexpr int cells_z{ 16 };
+    // Yaw bins are centered at multiples of 45 degrees, so that each of them maps onto
+    // one of 8 neighbours of a cell in the heatmap.
+    static constexpr int yaw_bins{ 8 };
+    // Looking down, level and up.
+    static constexpr int pitch_bins{ 3 };
+
+    // GPU time of a frame becomes known a few frames later (see GpuTimer),
+    // so the sweep waits at each viewpoint before measuring.
+    static constexpr std::size_t sweep_settle_frames{ 6 };
+    static constexpr std::size_t sweep_measure_frames{ 3 };
+
+    glm::vec3 bounds_min, bounds_max;
+    std::vector<FrameCostCell> cells;
+
+    bool recording;
+
+    bool sweeping;
+    int sweep_layer;
+    // The viewpoint the camera moves to next.
+    std::size_t sweep_viewpoint;
+    // Frames rendered from the current viewpoint.
+    std::size_t sweep_frame;
+
+    void init(const glm::vec3& min, const glm::vec3& max);
+    void clear();
+
+    // Adds a frame rendered from the viewpoint. Viewpoints outside the bounds are ignored.
+    void record(const glm::vec3& position, float yaw, float pitch, double cpu_ms, double gpu_ms);
+
+    // Starts the sweep over the layer of cells that contains position.
+    void sweep_start(const glm::vec3& position);
+    // Called once per frame after the frame is rendered from the current sweep viewpoint.
+    // Records the frame if the viewpoint has settled, and sets the viewpoint for the next frame.
+    // Returns false (leaving the viewpoint as is) when every viewpoint of the layer is measured.
+    bool sweep_update(double cpu_ms, double gpu_ms, glm::vec3& position, float& yaw, float& pitch);
+
+    // Top view of the grid as a binary PPM image. Each cell is 3x3 squares:
+    // the 8 outer squares show cost in the respective yaw direction (the worst over height and pitch),
+    // and the center shows the worst of them. Colors go from blue (cheap) to red (the most expensive cell).
+    bool export_heatmap(const char* path) const;
+    // Every measured cell as a point in an ASCII PLY file: the point is at the center of the cell,
+    // its normal is the view direction, its color is the cost, and it has cpu_ms, gpu_ms and samples properties.
+    bool export_point_cloud(const char* path) const;
+
+private:
+    std::size_t cell_index(int x, int y, int z, int yaw_bin, int pitch_bin) const
+    {
+        return (((static_cast<std::size_t>(y) * cells_z + z) * cells_x + x) * yaw_bins + yaw_bin) * pitch_bins + pitch_bin;
+    }
+    glm::vec3 cell_center(int x, int y, int z) const;
+    float cost_ms_max() const;
+};
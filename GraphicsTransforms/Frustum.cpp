@@ -0,0 +1,93 @@
+﻿#include "Frustum.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+Frustum calculate_frustum(const glm::mat4& view_projection)
+{
+    // GLM stores matrices column-wise, so m[column][row].
+    const auto row = [&view_projection](const int i)
+        {
+            return glm::vec4{ view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i] };
+        };
+    const auto row0 = row(0);
+    const auto row1 = row(1);
+    const auto row2 = row(2);
+    const auto row3 = row(3);
+    Frustum frustum{ .planes = {
+        row3 + row0,
+        row3 - row0,
+        row3 + row1,
+        row3 - row1,
+        row3 + row2,
+        row3 - row2,
+    } };
+    for (auto& plane : frustum.planes)
+    {
+        plane /= glm::length(glm::vec3{ plane });
+    }
+    return frustum;
+}
+
+void calculate_frustum_corners(const glm::mat4& view_projection, glm::vec3 (&corners)[8])
+{
+    const auto view_projection_inv = glm::inverse(view_projection);
+    constexpr glm::vec2 loop[4] = {
+        { -1.0f, -1.0f },
+        { 1.0f, -1.0f },
+        { 1.0f, 1.0f },
+        { -1.0f, 1.0f },
+    };
+    for (std::size_t i = 0; i != 8; ++i)
+    {
+        const auto z = i < 4 ? -1.0f : 1.0f;
+        const auto corner = view_projection_inv * glm::vec4{ loop[i % 4], z, 1.0f };
+        // On GPU, the division by w is done after the vertex shader, here it has to be done explicitly.
+        corners[i] = glm::vec3{ corner } / corner.w;
+    }
+}
+
+void cull_spheres_multi_view(const Frustum* const frustums, const std::size_t frustums_count,
+    const void* const bounds, const std::size_t stride, const float radius_scale, const std::size_t count, std::uint64_t* const masks)
+{
+    // Planes are stored by component, so that the 6 planes of a view are contiguous for each of them.
+    struct Planes
+    {
+        float x[6], y[6], z[6], w[6];
+    };
+    Planes planes[multi_view_frustums_max];
+    const auto views_count = frustums_count < multi_view_frustums_max ? frustums_count : multi_view_frustums_max;
+    for (std::size_t v = 0; v != views_count; ++v)
+    {
+        for (std::size_t p = 0; p != 6; ++p)
+        {
+            const auto& plane = frustums[v].planes[p];
+            planes[v].x[p] = plane.x;
+            planes[v].y[p] = plane.y;
+            planes[v].z[p] = plane.z;
+            planes[v].w[p] = plane.w;
+        }
+    }
+
+    const auto* bound = static_cast<const unsigned char*>(bounds);
+    for (std::size_t i = 0; i != count; ++i, bound += stride)
+    {
+        // memcpy, because objects may be of any type, and the vec4 isn't necessarily aligned.
+        glm::vec4 sphere;
+        std::memcpy(&sphere, bound, sizeof(sphere));
+        const auto radius = sphere.w * radius_scale;
+        std::uint64_t mask = 0;
+        for (std::size_t v = 0; v != views_count; ++v)
+        {
+            const auto& view_planes = planes[v];
+            // No early exit, so that the loop over planes has no branches.
+            auto inside = true;
+            for (std::size_t p = 0; p != 6; ++p)
+            {
+                inside &= view_planes.x[p] * sphere.x + view_planes.y[p] * sphere.y + view_planes.z[p] * sphere.z + view_planes.w[p] >= -radius;
+            }
+            mask |= static_cast<std::uint64_t>(inside) << v;
+        }
+        masks[i] = mask;
+    }
+}
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Visible volume of a camera, represented by 6 planes in world space.
+// Each plane is (a, b, c, d), where (a, b, c) is a normal pointing inside the frustum,
+// so a point p is on the inner side of the plane if dot((a, b, c), p) + d >= 0.
+// Normals are normalized, so dot((a, b, c), p) + d is the signed distance to the plane.
+struct Frustum
+{
+    // Left, right, bottom, top, near, far.
+    glm::vec4 planes[6];
+};
+
+// Extracts planes of the frustum from the view-projection matrix (Gribb-Hartmann method).
+// A point p is inside the frustum if -w <= x, y, z <= w, where (x, y, z, w) = M * p.
+// Each of those 6 inequalities is a plane, for example, -w <= x is
+// dot(row3 + row0, p) >= 0, where row0 and row3 are rows of the matrix M.
+Frustum calculate_frustum(const glm::mat4& view_projection);
+
+// Calculates world space positions of 8 corners of the frustum with the same trick
+// that is used for rendering frustums: the inverse view-projection matrix
+// transforms the cube (+-1, +-1, +-1) in clip space into the frustum in world space.
+// The order of corners is: 4 corners of the near plane (z = -1), then 4 corners of the far plane (z = 1),
+// each as a loop (-1, -1), (1, -1), (1, 1), (-1, 1).
+void calculate_frustum_corners(const glm::mat4& view_projection, glm::vec3 (&corners)[8]);
+
+// Returns false if the sphere is completely outside of the frustum.
+// The test is conservative: a sphere near a corner of the frustum may be outside,
+// but still be reported as intersecting.
+inline bool frustum_intersects_sphere(const Frustum& frustum, const glm::vec3& center, const float radius)
+{
+    for (const auto& plane : frustum.planes)
+    {
+        if (glm::dot(glm::vec3{ plane }, center) + plane.w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The maximum count of frustums cull_spheres_multi_view tests against, a bit of a mask per frustum.
+inline constexpr std::size_t multi_view_frustums_max{ 64 };
+
+// Tests bounding spheres of count objects against several frustums in a single pass over the objects.
+// The sphere of the object i is xyz (center) and w * radius_scale (radius) of the vec4 at bounds + i * stride bytes,
+// so bounds are read in place from an array of objects. Bit v of masks[i] is set if the sphere intersects frustums[v].
+// Culling views one by one reads every bound once per view, here every bound is read once,
+// and memory traffic stays the same as the count of views grows (planes of all views fit into L1 cache).
+void cull_spheres_multi_view(const Frustum* frustums, std::size_t frustums_count,
+    const void* bounds, std::size_t stride, float radius_scale, std::size_t count, std::uint64_t* masks);
+
+// Returns false if the axis-aligned box is completely outside of the frustum.
+// For each plane, only the corner of the box that is the furthest along the normal is tested.
+// Conservative the same way as the test of spheres.
+inline bool frustum_intersects_box(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+    for (const auto& plane : frustum.planes)
+    {
+        const glm::vec3 corner{
+            plane.x >= 0.0f ? max.x : min.x,
+            plane.y >= 0.0f ? max.y : min.y,
+            plane.z >= 0.0f ? max.z : min.z,
+        };
+        if (glm::dot(glm::vec3{ plane }, corner) + plane.w < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,148 @@
+﻿#include "GlUtils.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+GlCounters gl_counters{};
+
+unsigned compile_shader(const char* const source, const GLenum type, const char* const shader_name)
+{
+    const auto shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        GLint info_log_length;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+        const auto info_log = new char[info_log_length];
+        glGetShaderInfoLog(shader, info_log_length, NULL, info_log);
+        std::cout << "Error: failed to compile shader \"" << shader_name << "\"\n" << info_log << std::endl;
+        delete[] info_log;
+        std::exit(1);
+    }
+    return shader;
+}
+
+// Links the program and checks the result.
+// In case of an error, prints it and exits the program.
+static void link_program_checked(const unsigned shader_program, const char* const program_name)
+{
+    glLinkProgram(shader_program);
+    GLint success;
+    glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        GLint info_log_length;
+        glGetProgramiv(shader_program, GL_INFO_LOG_LENGTH, &info_log_length);
+        const auto info_log = new char[info_log_length];
+        glGetProgramInfoLog(shader_program, info_log_length, NULL, info_log);
+        std::cout << "Error: failed to link shader program \"" << program_name << "\"\n" << info_log << std::endl;
+        delete[] info_log;
+        std::exit(1);
+    }
+}
+
+unsigned link_program(const unsigned shader_vertex, const unsigned shader_fragment, const char* const program_name)
+{
+    const auto shader_program = glCreateProgram();
+    glAttachShader(shader_program, shader_vertex);
+    glAttachShader(shader_program, shader_fragment);
+    link_program_checked(shader_program, program_name);
+    return shader_program;
+}
+
+unsigned create_program(const char* const shader_vertex_source, const char* const shader_fragment_source, const char* const program_name)
+{
+    const auto shader_vertex = compile_shader(shader_vertex_source, GL_VERTEX_SHADER, program_name);
+    const auto shader_fragment = compile_shader(shader_fragment_source, GL_FRAGMENT_SHADER, program_name);
+    const auto shader_program = link_program(shader_vertex, shader_fragment, program_name);
+    glDeleteShader(shader_fragment);
+    glDeleteShader(shader_vertex);
+    return shader_program;
+}
+
+unsigned create_program_transform_feedback(const char* const shader_vertex_source, const char* const* const varyings, const GLsizei varyings_count, const char* const program_name)
+{
+    const auto shader_vertex = compile_shader(shader_vertex_source, GL_VERTEX_SHADER, program_name);
+    const auto shader_program = glCreateProgram();
+    glAttachShader(shader_program, shader_vertex);
+    // Captured outputs have to be specified before linking.
+    glTransformFeedbackVaryings(shader_program, varyings_count, varyings, GL_INTERLEAVED_ATTRIBS);
+    link_program_checked(shader_program, program_name);
+    glDeleteShader(shader_vertex);
+    return shader_program;
+}
+
+void GpuTimer::init()
+{
+    glGenQueries(queries_count, queries);
+    measurements_count = 0;
+    elapsed_ms = 0.0;
+}
+
+void GpuTimer::destroy()
+{
+    glDeleteQueries(queries_count, queries);
+}
+
+void GpuTimer::begin()
+{
+    const auto query = queries[measurements_count % queries_count];
+    // The query was issued queries_count measurements ago,
+    // so most likely GPU has already finished those commands.
+    // If it has not, keep the previous value instead of waiting.
+    if (measurements_count >= queries_count)
+    {
+        GLint available;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed_ns;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+            elapsed_ms = static_cast<double>(elapsed_ns) / 1.0e6;
+        }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void GpuFrameQueue::init()
+{
+    first = 0;
+    count = 0;
+}
+
+void GpuFrameQueue::destroy()
+{
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        glDeleteSync(fences[(first + i) % fences_max]);
+    }
+    count = 0;
+}
+
+void GpuFrameQueue::end_frame()
+{
+    // GPU finishes frames in order, so the signaled fences are at the front.
+    while (count != 0)
+    {
+        GLint status;
+        glGetSynciv(fences[first], GL_SYNC_STATUS, 1, nullptr, &status);
+        if (status != GL_SIGNALED && count != fences_max)
+        {
+            break;
+        }
+        glDeleteSync(fences[first]);
+        first = (first + 1) % fences_max;
+        --count;
+    }
+    fences[(first + count) % fences_max] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++count;
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    ++measurements_count;
+}
@@ -0,0 +1,173 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// Compiles OpenGL shader and returns its handle.
+// In case of an error, prints it and exits the program.
+unsigned compile_shader(const char* source, GLenum type, const char* shader_name);
+
+// Links OpenGL vertex and fragment shaders into a shader program and returns its handle.
+// In case of an error, prints it and exits the program.
+unsigned link_program(unsigned shader_vertex, unsigned shader_fragment, const char* program_name);
+
+// Compiles vertex and fragment shaders, links them into a shader program and returns its handle.
+// The shaders are deleted right away, since the program keeps everything it needs.
+unsigned create_program(const char* shader_vertex_source, const char* shader_fragment_source, const char* program_name);
+
+// Creates a shader program that has only a vertex shader, outputs of which are captured
+// with transform feedback into one buffer (the outputs are interleaved in the order of varyings).
+unsigned create_program_transform_feedback(const char* shader_vertex_source, const char* const* varyings, GLsizei varyings_count, const char* program_name);
+
+// Packs a color with components in [0, 1] into RGBA8 (red is the lowest byte).
+// Vertex attributes of this type are read with GL_UNSIGNED_BYTE and normalization enabled.
+inline std::uint32_t pack_color(const glm::vec3& color, const float alpha = 1.0f)
+{
+    const auto r = static_cast<std::uint32_t>(color.x * 255.0f + 0.5f);
+    const auto g = static_cast<std::uint32_t>(color.y * 255.0f + 0.5f);
+    const auto b = static_cast<std::uint32_t>(color.z * 255.0f + 0.5f);
+    const auto a = static_cast<std::uint32_t>(alpha * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+// Counts of OpenGL commands issued since the last reset (the main loop resets them every frame).
+// The commands are counted by the wrappers below, so per-frame rendering code calls them
+// instead of the respective gl* functions. Initialization code doesn't need to.
+struct GlCounters
+{
+    std::size_t draw_calls;
+    // Binds of programs, vertex arrays, textures and framebuffers.
+    std::size_t state_changes;
+    std::size_t buffer_uploads;
+    std::size_t bytes_uploaded;
+};
+
+extern GlCounters gl_counters;
+
+inline void use_program(const unsigned program)
+{
+    ++gl_counters.state_changes;
+    glUseProgram(program);
+}
+
+inline void bind_vertex_array(const unsigned vao)
+{
+    ++gl_counters.state_changes;
+    glBindVertexArray(vao);
+}
+
+inline void bind_texture(const GLenum unit, const unsigned texture)
+{
+    ++gl_counters.state_changes;
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+inline void bind_texture_array(const GLenum unit, const unsigned texture)
+{
+    ++gl_counters.state_changes;
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+}
+
+inline void bind_texture_buffer(const GLenum unit, const unsigned texture)
+{
+    ++gl_counters.state_changes;
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
+
+inline void bind_framebuffer(const GLenum target, const unsigned framebuffer)
+{
+    ++gl_counters.state_changes;
+    glBindFramebuffer(target, framebuffer);
+}
+
+inline void draw_arrays(const GLenum mode, const GLint first, const GLsizei count)
+{
+    ++gl_counters.draw_calls;
+    glDrawArrays(mode, first, count);
+}
+
+// offset is in bytes from the start of the bound element array buffer.
+inline void draw_elements(const GLenum mode, const GLsizei count, const GLenum type, const std::size_t offset)
+{
+    ++gl_counters.draw_calls;
+    glDrawElements(mode, count, type, reinterpret_cast<const void*>(offset));
+}
+
+inline void draw_elements_instanced(const GLenum mode, const GLsizei count, const GLenum type, const std::size_t offset, const GLsizei instances_count)
+{
+    ++gl_counters.draw_calls;
+    glDrawElementsInstanced(mode, count, type, reinterpret_cast<const void*>(offset), instances_count);
+}
+
+inline void draw_arrays_instanced(const GLenum mode, const GLint first, const GLsizei count, const GLsizei instances_count)
+{
+    ++gl_counters.draw_calls;
+    glDrawArraysInstanced(mode, first, count, instances_count);
+}
+
+// data may be nullptr, in which case nothing is uploaded, only memory is allocated.
+inline void buffer_data(const GLenum target, const std::size_t size, const void* const data, const GLenum usage)
+{
+    if (data != nullptr)
+    {
+        ++gl_counters.buffer_uploads;
+        gl_counters.bytes_uploaded += size;
+    }
+    glBufferData(target, static_cast<GLsizeiptr>(size), data, usage);
+}
+
+inline void buffer_sub_data(const GLenum target, const std::size_t offset, const std::size_t size, const void* const data)
+{
+    ++gl_counters.buffer_uploads;
+    gl_counters.bytes_uploaded += size;
+    glBufferSubData(target, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+}
+
+// Measures how much time GPU spends on the commands issued between begin() and end().
+// OpenGL commands are executed asynchronously, so measuring them with std::chrono on CPU
+// would only show how long it takes to submit them.
+// Instead, a GL_TIME_ELAPSED query is used. Its result becomes available a few frames later,
+// and asking for it earlier would stall CPU until GPU catches up.
+// That's why the timer cycles through several queries and reads the oldest one.
+// Note that GL_TIME_ELAPSED queries can't be nested, so 2 timers can't be active at once.
+struct GpuTimer
+{
+    static constexpr std::size_t queries_count{ 4 };
+
+    unsigned queries[queries_count];
+    // How many times begin() was called.
+    std::size_t measurements_count;
+    // The latest available measurement in milliseconds.
+    double elapsed_ms;
+
+    void init();
+    void destroy();
+
+    void begin();
+    void end();
+};
+
+// Tracks how far CPU is ahead of GPU: a fence is inserted after every frame,
+// and the frames fences of which aren't signaled yet are in flight.
+struct GpuFrameQueue
+{
+    // The driver normally blocks CPU long before that many frames are queued.
+    static constexpr std::size_t fences_max{ 16 };
+
+    GLsync fences[fences_max];
+    // Fences of frames in flight are fences[first], ..., fences[(first + count - 1) % fences_max].
+    std::size_t first;
+    std::size_t count;
+
+    void init();
+    void destroy();
+
+    // Called after all commands of a frame.
+    void end_frame();
+};
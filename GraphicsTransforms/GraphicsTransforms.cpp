@@ -1,11 +1,16 @@
 ﻿#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <string_view>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
@@ -13,6 +18,32 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "Animation.hpp"
+#include "City.hpp"
+#include "CubeNxN.hpp"
+#include "CubeSolver.hpp"
+#include "DebugDraw.hpp"
+#include "FrameCostMap.hpp"
+#include "GlUtils.hpp"
+#include "Hud.hpp"
+#include "Impostors.hpp"
+#include "LiveLink.hpp"
+#include "Metrics.hpp"
+#include "ParallelRender.hpp"
+#include "Particles.hpp"
+#include "PrototypeGroups.hpp"
+#include "ScriptedQuads.hpp"
+#include "Shadows.hpp"
+#include "Replay.hpp"
+#include "RubiksCube.hpp"
+#include "RubiksCubes.hpp"
+#include "SnapshotRing.hpp"
+#include "StateHash.hpp"
+#include "Stats.hpp"
+#include "Terrain.hpp"
+#include "Transparency.hpp"
+#include "VisibilityBuffer.hpp"
+
 // Up vector in world space.
 // World space is right-handed coordinate system, more precisely:
 // Ox points towards the right.
@@ -28,6 +59,11 @@ static constexpr float near[cameras_count] = { 0.1f, 0.1f };
 // Distance to the far plane of a projection (used for both types of projection).
 static constexpr float far[cameras_count] = { 10.0f, 50.0f };
 
+// Tables of the Rubik's cube solver are generated once and kept in this file in the working directory.
+static constexpr auto cube_solver_tables_path = "cube_solver_tables.bin";
+// Visibility sets of the city are baked once and kept in this file in the working directory.
+static constexpr auto city_visibility_path = "city_visibility.bin";
+
 // There are 2 types of projection.
 enum struct ProjectionType
 {
@@ -88,6 +124,9 @@ struct WindowData
     // Vertical field of view (angle in radians) of the perspective projection.
     float fov[cameras_count];
 
+    // Keys of a replay, which replace the keyboard (nullptr when there is no replay).
+    const ReplayPlayer* replay;
+
     // Calculates normalied vector that points from the front of the i-th camera.
     glm::vec3 calculate_camera_front(const std::size_t i) const
     {
@@ -155,6 +194,54 @@ struct WindowData
     }
 };
 
+// Everything that determines what a frame looks like: cameras, transforms of the quads,
+// animation angles and which objects are rendered.
+// It's stored in SnapshotRing as raw bytes, so it must be trivially copyable,
+// and it's zeroed with memset before filling, so that padding bytes are always the same.
+// Some state isn't included, and restoring a frame leaves it as it is: particles and stickers of the NxN cube
+// (they live on GPU), scripted quads and Rubik's cubes (their state is in coroutines), positions of translucent quads
+// moved with the ` key (there are too many of them), and objects of the live link. They stop during time travel instead,
+// except the live link, which is driven by another process.
+struct WorldState
+{
+    std::uint32_t camera_active_index;
+    std::uint32_t camera_fov_control_index;
+    glm::vec3 camera_pos[cameras_count];
+    float yaw[cameras_count];
+    float pitch[cameras_count];
+    float ortho_height_half[cameras_count];
+    float fov[cameras_count];
+    ProjectionType projection_type[cameras_count];
+    bool view_enable[cameras_count];
+    bool projection_enable[cameras_count];
+
+    bool quad_enable[2];
+    bool quad_scale[2];
+    bool quad_rotate[2];
+    bool quad_translate[2];
+
+    float quads_pair_animation_angles[2];
+    float quads_triplet_animation_angle;
+    bool quads_pair_animation_enable;
+    bool quads_triplet_enable;
+    bool quads_triplet_animation_enable;
+
+    bool camera_render_enable[cameras_count];
+    bool frustum_render_enable[cameras_count];
+    bool translucent_quads_enable;
+    bool particles_enable;
+    bool scripted_quads_enable;
+    bool rubiks_cubes_enable;
+    bool cube_nxn_enable;
+    bool terrain_enable;
+    bool impostors_enable;
+    bool prototype_groups_enable;
+    bool city_enable;
+    bool shadows_enable;
+    bool visibility_buffer_enable;
+};
+static_assert(std::is_trivially_copyable_v<WorldState>);
+
 // This function is called when the window size is changed.
 // width and height are the new size of the window.
 static void framebuffer_size_callback(GLFWwindow* const window, const int width, const int height)
@@ -176,6 +263,11 @@ static void framebuffer_size_callback(GLFWwindow* const window, const int width,
 static void mouse_callback(GLFWwindow* const window, double xpos_in, double ypos_in)
 {
     const auto data = static_cast<WindowData*>(glfwGetWindowUserPointer(window));
+    // The mouse would make replays differ from run to run.
+    if (data->replay != nullptr)
+    {
+        return;
+    }
 
     const glm::vec2 pos{ static_cast<float>(xpos_in), static_cast<float>(ypos_in) };
 
@@ -216,7 +308,7 @@ static void mouse_callback(GLFWwindow* const window, double xpos_in, double ypos
 static void scroll_callback(GLFWwindow* const window, const double xoffset, const double yoffset)
 {
     const auto data = static_cast<WindowData*>(glfwGetWindowUserPointer(window));
-    if (!data->projection_enable[data->camera_fov_control_index])
+    if (data->replay != nullptr || !data->projection_enable[data->camera_fov_control_index])
     {
         return;
     }
@@ -243,51 +335,16 @@ static void scroll_callback(GLFWwindow* const window, const double xoffset, cons
     }
 }
 
-// Compiles OpenGL shader and returns its handle.
-// In case of an error, prints it and exits the program.
-static unsigned compile_shader(const char* const source, const GLenum type, const char* const shader_name)
+// Returns whether the key is pressed.
+// During a replay, keys are taken from the replay instead of the keyboard.
+static bool key_pressed(GLFWwindow* const window, const int key)
 {
-    const auto shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    const auto data = static_cast<const WindowData*>(glfwGetWindowUserPointer(window));
+    if (data->replay != nullptr)
     {
-        GLint info_log_length;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
-        const auto info_log = new char[info_log_length];
-        glGetShaderInfoLog(shader, info_log_length, NULL, info_log);
-        std::cout << "Error: failed to compile shader \"" << shader_name << "\"\n" << info_log << std::endl;
-        delete[] info_log;
-        std::exit(1);
+        return data->replay->key_pressed(key);
     }
-    return shader;
-}
-
-// Links OpenGL vertex and fragment shaders into a shader program and returns its handle.
-// In case of an error, prints it and exits the program.
-static unsigned link_program(const unsigned shader_vertex, const unsigned shader_fragment, const char* const program_name)
-{
-    const auto shader_program = glCreateProgram();
-    glAttachShader(shader_program, shader_vertex);
-    glAttachShader(shader_program, shader_fragment);
-    glLinkProgram(shader_program);
-    {
-        GLint success;
-        glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
-        if (!success)
-        {
-            GLint info_log_length;
-            glGetProgramiv(shader_program, GL_INFO_LOG_LENGTH, &info_log_length);
-            const auto info_log = new char[info_log_length];
-            glGetProgramInfoLog(shader_program, info_log_length, NULL, info_log);
-            std::cout << "Error: failed to link shader program \"" << program_name << "\"\n" << info_log << std::endl;
-            delete[] info_log;
-            std::exit(1);
-        }
-    }
-    return shader_program;
+    return glfwGetKey(window, key) == GLFW_PRESS;
 }
 
 // glfwGetKey returns either GLFW_PRESS or GLFW_RELEASE.
@@ -302,7 +359,7 @@ auto create_debounce_key_press_handler(T&& f)
     // It's a lambda function with a mutable state.
     return [released = true, f = std::forward<T>(f)](GLFWwindow* const window, const int key) mutable
         {
-            if (glfwGetKey(window, key) == GLFW_PRESS)
+            if (key_pressed(window, key))
             {
                 if (released)
                 {
@@ -327,13 +384,145 @@ static auto create_debounce_key_press_handler_bool_switcher(bool& value)
         });
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+    // Command line options.
+    // --metrics <port> serves metrics for Prometheus at http://127.0.0.1:<port>/metrics.
+    // --replay <scenario> plays a scripted session with a fixed time step and quits at its end.
+    // --list-replays prints names of the scenarios, separated by spaces, and quits.
+    // --headless hides the window (useful for replays).
+    // --report <path> writes CPU time of the replayed frames into the file.
+    // --cube-benchmark measures how many moves per second the Rubik's cube engine applies and how many cubes per second
+    // the solver solves, and quits.
+    // --parallel-render <workers> <sort-first|sort-last> renders frames with worker processes, prints their rate,
+    // and quits.
+    // --vbuffer-benchmark measures time of a frame of forward and visibility buffer shading as depth complexity grows,
+    // and quits.
+    // --live-link-producer connects to the live link of a running instance and drives its objects and camera
+    // until that instance closes the link.
+    // --live-link-benchmark measures latency of the live link with a forked producer, and quits.
+    // --fast-forward <seconds> simulates the first seconds of the session (of the replay, if any) without rendering them,
+    // prints how fast it went, and continues from there.
+    // --state-hash <path> writes hashes of the state of every rendered frame into the file.
+    // --state-hash-reference <path> compares them with a file written by another run and prints the first divergence.
+    // --state-hash-tolerance <bits> rounds off the low bits of mantissas of floats before they are hashed.
+    unsigned short metrics_port = 0;
+    const ReplayScenario* replay_scenario = nullptr;
+    bool headless = false;
+    const char* replay_report_path = nullptr;
+    bool visibility_buffer_benchmark_run = false;
+    double fast_forward_s = 0.0;
+    const char* state_hash_path = nullptr;
+    const char* state_hash_reference_path = nullptr;
+    unsigned state_hash_float_bits_dropped = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view option{ argv[i] };
+        if (option == "--metrics" && i + 1 < argc)
+        {
+            metrics_port = static_cast<unsigned short>(std::atoi(argv[++i]));
+        }
+        else if (option == "--replay" && i + 1 < argc)
+        {
+            replay_scenario = find_replay_scenario(argv[++i]);
+            if (replay_scenario == nullptr)
+            {
+                std::cout << "Unknown replay scenario: " << argv[i] << std::endl;
+                std::cout << "Replay scenarios: " << replay_scenario_names() << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--list-replays")
+        {
+            std::cout << replay_scenario_names() << std::endl;
+            return 0;
+        }
+        else if (option == "--cube-benchmark")
+        {
+            cube_benchmark();
+            cube_solver_benchmark(cube_solver_tables_path);
+            return 0;
+        }
+        else if (option == "--parallel-render" && i + 2 < argc)
+        {
+            const auto workers_count = static_cast<std::size_t>(std::max(std::atoi(argv[i + 1]), 1));
+            const std::string_view mode{ argv[i + 2] };
+            if (mode != "sort-first" && mode != "sort-last")
+            {
+                std::cout << "Unknown parallel rendering mode: " << mode << " (should be sort-first or sort-last)" << std::endl;
+                return 1;
+            }
+            return parallel_render_benchmark(workers_count, mode == "sort-first" ? ParallelRenderMode::sort_first : ParallelRenderMode::sort_last) ? 0 : 1;
+        }
+        else if (option == "--live-link-producer")
+        {
+            return live_link_producer_run() ? 0 : 1;
+        }
+        else if (option == "--live-link-benchmark")
+        {
+            return live_link_benchmark() ? 0 : 1;
+        }
+        else if (option == "--vbuffer-benchmark")
+        {
+            visibility_buffer_benchmark_run = true;
+        }
+        else if (option == "--headless")
+        {
+            headless = true;
+        }
+        else if (option == "--report" && i + 1 < argc)
+        {
+            replay_report_path = argv[++i];
+        }
+        else if (option == "--fast-forward" && i + 1 < argc)
+        {
+            fast_forward_s = std::atof(argv[++i]);
+        }
+        else if (option == "--state-hash" && i + 1 < argc)
+        {
+            state_hash_path = argv[++i];
+        }
+        else if (option == "--state-hash-reference" && i + 1 < argc)
+        {
+            state_hash_reference_path = argv[++i];
+        }
+        else if (option == "--state-hash-tolerance" && i + 1 < argc)
+        {
+            state_hash_float_bits_dropped = static_cast<unsigned>(std::max(std::atoi(argv[++i]), 0));
+        }
+        else
+        {
+            std::cout << "Unknown option: " << option << std::endl;
+            std::cout << "Usage: GraphicsTransforms [--metrics <port>] [--replay <scenario>] [--list-replays] [--headless] [--report <path>] [--cube-benchmark] [--parallel-render <workers> <sort-first|sort-last>] [--vbuffer-benchmark] [--live-link-producer] [--live-link-benchmark] [--fast-forward <seconds>] [--state-hash <path>] [--state-hash-reference <path>] [--state-hash-tolerance <bits>]" << std::endl;
+            return 1;
+        }
+    }
+    ReplayPlayer replay_player{ };
+    if (replay_scenario != nullptr)
+    {
+        replay_player.start(*replay_scenario);
+    }
+    StateHashLog state_hash_log{ };
+    if ((state_hash_path != nullptr || state_hash_reference_path != nullptr)
+        && !state_hash_log.open(state_hash_path, state_hash_reference_path, state_hash_float_bits_dropped))
+    {
+        return 1;
+    }
+
     // Initialize window and rendering context for OpenGL 3.3 (version 3.3 is enough for this demo).
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Translucent quads copy the depth buffer of the window into their framebuffer,
+    // which requires the exact same format (24 bits of depth and 8 bits of stencil).
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8);
+    // GLFW can't create a context without a window, so a headless run just doesn't show it.
+    if (headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     // Initial state of cameras.
     static constexpr float yaw_initial[2] = { glm::radians(-90.0f), 0.0f };
@@ -357,6 +546,7 @@ int main()
         .projection_type = { ProjectionType::perspective, ProjectionType::perspective },
         .ortho_height_half = { ortho_height_half_initial[0], ortho_height_half_initial[1] },
         .fov = { fov_initial[0], fov_initial[1] },
+        .replay = replay_scenario != nullptr ? &replay_player : nullptr,
     };
 
     // Create window and set callbacks.
@@ -369,6 +559,11 @@ int main()
     }
     glfwSetWindowUserPointer(window, &window_data);
     glfwMakeContextCurrent(window);
+    // Replays measure the CPU time of frames, so they aren't throttled by v-sync.
+    if (replay_scenario != nullptr)
+    {
+        glfwSwapInterval(0);
+    }
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -386,6 +581,14 @@ int main()
 
     std::cout << "Loaded OpenGL " << GLAD_VERSION_MAJOR(gl_version) << '.' << GLAD_VERSION_MINOR(gl_version) << std::endl;
 
+    // Unlike the cube benchmark, it needs OpenGL, so it runs once the context is ready.
+    if (visibility_buffer_benchmark_run)
+    {
+        visibility_buffer_benchmark();
+        glfwTerminate();
+        return 0;
+    }
+
     // Define 3D coordinates of the vertices of a quad (+-0.5, +-0.5, 0).
     // A quad is rendered as 2 triangles.
     // 3 consecutive vertices represent a triangle.
@@ -478,46 +681,10 @@ void main()
     glDeleteShader(shader_fragment);
     glDeleteShader(shader_vertex);
 
-    // Vertices used to draw frustums.
-    // Those are rendered not as triangles, but as lines,
-    // so there should be 12 edges of the cube with vertices (+-1, +-1, +-1).
-    // Vertices 0-3 and 4-7 will be rendered as a loop, thus producing 4 lines each.
-    // Starting from the vertex 8, each pair of vertices will be rendered as one line.
-    const float vertices_frustum[] = {
-        // loop at z=-1.0f
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        // loop at z=1.0f
-        -1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        // line
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, 1.0f,
-        // line
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, 1.0f,
-        // line
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-        // line
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, 1.0f,
-    };
-    unsigned vbo_frustum, vao_frustum;
-    glGenVertexArrays(1, &vao_frustum);
-    glGenBuffers(1, &vbo_frustum);
-
-    glBindVertexArray(vao_frustum);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_frustum);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_frustum), vertices_frustum, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(0);
+    // Frustums, bounds and other debug visualization are rendered by the debug draw,
+    // which collects lines and triangles during the frame and renders them all at once.
+    DebugDraw debug_draw;
+    debug_draw.init();
 
     // Camera will be rendered separately from the frustum
     // as a pyramid with a rectangular base.
@@ -740,6 +907,381 @@ void main()
     // Enable/disable animation of 3 quads simulating the corner of the Rubik's cube.
     auto handle_quads_triplet_animation_enable_switch = create_debounce_key_press_handler_bool_switcher(quads_triplet_animation_enable);
 
+    // This is a section for the field of translucent quads rendered with instancing.
+    auto translucent_quads_enable = false;
+    TranslucentQuads translucent_quads;
+    translucent_quads.init(vbo_quad);
+
+    // Enable/disable rendering of translucent quads.
+    auto handle_translucent_quads_enable_switch = create_debounce_key_press_handler_bool_switcher(translucent_quads_enable);
+    // Switch between weighted blended OIT and sorting.
+    auto handle_translucent_quads_mode_switch = create_debounce_key_press_handler([&translucent_quads]()
+        {
+            switch (translucent_quads.mode)
+            {
+            case TransparencyMode::weighted_blended:
+                translucent_quads.mode = TransparencyMode::sorted;
+                std::cout << "Transparency: sorted" << std::endl;
+                break;
+            case TransparencyMode::sorted:
+                translucent_quads.mode = TransparencyMode::weighted_blended;
+                std::cout << "Transparency: weighted blended" << std::endl;
+                break;
+            }
+        });
+    // Halve/double the count of translucent quads.
+    auto handle_translucent_quads_count_decrease = create_debounce_key_press_handler([&translucent_quads]()
+        {
+            translucent_quads.generate(std::max<std::size_t>(1, translucent_quads.instances.size() / 2));
+            std::cout << "Translucent quads: " << translucent_quads.instances.size() << std::endl;
+        });
+    auto handle_translucent_quads_count_increase = create_debounce_key_press_handler([&translucent_quads]()
+        {
+            translucent_quads.generate(std::min(TranslucentQuads::count_max, translucent_quads.instances.size() * 2));
+            std::cout << "Translucent quads: " << translucent_quads.instances.size() << std::endl;
+        });
+    // How many quads move every frame: none, 64, 1024 or 16384. Only they are uploaded again.
+    std::size_t translucent_quads_moving_count = 0;
+    auto handle_translucent_quads_moving_switch = create_debounce_key_press_handler([&translucent_quads_moving_count]()
+        {
+            translucent_quads_moving_count = translucent_quads_moving_count == 0 ? 64
+                : translucent_quads_moving_count == 16384 ? 0 : translucent_quads_moving_count * 16;
+            std::cout << "Translucent quads: " << translucent_quads_moving_count << " moving every frame" << std::endl;
+        });
+    // Translucent quads are culled against the active camera, unless the culling is frozen.
+    // Freezing keeps the last frustum, so that it's possible to fly around and see what was culled.
+    auto translucent_quads_culling_freeze = false;
+    auto translucent_quads_culling_view_projection = glm::mat4{ 1.0f };
+    auto translucent_quads_bounds_render_enable = false;
+    auto handle_translucent_quads_culling_freeze_switch = create_debounce_key_press_handler_bool_switcher(translucent_quads_culling_freeze);
+    auto handle_translucent_quads_bounds_render_enable_switch = create_debounce_key_press_handler_bool_switcher(translucent_quads_bounds_render_enable);
+    // The comparison needs matrices of the active camera, so it's requested here and done in the render loop.
+    auto translucent_quads_compare_requested = false;
+    auto handle_translucent_quads_compare = create_debounce_key_press_handler([&translucent_quads_compare_requested]()
+        {
+            translucent_quads_compare_requested = true;
+        });
+    // The same for the comparison of culling view by view and in one pass over quads.
+    auto translucent_quads_compare_culling_requested = false;
+    auto handle_translucent_quads_compare_culling = create_debounce_key_press_handler([&translucent_quads_compare_culling_requested]()
+        {
+            translucent_quads_compare_culling_requested = true;
+        });
+    // Cost of translucent quads is averaged and printed once per second.
+    auto translucent_quads_report_time = std::chrono::steady_clock::now();
+    std::size_t translucent_quads_report_frames = 0;
+    double translucent_quads_report_cpu_ms = 0.0;
+    double translucent_quads_report_gpu_ms = 0.0;
+    double translucent_quads_report_sort_ms = 0.0;
+    std::size_t translucent_quads_report_uploaded_bytes = 0;
+    std::size_t translucent_quads_report_uploaded_ranges = 0;
+    // How many times each DepthSortAlgorithm was chosen.
+    std::size_t translucent_quads_report_sorts[4] = { 0, 0, 0, 0 };
+
+    // This is a section for the particle fountain simulated and rendered on GPU.
+    auto particles_enable = false;
+    Particles particles;
+    particles.init();
+
+    // Enable/disable simulation and rendering of particles.
+    auto handle_particles_enable_switch = create_debounce_key_press_handler_bool_switcher(particles_enable);
+    // Halve/double the count of particles.
+    auto handle_particles_count_decrease = create_debounce_key_press_handler([&particles]()
+        {
+            particles.generate(std::max<std::size_t>(1, particles.count / 2));
+            std::cout << "Particles: " << particles.count << std::endl;
+        });
+    auto handle_particles_count_increase = create_debounce_key_press_handler([&particles]()
+        {
+            particles.generate(std::min(Particles::count_max, particles.count * 2));
+            std::cout << "Particles: " << particles.count << std::endl;
+        });
+    // Cost of particles is averaged and printed once per second.
+    auto particles_report_time = std::chrono::steady_clock::now();
+    std::size_t particles_report_frames = 0;
+    double particles_report_simulate_ms = 0.0;
+    double particles_report_render_ms = 0.0;
+    double particles_report_frame_ms = 0.0;
+
+    // This is a section for the floor of quads animated by coroutine scripts.
+    auto scripted_quads_enable = false;
+    // Coroutine frames of all scripts come from this pool: every quad has its script and at most one child tween,
+    // and a few more blocks are left for other demos.
+    animation_frame_pool.init(2 * ScriptedQuads::count + 64);
+    ScriptedQuads scripted_quads;
+    scripted_quads.init(vbo_quad);
+
+    // Enable/disable scripted quads.
+    auto handle_scripted_quads_enable_switch = create_debounce_key_press_handler_bool_switcher(scripted_quads_enable);
+    // Cost of scripts is averaged and printed once per second.
+    auto scripted_quads_report_time = std::chrono::steady_clock::now();
+    std::size_t scripted_quads_report_frames = 0;
+    double scripted_quads_report_update_ms = 0.0;
+
+    // This is a section for the field of Rubik's cubes driven by the cube engine.
+    auto rubiks_cubes_enable = false;
+    RubiksCubes rubiks_cubes;
+    rubiks_cubes.init(1);
+
+    // Enable/disable Rubik's cubes.
+    auto handle_rubiks_cubes_enable_switch = create_debounce_key_press_handler_bool_switcher(rubiks_cubes_enable);
+    // Switch between random turns and scramble-solve cycles. Tables of the solver are loaded on the first switch,
+    // since generating them takes a couple of seconds when there is no file yet.
+    CubeSolver cube_solver;
+    auto handle_rubiks_cubes_solver_switch = create_debounce_key_press_handler([&rubiks_cubes, &cube_solver]()
+        {
+            if (!cube_solver.ready())
+            {
+                cube_solver.init(cube_solver_tables_path);
+            }
+            rubiks_cubes.set_solver(rubiks_cubes.solver == nullptr ? &cube_solver : nullptr);
+            std::cout << "Rubik's cubes: " << (rubiks_cubes.solver == nullptr ? "random turns" : "scramble and solve") << std::endl;
+        });
+    // Multiply the count of cubes by 4 (after the maximum, it starts from 1 again).
+    auto handle_rubiks_cubes_count_switch = create_debounce_key_press_handler([&rubiks_cubes]()
+        {
+            const auto count = rubiks_cubes.count() * 4;
+            rubiks_cubes.generate(count > RubiksCubes::count_max ? 1 : count);
+            std::cout << "Rubik's cubes: " << rubiks_cubes.count() << std::endl;
+        });
+    // Cost of cubes is averaged and printed once per second.
+    auto rubiks_cubes_report_time = std::chrono::steady_clock::now();
+    std::size_t rubiks_cubes_report_frames = 0;
+    double rubiks_cubes_report_render_ms = 0.0;
+    double rubiks_cubes_report_frame_ms = 0.0;
+
+    // This is a section for the NxN Rubik's cube, layers of which are turned on GPU.
+    auto cube_nxn_enable = false;
+    CubeNxN cube_nxn;
+    cube_nxn.init(3);
+
+    // Enable/disable the NxN cube.
+    auto handle_cube_nxn_enable_switch = create_debounce_key_press_handler_bool_switcher(cube_nxn_enable);
+    // Switch to the next size of the cube (after the largest, it starts from 3 again).
+    auto handle_cube_nxn_size_switch = create_debounce_key_press_handler([&cube_nxn]()
+        {
+            constexpr std::size_t sizes[] = { 3, 8, 32, 128, 256, CubeNxN::n_max };
+            const auto next = std::find_if(std::begin(sizes), std::end(sizes), [&cube_nxn](const std::size_t n) { return n > cube_nxn.n; });
+            cube_nxn.generate(next == std::end(sizes) ? sizes[0] : *next);
+            std::cout << "NxN cube: " << cube_nxn.n << 'x' << cube_nxn.n << 'x' << cube_nxn.n
+                << ", " << cube_nxn.stickers_count << " stickers" << std::endl;
+        });
+    // Cost of the cube is averaged and printed once per second.
+    auto cube_nxn_report_time = std::chrono::steady_clock::now();
+    std::size_t cube_nxn_report_frames = 0;
+    double cube_nxn_report_render_ms = 0.0;
+    double cube_nxn_report_frame_ms = 0.0;
+
+    // This is a section for the clipmap terrain that follows the active camera.
+    auto terrain_enable = false;
+    Terrain terrain;
+    terrain.init();
+
+    // Enable/disable the terrain.
+    auto handle_terrain_enable_switch = create_debounce_key_press_handler_bool_switcher(terrain_enable);
+    // Cost of the terrain is averaged and printed once per second, together with heights streamed during the second.
+    auto terrain_report_time = std::chrono::steady_clock::now();
+    std::size_t terrain_report_frames = 0;
+    double terrain_report_render_ms = 0.0;
+    std::size_t terrain_report_texels = 0;
+
+    // This is a section for the field of clusters, distant ones of which are drawn as impostors.
+    auto impostors_enable = false;
+    Impostors impostors;
+    impostors.init();
+
+    // Enable/disable the clusters.
+    auto handle_impostors_enable_switch = create_debounce_key_press_handler_bool_switcher(impostors_enable);
+    // Cost of the clusters is averaged and printed once per second, together with pictures refreshed during the second.
+    auto impostors_report_time = std::chrono::steady_clock::now();
+    std::size_t impostors_report_frames = 0;
+    double impostors_report_render_ms = 0.0;
+    std::size_t impostors_report_refreshed = 0;
+
+    // This is a section for thousands of triplets and pairs of quads, instanced as whole groups.
+    auto prototype_groups_enable = false;
+    PrototypeGroups prototype_groups;
+    prototype_groups.init();
+
+    // Enable/disable the groups.
+    auto handle_prototype_groups_enable_switch = create_debounce_key_press_handler_bool_switcher(prototype_groups_enable);
+    // Cost of the groups is averaged and printed once per second.
+    auto prototype_groups_report_time = std::chrono::steady_clock::now();
+    std::size_t prototype_groups_report_frames = 0;
+    double prototype_groups_report_render_ms = 0.0;
+
+    // This is a section for the static city, buildings of which are culled by precomputed visibility sets.
+    auto city_enable = false;
+    City city;
+    city.init();
+
+    // Enable/disable the city. Visibility sets are loaded on the first switch,
+    // since baking them takes a while when there is no file yet.
+    auto handle_city_enable_switch = create_debounce_key_press_handler([&city_enable, &city]()
+        {
+            if (!city.visibility_ready())
+            {
+                city.load_visibility(city_visibility_path);
+            }
+            city_enable = !city_enable;
+        });
+    // Cost of the city is averaged and printed once per second.
+    auto city_report_time = std::chrono::steady_clock::now();
+    std::size_t city_report_frames = 0;
+    double city_report_render_ms = 0.0;
+
+    // This is a section for the ground with pillars, lit by a directional light with shadows.
+    // The animated pair and triplet of quads cast shadows on it too.
+    auto shadows_enable = false;
+    Shadows shadows;
+    shadows.init();
+
+    // Enable/disable shadows.
+    auto handle_shadows_enable_switch = create_debounce_key_press_handler_bool_switcher(shadows_enable);
+    // Enable/disable caching of the static layer, to compare the cost.
+    auto handle_shadows_cache_switch = create_debounce_key_press_handler([&shadows]()
+        {
+            shadows.cache_enable = !shadows.cache_enable;
+            std::cout << "Shadows: static layer " << (shadows.cache_enable ? "cached" : "rendered every frame") << std::endl;
+        });
+    // Cost of shadows is averaged and printed once per second, together with renders of the static layer during the second.
+    auto shadows_report_time = std::chrono::steady_clock::now();
+    std::size_t shadows_report_frames = 0;
+    double shadows_report_render_ms = 0.0;
+    std::size_t shadows_report_static_renders = 0;
+
+    // This is a section for a stack of layers of high-polygon meshes in front of the camera,
+    // shaded forward or through a visibility buffer, to compare the cost of overdraw.
+    auto visibility_buffer_enable = false;
+    VisibilityBuffer visibility_buffer;
+    visibility_buffer.init();
+
+    // Enable/disable the stack.
+    auto handle_visibility_buffer_enable_switch = create_debounce_key_press_handler_bool_switcher(visibility_buffer_enable);
+    // Switch between forward and visibility buffer shading.
+    auto handle_visibility_buffer_path_switch = create_debounce_key_press_handler([&visibility_buffer]()
+        {
+            visibility_buffer.path = visibility_buffer.path == ShadingPath::forward ? ShadingPath::visibility_buffer : ShadingPath::forward;
+            std::cout << "Visibility buffer: " << (visibility_buffer.path == ShadingPath::forward ? "forward" : "visibility buffer") << " shading" << std::endl;
+        });
+    // Double the count of layers, from 1 to the maximum and back to 1.
+    auto handle_visibility_buffer_layers_switch = create_debounce_key_press_handler([&visibility_buffer]()
+        {
+            visibility_buffer.layers = visibility_buffer.layers == VisibilityBuffer::layers_max ? 1 : visibility_buffer.layers * 2;
+            std::cout << "Visibility buffer: " << visibility_buffer.layers << " layers" << std::endl;
+        });
+    // Cost of the stack is averaged and printed once per second.
+    auto visibility_buffer_report_time = std::chrono::steady_clock::now();
+    std::size_t visibility_buffer_report_frames = 0;
+    double visibility_buffer_report_render_ms = 0.0;
+
+    // This is a section for objects and the camera driven by another process through the live link.
+    // The link is an external connection rather than a part of the world, so it isn't in the world state.
+    auto live_link_enable = false;
+    auto live_link_camera_follow = true;
+    LiveLinkConsumer live_link;
+    LiveLinkObjects live_link_objects;
+    live_link_objects.init();
+
+    // Open/close the link. Closing it tells the producer to stop.
+    auto handle_live_link_enable_switch = create_debounce_key_press_handler([&live_link_enable, &live_link]()
+        {
+            if (live_link_enable)
+            {
+                live_link.destroy();
+                live_link_enable = false;
+                std::cout << "Live link: closed" << std::endl;
+            }
+            else if (live_link.create(live_link_name))
+            {
+                live_link_enable = true;
+                std::cout << "Live link: waiting for a producer at " << live_link_name << " (run GraphicsTransforms --live-link-producer)" << std::endl;
+            }
+            else
+            {
+                std::cout << "Live link: can't create shared memory " << live_link_name << std::endl;
+            }
+        });
+    // Enable/disable following of the camera pose sent by the producer.
+    auto handle_live_link_camera_follow_switch = create_debounce_key_press_handler_bool_switcher(live_link_camera_follow);
+    // Batches, transforms and latency are summed and printed once per second.
+    auto live_link_report_time = std::chrono::steady_clock::now();
+    std::size_t live_link_report_frames = 0;
+    std::size_t live_link_report_batches = 0;
+    std::size_t live_link_report_transforms = 0;
+    double live_link_report_latency_ms = 0.0;
+    double live_link_report_latency_ms_max = 0.0;
+    double live_link_report_render_ms = 0.0;
+    // Batches that were waiting in the ring at the start of the latest frame, before they were applied.
+    std::size_t live_link_batches_queued = 0;
+
+    // This is a section for the HUD with frame statistics.
+    auto hud_enable = false;
+    Hud hud;
+    hud.init();
+    // GPU time of passes that aren't measured by the subsystems themselves.
+    GpuTimer gpu_timer_scene;
+    GpuTimer gpu_timer_debug_draw;
+    gpu_timer_scene.init();
+    gpu_timer_debug_draw.init();
+
+    // Enable/disable the HUD.
+    auto handle_hud_enable_switch = create_debounce_key_press_handler_bool_switcher(hud_enable);
+
+    // The metrics server is started only if its port is given in the command line.
+    MetricsServer metrics_server;
+    if (metrics_port != 0)
+    {
+        metrics_server.start(metrics_port);
+    }
+    GpuFrameQueue gpu_frame_queue;
+    gpu_frame_queue.init();
+
+    // This is a section for the map of frame cost over viewpoints of the active camera.
+    // The bounds cover the scene with some margin.
+    FrameCostMap frame_cost_map;
+    frame_cost_map.init({ -8.0f, -4.0f, -12.0f }, { 8.0f, 4.0f, 4.0f });
+    const auto frame_cost_map_export = [&frame_cost_map]()
+        {
+            const auto heatmap_exported = frame_cost_map.export_heatmap("frame_cost_heatmap.ppm");
+            const auto point_cloud_exported = frame_cost_map.export_point_cloud("frame_cost_points.ply");
+            std::cout << "Frame cost map: "
+                << (heatmap_exported ? "frame_cost_heatmap.ppm" : "failed to write frame_cost_heatmap.ppm") << ", "
+                << (point_cloud_exported ? "frame_cost_points.ply" : "failed to write frame_cost_points.ply") << std::endl;
+        };
+    // Start/stop recording frames while the camera is controlled manually.
+    // The map starts empty, and it's exported when the recording stops.
+    auto handle_frame_cost_map_recording_switch = create_debounce_key_press_handler([&frame_cost_map, &frame_cost_map_export]()
+        {
+            frame_cost_map.recording = !frame_cost_map.recording;
+            if (frame_cost_map.recording)
+            {
+                frame_cost_map.clear();
+                std::cout << "Frame cost map: recording" << std::endl;
+            }
+            else
+            {
+                frame_cost_map_export();
+            }
+        });
+    // Start/stop the sweep. It's exported when the sweep finishes or is stopped.
+    auto handle_frame_cost_map_sweep_switch = create_debounce_key_press_handler([&frame_cost_map, &frame_cost_map_export, &window_data]()
+        {
+            if (frame_cost_map.sweeping)
+            {
+                frame_cost_map.sweeping = false;
+                frame_cost_map_export();
+                return;
+            }
+            // The sweep controls the active camera, and it makes sense only if the camera is a real one.
+            const auto i = window_data.camera_active_index;
+            window_data.view_enable[i] = true;
+            window_data.projection_enable[i] = true;
+            frame_cost_map.clear();
+            frame_cost_map.sweep_start(window_data.camera_pos[i]);
+            std::cout << "Frame cost map: sweeping" << std::endl;
+        });
+
     // Camera and frustums rendering.
     bool camera_render_enable[2] = { false, false };
     bool frustum_render_enable[2] = { false, false };
@@ -752,18 +1294,334 @@ void main()
     auto handle_frustum_0_render_enable_switch = create_debounce_key_press_handler_bool_switcher(frustum_render_enable[0]);
     auto handle_frustum_1_render_enable_switch = create_debounce_key_press_handler_bool_switcher(frustum_render_enable[1]);
 
+    // This is a section for time travel: the world state of every frame is recorded,
+    // and it's possible to stop, go back and forth through the recorded frames and see them rendered again.
+    const auto capture_world_state = [&]()
+        {
+            WorldState state;
+            std::memset(static_cast<void*>(&state), 0, sizeof(state));
+            state.camera_active_index = static_cast<std::uint32_t>(window_data.camera_active_index);
+            state.camera_fov_control_index = static_cast<std::uint32_t>(window_data.camera_fov_control_index);
+            for (std::size_t i = 0; i != cameras_count; ++i)
+            {
+                state.camera_pos[i] = window_data.camera_pos[i];
+                state.yaw[i] = window_data.yaw[i];
+                state.pitch[i] = window_data.pitch[i];
+                state.ortho_height_half[i] = window_data.ortho_height_half[i];
+                state.fov[i] = window_data.fov[i];
+                state.projection_type[i] = window_data.projection_type[i];
+                state.view_enable[i] = window_data.view_enable[i];
+                state.projection_enable[i] = window_data.projection_enable[i];
+                state.camera_render_enable[i] = camera_render_enable[i];
+                state.frustum_render_enable[i] = frustum_render_enable[i];
+            }
+            for (std::size_t i = 0; i != quads_count; ++i)
+            {
+                state.quad_enable[i] = quad_enable[i];
+                state.quad_scale[i] = quad_scale[i];
+                state.quad_rotate[i] = quad_rotate[i];
+                state.quad_translate[i] = quad_translate[i];
+            }
+            state.quads_pair_animation_angles[0] = quads_pair_animation_angles[0];
+            state.quads_pair_animation_angles[1] = quads_pair_animation_angles[1];
+            state.quads_triplet_animation_angle = quads_triplet_animation_angle;
+            state.quads_pair_animation_enable = quads_pair_animation_enable;
+            state.quads_triplet_enable = quads_triplet_enable;
+            state.quads_triplet_animation_enable = quads_triplet_animation_enable;
+            state.translucent_quads_enable = translucent_quads_enable;
+            state.particles_enable = particles_enable;
+            state.scripted_quads_enable = scripted_quads_enable;
+            state.rubiks_cubes_enable = rubiks_cubes_enable;
+            state.cube_nxn_enable = cube_nxn_enable;
+            state.terrain_enable = terrain_enable;
+            state.impostors_enable = impostors_enable;
+            state.prototype_groups_enable = prototype_groups_enable;
+            state.city_enable = city_enable;
+            state.shadows_enable = shadows_enable;
+            state.visibility_buffer_enable = visibility_buffer_enable;
+            return state;
+        };
+    const auto restore_world_state = [&](const WorldState& state)
+        {
+            window_data.camera_active_index = state.camera_active_index;
+            window_data.camera_fov_control_index = state.camera_fov_control_index;
+            for (std::size_t i = 0; i != cameras_count; ++i)
+            {
+                window_data.camera_pos[i] = state.camera_pos[i];
+                window_data.yaw[i] = state.yaw[i];
+                window_data.pitch[i] = state.pitch[i];
+                window_data.ortho_height_half[i] = state.ortho_height_half[i];
+                window_data.fov[i] = state.fov[i];
+                window_data.projection_type[i] = state.projection_type[i];
+                window_data.view_enable[i] = state.view_enable[i];
+                window_data.projection_enable[i] = state.projection_enable[i];
+                camera_render_enable[i] = state.camera_render_enable[i];
+                frustum_render_enable[i] = state.frustum_render_enable[i];
+            }
+            for (std::size_t i = 0; i != quads_count; ++i)
+            {
+                quad_enable[i] = state.quad_enable[i];
+                quad_scale[i] = state.quad_scale[i];
+                quad_rotate[i] = state.quad_rotate[i];
+                quad_translate[i] = state.quad_translate[i];
+            }
+            quads_pair_animation_angles[0] = state.quads_pair_animation_angles[0];
+            quads_pair_animation_angles[1] = state.quads_pair_animation_angles[1];
+            quads_triplet_animation_angle = state.quads_triplet_animation_angle;
+            quads_pair_animation_enable = state.quads_pair_animation_enable;
+            quads_triplet_enable = state.quads_triplet_enable;
+            quads_triplet_animation_enable = state.quads_triplet_animation_enable;
+            translucent_quads_enable = state.translucent_quads_enable;
+            particles_enable = state.particles_enable;
+            scripted_quads_enable = state.scripted_quads_enable;
+            rubiks_cubes_enable = state.rubiks_cubes_enable;
+            cube_nxn_enable = state.cube_nxn_enable;
+            terrain_enable = state.terrain_enable;
+            impostors_enable = state.impostors_enable;
+            prototype_groups_enable = state.prototype_groups_enable;
+            city_enable = state.city_enable;
+            shadows_enable = state.shadows_enable;
+            visibility_buffer_enable = state.visibility_buffer_enable;
+        };
+    // A keyframe per second at 60 fps. The state takes about 100 bytes, and a delta of a frame
+    // when only the camera or an animation moves takes about 15, with 8 bytes of its record
+    // 1 MB keeps about 12 minutes.
+    SnapshotRing world_history;
+    world_history.init(sizeof(WorldState), 60, 1 << 20, 16);
+    auto time_travel = false;
+    // Index of the shown snapshot in world_history.
+    std::size_t time_travel_index = 0;
+    const auto time_travel_print = [&world_history, &time_travel_index]()
+        {
+            std::cout << "Time travel: frame " << world_history.frame_first + time_travel_index
+                << " (" << world_history.count() - 1 - time_travel_index << " back)" << std::endl;
+        };
+    // Entering time travel shows the last frame. Leaving it continues from the shown frame,
+    // and the frames after it are forgotten.
+    auto handle_time_travel_switch = create_debounce_key_press_handler([&]()
+        {
+            if (world_history.count() == 0)
+            {
+                return;
+            }
+            time_travel = !time_travel;
+            if (time_travel)
+            {
+                time_travel_index = world_history.count() - 1;
+                std::cout << "Time travel: " << world_history.count() << " frames, "
+                    << world_history.bytes_used << " bytes (" << world_history.bytes_raw() << " bytes uncompressed) of "
+                    << world_history.budget_bytes << " bytes" << std::endl;
+                time_travel_print();
+            }
+            else
+            {
+                world_history.truncate(time_travel_index);
+                std::cout << "Time travel: continue from frame " << world_history.frame_first + time_travel_index << std::endl;
+            }
+        });
+    const auto time_travel_step = [&](const std::ptrdiff_t frames)
+        {
+            if (!time_travel)
+            {
+                return;
+            }
+            const auto last = static_cast<std::ptrdiff_t>(world_history.count()) - 1;
+            time_travel_index = static_cast<std::size_t>(std::clamp(static_cast<std::ptrdiff_t>(time_travel_index) + frames, std::ptrdiff_t{ 0 }, last));
+            time_travel_print();
+        };
+    auto handle_time_travel_back = create_debounce_key_press_handler([&time_travel_step]() { time_travel_step(-1); });
+    auto handle_time_travel_forward = create_debounce_key_press_handler([&time_travel_step]() { time_travel_step(1); });
+    auto handle_time_travel_back_far = create_debounce_key_press_handler([&time_travel_step]() { time_travel_step(-60); });
+    auto handle_time_travel_forward_far = create_debounce_key_press_handler([&time_travel_step]() { time_travel_step(60); });
+
+    // CPU time of every replayed frame in milliseconds.
+    std::vector<double> replay_cpu_ms;
+    if (replay_scenario != nullptr)
+    {
+        replay_cpu_ms.reserve(replay_scenario->frames_count);
+    }
+
+    // Angles of the animated quads grow linearly with time. They are kept within a turn,
+    // so that they don't lose precision after hours.
+    // Fast-forward calls it for every frame it jumps over too: one long step would give only approximately
+    // the same angles because of rounding, and state hashes of runs with and without fast-forward wouldn't match.
+    const auto advance_quads_animations = [&](const float time_delta_s)
+        {
+            constexpr auto turn = glm::radians(360.0f);
+            const auto angle_delta = glm::radians(time_delta_s);
+            if (quads_pair_animation_enable)
+            {
+                quads_pair_animation_angles[0] = std::fmod(quads_pair_animation_angles[0] + 20.0f * angle_delta, turn);
+                quads_pair_animation_angles[1] = std::fmod(quads_pair_animation_angles[1] + 40.0f * angle_delta, turn);
+            }
+            if (quads_triplet_enable && quads_triplet_animation_enable)
+            {
+                quads_triplet_animation_angle = std::fmod(quads_triplet_animation_angle + 40.0f * angle_delta, turn);
+            }
+        };
+    FastForward fast_forward{ };
+    fast_forward.start(fast_forward_s);
+
+    // Hashes the state of the frame after everything is updated and culled.
+    // Only what the result depends on is hashed, objects that are disabled aren't.
+    const auto hash_frame_state = [&](const std::uint64_t frame)
+        {
+            FrameStateHashes hashes{ .frame = frame, .hashes = { } };
+            const auto hash = [&hashes, &state_hash_log](const StateHashSubsystem subsystem, const auto& add)
+                {
+                    StateHasher hasher{ .float_bits_dropped = state_hash_log.float_bits_dropped };
+                    add(hasher);
+                    hashes.hashes[static_cast<std::size_t>(subsystem)] = hasher.value;
+                };
+            hash(StateHashSubsystem::cameras, [&](StateHasher& hasher)
+                {
+                    hasher.add_u64(window_data.camera_active_index);
+                    for (std::size_t i = 0; i != cameras_count; ++i)
+                    {
+                        hasher.add_mat4(window_data.calculate_view(i));
+                        hasher.add_mat4(window_data.calculate_projection(i));
+                    }
+                });
+            hash(StateHashSubsystem::world, [&](StateHasher& hasher)
+                {
+                    for (std::size_t i = 0; i != quads_count; ++i)
+                    {
+                        hasher.add_bool(quad_enable[i]);
+                    }
+                    hasher.add_bool(quads_pair_animation_enable);
+                    hasher.add_floats(quads_pair_animation_angles, 2);
+                    hasher.add_bool(quads_triplet_enable);
+                    hasher.add_float(quads_triplet_animation_angle);
+                    hasher.add_bool(translucent_quads_enable);
+                    if (translucent_quads_enable)
+                    {
+                        for (const auto& instance : translucent_quads.instances)
+                        {
+                            hasher.add_floats(glm::value_ptr(instance.position_scale), 4);
+                        }
+                    }
+                    hasher.add_bool(scripted_quads_enable);
+                    if (scripted_quads_enable)
+                    {
+                        for (const auto& quad : scripted_quads.quads)
+                        {
+                            hasher.add_float(quad.angle);
+                            hasher.add_float(quad.lift);
+                        }
+                    }
+                    // Stickers are on GPU, but they are turned only by the turns that are hashed here frame by frame.
+                    hasher.add_bool(cube_nxn_enable);
+                    if (cube_nxn_enable)
+                    {
+                        hasher.add_u64(cube_nxn.n);
+                        hasher.add_u64(cube_nxn.current);
+                        hasher.add_word(static_cast<std::uint32_t>(cube_nxn.turn_axis));
+                        hasher.add_word(static_cast<std::uint32_t>(cube_nxn.turn_layer));
+                        hasher.add_float(cube_nxn.turn_angle);
+                    }
+                    hasher.add_bool(prototype_groups_enable);
+                    if (prototype_groups_enable)
+                    {
+                        for (const auto& model : prototype_groups.members.models)
+                        {
+                            hasher.add_mat4(model);
+                        }
+                    }
+                    hasher.add_bool(rubiks_cubes_enable);
+                    if (rubiks_cubes_enable)
+                    {
+                        for (std::size_t i = 0; i != rubiks_cubes.count(); ++i)
+                        {
+                            const auto& state = rubiks_cubes.states[i];
+                            hasher.add_u64(state.corners);
+                            hasher.add_u64(state.edges_low);
+                            hasher.add_word(state.edges_high);
+                            hasher.add_word(rubiks_cubes.moves[i]);
+                        }
+                    }
+                    hasher.add_bool(live_link_enable);
+                    if (live_link_enable)
+                    {
+                        for (std::size_t i = 0; i != live_link_objects.count_drawn; ++i)
+                        {
+                            hasher.add_mat4(live_link_objects.models[i]);
+                        }
+                    }
+                });
+            hash(StateHashSubsystem::visibility, [&](StateHasher& hasher)
+                {
+                    if (translucent_quads_enable)
+                    {
+                        hasher.add_bytes(translucent_quads.visible.data(), translucent_quads.visible.size());
+                        for (const auto mask : translucent_quads.view_masks)
+                        {
+                            hasher.add_u64(mask);
+                        }
+                    }
+                    if (terrain_enable)
+                    {
+                        for (std::size_t level = 0; level != Terrain::levels_count; ++level)
+                        {
+                            hasher.add_word(static_cast<std::uint32_t>(terrain.centers[level].x));
+                            hasher.add_word(static_cast<std::uint32_t>(terrain.centers[level].y));
+                            hasher.add_word(terrain.blocks_visible[level]);
+                        }
+                    }
+                    // Clusters drawn as impostors and the views their impostors were captured from.
+                    if (impostors_enable)
+                    {
+                        hasher.add_u64(impostors.clusters_near);
+                        for (const auto& instance : impostors.instances)
+                        {
+                            hasher.add_float(instance.cell);
+                            hasher.add_floats(glm::value_ptr(instance.right), 3);
+                            hasher.add_floats(glm::value_ptr(instance.up), 3);
+                        }
+                    }
+                    // Sets of buildings are baked on threads, so they show whether the count of threads matters.
+                    if (city_enable)
+                    {
+                        hasher.add_u64(city.cell);
+                        if (city.visibility_ready() && city.cell < City::cells_count)
+                        {
+                            for (std::size_t i = 0; i != city.visibility_words; ++i)
+                            {
+                                hasher.add_word(city.visibility[city.cell * city.visibility_words + i]);
+                            }
+                        }
+                    }
+                });
+            state_hash_log.add(hashes);
+        };
+    // Number of the frame, counting frames simulated by fast-forward, so that runs with the same fast-forward match.
+    std::uint64_t frame_number = 0;
+    if (fast_forward.active())
+    {
+        std::cout << "Fast-forward: simulating " << fast_forward_s << " s without rendering" << std::endl;
+    }
+
     auto time_last = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(window))
     {
         // Calculate time since the last frame.
         // Using this value is crucial for a smooth animation.
+        // Replays and fast-forward use a fixed time step, so that they simulate the same frames no matter how fast they run.
+        const auto fast_forward_active = fast_forward.active();
         const auto time_current = std::chrono::steady_clock::now();
         const auto time_delta = time_current - time_last;
-        const auto time_delta_s = std::chrono::duration_cast<std::chrono::duration<float>>(time_delta).count();
+        const auto time_delta_s = replay_scenario != nullptr || fast_forward_active
+            ? replay_time_step_s
+            : std::chrono::duration_cast<std::chrono::duration<float>>(time_delta).count();
         time_last = time_current;
+        if (replay_scenario != nullptr)
+        {
+            replay_player.advance();
+        }
+        // Counters of draw calls, state changes and uploads start from zero every frame.
+        gl_counters = { };
 
         // Quit after pressing Escape.
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        if (key_pressed(window, GLFW_KEY_ESCAPE))
         {
             glfwSetWindowShouldClose(window, true);
         }
@@ -832,29 +1690,239 @@ void main()
         handle_camera_1_render_enable_switch(window, GLFW_KEY_M);
         handle_frustum_1_render_enable_switch(window, GLFW_KEY_COMMA);
 
+        // Enable/disable rendering of translucent quads on 3, switch the way they are rendered on 4,
+        // compare quality of both ways on 5, change their count on [ and ].
+        // By default, it's disabled.
+        handle_translucent_quads_enable_switch(window, GLFW_KEY_3);
+        handle_translucent_quads_mode_switch(window, GLFW_KEY_4);
+        handle_translucent_quads_compare(window, GLFW_KEY_5);
+        handle_translucent_quads_count_decrease(window, GLFW_KEY_LEFT_BRACKET);
+        handle_translucent_quads_count_increase(window, GLFW_KEY_RIGHT_BRACKET);
+        // Change how many translucent quads move every frame on `.
+        // By default, they stand still.
+        handle_translucent_quads_moving_switch(window, GLFW_KEY_GRAVE_ACCENT);
+        // Enable/disable rendering of bounds of translucent quads (colored by the culling result) on 7,
+        // freeze/unfreeze culling on 8.
+        // By default, it's disabled.
+        handle_translucent_quads_bounds_render_enable_switch(window, GLFW_KEY_7);
+        handle_translucent_quads_culling_freeze_switch(window, GLFW_KEY_8);
+        // Compare culling of translucent quads against many views one by one and in one pass on F12.
+        handle_translucent_quads_compare_culling(window, GLFW_KEY_F12);
+
+        // Enable/disable particles on 6, change their count on - and =.
+        // By default, it's disabled.
+        handle_particles_enable_switch(window, GLFW_KEY_6);
+        handle_particles_count_decrease(window, GLFW_KEY_MINUS);
+        handle_particles_count_increase(window, GLFW_KEY_EQUAL);
+
+        // Enable/disable scripted quads on /.
+        // By default, it's disabled.
+        handle_scripted_quads_enable_switch(window, GLFW_KEY_SLASH);
+
+        // Enable/disable Rubik's cubes on ;, change their count on ', solve them on \.
+        // By default, it's disabled.
+        handle_rubiks_cubes_enable_switch(window, GLFW_KEY_SEMICOLON);
+        handle_rubiks_cubes_count_switch(window, GLFW_KEY_APOSTROPHE);
+        handle_rubiks_cubes_solver_switch(window, GLFW_KEY_BACKSLASH);
+
+        // Enable/disable the NxN cube on F1, change its size on F2.
+        // By default, it's disabled.
+        handle_cube_nxn_enable_switch(window, GLFW_KEY_F1);
+        handle_cube_nxn_size_switch(window, GLFW_KEY_F2);
+
+        // Enable/disable the terrain on F3.
+        // By default, it's disabled.
+        handle_terrain_enable_switch(window, GLFW_KEY_F3);
+
+        // Enable/disable the field of clusters on F4.
+        // By default, it's disabled.
+        handle_impostors_enable_switch(window, GLFW_KEY_F4);
+
+        // Enable/disable the prototype groups on F5.
+        // By default, it's disabled.
+        handle_prototype_groups_enable_switch(window, GLFW_KEY_F5);
+
+        // Enable/disable the city on F6.
+        // By default, it's disabled.
+        handle_city_enable_switch(window, GLFW_KEY_F6);
+
+        // Enable/disable shadows on F7, and caching of their static layer on F8.
+        // By default, shadows are disabled, and the cache is enabled.
+        handle_shadows_enable_switch(window, GLFW_KEY_F7);
+        handle_shadows_cache_switch(window, GLFW_KEY_F8);
+
+        // Enable/disable the stack of meshes on F9, switch between forward and visibility buffer shading on F10,
+        // and double the count of layers on F11.
+        // By default, the stack is disabled, shaded forward and has 4 layers.
+        handle_visibility_buffer_enable_switch(window, GLFW_KEY_F9);
+        handle_visibility_buffer_path_switch(window, GLFW_KEY_F10);
+        handle_visibility_buffer_layers_switch(window, GLFW_KEY_F11);
+
+        // Open/close the live link on Insert, enable/disable following of the producer's camera on Delete.
+        // By default, the link is closed, and the camera follows the producer once it's open.
+        handle_live_link_enable_switch(window, GLFW_KEY_INSERT);
+        handle_live_link_camera_follow_switch(window, GLFW_KEY_DELETE);
+
+        // Enable/disable the HUD on 9.
+        // By default, it's disabled.
+        handle_hud_enable_switch(window, GLFW_KEY_9);
+
+        // Start/stop recording of the frame cost map on 0, start/stop the sweep on period.
+        // By default, it's stopped.
+        handle_frame_cost_map_recording_switch(window, GLFW_KEY_0);
+        handle_frame_cost_map_sweep_switch(window, GLFW_KEY_PERIOD);
+
+        // Enter/leave time travel on Home. Go one frame back/forward on left/right arrows,
+        // 60 frames back/forward on down/up arrows.
+        // By default, it's disabled.
+        handle_time_travel_switch(window, GLFW_KEY_HOME);
+        handle_time_travel_back(window, GLFW_KEY_LEFT);
+        handle_time_travel_forward(window, GLFW_KEY_RIGHT);
+        handle_time_travel_back_far(window, GLFW_KEY_DOWN);
+        handle_time_travel_forward_far(window, GLFW_KEY_UP);
+
         // Calculate active camera's front and right vectors
         // and apply corresponding offset to the camera's position if some of w, a, s, d is pressed.
         // That's a so-called "FPS-camera control" (FPS stands for first-person shooter).
         const auto camera_front = window_data.calculate_camera_front(window_data.camera_active_index);
         const auto camera_right = glm::cross(camera_front, up);
         const auto camera_speed = 2.5f * time_delta_s;
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        if (key_pressed(window, GLFW_KEY_W))
         {
             window_data.camera_pos[window_data.camera_active_index] += camera_speed * camera_front;
         }
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        if (key_pressed(window, GLFW_KEY_S))
         {
             window_data.camera_pos[window_data.camera_active_index] -= camera_speed * camera_front;
         }
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        if (key_pressed(window, GLFW_KEY_A))
         {
             window_data.camera_pos[window_data.camera_active_index] -= camera_speed * camera_right;
         }
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        if (key_pressed(window, GLFW_KEY_D))
         {
             window_data.camera_pos[window_data.camera_active_index] += camera_speed * camera_right;
         }
 
+        // Apply every batch the producer committed since the last frame, in order, right from the shared memory.
+        // The camera pose of the producer replaces the active camera's one, like any other input of the frame.
+        // At most a full ring is applied: head comes from another process, and a producer that commits
+        // as fast as the renderer drains (or a broken one) mustn't keep the frame from ending.
+        if (live_link_enable)
+        {
+            const auto time_received_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            live_link_batches_queued = static_cast<std::size_t>(live_link.queued());
+            for (std::uint32_t drained = 0; drained != LiveLinkConsumer::capacity; ++drained)
+            {
+                const auto batch = live_link.front();
+                if (batch == nullptr)
+                {
+                    break;
+                }
+                live_link_objects.apply(*batch);
+                if (batch->camera_valid != 0 && live_link_camera_follow)
+                {
+                    const auto& camera = batch->camera;
+                    window_data.camera_pos[window_data.camera_active_index] = { camera.position[0], camera.position[1], camera.position[2] };
+                    window_data.yaw[window_data.camera_active_index] = camera.yaw;
+                    window_data.pitch[window_data.camera_active_index] = camera.pitch;
+                }
+                const auto latency_ms = static_cast<double>(time_received_ns - batch->send_time_ns) / 1e6;
+                live_link_report_latency_ms += latency_ms;
+                live_link_report_latency_ms_max = std::max(live_link_report_latency_ms_max, latency_ms);
+                ++live_link_report_batches;
+                live_link_report_transforms += batch->transforms_count;
+                live_link.pop();
+            }
+        }
+
+        // The state the frame is rendered with is either recorded or, during time travel,
+        // replaced by the recorded one (whatever the input changed above is discarded).
+        if (time_travel)
+        {
+            WorldState state;
+            world_history.get(time_travel_index, &state);
+            restore_world_state(state);
+        }
+        else
+        {
+            const auto state = capture_world_state();
+            world_history.push(&state);
+        }
+
+        // During fast-forward, only animations and transforms are updated, nothing is rendered.
+        if (fast_forward_active)
+        {
+            // Scripts, moves of cubes and moving quads have to be stepped frame by frame, as well as held keys.
+            // Without them, this frame and the following ones without replay events are simulated in one step.
+            const auto stepping = time_travel || scripted_quads_enable || rubiks_cubes_enable || cube_nxn_enable
+                || (translucent_quads_enable && translucent_quads_moving_count != 0) || live_link_enable
+                || (replay_scenario != nullptr && replay_player.any_key_pressed());
+            auto frames = std::uint64_t{ 1 };
+            if (!stepping)
+            {
+                frames = fast_forward.frames_remaining();
+                if (replay_scenario != nullptr)
+                {
+                    frames = std::min<std::uint64_t>(frames, std::uint64_t{ replay_player.frames_without_events() } + 1);
+                    replay_player.skip(static_cast<std::uint32_t>(frames - 1));
+                }
+            }
+            // Every frame that is jumped over is recorded too, so that time travel still goes one frame per snapshot.
+            // Only the angles change between them, so both take a few operations per frame.
+            for (std::uint64_t i = 0; i != frames; ++i)
+            {
+                if (i != 0)
+                {
+                    const auto state = capture_world_state();
+                    world_history.push(&state);
+                }
+                advance_quads_animations(time_delta_s);
+            }
+            // Particles are simulated on GPU, so they don't move during fast-forward.
+            if (!time_travel)
+            {
+                if (scripted_quads_enable)
+                {
+                    scripted_quads.update(time_delta_s);
+                }
+                if (rubiks_cubes_enable)
+                {
+                    rubiks_cubes.update(time_delta_s);
+                }
+                if (cube_nxn_enable)
+                {
+                    cube_nxn.update(time_delta_s);
+                }
+            }
+            if (translucent_quads_enable && translucent_quads_moving_count != 0 && !time_travel)
+            {
+                translucent_quads.move(translucent_quads_moving_count);
+                // Marks of single quads would pile up over thousands of frames, and most quads move by then anyway.
+                translucent_quads.instances_dirty.mark_all();
+            }
+            fast_forward.advance(frames);
+            frame_number += frames;
+
+            if (!fast_forward.active())
+            {
+                fast_forward.report();
+                // The first rendered frame continues where fast-forward stopped, rather than after the time it took.
+                time_last = std::chrono::steady_clock::now();
+                if (replay_scenario != nullptr && replay_player.finished())
+                {
+                    glfwSetWindowShouldClose(window, true);
+                }
+            }
+            // Events are still polled once in a while, so that the window stays responsive.
+            if (fast_forward.steps % 1024 == 0)
+            {
+                glfwPollEvents();
+            }
+            continue;
+        }
+
+        gpu_timer_scene.begin();
         // Set so-called clear color.
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         // Apply clear color, resetting all pixels to black.
@@ -868,14 +1936,16 @@ void main()
         const auto view_projection = projection * view;
 
         // Bind a shader program that will be used for the subsequent draw calls.
-        glUseProgram(shader_program);
+        // use_program and the similar functions call the respective gl* functions,
+        // and count the calls for the HUD (see GlCounters).
+        use_program(shader_program);
 
         // Set uniform variable with name "color" of type vec3 in the shader_program.
         constexpr glm::vec3 quad_color{ 1.0f, 1.0f, 1.0f };
         glUniform3f(glGetUniformLocation(shader_program, "color"), quad_color.x, quad_color.y, quad_color.z);
 
         // Bind a vertex array object that will be used for the subsequent draw calls.
-        glBindVertexArray(vao_quad);
+        bind_vertex_array(vao_quad);
 
         constexpr glm::vec3 quad_translation[quads_count] = {
             { -1.0f, 0.0f, 0.0f },
@@ -916,7 +1986,7 @@ void main()
             // The draw call that asks OpenGL to take vertices from the bound
             // vertex array object (namely, 6 vertices starting from vertex 0),
             // and use the bound shader program to render those vertices as triangles.
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            draw_arrays(GL_TRIANGLES, 0, 6);
         }
 
         if (quads_pair_animation_enable)
@@ -948,12 +2018,12 @@ void main()
                 const auto mvp = view_projection * model;
                 glUniform3f(glGetUniformLocation(shader_program, "color"), colors[i].x, colors[i].y, colors[i].z);
                 glUniformMatrix4fv(glGetUniformLocation(shader_program, "model_view_projection"), 1, GL_FALSE, glm::value_ptr(mvp));
-                glDrawArrays(GL_TRIANGLES, 0, 6);
+                draw_arrays(GL_TRIANGLES, 0, 6);
+                if (shadows_enable)
+                {
+                    shadows.add_dynamic_caster(model);
+                }
             }
-            // Note that angle change depends on time since previous frame.
-            const auto angle_delta = glm::radians(time_delta_s);
-            quads_pair_animation_angles[0] += 20.0f * angle_delta;
-            quads_pair_animation_angles[1] += 40.0f * angle_delta;
         }
 
         if (quads_triplet_enable)
@@ -986,14 +2056,15 @@ void main()
                 const auto mvp = view_projection * model;
                 glUniform3f(glGetUniformLocation(shader_program, "color"), colors[i].x, colors[i].y, colors[i].z);
                 glUniformMatrix4fv(glGetUniformLocation(shader_program, "model_view_projection"), 1, GL_FALSE, glm::value_ptr(mvp));
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-            }
-            if (quads_triplet_animation_enable)
-            {
-                const auto angle_delta = glm::radians(time_delta_s);
-                quads_triplet_animation_angle += 40.0f * angle_delta;
+                draw_arrays(GL_TRIANGLES, 0, 6);
+                if (shadows_enable)
+                {
+                    shadows.add_dynamic_caster(model);
+                }
             }
         }
+        // Note that angle change depends on time since previous frame.
+        advance_quads_animations(time_delta_s);
 
         for (std::size_t i = 0; i != 2; ++i)
         {
@@ -1001,9 +2072,6 @@ void main()
             {
                 continue;
             }
-            // For rendering the frustums, bind vao_frustum,
-            // but use the same shader program as for previous draw calls.
-            glBindVertexArray(vao_frustum);
             // The trick to render frustum easily is application of ivnerse matrices.
             // View matrix is a matrix that transforms world space into camera space.
             // Projection matrix is a matrix that transforms camera space into clip space.
@@ -1013,23 +2081,12 @@ void main()
             // So, to obtain vertices of the frustum in camera space, it's enough to apply
             // the inverse projection matrix to 8 vertices (+-1, +-1, +-1).
             // Then, the inverse view matrix should be applied to get vertices in world space.
-            // Then, as usual, view and projection matrices of the active camera has to be applied.
-            // The resulting MVP matrix is
-            // active_camera_projection * active_camera_view * rendered_camera_view_inverse * rendered_camera_projection_inverse.
+            // That is, (projection * view)^-1 = view_inverse * projection_inverse.
+            // calculate_frustum_corners does that on CPU, then 12 edges are appended to the debug draw,
+            // and view and projection matrices of the active camera are applied when it's flushed.
             const auto camera_view = window_data.calculate_view(i);
             const auto camera_projection = window_data.calculate_projection(i);
-            const auto view_inv = glm::inverse(camera_view);
-            const auto projection_inv = glm::inverse(camera_projection);
-            const auto model = view_inv * projection_inv;
-            const auto mvp = view_projection * model;
-            glUniform3f(glGetUniformLocation(shader_program, "color"), 0.0f, 1.0f, 0.0f);
-            glUniformMatrix4fv(glGetUniformLocation(shader_program, "model_view_projection"), 1, GL_FALSE, glm::value_ptr(mvp));
-            // This draws 4 lines from 4 vertices.
-            glDrawArrays(GL_LINE_LOOP, 0, 4);
-            // This draws 4 lines from 4 vertices.
-            glDrawArrays(GL_LINE_LOOP, 4, 4);
-            // This draws 4 lines from 8 vertices (line between vertex 0 and vertex 1, between 2 and 3, etc.).
-            glDrawArrays(GL_LINES, 8, 8);
+            debug_draw.frustum(camera_projection * camera_view, { 0.0f, 1.0f, 0.0f });
         }
 
         for (std::size_t i = 0; i != 2; ++i)
@@ -1039,8 +2096,8 @@ void main()
                 continue;
             }
             // Bind shader program and vertex array object specific for the camera pyramids.
-            glUseProgram(shader_program_camera);
-            glBindVertexArray(vao_camera);
+            use_program(shader_program_camera);
+            bind_vertex_array(vao_camera);
             // The trick to rendering the pyramids is the same as
             // with frustums (applying inverse projection and view matrices).
             // The only new detail here is the tip of the pyramid.
@@ -1062,18 +2119,488 @@ void main()
             const auto mvp_camera = view_projection * view_inv;
             glUniformMatrix4fv(glGetUniformLocation(shader_program_camera, "model_view_projection"), 1, GL_FALSE, glm::value_ptr(mvp_camera));
             glUniformMatrix4fv(glGetUniformLocation(shader_program_camera, "projection_inv"), 1, GL_FALSE, glm::value_ptr(projection_inv));
-            glDrawArrays(GL_TRIANGLES, 0, 18);
+            draw_arrays(GL_TRIANGLES, 0, 18);
+        }
+        if (scripted_quads_enable)
+        {
+            // Scripts stop during time travel, as particles do.
+            if (!time_travel)
+            {
+                scripted_quads.update(time_delta_s);
+            }
+            scripted_quads.render(view_projection);
+
+            scripted_quads_report_update_ms += scripted_quads.update_cpu_ms;
+            ++scripted_quads_report_frames;
+            if (time_current - scripted_quads_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "Scripted quads: " << scripted_quads.scheduler.scripts.size() << " scripts"
+                    << ", resumed " << scripted_quads.scheduler.resumed_count << " last frame"
+                    << ", update CPU " << scripted_quads_report_update_ms / static_cast<double>(scripted_quads_report_frames) << " ms"
+                    << ", pool blocks " << animation_frame_pool.blocks_used
+                    << ", heap allocations " << animation_frame_pool.heap_allocations << std::endl;
+                scripted_quads_report_time = time_current;
+                scripted_quads_report_frames = 0;
+                scripted_quads_report_update_ms = 0.0;
+            }
+        }
+        gpu_timer_scene.end();
+
+        // Rubik's cubes have their own GPU timer, so they are rendered after the scene (timers can't be nested).
+        if (rubiks_cubes_enable)
+        {
+            if (!time_travel)
+            {
+                rubiks_cubes.update(time_delta_s);
+            }
+            rubiks_cubes.render(view_projection);
+
+            rubiks_cubes_report_render_ms += rubiks_cubes.gpu_timer.elapsed_ms;
+            rubiks_cubes_report_frame_ms += 1000.0 * time_delta_s;
+            ++rubiks_cubes_report_frames;
+            if (time_current - rubiks_cubes_report_time >= std::chrono::seconds{ 1 })
+            {
+                const auto frames = static_cast<double>(rubiks_cubes_report_frames);
+                std::cout << "Rubik's cubes: " << rubiks_cubes.count() << " cubes per frame"
+                    << " (" << rubiks_cubes.stickers.size() << " stickers)"
+                    << ", render GPU " << rubiks_cubes_report_render_ms / frames << " ms"
+                    << ", frame " << rubiks_cubes_report_frame_ms / frames << " ms" << std::endl;
+                rubiks_cubes_report_time = time_current;
+                rubiks_cubes_report_frames = 0;
+                rubiks_cubes_report_render_ms = 0.0;
+                rubiks_cubes_report_frame_ms = 0.0;
+            }
+        }
+
+        if (cube_nxn_enable)
+        {
+            if (!time_travel)
+            {
+                cube_nxn.update(time_delta_s);
+            }
+            cube_nxn.render(view_projection);
+
+            cube_nxn_report_render_ms += cube_nxn.gpu_timer.elapsed_ms;
+            cube_nxn_report_frame_ms += 1000.0 * time_delta_s;
+            ++cube_nxn_report_frames;
+            if (time_current - cube_nxn_report_time >= std::chrono::seconds{ 1 })
+            {
+                const auto frames = static_cast<double>(cube_nxn_report_frames);
+                std::cout << "NxN cube: N " << cube_nxn.n << " (" << cube_nxn.stickers_count << " stickers)"
+                    << ", render GPU " << cube_nxn_report_render_ms / frames << " ms"
+                    << ", frame " << cube_nxn_report_frame_ms / frames << " ms" << std::endl;
+                cube_nxn_report_time = time_current;
+                cube_nxn_report_frames = 0;
+                cube_nxn_report_render_ms = 0.0;
+                cube_nxn_report_frame_ms = 0.0;
+            }
+        }
+
+        if (terrain_enable)
+        {
+            // The terrain depends only on the camera, so it follows the camera during time travel too.
+            terrain.update(window_data.camera_pos[window_data.camera_active_index]);
+            terrain.render(view_projection);
+
+            terrain_report_render_ms += terrain.gpu_timer.elapsed_ms;
+            terrain_report_texels += terrain.texels_uploaded;
+            ++terrain_report_frames;
+            if (time_current - terrain_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "Terrain: " << Terrain::levels_count << " levels, "
+                    << terrain.blocks_drawn << '/' << Terrain::levels_count * Terrain::blocks_count << " blocks"
+                    << " (" << terrain.triangles_drawn << " triangles) drawn"
+                    << ", heights uploaded " << terrain_report_texels << " texels/s"
+                    << ", render GPU " << terrain_report_render_ms / static_cast<double>(terrain_report_frames) << " ms" << std::endl;
+                terrain_report_time = time_current;
+                terrain_report_frames = 0;
+                terrain_report_render_ms = 0.0;
+                terrain_report_texels = 0;
+            }
+        }
+
+        if (impostors_enable)
+        {
+            impostors.render(view_projection, window_data.camera_pos[window_data.camera_active_index]);
+
+            impostors_report_render_ms += impostors.gpu_timer.elapsed_ms;
+            impostors_report_refreshed += impostors.refreshed;
+            ++impostors_report_frames;
+            if (time_current - impostors_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "Impostors: " << impostors.clusters_near << " clusters drawn as geometry, "
+                    << impostors.impostors_drawn << " as impostors (of " << Impostors::clusters_count << ")"
+                    << ", refreshed " << impostors_report_refreshed << " impostors/s"
+                    << ", render GPU " << impostors_report_render_ms / static_cast<double>(impostors_report_frames) << " ms" << std::endl;
+                impostors_report_time = time_current;
+                impostors_report_frames = 0;
+                impostors_report_render_ms = 0.0;
+                impostors_report_refreshed = 0;
+            }
         }
 
+        if (prototype_groups_enable)
+        {
+            // Members are posed by the animations of the pair and the triplet above, whether those are shown or not.
+            prototype_groups.update(quads_pair_animation_angles, quads_triplet_animation_angle);
+            prototype_groups.render(view_projection);
+
+            prototype_groups_report_render_ms += prototype_groups.gpu_timer.elapsed_ms;
+            ++prototype_groups_report_frames;
+            if (time_current - prototype_groups_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "Prototype groups: " << PrototypeGroups::groups_count << " groups of "
+                    << prototype_groups.quads_count() << " quads in " << PrototypeGroups::prototypes_count << " draw calls"
+                    << ", instance data " << prototype_groups.instance_bytes() / 1024 << " KB"
+                    << " (flattened " << prototype_groups.flattened_bytes() / 1024 << " KB)"
+                    << ", render GPU " << prototype_groups_report_render_ms / static_cast<double>(prototype_groups_report_frames) << " ms" << std::endl;
+                prototype_groups_report_time = time_current;
+                prototype_groups_report_frames = 0;
+                prototype_groups_report_render_ms = 0.0;
+            }
+        }
+
+        if (city_enable)
+        {
+            const auto& camera_position = window_data.camera_pos[window_data.camera_active_index];
+            city.render(view_projection, camera_position);
+
+            city_report_render_ms += city.gpu_timer.elapsed_ms;
+            ++city_report_frames;
+            if (time_current - city_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "City: ";
+                if (city.cell == City::cells_count)
+                {
+                    std::cout << "outside of the visibility cells";
+                }
+                else
+                {
+                    std::cout << "cell (" << city.cell % City::lots_per_side << ", " << city.cell / City::lots_per_side << ')';
+                }
+                std::cout << ", " << city.buildings_drawn << '/' << city.buildings.size() << " buildings in "
+                    << city.ranges_drawn << " ranges drawn"
+                    << ", render GPU " << city_report_render_ms / static_cast<double>(city_report_frames) << " ms" << std::endl;
+                city_report_time = time_current;
+                city_report_frames = 0;
+                city_report_render_ms = 0.0;
+            }
+        }
+
+        if (shadows_enable)
+        {
+            shadows.render(view_projection);
+
+            shadows_report_render_ms += shadows.gpu_timer.elapsed_ms;
+            shadows_report_static_renders += shadows.static_rendered ? 1 : 0;
+            ++shadows_report_frames;
+            if (time_current - shadows_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "Shadows: static layer rendered " << shadows_report_static_renders << " times/s"
+                    << (shadows.cache_enable ? "" : " (cache disabled)")
+                    << ", " << shadows.dynamic_casters_drawn << " dynamic casters"
+                    << ", render GPU " << shadows_report_render_ms / static_cast<double>(shadows_report_frames) << " ms" << std::endl;
+                shadows_report_time = time_current;
+                shadows_report_frames = 0;
+                shadows_report_render_ms = 0.0;
+                shadows_report_static_renders = 0;
+            }
+        }
+
+        if (visibility_buffer_enable)
+        {
+            visibility_buffer.render(projection);
+
+            visibility_buffer_report_render_ms += visibility_buffer.gpu_timer.elapsed_ms;
+            ++visibility_buffer_report_frames;
+            if (time_current - visibility_buffer_report_time >= std::chrono::seconds{ 1 })
+            {
+                std::cout << "Visibility buffer: " << (visibility_buffer.path == ShadingPath::forward ? "forward" : "visibility buffer")
+                    << ", " << visibility_buffer.layers << " layers, " << visibility_buffer.triangles_drawn() << " triangles"
+                    << ", render GPU " << visibility_buffer_report_render_ms / static_cast<double>(visibility_buffer_report_frames) << " ms" << std::endl;
+                visibility_buffer_report_time = time_current;
+                visibility_buffer_report_frames = 0;
+                visibility_buffer_report_render_ms = 0.0;
+            }
+        }
+
+        if (live_link_enable)
+        {
+            live_link_objects.render(view_projection);
+
+            live_link_report_render_ms += live_link_objects.gpu_timer.elapsed_ms;
+            ++live_link_report_frames;
+            if (time_current - live_link_report_time >= std::chrono::seconds{ 1 })
+            {
+                const auto seconds = std::chrono::duration<double>(time_current - live_link_report_time).count();
+                std::cout << "Live link: " << static_cast<double>(live_link_report_batches) / seconds << " batches/s, "
+                    << static_cast<double>(live_link_report_transforms) / seconds << " transforms/s, "
+                    << live_link_objects.count_drawn << " objects, latency avg "
+                    << (live_link_report_batches != 0 ? live_link_report_latency_ms / static_cast<double>(live_link_report_batches) : 0.0)
+                    << " ms max " << live_link_report_latency_ms_max << " ms"
+                    << ", render GPU " << live_link_report_render_ms / static_cast<double>(live_link_report_frames) << " ms" << std::endl;
+                live_link_report_time = time_current;
+                live_link_report_frames = 0;
+                live_link_report_batches = 0;
+                live_link_report_transforms = 0;
+                live_link_report_latency_ms = 0.0;
+                live_link_report_latency_ms_max = 0.0;
+                live_link_report_render_ms = 0.0;
+            }
+        }
+
+        // Particles don't write depth and are blended additively, so they can be rendered
+        // after opaque objects in any order relative to other translucent objects.
+        if (particles_enable)
+        {
+            // Particles aren't in the world state, so at least they stop during time travel.
+            if (!time_travel)
+            {
+                particles.simulate(time_delta_s);
+            }
+            particles.render(view, projection);
+
+            particles_report_simulate_ms += particles.gpu_timer_simulate.elapsed_ms;
+            particles_report_render_ms += particles.gpu_timer_render.elapsed_ms;
+            particles_report_frame_ms += 1000.0 * time_delta_s;
+            ++particles_report_frames;
+            if (time_current - particles_report_time >= std::chrono::seconds{ 1 })
+            {
+                const auto frames = static_cast<double>(particles_report_frames);
+                std::cout << "Particles: " << particles.count
+                    << ", simulate GPU " << particles_report_simulate_ms / frames << " ms"
+                    << ", render GPU " << particles_report_render_ms / frames << " ms"
+                    << ", frame " << particles_report_frame_ms / frames << " ms" << std::endl;
+                particles_report_time = time_current;
+                particles_report_frames = 0;
+                particles_report_simulate_ms = 0.0;
+                particles_report_render_ms = 0.0;
+                particles_report_frame_ms = 0.0;
+            }
+        }
+
+        // Translucent quads are rendered the last, over all opaque objects.
+        if (translucent_quads_enable)
+        {
+            if (translucent_quads_compare_requested)
+            {
+                translucent_quads.compare_quality(view, projection, window_data.width, window_data.height);
+                translucent_quads_compare_requested = false;
+            }
+            if (translucent_quads_compare_culling_requested)
+            {
+                translucent_quads.compare_culling(view, projection);
+                translucent_quads_compare_culling_requested = false;
+            }
+
+            // Positions of quads aren't in the world state, so they stop during time travel, as particles do.
+            if (translucent_quads_moving_count != 0 && !time_travel)
+            {
+                translucent_quads.move(translucent_quads_moving_count);
+            }
+
+            if (!translucent_quads_culling_freeze)
+            {
+                translucent_quads_culling_view_projection = view_projection;
+            }
+            translucent_quads.cull(translucent_quads_culling_view_projection);
+
+            translucent_quads.render(view, projection, window_data.width, window_data.height, 0);
+
+            if (translucent_quads_bounds_render_enable)
+            {
+                // Bounds of visible quads are green, and of culled quads are red.
+                // Only first quads are shown, otherwise lines would cover everything.
+                constexpr std::size_t bounds_count_max = 8192;
+                const auto bounds_count = std::min(bounds_count_max, translucent_quads.instances.size());
+                for (std::size_t i = 0; i != bounds_count; ++i)
+                {
+                    const auto& instance = translucent_quads.instances[i];
+                    const glm::vec3 center{ instance.position_scale };
+                    const auto extent = glm::vec3{ 0.5f, 0.5f, 0.0f } * instance.position_scale.w;
+                    const auto color = translucent_quads.visible[i] ? glm::vec3{ 0.0f, 1.0f, 0.0f } : glm::vec3{ 1.0f, 0.0f, 0.0f };
+                    debug_draw.box(center - extent, center + extent, color);
+                }
+            }
+            if (translucent_quads_culling_freeze)
+            {
+                debug_draw.frustum(translucent_quads_culling_view_projection, { 1.0f, 1.0f, 0.0f });
+            }
+
+            translucent_quads_report_cpu_ms += translucent_quads.cpu_ms;
+            translucent_quads_report_gpu_ms += translucent_quads.gpu_timer.elapsed_ms;
+            translucent_quads_report_uploaded_bytes += translucent_quads.uploaded_bytes;
+            translucent_quads_report_uploaded_ranges += translucent_quads.uploaded_ranges;
+            if (translucent_quads.mode == TransparencyMode::sorted)
+            {
+                translucent_quads_report_sort_ms += translucent_quads.depth_sorter.sort_ms;
+                ++translucent_quads_report_sorts[static_cast<std::size_t>(translucent_quads.depth_sorter.algorithm)];
+            }
+            ++translucent_quads_report_frames;
+            if (time_current - translucent_quads_report_time >= std::chrono::seconds{ 1 })
+            {
+                const auto frames = static_cast<double>(translucent_quads_report_frames);
+                std::cout << "Transparency: "
+                    << (translucent_quads.mode == TransparencyMode::sorted ? "sorted" : "weighted blended")
+                    << ", " << translucent_quads.instances.size() << " quads"
+                    << ", CPU " << translucent_quads_report_cpu_ms / frames << " ms"
+                    << ", GPU " << translucent_quads_report_gpu_ms / frames << " ms"
+                    << ", uploaded " << static_cast<double>(translucent_quads_report_uploaded_bytes) / frames << " bytes/frame"
+                    << " in " << static_cast<double>(translucent_quads_report_uploaded_ranges) / frames << " ranges" << std::endl;
+                if (translucent_quads.mode == TransparencyMode::sorted)
+                {
+                    std::cout << "Depth sort: " << translucent_quads_report_sort_ms / frames << " ms per frame (";
+                    for (std::size_t i = 0; i != 4; ++i)
+                    {
+                        std::cout << (i == 0 ? "" : ", ") << depth_sort_algorithm_name(static_cast<DepthSortAlgorithm>(i))
+                            << ' ' << translucent_quads_report_sorts[i];
+                    }
+                    std::cout << " frames)" << std::endl;
+                }
+                translucent_quads_report_time = time_current;
+                translucent_quads_report_frames = 0;
+                translucent_quads_report_cpu_ms = 0.0;
+                translucent_quads_report_gpu_ms = 0.0;
+                translucent_quads_report_sort_ms = 0.0;
+                translucent_quads_report_uploaded_bytes = 0;
+                translucent_quads_report_uploaded_ranges = 0;
+                std::fill(std::begin(translucent_quads_report_sorts), std::end(translucent_quads_report_sorts), 0);
+            }
+        }
+
+        // Debug primitives are rendered over translucent objects, so that they are easy to see.
+        gpu_timer_debug_draw.begin();
+        debug_draw.flush(view_projection);
+        gpu_timer_debug_draw.end();
+
+        // Statistics of the frame are collected only if somebody needs them.
+        if (hud_enable || metrics_server.running() || frame_cost_map.recording || frame_cost_map.sweeping)
+        {
+            FrameStats stats{ };
+            stats.frame_ms = 1000.0 * time_delta_s;
+            stats.cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_current).count();
+            const auto pass_gpu_ms = [&stats](const RenderPass pass) -> double&
+                {
+                    return stats.pass_gpu_ms[static_cast<std::size_t>(pass)];
+                };
+            pass_gpu_ms(RenderPass::scene) = gpu_timer_scene.elapsed_ms;
+            pass_gpu_ms(RenderPass::rubiks_cubes) = rubiks_cubes_enable ? rubiks_cubes.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::cube_nxn) = cube_nxn_enable ? cube_nxn.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::terrain) = terrain_enable ? terrain.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::impostors) = impostors_enable ? impostors.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::prototype_groups) = prototype_groups_enable ? prototype_groups.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::city) = city_enable ? city.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::shadows) = shadows_enable ? shadows.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::visibility_buffer) = visibility_buffer_enable ? visibility_buffer.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::live_link) = live_link_enable ? live_link_objects.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::particles_simulate) = particles_enable ? particles.gpu_timer_simulate.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::particles_render) = particles_enable ? particles.gpu_timer_render.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::transparency) = translucent_quads_enable ? translucent_quads.gpu_timer.elapsed_ms : 0.0;
+            pass_gpu_ms(RenderPass::debug_draw) = gpu_timer_debug_draw.elapsed_ms;
+            pass_gpu_ms(RenderPass::hud) = hud_enable ? hud.gpu_timer.elapsed_ms : 0.0;
+            stats.draw_calls = gl_counters.draw_calls;
+            stats.state_changes = gl_counters.state_changes;
+            stats.buffer_uploads = gl_counters.buffer_uploads;
+            stats.bytes_uploaded = gl_counters.bytes_uploaded;
+            if (translucent_quads_enable)
+            {
+                stats.objects_visible = translucent_quads.visible_count;
+                stats.objects_culled = translucent_quads.instances.size() - translucent_quads.visible_count;
+            }
+            stats.memory_process_bytes = process_memory_bytes();
+            stats.memory_gpu_bytes = translucent_quads.gpu_memory_bytes() + particles.gpu_memory_bytes()
+                + scripted_quads.gpu_memory_bytes() + rubiks_cubes.gpu_memory_bytes() + cube_nxn.gpu_memory_bytes()
+                + terrain.gpu_memory_bytes() + impostors.gpu_memory_bytes() + prototype_groups.gpu_memory_bytes()
+                + city.gpu_memory_bytes() + shadows.gpu_memory_bytes() + visibility_buffer.gpu_memory_bytes()
+                + live_link_objects.gpu_memory_bytes() + debug_draw.gpu_memory_bytes() + hud.gpu_memory_bytes();
+            stats.gpu_frames_in_flight = gpu_frame_queue.count;
+            stats.live_link_batches_queued = live_link_enable ? live_link_batches_queued : 0;
+            stats.hud_cpu_ms = hud_enable ? hud.cpu_ms : 0.0;
+
+            if (metrics_server.running())
+            {
+                metrics_server.publish(stats);
+            }
+            // The HUD is rendered over everything.
+            if (hud_enable)
+            {
+                hud.render(stats, window_data.width, window_data.height);
+            }
+
+            // GPU time lags behind by a few frames, which doesn't matter when the camera moves smoothly.
+            // The sweep waits for it at each viewpoint.
+            const auto i = window_data.camera_active_index;
+            if (frame_cost_map.recording)
+            {
+                frame_cost_map.record(window_data.camera_pos[i], window_data.yaw[i], window_data.pitch[i], stats.cpu_ms, stats.gpu_ms());
+            }
+            if (frame_cost_map.sweeping
+                && !frame_cost_map.sweep_update(stats.cpu_ms, stats.gpu_ms(), window_data.camera_pos[i], window_data.yaw[i], window_data.pitch[i]))
+            {
+                frame_cost_map_export();
+            }
+        }
+
+        if (state_hash_log.active())
+        {
+            hash_frame_state(frame_number);
+        }
+        ++frame_number;
+
+        gpu_frame_queue.end_frame();
+        if (replay_scenario != nullptr)
+        {
+            replay_cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_current).count());
+            if (replay_player.finished())
+            {
+                glfwSetWindowShouldClose(window, true);
+            }
+        }
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    metrics_server.stop();
+    state_hash_log.close();
+
+    if (replay_scenario != nullptr)
+    {
+        const auto report = summarize_replay(replay_cpu_ms);
+        std::cout << "Replay " << replay_scenario->name << ": " << report.frames_count << " frames, cpu ms"
+            << " mean " << report.cpu_ms_mean << " p50 " << report.cpu_ms_p50
+            << " p95 " << report.cpu_ms_p95 << " p99 " << report.cpu_ms_p99 << " max " << report.cpu_ms_max << std::endl;
+        if (replay_report_path != nullptr && !write_replay_report(replay_report_path, replay_scenario->name, report))
+        {
+            std::cout << "Failed to write the replay report to " << replay_report_path << std::endl;
+        }
+    }
+
     // Delete OpenGL objects.
+    gpu_frame_queue.destroy();
+    gpu_timer_debug_draw.destroy();
+    gpu_timer_scene.destroy();
+    hud.destroy();
+    if (live_link_enable)
+    {
+        live_link.destroy();
+    }
+    live_link_objects.destroy();
+    visibility_buffer.destroy();
+    shadows.destroy();
+    city.destroy();
+    prototype_groups.destroy();
+    impostors.destroy();
+    terrain.destroy();
+    cube_nxn.destroy();
+    rubiks_cubes.destroy();
+    cube_solver.destroy();
+    scripted_quads.destroy();
+    animation_frame_pool.destroy();
+    debug_draw.destroy();
+    particles.destroy();
+    translucent_quads.destroy();
     glDeleteVertexArrays(1, &vao_camera);
     glDeleteBuffers(1, &vbo_camera);
-    glDeleteVertexArrays(1, &vao_frustum);
-    glDeleteBuffers(1, &vbo_frustum);
     glDeleteVertexArrays(1, &vao_quad);
     glDeleteBuffers(1, &vbo_quad);
     glDeleteProgram(shader_program_camera);
@@ -0,0 +1,351 @@
+﻿#include "Hud.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+
+#include "GlUtils.hpp"
+
+static const auto shader_vertex_hud_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aUv;
+layout (location = 2) in vec4 aColor;
+out vec2 vUv;
+out vec4 vColor;
+uniform vec2 screen_size;
+void main()
+{
+    // Pixels to normalized device coordinates, flipping y.
+    gl_Position = vec4(aPos.x / screen_size.x * 2.0 - 1.0, 1.0 - aPos.y / screen_size.y * 2.0, 0.0, 1.0);
+    vUv = aUv;
+    vColor = aColor;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_hud_source = R"SHADER_SOURCE(#version 330 core
+in vec2 vUv;
+in vec4 vColor;
+out vec4 FragColor;
+uniform sampler2D atlas;
+void main()
+{
+    FragColor = vec4(vColor.rgb, vColor.a * texture(atlas, vUv).r);
+}
+)SHADER_SOURCE";
+
+// A tiny bitmap font. Each glyph is 5x7 texels, '#' is a lit texel.
+struct HudGlyph
+{
+    char character;
+    const char* rows[7];
+};
+
+static constexpr HudGlyph hud_glyphs[] = {
+    { '0', { " ### ", "#   #", "#  ##", "# # #", "##  #", "#   #", " ### " } },
+    { '1', { "  #  ", " ##  ", "  #  ", "  #  ", "  #  ", "  #  ", " ### " } },
+    { '2', { " ### ", "#   #", "    #", "   # ", "  #  ", " #   ", "#####" } },
+    { '3', { "#####", "   # ", "  #  ", "   # ", "    #", "#   #", " ### " } },
+    { '4', { "   # ", "  ## ", " # # ", "#  # ", "#####", "   # ", "   # " } },
+    { '5', { "#####", "#    ", "#### ", "    #", "    #", "#   #", " ### " } },
+    { '6', { "  ## ", " #   ", "#    ", "#### ", "#   #", "#   #", " ### " } },
+    { '7', { "#####", "    #", "   # ", "  #  ", " #   ", " #   ", " #   " } },
+    { '8', { " ### ", "#   #", "#   #", " ### ", "#   #", "#   #", " ### " } },
+    { '9', { " ### ", "#   #", "#   #", " ####", "    #", "   # ", " ##  " } },
+    { 'A', { " ### ", "#   #", "#   #", "#####", "#   #", "#   #", "#   #" } },
+    { 'B', { "#### ", "#   #", "#   #", "#### ", "#   #", "#   #", "#### " } },
+    { 'C', { " ### ", "#   #", "#    ", "#    ", "#    ", "#   #", " ### " } },
+    { 'D', { "#### ", "#   #", "#   #", "#   #", "#   #", "#   #", "#### " } },
+    { 'E', { "#####", "#    ", "#    ", "#### ", "#    ", "#    ", "#####" } },
+    { 'F', { "#####", "#    ", "#    ", "#### ", "#    ", "#    ", "#    " } },
+    { 'G', { " ### ", "#   #", "#    ", "# ###", "#   #", "#   #", " ####" } },
+    { 'H', { "#   #", "#   #", "#   #", "#####", "#   #", "#   #", "#   #" } },
+    { 'I', { " ### ", "  #  ", "  #  ", "  #  ", "  #  ", "  #  ", " ### " } },
+    { 'J', { "  ###", "   # ", "   # ", "   # ", "   # ", "#  # ", " ##  " } },
+    { 'K', { "#   #", "#  # ", "# #  ", "##   ", "# #  ", "#  # ", "#   #" } },
+    { 'L', { "#    ", "#    ", "#    ", "#    ", "#    ", "#    ", "#####" } },
+    { 'M', { "#   #", "## ##", "# # #", "# # #", "#   #", "#   #", "#   #" } },
+    { 'N', { "#   #", "#   #", "##  #", "# # #", "#  ##", "#   #", "#   #" } },
+    { 'O', { " ### ", "#   #", "#   #", "#   #", "#   #", "#   #", " ### " } },
+    { 'P', { "#### ", "#   #", "#   #", "#### ", "#    ", "#    ", "#    " } },
+    { 'Q', { " ### ", "#   #", "#   #", "#   #", "# # #", "#  # ", " ## #" } },
+    { 'R', { "#### ", "#   #", "#   #", "#### ", "# #  ", "#  # ", "#   #" } },
+    { 'S', { " ####", "#    ", "#    ", " ### ", "    #", "    #", "#### " } },
+    { 'T', { "#####", "  #  ", "  #  ", "  #  ", "  #  ", "  #  ", "  #  " } },
+    { 'U', { "#   #", "#   #", "#   #", "#   #", "#   #", "#   #", " ### " } },
+    { 'V', { "#   #", "#   #", "#   #", "#   #", "#   #", " # # ", "  #  " } },
+    { 'W', { "#   #", "#   #", "#   #", "# # #", "# # #", "# # #", " # # " } },
+    { 'X', { "#   #", "#   #", " # # ", "  #  ", " # # ", "#   #", "#   #" } },
+    { 'Y', { "#   #", "#   #", " # # ", "  #  ", "  #  ", "  #  ", "  #  " } },
+    { 'Z', { "#####", "    #", "   # ", "  #  ", " #   ", "#    ", "#####" } },
+    { '.', { "     ", "     ", "     ", "     ", "     ", " ##  ", " ##  " } },
+    { ',', { "     ", "     ", "     ", "     ", " ##  ", "  #  ", " #   " } },
+    { ':', { "     ", " ##  ", " ##  ", "     ", " ##  ", " ##  ", "     " } },
+    { '/', { "     ", "    #", "   # ", "  #  ", " #   ", "#    ", "     " } },
+    { '%', { "##   ", "##  #", "   # ", "  #  ", " #   ", "#  ##", "   ##" } },
+    { '-', { "     ", "     ", "     ", "#####", "     ", "     ", "     " } },
+    { '+', { "     ", "  #  ", "  #  ", "#####", "  #  ", "  #  ", "     " } },
+    { '(', { "   # ", "  #  ", " #   ", " #   ", " #   ", "  #  ", "   # " } },
+    { ')', { " #   ", "  #  ", "   # ", "   # ", "   # ", "  #  ", " #   " } },
+    { '[', { " ### ", " #   ", " #   ", " #   ", " #   ", " #   ", " ### " } },
+    { ']', { " ### ", "   # ", "   # ", "   # ", "   # ", "   # ", " ### " } },
+    { '<', { "   # ", "  #  ", " #   ", "#    ", " #   ", "  #  ", "   # " } },
+    { '>', { " #   ", "  #  ", "   # ", "    #", "   # ", "  #  ", " #   " } },
+    { '=', { "     ", "     ", "#####", "     ", "#####", "     ", "     " } },
+    { '_', { "     ", "     ", "     ", "     ", "     ", "     ", "#####" } },
+    { '|', { "  #  ", "  #  ", "  #  ", "  #  ", "  #  ", "  #  ", "  #  " } },
+    { '!', { "  #  ", "  #  ", "  #  ", "  #  ", "  #  ", "     ", "  #  " } },
+    { '?', { " ### ", "#   #", "    #", "   # ", "  #  ", "     ", "  #  " } },
+    { '#', { " # # ", " # # ", "#####", " # # ", "#####", " # # ", " # # " } },
+    { '*', { "     ", "  #  ", "# # #", " ### ", "# # #", "  #  ", "     " } },
+    { '\'', { "  #  ", "  #  ", " #   ", "     ", "     ", "     ", "     " } },
+};
+
+// The atlas has a cell for every printable ASCII character (32-126) and one more solid cell.
+// Cells are 6x8 texels: the glyph and an empty column and row, so that neighbouring glyphs don't bleed.
+static constexpr int atlas_cell_width = 6;
+static constexpr int atlas_cell_height = 8;
+static constexpr int atlas_columns = 16;
+static constexpr int atlas_rows = 6;
+static constexpr int atlas_width = atlas_cell_width * atlas_columns;
+static constexpr int atlas_height = atlas_cell_height * atlas_rows;
+static constexpr int atlas_first_character = 32;
+// The cell of DEL (127) is unused by text, so it's filled and sampled by rectangles.
+static constexpr int atlas_solid_cell = 127 - atlas_first_character;
+
+void Hud::init()
+{
+    // Rows of the atlas go from the top, the same as in pixel coordinates of the HUD.
+    // OpenGL considers the first row the bottom one, but that doesn't matter,
+    // as long as texture coordinates are calculated the same way.
+    std::vector<unsigned char> atlas(atlas_width * atlas_height, 0);
+    for (const auto& glyph : hud_glyphs)
+    {
+        const auto cell = glyph.character - atlas_first_character;
+        const auto x0 = (cell % atlas_columns) * atlas_cell_width;
+        const auto y0 = (cell / atlas_columns) * atlas_cell_height;
+        for (int y = 0; y != 7; ++y)
+        {
+            for (int x = 0; x != 5; ++x)
+            {
+                if (glyph.rows[y][x] == '#')
+                {
+                    atlas[(y0 + y) * atlas_width + x0 + x] = 255;
+                }
+            }
+        }
+    }
+    {
+        const auto x0 = (atlas_solid_cell % atlas_columns) * atlas_cell_width;
+        const auto y0 = (atlas_solid_cell / atlas_columns) * atlas_cell_height;
+        for (int y = 0; y != atlas_cell_height; ++y)
+        {
+            std::fill_n(atlas.begin() + (y0 + y) * atlas_width + x0, atlas_cell_width, 255);
+        }
+    }
+
+    glGenTextures(1, &texture_atlas);
+    glBindTexture(GL_TEXTURE_2D, texture_atlas);
+    // Rows of the atlas are tightly packed, while OpenGL expects them aligned to 4 bytes by default.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas_width, atlas_height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // Glyphs are scaled by an integer factor, so nearest filtering keeps them crisp.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), reinterpret_cast<void*>(offsetof(HudVertex, position)));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), reinterpret_cast<void*>(offsetof(HudVertex, uv)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HudVertex), reinterpret_cast<void*>(offsetof(HudVertex, color)));
+    glEnableVertexAttribArray(2);
+    vbo_capacity = 0;
+
+    shader_program = create_program(shader_vertex_hud_source, shader_fragment_hud_source, "hud program");
+
+    std::fill(std::begin(frame_ms_history), std::end(frame_ms_history), 0.0f);
+    std::fill(std::begin(gpu_ms_history), std::end(gpu_ms_history), 0.0f);
+    history_next = 0;
+
+    cpu_ms = 0.0;
+    gpu_timer.init();
+}
+
+void Hud::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteTextures(1, &texture_atlas);
+}
+
+// Appends two triangles of an axis-aligned quad.
+static void append_quad(std::vector<HudVertex>& vertices, const glm::vec2& min, const glm::vec2& max,
+    const glm::vec2& uv_min, const glm::vec2& uv_max, const std::uint32_t color)
+{
+    vertices.push_back({ { min.x, min.y }, { uv_min.x, uv_min.y }, color });
+    vertices.push_back({ { max.x, min.y }, { uv_max.x, uv_min.y }, color });
+    vertices.push_back({ { max.x, max.y }, { uv_max.x, uv_max.y }, color });
+    vertices.push_back({ { min.x, min.y }, { uv_min.x, uv_min.y }, color });
+    vertices.push_back({ { max.x, max.y }, { uv_max.x, uv_max.y }, color });
+    vertices.push_back({ { min.x, max.y }, { uv_min.x, uv_max.y }, color });
+}
+
+void Hud::rect(const glm::vec2& position, const glm::vec2& size, const std::uint32_t color)
+{
+    // All vertices sample the center of the solid cell.
+    const glm::vec2 uv{
+        ((atlas_solid_cell % atlas_columns) * atlas_cell_width + 0.5f * atlas_cell_width) / atlas_width,
+        ((atlas_solid_cell / atlas_columns) * atlas_cell_height + 0.5f * atlas_cell_height) / atlas_height,
+    };
+    append_quad(vertices, position, position + size, uv, uv, color);
+}
+
+float Hud::text(const glm::vec2& position, const std::string_view string, const std::uint32_t color)
+{
+    constexpr auto scale = static_cast<float>(glyph_scale);
+    auto x = position.x;
+    for (auto character : string)
+    {
+        if (character >= 'a' && character <= 'z')
+        {
+            character = static_cast<char>(character - 'a' + 'A');
+        }
+        // Spaces and unknown characters only advance.
+        if (character > ' ' && character < 127)
+        {
+            const auto cell = character - atlas_first_character;
+            const auto texel_min = glm::vec2((cell % atlas_columns) * atlas_cell_width, (cell / atlas_columns) * atlas_cell_height);
+            const glm::vec2 texel_max = texel_min + glm::vec2{ 5.0f, 7.0f };
+            const glm::vec2 atlas_size{ atlas_width, atlas_height };
+            append_quad(vertices, { x, position.y }, glm::vec2{ x, position.y } + glm::vec2{ 5.0f, 7.0f } * scale,
+                texel_min / atlas_size, texel_max / atlas_size, color);
+        }
+        x += atlas_cell_width * scale;
+    }
+    return x;
+}
+
+void Hud::render(const FrameStats& stats, const int width, const int height)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+
+    frame_ms_history[history_next] = static_cast<float>(stats.frame_ms);
+    gpu_ms_history[history_next] = static_cast<float>(stats.gpu_ms());
+    history_next = (history_next + 1) % history_size;
+
+    constexpr auto line_height = static_cast<float>(atlas_cell_height * glyph_scale + 4);
+    constexpr float margin = 8.0f;
+    constexpr float padding = 8.0f;
+    constexpr float panel_width = 2.0f * history_size + 2.0f * padding;
+    constexpr float graph_height = 64.0f;
+    // The graph shows frames up to 33.3 ms (30 fps), longer frames are clipped.
+    constexpr float graph_ms_max = 1000.0f / 30.0f;
+    constexpr auto passes_count = static_cast<std::size_t>(RenderPass::count);
+    constexpr auto lines_count = 8 + passes_count;
+    constexpr auto panel_height = lines_count * line_height + graph_height + 3.0f * padding;
+
+    const auto color_text = pack_color({ 1.0f, 1.0f, 1.0f });
+    const auto color_label = pack_color({ 0.6f, 0.8f, 1.0f });
+    constexpr auto megabyte = 1024.0 * 1024.0;
+
+    // The panel goes first, so that everything else is blended over it.
+    rect({ margin, margin }, { panel_width, panel_height }, pack_color({ 0.0f, 0.0f, 0.0f }, 0.7f));
+
+    const auto left = margin + padding;
+    auto y = margin + padding;
+    char line[128];
+    const auto print_line = [&](const std::uint32_t color)
+        {
+            text({ left, y }, line, color);
+            y += line_height;
+        };
+
+    std::snprintf(line, sizeof(line), "frame %6.2f ms %6.1f fps", stats.frame_ms, stats.frame_ms > 0.0 ? 1000.0 / stats.frame_ms : 0.0);
+    print_line(color_text);
+    std::snprintf(line, sizeof(line), "cpu %6.2f ms  gpu %6.2f ms", stats.cpu_ms, stats.gpu_ms());
+    print_line(color_text);
+
+    // Frame times are green, yellow or red depending on whether the frame fits 60 fps, 30 fps or neither.
+    // GPU times are drawn over them in blue. Bars go from the oldest frame on the left.
+    rect({ left, y }, { 2.0f * history_size, graph_height }, pack_color({ 0.2f, 0.2f, 0.2f }, 0.5f));
+    const auto bar_height = [&](const float ms)
+        {
+            return std::min(ms, graph_ms_max) / graph_ms_max * graph_height;
+        };
+    for (std::size_t i = 0; i != history_size; ++i)
+    {
+        const auto index = (history_next + i) % history_size;
+        const auto x = left + 2.0f * i;
+        const auto frame_ms = frame_ms_history[index];
+        const auto frame_color = frame_ms <= 1000.0f / 60.0f ? glm::vec3{ 0.2f, 0.9f, 0.2f }
+            : frame_ms <= graph_ms_max ? glm::vec3{ 0.9f, 0.9f, 0.2f } : glm::vec3{ 0.9f, 0.2f, 0.2f };
+        const auto frame_height = bar_height(frame_ms);
+        rect({ x, y + graph_height - frame_height }, { 2.0f, frame_height }, pack_color(frame_color));
+        const auto gpu_height = bar_height(gpu_ms_history[index]);
+        rect({ x, y + graph_height - gpu_height }, { 2.0f, gpu_height }, pack_color({ 0.3f, 0.5f, 1.0f }, 0.8f));
+    }
+    // The line of 16.7 ms (60 fps).
+    rect({ left, y + graph_height - bar_height(1000.0f / 60.0f) }, { 2.0f * history_size, 1.0f }, pack_color({ 1.0f, 1.0f, 1.0f }, 0.5f));
+    y += graph_height + padding;
+
+    for (std::size_t i = 0; i != passes_count; ++i)
+    {
+        std::snprintf(line, sizeof(line), "gpu %-19s %7.3f ms", render_pass_name(static_cast<RenderPass>(i)), stats.pass_gpu_ms[i]);
+        print_line(color_label);
+    }
+    std::snprintf(line, sizeof(line), "draws %zu  state changes %zu", stats.draw_calls, stats.state_changes);
+    print_line(color_text);
+    std::snprintf(line, sizeof(line), "uploads %zu  %.2f mb", stats.buffer_uploads, stats.bytes_uploaded / megabyte);
+    print_line(color_text);
+    std::snprintf(line, sizeof(line), "visible %zu  culled %zu", stats.objects_visible, stats.objects_culled);
+    print_line(color_text);
+    std::snprintf(line, sizeof(line), "memory %.1f mb  gpu %.1f mb", stats.memory_process_bytes / megabyte, stats.memory_gpu_bytes / megabyte);
+    print_line(color_text);
+    std::snprintf(line, sizeof(line), "gpu queue %zu frames", stats.gpu_frames_in_flight);
+    print_line(color_text);
+    std::snprintf(line, sizeof(line), "hud cpu %.3f ms  gpu %.3f ms", stats.hud_cpu_ms, stats.pass_gpu_ms[static_cast<std::size_t>(RenderPass::hud)]);
+    print_line(color_label);
+
+    gpu_timer.begin();
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // The buffer is orphaned the same way as in DebugDraw::flush.
+    vbo_capacity = std::max(vbo_capacity, vertices.size());
+    buffer_data(GL_ARRAY_BUFFER, vbo_capacity * sizeof(HudVertex), nullptr, GL_STREAM_DRAW);
+    buffer_sub_data(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(HudVertex), vertices.data());
+
+    // The HUD is drawn over everything, so depth isn't tested.
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    use_program(shader_program);
+    glUniform2f(glGetUniformLocation(shader_program, "screen_size"), static_cast<float>(width), static_cast<float>(height));
+    glUniform1i(glGetUniformLocation(shader_program, "atlas"), 0);
+    bind_texture(GL_TEXTURE0, texture_atlas);
+    bind_vertex_array(vao);
+    draw_arrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()));
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    gpu_timer.end();
+
+    // clear() keeps the memory, so the next frame doesn't allocate.
+    vertices.clear();
+
+    const auto time_end = std::chrono::steady_clock::now();
+    cpu_ms = std::chrono::duration<double, std::milli>(time_end - time_start).count();
+}
+
+std::size_t Hud::gpu_memory_bytes() const
+{
+    return vbo_capacity * sizeof(HudVertex) + static_cast<std::size_t>(atlas_width) * atlas_height;
+}
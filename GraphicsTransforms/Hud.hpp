@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+#include "Stats.hpp"
+
+// Vertex of the HUD. Position is in pixels, the origin is the top left corner of the window,
+// and y goes down, like in text editors. Color is packed with pack_color.
+struct HudVertex
+{
+    glm::vec2 position;
+    glm::vec2 uv;
+    std::uint32_t color;
+};
+
+// On-screen overlay with frame statistics (see FrameStats).
+// Text and rectangles are appended into one CPU array and rendered with one draw call:
+// glyphs are sampled from an atlas texture, and rectangles sample a solid cell of the same atlas,
+// so both use the same program, texture and vertex format.
+struct Hud
+{
+    // Count of frames shown in the frame time graph.
+    static constexpr std::size_t history_size{ 240 };
+    // Glyphs are 5x7 texels, each texel covers glyph_scale x glyph_scale pixels.
+    static constexpr int glyph_scale{ 2 };
+
+    std::vector<HudVertex> vertices;
+    unsigned vbo, vao, texture_atlas, shader_program;
+    // Size of vbo in vertices.
+    std::size_t vbo_capacity;
+
+    // Ring buffers of the last frames, history_next is the oldest frame.
+    float frame_ms_history[history_size];
+    float gpu_ms_history[history_size];
+    std::size_t history_next;
+
+    // Cost of the last render().
+    double cpu_ms;
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Appends a rectangle with the top left corner at position.
+    void rect(const glm::vec2& position, const glm::vec2& size, std::uint32_t color);
+    // Appends a line of text with the top left corner at position and returns x after the last glyph.
+    // Lowercase letters are shown as uppercase, characters missing in the font are shown as spaces.
+    float text(const glm::vec2& position, std::string_view string, std::uint32_t color);
+
+    // Lays out the statistics, then renders and forgets everything appended since the last call.
+    void render(const FrameStats& stats, int width, int height);
+
+    // Size of the buffer and the atlas.
+    std::size_t gpu_memory_bytes() const;
+};
@@ -0,0 +1,351 @@
+﻿#include "Impostors.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Frustum.hpp"
+
+static const auto shader_vertex_geometry_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec4 aColor;
+out vec3 vColor;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(aPosition, 1.0);
+    vColor = aColor.rgb;
+}
+)SHADER_SOURCE";
+
+// Alpha marks covered pixels of the capture, the rest of the cell stays transparent.
+static const auto shader_fragment_geometry_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// The billboard is spanned by the axes of the capture, and its corners map to the corners of the cell.
+static const auto shader_vertex_impostors_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec4 aCenterCell;
+layout (location = 1) in vec3 aRight;
+layout (location = 2) in vec3 aUp;
+out vec2 vTexCoord;
+uniform mat4 view_projection;
+uniform float cells_per_side;
+const vec2 corners[6] = vec2[6](
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0),
+    vec2(-1.0, 1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0),
+    vec2(1.0, -1.0)
+);
+void main()
+{
+    vec2 corner = corners[gl_VertexID];
+    vec3 position = aCenterCell.xyz + aRight * corner.x + aUp * corner.y;
+    float cell = aCenterCell.w;
+    vec2 cell_origin = vec2(mod(cell, cells_per_side), floor(cell / cells_per_side));
+    vTexCoord = (cell_origin + corner * 0.5 + 0.5) / cells_per_side;
+    gl_Position = view_projection * vec4(position, 1.0);
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_impostors_source = R"SHADER_SOURCE(#version 330 core
+in vec2 vTexCoord;
+out vec4 FragColor;
+uniform sampler2D atlas;
+void main()
+{
+    vec4 color = texture(atlas, vTexCoord);
+    if (color.a < 0.5)
+    {
+        discard;
+    }
+    FragColor = vec4(color.rgb / color.a, 1.0);
+}
+)SHADER_SOURCE";
+
+static constexpr std::size_t vertices_per_cluster{ Impostors::quads_per_cluster * 6 };
+
+void Impostors::init()
+{
+    // Clusters stand in a square field to the right of the initial position of the first camera,
+    // which the second camera looks at.
+    centers.resize(clusters_count);
+    for (std::size_t i = 0; i != clusters_count; ++i)
+    {
+        centers[i] = {
+            10.0f + cluster_spacing * static_cast<float>(i % clusters_per_side),
+            0.0f,
+            cluster_spacing * (static_cast<float>(i / clusters_per_side) - 0.5f * static_cast<float>(clusters_per_side - 1)),
+        };
+    }
+
+    // A cluster is a bush of randomly turned leaves, lit by a fixed light, with its own shade of green.
+    constexpr float leaf_half_size{ 0.18f };
+    constexpr glm::vec2 corners[6] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { -1.0f, 1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }, { 1.0f, -1.0f } };
+    const auto light = glm::normalize(glm::vec3{ 0.4f, 0.8f, 0.6f });
+    std::mt19937 random{ 7 };
+    std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+    std::normal_distribution<float> normal{ 0.0f, 1.0f };
+    std::vector<ClusterVertex> vertices;
+    vertices.reserve(clusters_count * vertices_per_cluster);
+    for (std::size_t i = 0; i != clusters_count; ++i)
+    {
+        const glm::vec3 tint{ 0.15f + 0.25f * unit(random), 0.4f + 0.3f * unit(random), 0.1f + 0.15f * unit(random) };
+        for (std::size_t quad = 0; quad != quads_per_cluster; ++quad)
+        {
+            const auto direction = glm::normalize(glm::vec3{ normal(random), normal(random), normal(random) });
+            const auto radius = (cluster_radius - leaf_half_size * 1.5f) * std::cbrt(unit(random));
+            const auto position = centers[i] + direction * radius;
+            const auto leaf_normal = glm::normalize(glm::vec3{ normal(random), normal(random), normal(random) });
+            const auto helper = std::abs(leaf_normal.y) < 0.9f ? glm::vec3{ 0.0f, 1.0f, 0.0f } : glm::vec3{ 1.0f, 0.0f, 0.0f };
+            const auto u = glm::normalize(glm::cross(leaf_normal, helper)) * leaf_half_size;
+            const auto v = glm::normalize(glm::cross(leaf_normal, u)) * leaf_half_size;
+            // Leaves are lit from both sides, and the inner ones are darker.
+            const auto brightness = (0.35f + 0.65f * std::abs(glm::dot(leaf_normal, light))) * (0.6f + 0.4f * radius / cluster_radius);
+            const auto color = pack_color(glm::min(tint * brightness, glm::vec3{ 1.0f }));
+            for (const auto& corner : corners)
+            {
+                vertices.push_back({ position + u * corner.x + v * corner.y, color });
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &vao_geometry);
+    glGenBuffers(1, &vbo_geometry);
+    glBindVertexArray(vao_geometry);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ClusterVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ClusterVertex), reinterpret_cast<void*>(offsetof(ClusterVertex, position)));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ClusterVertex), reinterpret_cast<void*>(offsetof(ClusterVertex, color)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glGenVertexArrays(1, &vao_impostors);
+    glGenBuffers(1, &vbo_instances);
+    glBindVertexArray(vao_impostors);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    glBufferData(GL_ARRAY_BUFFER, clusters_count * sizeof(ImpostorInstance), nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), reinterpret_cast<void*>(offsetof(ImpostorInstance, center)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), reinterpret_cast<void*>(offsetof(ImpostorInstance, right)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), reinterpret_cast<void*>(offsetof(ImpostorInstance, up)));
+    for (unsigned i = 0; i != 3; ++i)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    glBindVertexArray(0);
+
+    constexpr int atlas_size{ cell_size * atlas_cells_per_side };
+    glGenTextures(1, &texture_atlas);
+    glBindTexture(GL_TEXTURE_2D, texture_atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas_size, atlas_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenFramebuffers(1, &fbo_atlas);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_atlas);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_atlas, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Error: impostor atlas framebuffer is incomplete" << std::endl;
+        std::exit(1);
+    }
+
+    glGenTextures(1, &texture_capture);
+    glBindTexture(GL_TEXTURE_2D, texture_capture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cell_size, cell_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenRenderbuffers(1, &rbo_capture_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_capture_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, cell_size, cell_size);
+    glGenFramebuffers(1, &fbo_capture);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_capture);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_capture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo_capture_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Error: impostor capture framebuffer is incomplete" << std::endl;
+        std::exit(1);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    shader_program_geometry = create_program(shader_vertex_geometry_source, shader_fragment_geometry_source, "impostor clusters program");
+    shader_program_impostors = create_program(shader_vertex_impostors_source, shader_fragment_impostors_source, "impostors program");
+    gpu_timer.init();
+
+    captures.assign(clusters_count, Capture{ });
+    instances.reserve(clusters_count);
+    refresh_next = 0;
+    clusters_near = 0;
+    impostors_drawn = 0;
+    refreshed = 0;
+}
+
+void Impostors::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program_impostors);
+    glDeleteProgram(shader_program_geometry);
+    glDeleteFramebuffers(1, &fbo_capture);
+    glDeleteRenderbuffers(1, &rbo_capture_depth);
+    glDeleteTextures(1, &texture_capture);
+    glDeleteFramebuffers(1, &fbo_atlas);
+    glDeleteTextures(1, &texture_atlas);
+    glDeleteBuffers(1, &vbo_instances);
+    glDeleteVertexArrays(1, &vao_impostors);
+    glDeleteBuffers(1, &vbo_geometry);
+    glDeleteVertexArrays(1, &vao_geometry);
+}
+
+void Impostors::draw_geometry(const glm::mat4& view_projection, const std::size_t first_cluster, const std::size_t clusters)
+{
+    use_program(shader_program_geometry);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_geometry, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    bind_vertex_array(vao_geometry);
+    draw_arrays(GL_TRIANGLES, static_cast<GLint>(first_cluster * vertices_per_cluster), static_cast<GLsizei>(clusters * vertices_per_cluster));
+}
+
+void Impostors::capture(const std::size_t cluster, const glm::vec3& camera_position)
+{
+    // The cluster is looked at from the camera, but with an orthographic projection that fits its bounding sphere,
+    // so the picture is the same as the billboard shows it, just without perspective inside the cluster.
+    const auto center = centers[cluster];
+    const auto offset = center - camera_position;
+    const auto distance = glm::length(offset);
+    const auto direction = offset / distance;
+    const auto up_hint = std::abs(direction.y) > 0.99f ? glm::vec3{ 0.0f, 0.0f, 1.0f } : glm::vec3{ 0.0f, 1.0f, 0.0f };
+    const auto view = glm::lookAt(center - 2.0f * impostor_extent * direction, center, up_hint);
+    const auto projection = glm::ortho(-impostor_extent, impostor_extent, -impostor_extent, impostor_extent, impostor_extent, 3.0f * impostor_extent);
+
+    bind_framebuffer(GL_FRAMEBUFFER, fbo_capture);
+    glViewport(0, 0, cell_size, cell_size);
+    constexpr float transparent[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    constexpr float depth_far{ 1.0f };
+    glClearBufferfv(GL_COLOR, 0, transparent);
+    glClearBufferfv(GL_DEPTH, 0, &depth_far);
+    draw_geometry(projection * view, cluster, 1);
+
+    const auto cell_x = static_cast<GLint>(cluster % atlas_cells_per_side) * cell_size;
+    const auto cell_y = static_cast<GLint>(cluster / atlas_cells_per_side) * cell_size;
+    bind_framebuffer(GL_DRAW_FRAMEBUFFER, fbo_atlas);
+    glBlitFramebuffer(0, 0, cell_size, cell_size, cell_x, cell_y, cell_x + cell_size, cell_y + cell_size, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Rows of the view matrix are the axes of the camera in world space.
+    auto& record = captures[cluster];
+    record.direction = direction;
+    record.distance = distance;
+    record.right = glm::vec3{ view[0][0], view[1][0], view[2][0] } * impostor_extent;
+    record.up = glm::vec3{ view[0][1], view[1][1], view[2][1] } * impostor_extent;
+    record.valid = true;
+}
+
+void Impostors::render(const glm::mat4& view_projection, const glm::vec3& camera_position)
+{
+    gpu_timer.begin();
+    const auto frustum = calculate_frustum(view_projection);
+    const auto visible = [&frustum, this](const std::size_t cluster)
+        {
+            return frustum_intersects_sphere(frustum, centers[cluster], cluster_radius);
+        };
+    const auto near = [&camera_position, this](const std::size_t cluster)
+        {
+            return glm::distance(centers[cluster], camera_position) < near_distance;
+        };
+
+    // Captures render into other targets, the current ones are restored afterwards.
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    const auto cos_refresh_angle = std::cos(refresh_angle);
+    refreshed = 0;
+    for (std::size_t i = 0; i != clusters_count && refreshed != refreshes_per_frame_max; ++i)
+    {
+        const auto cluster = (refresh_next + i) % clusters_count;
+        if (near(cluster) || !visible(cluster))
+        {
+            continue;
+        }
+        const auto& record = captures[cluster];
+        const auto offset = centers[cluster] - camera_position;
+        const auto distance = glm::length(offset);
+        const auto stale = !record.valid
+            || glm::dot(offset / distance, record.direction) < cos_refresh_angle
+            || distance > record.distance * refresh_distance_ratio
+            || distance * refresh_distance_ratio < record.distance;
+        if (stale)
+        {
+            capture(cluster, camera_position);
+            ++refreshed;
+            refresh_next = cluster + 1;
+        }
+    }
+    if (refreshed != 0)
+    {
+        bind_framebuffer(GL_FRAMEBUFFER, static_cast<unsigned>(framebuffer));
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // Nearby clusters (and distant ones that have no picture yet) are drawn as geometry,
+    // neighbouring clusters in one draw call, since they are neighbours in the buffer.
+    clusters_near = 0;
+    instances.clear();
+    std::size_t run_first = 0;
+    std::size_t run_count = 0;
+    for (std::size_t cluster = 0; cluster != clusters_count; ++cluster)
+    {
+        const auto geometry = visible(cluster) && (near(cluster) || !captures[cluster].valid);
+        if (geometry)
+        {
+            run_first = run_count == 0 ? cluster : run_first;
+            ++run_count;
+            ++clusters_near;
+            continue;
+        }
+        if (run_count != 0)
+        {
+            draw_geometry(view_projection, run_first, run_count);
+            run_count = 0;
+        }
+        if (visible(cluster) && captures[cluster].valid)
+        {
+            const auto& record = captures[cluster];
+            instances.push_back({ centers[cluster], static_cast<float>(cluster), record.right, 0.0f, record.up, 0.0f });
+        }
+    }
+    if (run_count != 0)
+    {
+        draw_geometry(view_projection, run_first, run_count);
+    }
+
+    impostors_drawn = instances.size();
+    if (!instances.empty())
+    {
+        use_program(shader_program_impostors);
+        glUniformMatrix4fv(glGetUniformLocation(shader_program_impostors, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+        glUniform1f(glGetUniformLocation(shader_program_impostors, "cells_per_side"), static_cast<float>(atlas_cells_per_side));
+        glUniform1i(glGetUniformLocation(shader_program_impostors, "atlas"), 0);
+        bind_texture(GL_TEXTURE0, texture_atlas);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+        buffer_sub_data(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(ImpostorInstance), instances.data());
+        bind_vertex_array(vao_impostors);
+        draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(instances.size()));
+    }
+    gpu_timer.end();
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+// Vertex of the cluster geometry, lighting is baked into the color.
+struct ClusterVertex
+{
+    glm::vec3 position;
+    std::uint32_t color;
+};
+
+// One billboard for the instanced draw of impostors. The layout has to match vertex attributes set in Impostors::init.
+struct ImpostorInstance
+{
+    glm::vec3 center;
+    float cell;
+    // Half extents of the billboard along the axes of the view it was captured from.
+    glm::vec3 right;
+    float padding0;
+    glm::vec3 up;
+    float padding1;
+};
+
+// A field of clusters of quads (bushes of leaves), where distant clusters are drawn as impostors.
+//
+// Nearby clusters are real geometry. A distant cluster is drawn as one textured quad instead: the picture of
+// the cluster, captured into its cell of an atlas from the direction the camera looks at it, with an orthographic
+// projection that covers its bounding sphere. The billboard is placed across that direction, so from the same
+// direction it looks like the geometry. The picture is refreshed only when the direction to the cluster
+// turns by more than a threshold angle or the distance changes by more than a threshold ratio,
+// and only a few pictures are refreshed per frame, so capturing has a bounded cost too.
+// All impostors are drawn with one instanced draw call, so the cost of geometry is in nearby clusters only.
+struct Impostors
+{
+    static constexpr std::size_t clusters_per_side{ 16 };
+    static constexpr std::size_t clusters_count{ clusters_per_side * clusters_per_side };
+    static constexpr std::size_t quads_per_cluster{ 256 };
+    static constexpr float cluster_radius{ 1.5f };
+    // Half size of the billboard, a bit larger than the cluster, so that filtering doesn't bleed between cells.
+    static constexpr float impostor_extent{ 1.1f * cluster_radius };
+    static constexpr float cluster_spacing{ 5.0f };
+    // Clusters closer than that are drawn as geometry.
+    static constexpr float near_distance{ 20.0f };
+    static constexpr float refresh_angle{ glm::radians(3.0f) };
+    static constexpr float refresh_distance_ratio{ 1.25f };
+    static constexpr std::size_t refreshes_per_frame_max{ 16 };
+    // Each cluster has its cell in a square atlas.
+    static constexpr int cell_size{ 128 };
+    static constexpr int atlas_cells_per_side{ 16 };
+    static_assert(atlas_cells_per_side * atlas_cells_per_side >= clusters_count);
+
+    // Direction from the camera to the cluster and the distance at the time of the capture,
+    // and the half extents of the billboard across the direction.
+    struct Capture
+    {
+        glm::vec3 direction;
+        float distance;
+        glm::vec3 right;
+        glm::vec3 up;
+        bool valid;
+    };
+
+    std::vector<glm::vec3> centers;
+    std::vector<Capture> captures;
+    std::vector<ImpostorInstance> instances;
+    // Refreshing starts from the cluster after the last refreshed one, so that every cluster gets its turn.
+    std::size_t refresh_next;
+
+    unsigned vbo_geometry, vao_geometry;
+    unsigned vbo_instances, vao_impostors;
+    unsigned texture_atlas, fbo_atlas;
+    // Clusters are captured into a small target with depth, then copied into the atlas.
+    unsigned texture_capture, rbo_capture_depth, fbo_capture;
+    unsigned shader_program_geometry, shader_program_impostors;
+
+    // The latest frame.
+    std::size_t clusters_near;
+    std::size_t impostors_drawn;
+    std::size_t refreshed;
+
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Refreshes stale impostors, then draws nearby clusters and impostors of distant ones.
+    void render(const glm::mat4& view_projection, const glm::vec3& camera_position);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        constexpr std::size_t atlas_size{ static_cast<std::size_t>(cell_size) * atlas_cells_per_side };
+        return clusters_count * quads_per_cluster * 6 * sizeof(ClusterVertex) + clusters_count * sizeof(ImpostorInstance)
+            + atlas_size * atlas_size * 4 + cell_size * cell_size * 8;
+    }
+
+private:
+    void capture(std::size_t cluster, const glm::vec3& camera_position);
+    void draw_geometry(const glm::mat4& view_projection, std::size_t first_cluster, std::size_t clusters);
+};
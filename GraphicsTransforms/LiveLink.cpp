@@ -0,0 +1,402 @@
+﻿#include "LiveLink.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <glm/gtc/type_ptr.hpp>
+
+static constexpr char live_link_magic[8] = { 'G', 'T', 'L', 'I', 'V', 'E', 'L', 'K' };
+
+// Batches start on a cache line, after the header.
+static constexpr std::size_t batches_offset{ (sizeof(LiveLinkHeader) + 63) / 64 * 64 };
+
+static std::int64_t steady_time_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool LiveLinkConsumer::create(const char* const name)
+{
+    if (!memory.create(name, batches_offset + capacity * sizeof(LiveLinkBatch)))
+    {
+        return false;
+    }
+    header = new (memory.data) LiveLinkHeader{ };
+    std::memcpy(header->magic, live_link_magic, sizeof(live_link_magic));
+    header->version = live_link_version;
+    header->capacity = capacity;
+    header->batch_bytes = static_cast<std::uint32_t>(sizeof(LiveLinkBatch));
+    batches = reinterpret_cast<LiveLinkBatch*>(memory.data + batches_offset);
+    return true;
+}
+
+void LiveLinkConsumer::destroy()
+{
+    if (header != nullptr)
+    {
+        header->closed.store(1, std::memory_order_release);
+    }
+    memory.close();
+    header = nullptr;
+    batches = nullptr;
+}
+
+bool LiveLinkProducer::open(const char* const name)
+{
+    if (!memory.open(name) || memory.size < batches_offset)
+    {
+        memory.close();
+        return false;
+    }
+    header = reinterpret_cast<LiveLinkHeader*>(memory.data);
+    if (std::memcmp(header->magic, live_link_magic, sizeof(live_link_magic)) != 0 || header->version != live_link_version
+        || header->batch_bytes != sizeof(LiveLinkBatch) || memory.size < batches_offset + header->capacity * sizeof(LiveLinkBatch))
+    {
+        close();
+        return false;
+    }
+    batches = reinterpret_cast<LiveLinkBatch*>(memory.data + batches_offset);
+    return true;
+}
+
+void LiveLinkProducer::close()
+{
+    memory.close();
+    header = nullptr;
+    batches = nullptr;
+}
+
+void LiveLinkProducer::commit(LiveLinkBatch& batch)
+{
+    const auto head = header->head.load(std::memory_order_relaxed);
+    batch.sequence = head;
+    batch.send_time_ns = steady_time_ns();
+    // Release makes the contents of the batch visible before the new head.
+    header->head.store(head + 1, std::memory_order_release);
+}
+
+// Vertex shader of cubes, the model matrix is a per-instance attribute (4 columns).
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in mat4 aModel;
+out vec3 vColor;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * aModel * vec4(aPos, 1.0);
+    vec3 normal = normalize(mat3(aModel) * aNormal);
+    float light = 0.4 + 0.6 * max(dot(normal, normalize(vec3(0.3, 1.0, 0.5))), 0.0);
+    // Colors are different for neighbouring ids.
+    uint hash = uint(gl_InstanceID) * 2654435761u;
+    vec3 color = vec3(float(hash >> 24), float((hash >> 16) & 255u), float((hash >> 8) & 255u)) / 255.0;
+    vColor = (0.3 + 0.7 * color) * light;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// Model matrix of translation * rotation * scale. Columns of the rotation matrix of a unit quaternion are scaled.
+static glm::mat4 calculate_model(const LiveLinkTransform& transform)
+{
+    const auto x = transform.rotation[0];
+    const auto y = transform.rotation[1];
+    const auto z = transform.rotation[2];
+    const auto w = transform.rotation[3];
+    return glm::mat4{
+        glm::vec4{ 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f } * transform.scale[0],
+        glm::vec4{ 2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f } * transform.scale[1],
+        glm::vec4{ 2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f } * transform.scale[2],
+        glm::vec4{ transform.translation[0], transform.translation[1], transform.translation[2], 1.0f },
+    };
+}
+
+void LiveLinkObjects::init()
+{
+    // Zero matrices collapse cubes into a point, so objects that were never set aren't visible.
+    models.assign(objects_max, glm::mat4{ 0.0f });
+    models_dirty.clear();
+    count_drawn = 0;
+
+    // A cube (+-0.5), 6 faces of 2 triangles, a position and a normal per vertex.
+    std::vector<float> cube;
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        for (const auto side : { -1.0f, 1.0f })
+        {
+            glm::vec3 normal{ 0.0f };
+            normal[axis] = side;
+            glm::vec3 u{ 0.0f };
+            u[(axis + 1) % 3] = 1.0f;
+            glm::vec3 v{ 0.0f };
+            v[(axis + 2) % 3] = side;
+            const glm::vec2 corners[6] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, -1 }, { 1, 1 }, { -1, 1 } };
+            for (const auto& corner : corners)
+            {
+                const auto position = 0.5f * (normal + corner.x * u + corner.y * v);
+                cube.insert(cube.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+            }
+        }
+    }
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo_cube);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_cube);
+    glBufferData(GL_ARRAY_BUFFER, cube.size() * sizeof(float), cube.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), nullptr);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), reinterpret_cast<void*>(3 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glGenBuffers(1, &vbo_models);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_models);
+    glBufferData(GL_ARRAY_BUFFER, objects_max * sizeof(glm::mat4), models.data(), GL_DYNAMIC_DRAW);
+    // A mat4 attribute takes 4 locations, a column each.
+    for (unsigned column = 0; column != 4; ++column)
+    {
+        glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void*>(column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(2 + column);
+        glVertexAttribDivisor(2 + column, 1);
+    }
+    glBindVertexArray(0);
+
+    shader_program = create_program(shader_vertex_source, shader_fragment_source, "live link program");
+    gpu_timer.init();
+}
+
+void LiveLinkObjects::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &vbo_models);
+    glDeleteBuffers(1, &vbo_cube);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void LiveLinkObjects::apply(const LiveLinkBatch& batch)
+{
+    const auto count = std::min<std::size_t>(batch.transforms_count, LiveLinkBatch::transforms_max);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const auto& transform = batch.transforms[i];
+        if (transform.object >= objects_max)
+        {
+            continue;
+        }
+        models[transform.object] = calculate_model(transform);
+        models_dirty.mark(transform.object);
+        count_drawn = std::max<std::size_t>(count_drawn, transform.object + 1);
+    }
+}
+
+void LiveLinkObjects::render(const glm::mat4& view_projection)
+{
+    gpu_timer.begin();
+    if (!models_dirty.empty())
+    {
+        // Runs closer than 4 objects (256 bytes) are uploaded as one.
+        models_dirty.coalesce(objects_max, 4);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_models);
+        for (const auto& range : models_dirty.ranges)
+        {
+            buffer_sub_data(GL_ARRAY_BUFFER, range.first * sizeof(glm::mat4), range.count * sizeof(glm::mat4), models.data() + range.first);
+        }
+        models_dirty.clear();
+    }
+    if (count_drawn != 0)
+    {
+        use_program(shader_program);
+        glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+        bind_vertex_array(vao);
+        draw_arrays_instanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(count_drawn));
+    }
+    gpu_timer.end();
+}
+
+bool live_link_producer_run()
+{
+    LiveLinkProducer producer;
+    if (!producer.open(live_link_name))
+    {
+        std::cout << "Live link: no renderer to connect to (enable the live link in it first)" << std::endl;
+        return false;
+    }
+    std::cout << "Live link: connected" << std::endl;
+
+    // Objects move in a box in front of the first camera's initial position, the camera circles around the box.
+    constexpr glm::vec3 center{ 0.0f, 0.0f, -5.0f };
+    constexpr glm::vec3 extent{ 3.0f, 1.5f, 2.0f };
+    constexpr auto step = std::chrono::microseconds{ 1000000 / 240 };
+    std::size_t skipped = 0;
+    std::uint64_t steps = 0;
+    auto time_next = std::chrono::steady_clock::now();
+    while (!producer.closed())
+    {
+        const auto t = static_cast<float>(steps) / 240.0f;
+        if (const auto batch = producer.begin())
+        {
+            batch->transforms_count = static_cast<std::uint32_t>(LiveLinkBatch::transforms_max);
+            for (std::uint32_t i = 0; i != LiveLinkBatch::transforms_max; ++i)
+            {
+                const auto phase = 0.1f * static_cast<float>(i);
+                const auto position = center + extent * glm::vec3{ std::sin(0.7f * t + phase), std::sin(1.1f * t + 2.0f * phase), std::cos(0.5f * t + 3.0f * phase) };
+                // Rotation around the vertical axis.
+                const auto angle = t + phase;
+                auto& transform = batch->transforms[i];
+                transform = { .object = i,
+                    .translation = { position.x, position.y, position.z },
+                    .rotation = { 0.0f, std::sin(0.5f * angle), 0.0f, std::cos(0.5f * angle) },
+                    .scale = { 0.2f, 0.2f, 0.2f },
+                    .padding = 0.0f };
+            }
+            const auto angle = 0.2f * t;
+            const auto eye = center + glm::vec3{ 9.0f * std::sin(angle), 2.0f, 9.0f * std::cos(angle) };
+            const auto direction = glm::normalize(center - eye);
+            batch->camera_valid = 1;
+            batch->camera = { .position = { eye.x, eye.y, eye.z }, .yaw = std::atan2(direction.z, direction.x), .pitch = std::asin(direction.y) };
+            producer.commit(*batch);
+        }
+        else
+        {
+            ++skipped;
+        }
+        ++steps;
+        time_next += step;
+        std::this_thread::sleep_until(time_next);
+    }
+    std::cout << "Live link: closed by the renderer after " << steps << " steps (" << skipped << " skipped, because the renderer was behind)" << std::endl;
+    producer.close();
+    return true;
+}
+
+#if !defined(_WIN32)
+
+bool live_link_benchmark()
+{
+    constexpr std::size_t batches_count{ 20000 };
+    constexpr std::uint32_t transforms_count{ 16 };
+    // Batches are spaced, so that the consumer is waiting when one arrives, and the latency doesn't include queueing.
+    constexpr auto spacing = std::chrono::microseconds{ 50 };
+
+    const auto name = std::string{ live_link_name } + "-benchmark-" + std::to_string(getpid());
+    LiveLinkConsumer consumer;
+    if (!consumer.create(name.c_str()))
+    {
+        std::cout << "Live link: can't create shared memory" << std::endl;
+        return false;
+    }
+
+    std::cout.flush();
+    const auto pid = fork();
+    if (pid < 0)
+    {
+        std::cout << "Live link: can't fork the producer" << std::endl;
+        consumer.destroy();
+        return false;
+    }
+    if (pid == 0)
+    {
+        // The producer opens the link by name, like an external process would.
+        LiveLinkProducer producer;
+        if (!producer.open(name.c_str()))
+        {
+            _exit(1);
+        }
+        auto time_next = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i != batches_count; ++i)
+        {
+            LiveLinkBatch* batch = nullptr;
+            while ((batch = producer.begin()) == nullptr)
+            {
+                std::this_thread::yield();
+            }
+            batch->transforms_count = transforms_count;
+            batch->camera_valid = 0;
+            for (std::uint32_t t = 0; t != transforms_count; ++t)
+            {
+                batch->transforms[t] = { .object = t, .translation = { static_cast<float>(i), 0.0f, 0.0f },
+                    .rotation = { 0.0f, 0.0f, 0.0f, 1.0f }, .scale = { 1.0f, 1.0f, 1.0f }, .padding = 0.0f };
+            }
+            producer.commit(*batch);
+            // Yielding while spinning keeps the benchmark meaningful when both processes share a core.
+            time_next += spacing;
+            while (std::chrono::steady_clock::now() < time_next)
+            {
+                std::this_thread::yield();
+            }
+        }
+        producer.close();
+        _exit(0);
+    }
+
+    std::vector<double> latencies_us;
+    latencies_us.reserve(batches_count);
+    std::uint64_t sequence_expected = 0;
+    std::size_t out_of_order = 0;
+    const auto time_start = std::chrono::steady_clock::now();
+    while (latencies_us.size() != batches_count)
+    {
+        const auto batch = consumer.front();
+        if (batch == nullptr)
+        {
+            int status = 0;
+            if (waitpid(pid, &status, WNOHANG) == pid && consumer.front() == nullptr)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        latencies_us.push_back(static_cast<double>(steady_time_ns() - batch->send_time_ns) / 1000.0);
+        out_of_order += batch->sequence != sequence_expected;
+        ++sequence_expected;
+        consumer.pop();
+    }
+    const auto elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+    waitpid(pid, nullptr, 0);
+    consumer.destroy();
+
+    if (latencies_us.size() != batches_count)
+    {
+        std::cout << "Live link: the producer stopped after " << latencies_us.size() << " batches" << std::endl;
+        return false;
+    }
+    std::sort(latencies_us.begin(), latencies_us.end());
+    const auto percentile = [&latencies_us](const double p)
+        {
+            return latencies_us[std::min(latencies_us.size() - 1, static_cast<std::size_t>(p * static_cast<double>(latencies_us.size())))];
+        };
+    std::cout << "Live link latency of " << batches_count << " batches of " << transforms_count << " transforms (commit to visible): "
+        << "p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 " << percentile(0.999) << " us, max " << latencies_us.back() << " us"
+        << ", " << static_cast<double>(batches_count) / elapsed_s << " batches/s, " << out_of_order << " out of order" << std::endl;
+    return true;
+}
+
+#else
+
+bool live_link_benchmark()
+{
+    std::cout << "Live link benchmark needs fork, which isn't available on Windows" << std::endl;
+    return false;
+}
+
+#endif
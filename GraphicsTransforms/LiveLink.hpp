@@ -0,0 +1,182 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "DirtyRanges.hpp"
+#include "GlUtils.hpp"
+#include "SharedMemory.hpp"
+
+// Live link: an external process (a simulator) drives objects and the camera of the renderer every frame.
+// The renderer creates a ring of batches in shared memory, the producer opens it by name and fills batches in place.
+// There is exactly one producer and one consumer, so the ring needs no locks: the producer only moves head,
+// and the consumer only moves tail. The consumer applies batches right from the shared memory, nothing is copied.
+// Layouts are plain data of fixed size, so that producers don't have to be built from this code.
+
+inline constexpr auto live_link_name = "/GraphicsTransforms-link";
+inline constexpr std::uint32_t live_link_version{ 1 };
+
+// A new transform of an object: translation, rotation (a unit quaternion x, y, z, w) and scale.
+struct LiveLinkTransform
+{
+    std::uint32_t object;
+    float translation[3];
+    float rotation[4];
+    float scale[3];
+    float padding;
+};
+static_assert(sizeof(LiveLinkTransform) == 48);
+
+// A pose of the camera, the same as the renderer keeps (angles in radians).
+struct LiveLinkCamera
+{
+    float position[3];
+    float yaw;
+    float pitch;
+};
+
+// Transforms and the camera pose of one step of the producer.
+struct LiveLinkBatch
+{
+    static constexpr std::size_t transforms_max{ 256 };
+
+    std::uint64_t sequence;
+    // steady_clock time of the commit in nanoseconds. The clock is monotonic for the whole system
+    // (CLOCK_MONOTONIC on Linux, QueryPerformanceCounter on Windows), so times of processes are comparable.
+    std::int64_t send_time_ns;
+    std::uint32_t transforms_count;
+    // Whether camera is set.
+    std::uint32_t camera_valid;
+    LiveLinkCamera camera;
+    LiveLinkTransform transforms[transforms_max];
+};
+
+// The beginning of the shared memory, batches follow it.
+// head and tail are on their own cache lines, so that the producer and the consumer don't invalidate each other's line.
+struct LiveLinkHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t capacity;
+    std::uint32_t batch_bytes;
+    // Set by the renderer when it closes the link, producers stop then.
+    std::atomic<std::uint32_t> closed;
+    // Count of batches ever committed by the producer.
+    alignas(64) std::atomic<std::uint64_t> head;
+    // Count of batches ever applied by the consumer.
+    alignas(64) std::atomic<std::uint64_t> tail;
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+// The renderer's end of the link.
+struct LiveLinkConsumer
+{
+    // A few frames of a producer that runs faster than the renderer.
+    static constexpr std::uint32_t capacity{ 64 };
+
+    SharedMemory memory;
+    LiveLinkHeader* header{ nullptr };
+    LiveLinkBatch* batches{ nullptr };
+
+    // Returns false if the shared memory can't be created.
+    bool create(const char* name);
+    // Tells the producer that the link is closed and removes it.
+    void destroy();
+
+    // The oldest batch that isn't applied yet, or nullptr. It stays valid until pop.
+    const LiveLinkBatch* front() const
+    {
+        const auto tail = header->tail.load(std::memory_order_relaxed);
+        if (header->head.load(std::memory_order_acquire) == tail)
+        {
+            return nullptr;
+        }
+        return &batches[tail % capacity];
+    }
+
+    // Batches committed by the producer that aren't applied yet.
+    std::uint64_t queued() const
+    {
+        return header->head.load(std::memory_order_acquire) - header->tail.load(std::memory_order_relaxed);
+    }
+
+    // Gives the slot of the front batch back to the producer.
+    void pop()
+    {
+        header->tail.store(header->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// The producer's end of the link.
+struct LiveLinkProducer
+{
+    SharedMemory memory;
+    LiveLinkHeader* header{ nullptr };
+    LiveLinkBatch* batches{ nullptr };
+
+    // Returns false if there is no link with the name, or its layout is different.
+    bool open(const char* name);
+    void close();
+
+    // A free slot to fill in place, or nullptr if the consumer is behind and the ring is full
+    // (a simulator shouldn't wait for the renderer, it can skip the step or merge it into the next one).
+    LiveLinkBatch* begin() const
+    {
+        const auto head = header->head.load(std::memory_order_relaxed);
+        if (head - header->tail.load(std::memory_order_acquire) == header->capacity)
+        {
+            return nullptr;
+        }
+        return &batches[head % header->capacity];
+    }
+
+    // Stamps the batch from begin with the time and publishes it.
+    void commit(LiveLinkBatch& batch);
+
+    bool closed() const
+    {
+        return header->closed.load(std::memory_order_acquire) != 0;
+    }
+};
+
+// Objects driven by the live link, rendered as instanced cubes.
+// Only objects that changed since the last upload are uploaded (see DirtyRanges).
+struct LiveLinkObjects
+{
+    static constexpr std::size_t objects_max{ 1024 };
+
+    std::vector<glm::mat4> models;
+    DirtyRanges models_dirty;
+    // Objects that were set at least once are drawn, the first count_drawn of them.
+    std::size_t count_drawn;
+
+    unsigned vbo_cube, vbo_models, vao;
+    unsigned shader_program;
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Sets transforms of the batch (ids outside of objects_max are ignored).
+    void apply(const LiveLinkBatch& batch);
+    void render(const glm::mat4& view_projection);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return objects_max * sizeof(glm::mat4) + 36 * 6 * sizeof(float);
+    }
+};
+
+// Stand-in for the simulator: opens the link of a running renderer and pushes objects moving on Lissajous curves
+// and the camera circling around them at 240 steps per second, until the renderer closes the link.
+// Returns false if there is no link.
+bool live_link_producer_run();
+
+// Creates a link, forks a producer that commits small batches and measures time from the commit
+// to the moment the consumer sees the batch. Prints percentiles of the latency and returns false on failure
+// (always on Windows, which can't fork).
+bool live_link_benchmark();
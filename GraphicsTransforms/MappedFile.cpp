@@ -0,0 +1,96 @@
+﻿#include "MappedFile.hpp"
+
+#include <cstddef>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const char* path)
+{
+    close();
+#if defined(_WIN32)
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = nullptr;
+        return false;
+    }
+    LARGE_INTEGER file_size{ };
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        close();
+        return false;
+    }
+    const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        close();
+        return false;
+    }
+    data = static_cast<const std::byte*>(view);
+    size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    const auto descriptor = ::open(path, O_RDONLY);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    struct stat file_stat{ };
+    if (fstat(descriptor, &file_stat) != 0 || file_stat.st_size <= 0)
+    {
+        ::close(descriptor);
+        return false;
+    }
+    const auto view = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+    // The mapping keeps the file alive, the descriptor isn't needed anymore.
+    ::close(descriptor);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+    data = static_cast<const std::byte*>(view);
+    size = static_cast<std::size_t>(file_stat.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mapping != nullptr)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+    if (file != nullptr)
+    {
+        CloseHandle(file);
+        file = nullptr;
+    }
+#else
+    if (data != nullptr)
+    {
+        munmap(const_cast<std::byte*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+}
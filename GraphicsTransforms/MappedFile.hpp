@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <cstddef>
+
+// Read-only view of a whole file mapped into the address space.
+// Pages are loaded by the OS on the first access and shared with other processes that map the same file,
+// so opening even a large file is instant, and nothing is copied.
+struct MappedFile
+{
+    const std::byte* data{ nullptr };
+    std::size_t size{ 0 };
+
+    // Returns false if the file doesn't exist, is empty or can't be mapped.
+    bool open(const char* path);
+    // Does nothing if the file isn't open.
+    void close();
+
+    bool is_open() const
+    {
+        return data != nullptr;
+    }
+
+private:
+#if defined(_WIN32)
+    void* file{ nullptr };
+    void* mapping{ nullptr };
+#endif
+};
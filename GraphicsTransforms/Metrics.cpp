@@ -0,0 +1,321 @@
+﻿#include "Metrics.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using SocketHandle = SOCKET;
+static constexpr SocketHandle socket_invalid = INVALID_SOCKET;
+static void socket_close(const SocketHandle socket)
+{
+    closesocket(socket);
+}
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+using SocketHandle = int;
+static constexpr SocketHandle socket_invalid = -1;
+static void socket_close(const SocketHandle socket)
+{
+    close(socket);
+}
+#endif
+
+// Writing to a socket closed by the other side raises SIGPIPE on POSIX, which kills the program by default.
+#if defined(MSG_NOSIGNAL)
+static constexpr int send_flags = MSG_NOSIGNAL;
+#else
+static constexpr int send_flags = 0;
+#endif
+
+static void add_to_histogram(std::uint64_t (&buckets)[MetricsSnapshot::buckets_count], double& sum, const double seconds)
+{
+    std::size_t i = 0;
+    while (i != std::size(MetricsSnapshot::buckets) && seconds > MetricsSnapshot::buckets[i])
+    {
+        ++i;
+    }
+    ++buckets[i];
+    sum += seconds;
+}
+
+void MetricsSnapshot::add(const FrameStats& stats)
+{
+    ++frames_total;
+    add_to_histogram(frame_seconds_buckets, frame_seconds_sum, stats.frame_ms / 1000.0);
+    add_to_histogram(frame_cpu_seconds_buckets, frame_cpu_seconds_sum, stats.cpu_ms / 1000.0);
+    for (std::size_t i = 0; i != passes_count; ++i)
+    {
+        pass_gpu_seconds[i] = stats.pass_gpu_ms[i] / 1000.0;
+        pass_gpu_seconds_total[i] += pass_gpu_seconds[i];
+    }
+    draw_calls = stats.draw_calls;
+    draw_calls_total += stats.draw_calls;
+    state_changes = stats.state_changes;
+    state_changes_total += stats.state_changes;
+    buffer_uploads_total += stats.buffer_uploads;
+    bytes_uploaded_total += stats.bytes_uploaded;
+    objects_visible = stats.objects_visible;
+    objects_culled = stats.objects_culled;
+    memory_process_bytes = stats.memory_process_bytes;
+    memory_gpu_bytes = stats.memory_gpu_bytes;
+    gpu_frames_in_flight = stats.gpu_frames_in_flight;
+    live_link_batches_queued = stats.live_link_batches_queued;
+}
+
+// Appends a formatted line to the string.
+// The line is measured first and formatted right into the string, so it can be of any length.
+template <typename... Args>
+static void append(std::string& string, const char* format, const Args... args)
+{
+    const auto length = std::snprintf(nullptr, 0, format, args...);
+    if (length <= 0)
+    {
+        return;
+    }
+    const auto offset = string.size();
+    // snprintf writes the terminating zero too, which resize drops afterwards.
+    string.resize(offset + static_cast<std::size_t>(length) + 1);
+    std::snprintf(string.data() + offset, static_cast<std::size_t>(length) + 1, format, args...);
+    string.resize(offset + static_cast<std::size_t>(length));
+}
+
+static void append_histogram(std::string& string, const char* name, const char* help,
+    const std::uint64_t (&buckets)[MetricsSnapshot::buckets_count], const double sum)
+{
+    append(string, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i != std::size(MetricsSnapshot::buckets); ++i)
+    {
+        cumulative += buckets[i];
+        append(string, "%s_bucket{le=\"%g\"} %llu\n", name, MetricsSnapshot::buckets[i], static_cast<unsigned long long>(cumulative));
+    }
+    cumulative += buckets[MetricsSnapshot::buckets_count - 1];
+    append(string, "%s_bucket{le=\"+Inf\"} %llu\n", name, static_cast<unsigned long long>(cumulative));
+    append(string, "%s_sum %.9g\n%s_count %llu\n", name, sum, name, static_cast<unsigned long long>(cumulative));
+}
+
+static void append_metric(std::string& string, const char* name, const char* type, const char* help, const std::uint64_t value)
+{
+    append(string, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type, name, static_cast<unsigned long long>(value));
+}
+
+std::string MetricsSnapshot::format() const
+{
+    std::string string;
+    append_metric(string, "graphics_frames_total", "counter", "Frames rendered.", frames_total);
+    append_histogram(string, "graphics_frame_seconds", "Time between starts of consecutive frames.",
+        frame_seconds_buckets, frame_seconds_sum);
+    append_histogram(string, "graphics_frame_cpu_seconds", "CPU time of a frame without waiting for the swap.",
+        frame_cpu_seconds_buckets, frame_cpu_seconds_sum);
+
+    append(string, "# HELP graphics_pass_gpu_seconds GPU time of a render pass during the latest measured frame.\n"
+        "# TYPE graphics_pass_gpu_seconds gauge\n");
+    for (std::size_t i = 0; i != passes_count; ++i)
+    {
+        append(string, "graphics_pass_gpu_seconds{pass=\"%s\"} %.9g\n", render_pass_name(static_cast<RenderPass>(i)), pass_gpu_seconds[i]);
+    }
+    append(string, "# HELP graphics_pass_gpu_seconds_total GPU time of a render pass summed over frames.\n"
+        "# TYPE graphics_pass_gpu_seconds_total counter\n");
+    for (std::size_t i = 0; i != passes_count; ++i)
+    {
+        append(string, "graphics_pass_gpu_seconds_total{pass=\"%s\"} %.9g\n", render_pass_name(static_cast<RenderPass>(i)), pass_gpu_seconds_total[i]);
+    }
+
+    append_metric(string, "graphics_draw_calls", "gauge", "Draw calls during the latest frame.", draw_calls);
+    append_metric(string, "graphics_draw_calls_total", "counter", "Draw calls.", draw_calls_total);
+    append_metric(string, "graphics_state_changes", "gauge", "Binds of programs, vertex arrays, textures and framebuffers during the latest frame.", state_changes);
+    append_metric(string, "graphics_state_changes_total", "counter", "Binds of programs, vertex arrays, textures and framebuffers.", state_changes_total);
+    append_metric(string, "graphics_buffer_uploads_total", "counter", "Uploads of data into buffers.", buffer_uploads_total);
+    append_metric(string, "graphics_uploaded_bytes_total", "counter", "Bytes uploaded into buffers.", bytes_uploaded_total);
+
+    append(string, "# HELP graphics_objects Translucent quads that passed or failed frustum culling during the latest frame.\n"
+        "# TYPE graphics_objects gauge\n"
+        "graphics_objects{state=\"visible\"} %llu\n"
+        "graphics_objects{state=\"culled\"} %llu\n",
+        static_cast<unsigned long long>(objects_visible), static_cast<unsigned long long>(objects_culled));
+    append(string, "# HELP graphics_memory_bytes Memory of the process and of GPU resources created by the program.\n"
+        "# TYPE graphics_memory_bytes gauge\n"
+        "graphics_memory_bytes{kind=\"process\"} %llu\n"
+        "graphics_memory_bytes{kind=\"gpu\"} %llu\n",
+        static_cast<unsigned long long>(memory_process_bytes), static_cast<unsigned long long>(memory_gpu_bytes));
+    append(string, "# HELP graphics_queue_depth Items submitted, but not processed yet.\n"
+        "# TYPE graphics_queue_depth gauge\n"
+        "graphics_queue_depth{queue=\"gpu_frames\"} %llu\n"
+        "graphics_queue_depth{queue=\"live_link_batches\"} %llu\n",
+        static_cast<unsigned long long>(gpu_frames_in_flight), static_cast<unsigned long long>(live_link_batches_queued));
+    return string;
+}
+
+bool MetricsServer::start(const unsigned short port)
+{
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+        std::cout << "Metrics: failed to initialize Winsock" << std::endl;
+        return false;
+    }
+#endif
+    const auto fail = [](const char* message, const SocketHandle socket)
+        {
+            std::cout << "Metrics: " << message << std::endl;
+            if (socket != socket_invalid)
+            {
+                socket_close(socket);
+            }
+#if defined(_WIN32)
+            WSACleanup();
+#endif
+            return false;
+        };
+
+    const auto socket_server = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socket_server == socket_invalid)
+    {
+        return fail("failed to create a socket", socket_server);
+    }
+    // Allows restarting the program right away, while the old socket is in TIME_WAIT state.
+    const int reuse = 1;
+    setsockopt(socket_server, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    // Only local clients can connect.
+    sockaddr_in address{ };
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(socket_server, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        return fail("failed to bind the port", socket_server);
+    }
+    if (listen(socket_server, 8) != 0)
+    {
+        return fail("failed to listen", socket_server);
+    }
+
+    socket_listen = static_cast<std::uintptr_t>(socket_server);
+    stop_requested = false;
+    thread = std::thread{ [this]() { serve(); } };
+    std::cout << "Metrics: http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    if (!running())
+    {
+        return;
+    }
+    stop_requested = true;
+    thread.join();
+    socket_close(static_cast<SocketHandle>(socket_listen));
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+}
+
+void MetricsServer::publish(const FrameStats& stats)
+{
+    accumulated.add(stats);
+    slots[slot_write] = accumulated;
+    // The written slot becomes the middle one, and the frame loop gets the old middle slot,
+    // which the thread isn't reading (it reads only its own slot).
+    slot_write = slot_middle.exchange(slot_write | slot_fresh, std::memory_order_acq_rel) & ~slot_fresh;
+}
+
+void MetricsServer::serve()
+{
+    const auto socket_server = static_cast<SocketHandle>(socket_listen);
+    while (!stop_requested)
+    {
+        // Wait for a connection with a timeout, so that stop requests are noticed.
+        fd_set sockets;
+        FD_ZERO(&sockets);
+        FD_SET(socket_server, &sockets);
+        timeval timeout{ 0, 100000 };
+        // The first argument is ignored on Windows.
+        if (select(static_cast<int>(socket_server) + 1, &sockets, nullptr, nullptr, &timeout) <= 0)
+        {
+            continue;
+        }
+        const auto socket_client = accept(socket_server, nullptr, nullptr);
+        if (socket_client == socket_invalid)
+        {
+            continue;
+        }
+        respond(static_cast<std::uintptr_t>(socket_client));
+        socket_close(socket_client);
+    }
+}
+
+void MetricsServer::respond(const std::uintptr_t socket_handle)
+{
+    const auto socket_client = static_cast<SocketHandle>(socket_handle);
+
+    // A client that connects and stays silent must not hang the thread forever.
+#if defined(_WIN32)
+    const DWORD receive_timeout = 1000;
+#else
+    const timeval receive_timeout{ 1, 0 };
+#endif
+    setsockopt(socket_client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&receive_timeout), sizeof(receive_timeout));
+#if defined(SO_NOSIGPIPE)
+    const int no_sigpipe = 1;
+    setsockopt(socket_client, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+    // Only the request line matters, so the rest of the request is ignored.
+    char request[1024];
+    const auto received = recv(socket_client, request, sizeof(request) - 1, 0);
+    if (received <= 0)
+    {
+        return;
+    }
+    request[received] = '\0';
+
+    std::string body;
+    const char* status;
+    if (std::strncmp(request, "GET /metrics ", 13) == 0 || std::strncmp(request, "GET /metrics?", 13) == 0)
+    {
+        // Take the latest published snapshot, if there is a new one.
+        if (slot_middle.load(std::memory_order_relaxed) & slot_fresh)
+        {
+            slot_read = slot_middle.exchange(slot_read, std::memory_order_acq_rel) & ~slot_fresh;
+        }
+        body = slots[slot_read].format();
+        status = "200 OK";
+    }
+    else
+    {
+        body = "Metrics are at /metrics\n";
+        status = "404 Not Found";
+    }
+
+    std::string response;
+    append(response, "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, body.size());
+    response += body;
+
+    std::size_t sent = 0;
+    while (sent != response.size())
+    {
+        const auto result = send(socket_client, response.data() + sent, static_cast<int>(response.size() - sent), send_flags);
+        if (result <= 0)
+        {
+            return;
+        }
+        sent += static_cast<std::size_t>(result);
+    }
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include "Stats.hpp"
+
+// Cumulative metrics since the start of the program, plus the latest values of gauges.
+// Times are in seconds, as Prometheus recommends.
+struct MetricsSnapshot
+{
+    // Upper bounds of histogram buckets, the last bucket (+Inf) is implied.
+    static constexpr double buckets[] = { 0.001, 0.002, 0.004, 0.008, 0.0167, 0.0333, 0.05, 0.1, 0.25 };
+    static constexpr std::size_t buckets_count{ std::size(buckets) + 1 };
+    static constexpr auto passes_count = static_cast<std::size_t>(RenderPass::count);
+
+    std::uint64_t frames_total;
+
+    // Counts of frames per bucket (not cumulative, unlike in the exposition format).
+    std::uint64_t frame_seconds_buckets[buckets_count];
+    double frame_seconds_sum;
+    std::uint64_t frame_cpu_seconds_buckets[buckets_count];
+    double frame_cpu_seconds_sum;
+
+    double pass_gpu_seconds[passes_count];
+    double pass_gpu_seconds_total[passes_count];
+
+    std::uint64_t draw_calls;
+    std::uint64_t draw_calls_total;
+    std::uint64_t state_changes;
+    std::uint64_t state_changes_total;
+    std::uint64_t buffer_uploads_total;
+    std::uint64_t bytes_uploaded_total;
+
+    std::uint64_t objects_visible;
+    std::uint64_t objects_culled;
+
+    std::uint64_t memory_process_bytes;
+    std::uint64_t memory_gpu_bytes;
+
+    std::uint64_t gpu_frames_in_flight;
+    std::uint64_t live_link_batches_queued;
+
+    // Adds a frame to the counters and histograms and replaces the gauges.
+    void add(const FrameStats& stats);
+    // Formats the snapshot in Prometheus text exposition format (version 0.0.4).
+    std::string format() const;
+};
+
+// HTTP server on 127.0.0.1 that serves MetricsSnapshot at /metrics for Prometheus to scrape.
+// Requests are handled one by one on a background thread.
+// The frame loop and the thread exchange snapshots through a triple buffer:
+// the frame loop writes its slot and swaps it with the middle one, and the thread swaps
+// the middle slot with its own when it's fresh. Both swaps are a single atomic exchange,
+// so neither side ever waits for the other, and a slow scrape can't slow down a frame.
+struct MetricsServer
+{
+    // Opens the socket and starts the thread.
+    // Metrics are optional, so in case of an error it's printed, and false is returned.
+    bool start(unsigned short port);
+    // Stops the thread and closes the socket. Does nothing if the server isn't running.
+    void stop();
+    bool running() const
+    {
+        return thread.joinable();
+    }
+
+    // Called by the frame loop once per frame. Never blocks.
+    void publish(const FrameStats& stats);
+
+private:
+    // Index of the middle slot, and whether it has been published since the last exchange with the reader.
+    static constexpr unsigned slot_fresh{ 4 };
+
+    // The frame loop owns accumulated and slots[slot_write], the thread owns slots[slot_read].
+    MetricsSnapshot accumulated{ };
+    MetricsSnapshot slots[3]{ };
+    unsigned slot_write{ 0 };
+    std::atomic<unsigned> slot_middle{ 1 };
+    unsigned slot_read{ 2 };
+
+    std::thread thread;
+    std::atomic<bool> stop_requested{ false };
+    // A platform socket handle (int on POSIX, SOCKET on Windows).
+    std::uintptr_t socket_listen{ 0 };
+
+    void serve();
+    void respond(std::uintptr_t socket_client);
+};
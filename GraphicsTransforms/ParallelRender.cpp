@@ -0,0 +1,499 @@
+﻿#include "ParallelRender.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GlUtils.hpp"
+#include "MappedFile.hpp"
+#include "SharedMemory.hpp"
+
+static constexpr int image_width{ 1280 };
+static constexpr int image_height{ 720 };
+static constexpr std::size_t boxes_count{ std::size_t{ 1 } << 16 };
+static constexpr std::size_t frames_count{ 60 };
+static constexpr auto scene_path = "parallel_scene.bin";
+static constexpr auto image_path = "parallel_render.ppm";
+static constexpr char scene_magic[8] = { 'G', 'T', 'P', 'S', 'C', 'E', 'N', 'E' };
+
+struct ParallelSceneHeader
+{
+    char magic[8];
+    std::uint32_t boxes_count;
+    std::uint32_t reserved;
+};
+
+// Layout matches vertex attributes of the worker, so the mapped file is uploaded as is.
+struct ParallelSceneBox
+{
+    // xyz is the center, w is half of the size.
+    glm::vec4 center_size;
+    glm::vec4 color;
+};
+
+// The beginning of the shared memory. Atomics that are lock-free don't depend on the address space,
+// so they synchronize processes the same way they synchronize threads.
+struct ParallelControl
+{
+    // The frame workers have to render (frames start from 1).
+    std::atomic<std::uint32_t> frame;
+    std::atomic<std::uint32_t> quit;
+    // Count of workers that couldn't create a context.
+    std::atomic<std::uint32_t> failed;
+    // The last frame rendered by each worker, and how long it took (render and read back).
+    std::atomic<std::uint32_t> done[parallel_render_workers_max];
+    double render_ms[parallel_render_workers_max];
+};
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+// Pixels of the final image, and for sort-last, colors and depths of every worker follow the control block.
+static constexpr std::size_t pixels_count{ static_cast<std::size_t>(image_width) * image_height };
+static constexpr std::size_t image_offset{ (sizeof(ParallelControl) + 63) / 64 * 64 };
+static constexpr std::size_t slot_bytes{ pixels_count * (4 + sizeof(float)) };
+
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec4 aCenterSize;
+layout (location = 3) in vec4 aColor;
+out vec3 vColor;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(aCenterSize.xyz + aPos * aCenterSize.w, 1.0);
+    float light = 0.3 + 0.7 * max(dot(aNormal, normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+    vColor = aColor.rgb * light;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// Boxes of random sizes and colors scattered over a square, the same on every run.
+static bool write_scene()
+{
+    std::vector<ParallelSceneBox> boxes(boxes_count);
+    std::mt19937 random{ 17 };
+    std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+    for (auto& box : boxes)
+    {
+        const auto size = 0.2f + 0.8f * unit(random);
+        box.center_size = glm::vec4{ 100.0f * unit(random) - 50.0f, size, 100.0f * unit(random) - 50.0f, size };
+        box.color = glm::vec4{ 0.3f + 0.7f * unit(random), 0.3f + 0.7f * unit(random), 0.3f + 0.7f * unit(random), 1.0f };
+    }
+    ParallelSceneHeader header{ };
+    std::memcpy(header.magic, scene_magic, sizeof(scene_magic));
+    header.boxes_count = static_cast<std::uint32_t>(boxes_count);
+    const auto output = std::fopen(scene_path, "wb");
+    const auto written = output != nullptr
+        && std::fwrite(&header, sizeof(header), 1, output) == 1
+        && std::fwrite(boxes.data(), sizeof(ParallelSceneBox), boxes.size(), output) == boxes.size();
+    if (output != nullptr)
+    {
+        std::fclose(output);
+    }
+    return written;
+}
+
+// The camera circles around the field, so that every frame is different.
+static glm::mat4 calculate_view_projection(const std::uint32_t frame)
+{
+    const auto angle = 0.02f * static_cast<float>(frame);
+    const glm::vec3 eye{ 60.0f * std::cos(angle), 25.0f, 60.0f * std::sin(angle) };
+    const auto view = glm::lookAt(eye, glm::vec3{ 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f });
+    const auto projection = glm::perspective(glm::radians(45.0f), static_cast<float>(image_width) / static_cast<float>(image_height), 1.0f, 200.0f);
+    return projection * view;
+}
+
+// Rows [first, first + count) of the image (from the bottom, like OpenGL) that the worker renders in sort-first mode.
+static void calculate_strip(const std::size_t worker, const std::size_t workers_count, int& first, int& count)
+{
+    first = static_cast<int>(worker * image_height / workers_count);
+    count = static_cast<int>((worker + 1) * image_height / workers_count) - first;
+}
+
+#if !defined(_WIN32)
+
+// Body of a worker process. It never returns, the process exits at the end.
+[[noreturn]] static void run_worker(const std::size_t worker, const std::size_t workers_count, const ParallelRenderMode mode,
+    const MappedFile& scene, std::byte* const shared)
+{
+    auto& control = *reinterpret_cast<ParallelControl*>(shared);
+    const auto fail = [&control](const char* message)
+        {
+            std::cout << "Parallel rendering: worker failed: " << message << std::endl;
+            control.failed.fetch_add(1, std::memory_order_release);
+            // _exit, because the process is a copy of the parent, whose exit handlers must run only once.
+            _exit(1);
+        };
+
+    // The window is never shown, it only owns the context.
+    if (!glfwInit())
+    {
+        fail("can't initialize GLFW");
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    const auto window = glfwCreateWindow(16, 16, "Worker", nullptr, nullptr);
+    if (window == nullptr)
+    {
+        fail("can't create a window");
+    }
+    glfwMakeContextCurrent(window);
+    if (gladLoadGL(glfwGetProcAddress) == 0)
+    {
+        fail("can't load OpenGL");
+    }
+
+    // Sort-first renders a strip with all boxes, sort-last renders the whole image with a contiguous share of boxes.
+    int strip_first = 0;
+    int target_height = image_height;
+    std::size_t box_first = 0;
+    std::size_t box_count = boxes_count;
+    if (mode == ParallelRenderMode::sort_first)
+    {
+        calculate_strip(worker, workers_count, strip_first, target_height);
+    }
+    else
+    {
+        box_first = worker * boxes_count / workers_count;
+        box_count = (worker + 1) * boxes_count / workers_count - box_first;
+    }
+
+    unsigned rbo_color, rbo_depth, fbo;
+    glGenRenderbuffers(1, &rbo_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, image_width, target_height);
+    glGenRenderbuffers(1, &rbo_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, image_width, target_height);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fail("framebuffer is incomplete");
+    }
+
+    // A unit cube (+-1), 6 faces of 2 triangles, a position and a normal per vertex.
+    std::vector<float> cube;
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        for (const auto side : { -1.0f, 1.0f })
+        {
+            glm::vec3 normal{ 0.0f };
+            normal[axis] = side;
+            glm::vec3 u{ 0.0f };
+            u[(axis + 1) % 3] = 1.0f;
+            glm::vec3 v{ 0.0f };
+            v[(axis + 2) % 3] = 1.0f;
+            const glm::vec2 corners[6] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, -1 }, { 1, 1 }, { -1, 1 } };
+            for (const auto& corner : corners)
+            {
+                const auto position = normal + corner.x * u + corner.y * v;
+                cube.insert(cube.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+            }
+        }
+    }
+    unsigned vbo_cube, vbo_boxes, vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo_cube);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_cube);
+    glBufferData(GL_ARRAY_BUFFER, cube.size() * sizeof(float), cube.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), nullptr);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), reinterpret_cast<void*>(3 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    // Boxes are uploaded straight from the mapped file, nothing is copied on CPU.
+    const auto boxes = reinterpret_cast<const ParallelSceneBox*>(scene.data + sizeof(ParallelSceneHeader));
+    glGenBuffers(1, &vbo_boxes);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_boxes);
+    glBufferData(GL_ARRAY_BUFFER, box_count * sizeof(ParallelSceneBox), boxes + box_first, GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ParallelSceneBox), reinterpret_cast<void*>(offsetof(ParallelSceneBox, center_size)));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ParallelSceneBox), reinterpret_cast<void*>(offsetof(ParallelSceneBox, color)));
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(2, 1);
+    glVertexAttribDivisor(3, 1);
+    const auto shader_program = create_program(shader_vertex_source, shader_fragment_source, "parallel render program");
+
+    auto* const image = reinterpret_cast<unsigned char*>(shared + image_offset);
+    auto* const slot = shared + image_offset + pixels_count * 4 + worker * slot_bytes;
+    glEnable(GL_DEPTH_TEST);
+    // The viewport is the whole image shifted down by the first row of the strip, and the framebuffer is only
+    // as tall as the strip. Window coordinates differ from the full image by a whole number of pixels,
+    // so pixels are rasterized exactly as in the full image, and strips have no seams.
+    glViewport(0, -strip_first, image_width, image_height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    std::uint32_t frame_rendered = 0;
+    while (true)
+    {
+        // Frames are rare compared to the time of a spin, so yielding is enough.
+        std::uint32_t frame = 0;
+        while ((frame = control.frame.load(std::memory_order_acquire)) == frame_rendered && control.quit.load(std::memory_order_acquire) == 0)
+        {
+            std::this_thread::yield();
+        }
+        if (control.quit.load(std::memory_order_acquire) != 0)
+        {
+            break;
+        }
+
+        const auto time_start = std::chrono::steady_clock::now();
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        use_program(shader_program);
+        const auto view_projection = calculate_view_projection(frame);
+        glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+        bind_vertex_array(vao);
+        draw_arrays_instanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(box_count));
+        // Reading back waits until the frame is rendered.
+        if (mode == ParallelRenderMode::sort_first)
+        {
+            glReadPixels(0, 0, image_width, target_height, GL_RGBA, GL_UNSIGNED_BYTE, image + static_cast<std::size_t>(strip_first) * image_width * 4);
+        }
+        else
+        {
+            glReadPixels(0, 0, image_width, image_height, GL_RGBA, GL_UNSIGNED_BYTE, slot);
+            glReadPixels(0, 0, image_width, image_height, GL_DEPTH_COMPONENT, GL_FLOAT, slot + pixels_count * 4);
+        }
+        control.render_ms[worker] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+        control.done[worker].store(frame, std::memory_order_release);
+        frame_rendered = frame;
+    }
+
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &vbo_boxes);
+    glDeleteBuffers(1, &vbo_cube);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo_depth);
+    glDeleteRenderbuffers(1, &rbo_color);
+    glfwTerminate();
+    _exit(0);
+}
+
+// Keeps the closest pixel of all workers, rows are split between threads.
+static void composite_sort_last(std::byte* const shared, const std::size_t workers_count)
+{
+    auto* const image = reinterpret_cast<std::uint32_t*>(shared + image_offset);
+    const auto slots = shared + image_offset + pixels_count * 4;
+    const auto threads_count = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    const auto composite_rows = [&](const std::size_t row_first, const std::size_t row_end)
+        {
+            for (auto i = row_first * image_width; i != row_end * image_width; ++i)
+            {
+                auto depth_best = 2.0f;
+                std::uint32_t color_best = 0;
+                for (std::size_t worker = 0; worker != workers_count; ++worker)
+                {
+                    const auto slot = slots + worker * slot_bytes;
+                    const auto depth = reinterpret_cast<const float*>(slot + pixels_count * 4)[i];
+                    if (depth < depth_best)
+                    {
+                        depth_best = depth;
+                        color_best = reinterpret_cast<const std::uint32_t*>(slot)[i];
+                    }
+                }
+                image[i] = color_best;
+            }
+        };
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count);
+    for (std::size_t t = 0; t != threads_count; ++t)
+    {
+        threads.emplace_back(composite_rows, t * image_height / threads_count, (t + 1) * image_height / threads_count);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Binary PPM, rows from the top, which is the reverse of OpenGL.
+static void write_image(const unsigned char* const image)
+{
+    const auto output = std::fopen(image_path, "wb");
+    if (output == nullptr)
+    {
+        std::cout << "Parallel rendering: can't write " << image_path << std::endl;
+        return;
+    }
+    std::fprintf(output, "P6\n%d %d\n255\n", image_width, image_height);
+    std::vector<unsigned char> row(static_cast<std::size_t>(image_width) * 3);
+    for (auto y = image_height; y-- != 0;)
+    {
+        for (std::size_t x = 0; x != static_cast<std::size_t>(image_width); ++x)
+        {
+            const auto pixel = image + (static_cast<std::size_t>(y) * image_width + x) * 4;
+            row[3 * x] = pixel[0];
+            row[3 * x + 1] = pixel[1];
+            row[3 * x + 2] = pixel[2];
+        }
+        std::fwrite(row.data(), 1, row.size(), output);
+    }
+    std::fclose(output);
+}
+
+bool parallel_render_benchmark(const std::size_t workers_count_requested, const ParallelRenderMode mode)
+{
+    const auto workers_count = std::clamp<std::size_t>(workers_count_requested, 1, parallel_render_workers_max);
+    const auto mode_name = mode == ParallelRenderMode::sort_first ? "sort-first" : "sort-last";
+
+    MappedFile scene;
+    if (!write_scene() || !scene.open(scene_path) || scene.size != sizeof(ParallelSceneHeader) + boxes_count * sizeof(ParallelSceneBox))
+    {
+        std::cout << "Parallel rendering: can't write the scene to " << scene_path << std::endl;
+        return false;
+    }
+
+    SharedMemory shared;
+    const auto shared_size = image_offset + pixels_count * 4 + (mode == ParallelRenderMode::sort_last ? workers_count * slot_bytes : 0);
+    const auto shared_name = "/GraphicsTransforms-parallel-" + std::to_string(getpid());
+    if (!shared.create(shared_name.c_str(), shared_size))
+    {
+        std::cout << "Parallel rendering: can't create " << shared_size / (1024 * 1024) << " MB of shared memory" << std::endl;
+        return false;
+    }
+    auto& control = *new (shared.data) ParallelControl{ };
+
+    // Anything buffered would be printed by every child too.
+    std::cout.flush();
+    std::vector<pid_t> workers;
+    for (std::size_t worker = 0; worker != workers_count; ++worker)
+    {
+        const auto pid = fork();
+        if (pid == 0)
+        {
+            run_worker(worker, workers_count, mode, scene, shared.data);
+        }
+        if (pid < 0)
+        {
+            std::cout << "Parallel rendering: can't fork a worker" << std::endl;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    // Returns false if a worker failed or exited, otherwise waits until all of them render the frame.
+    // A worker that is killed by a signal can't report the failure, so the awaited worker is polled too.
+    const auto render_frame = [&](const std::uint32_t frame)
+        {
+            control.frame.store(frame, std::memory_order_release);
+            for (std::size_t worker = 0; worker != workers_count; ++worker)
+            {
+                while (control.done[worker].load(std::memory_order_acquire) != frame)
+                {
+                    if (control.failed.load(std::memory_order_acquire) != 0)
+                    {
+                        return false;
+                    }
+                    if (waitpid(workers[worker], nullptr, WNOHANG) == workers[worker])
+                    {
+                        std::cout << "Parallel rendering: worker " << worker << " exited unexpectedly" << std::endl;
+                        // It's reaped already, its pid may be reused.
+                        workers[worker] = 0;
+                        return false;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+            return true;
+        };
+
+    // The first frame isn't measured, workers create their contexts and compile shaders during it.
+    auto succeeded = workers.size() == workers_count && render_frame(1);
+    double frames_ms = 0.0;
+    double render_ms_max = 0.0;
+    double render_ms_min = 0.0;
+    double composite_ms = 0.0;
+    for (std::uint32_t frame = 2; succeeded && frame != frames_count + 2; ++frame)
+    {
+        const auto time_start = std::chrono::steady_clock::now();
+        succeeded = render_frame(frame);
+        const auto time_rendered = std::chrono::steady_clock::now();
+        if (mode == ParallelRenderMode::sort_last)
+        {
+            composite_sort_last(shared.data, workers_count);
+        }
+        const auto time_end = std::chrono::steady_clock::now();
+        frames_ms += std::chrono::duration<double, std::milli>(time_end - time_start).count();
+        composite_ms += std::chrono::duration<double, std::milli>(time_end - time_rendered).count();
+        const auto render_ms = std::minmax_element(control.render_ms, control.render_ms + workers_count);
+        render_ms_min += *render_ms.first;
+        render_ms_max += *render_ms.second;
+    }
+
+    control.quit.store(1, std::memory_order_release);
+    for (const auto pid : workers)
+    {
+        if (pid == 0)
+        {
+            continue;
+        }
+        if (!succeeded)
+        {
+            kill(pid, SIGTERM);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+
+    if (succeeded)
+    {
+        const auto frames = static_cast<double>(frames_count);
+        std::cout << "Parallel rendering, " << mode_name << ", " << workers_count << " workers, "
+            << image_width << 'x' << image_height << ", " << boxes_count << " boxes: "
+            << 1000.0 * frames / frames_ms << " frames/s, workers render " << render_ms_min / frames << " to " << render_ms_max / frames << " ms"
+            << ", composite " << composite_ms / frames << " ms" << std::endl;
+        write_image(reinterpret_cast<const unsigned char*>(shared.data + image_offset));
+    }
+    else
+    {
+        std::cout << "Parallel rendering: workers failed" << std::endl;
+    }
+    shared.close();
+    return succeeded;
+}
+
+#else
+
+bool parallel_render_benchmark(const std::size_t, const ParallelRenderMode)
+{
+    std::cout << "Parallel rendering needs fork, which isn't available on Windows" << std::endl;
+    return false;
+}
+
+#endif
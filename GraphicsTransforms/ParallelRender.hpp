@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <cstddef>
+
+// How the work of a frame is split between worker processes.
+enum struct ParallelRenderMode
+{
+    // Each worker renders all objects into its own horizontal strip of the screen,
+    // and reads it back right into its place of the final image, so compositing is free.
+    // Workers are busy unevenly when objects cover the screen unevenly.
+    sort_first,
+    // Each worker renders its share of objects into the whole screen with depth,
+    // and the compositor keeps the closest of their pixels. Work is split evenly, but compositing costs
+    // a pass over the images of all workers.
+    sort_last,
+};
+
+// The maximum count of worker processes.
+inline constexpr std::size_t parallel_render_workers_max{ 64 };
+
+// Renders frames of a field of boxes with workers_count worker processes and prints frames per second,
+// time of the slowest worker and time of compositing. The scene is written into a file, and every worker
+// maps it read-only, so all of them share the same pages. Workers have their own OpenGL contexts
+// and return their pixels through shared memory. The last frame is saved to parallel_render.ppm,
+// so that results of different modes and counts of workers can be compared.
+// Workers are forked, so it has to be called before GLFW is initialized. Returns false on failure
+// (always on Windows, which can't fork).
+bool parallel_render_benchmark(std::size_t workers_count, ParallelRenderMode mode);
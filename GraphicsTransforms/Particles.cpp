@@ -0,0 +1,234 @@
+﻿#include "Particles.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+// Simulation shader. Outputs are captured into the other buffer by transform feedback.
+// Dead and just born particles are (re)spawned at the emitter with a random velocity inside a cone.
+// GLSL 3.30 has no random number generator, so PCG hash of the particle index and the frame seed is used.
+static const auto shader_vertex_simulate_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec4 aPositionAge;
+layout (location = 1) in vec4 aVelocityLifetime;
+out vec4 outPositionAge;
+out vec4 outVelocityLifetime;
+uniform float time_delta;
+uniform uint seed;
+uniform vec3 emitter;
+uniform vec3 gravity;
+uint hash(uint x)
+{
+    uint state = x * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state) * (1.0 / 4294967295.0);
+}
+void main()
+{
+    vec3 position = aPositionAge.xyz;
+    float age = aPositionAge.w + time_delta;
+    vec3 velocity = aVelocityLifetime.xyz;
+    float lifetime = aVelocityLifetime.w;
+    bool born = aPositionAge.w < 0.0 && age >= 0.0;
+    if (born || age >= lifetime)
+    {
+        uint state = hash(uint(gl_VertexID) ^ seed);
+        float angle = random(state) * 6.2831853;
+        float spread = random(state) * 0.35;
+        float speed = 2.5 + random(state);
+        velocity = speed * normalize(vec3(cos(angle) * spread, 1.0, sin(angle) * spread));
+        position = emitter;
+        age = born ? age : age - lifetime;
+    }
+    else if (age >= 0.0)
+    {
+        velocity += gravity * time_delta;
+        position += velocity * time_delta;
+    }
+    outPositionAge = vec4(position, age);
+    outVelocityLifetime = vec4(velocity, lifetime);
+}
+)SHADER_SOURCE";
+
+// Billboard shader. The corners are ordered the same way as vertices_quad.
+// Particles that are not born yet are collapsed into a point outside of the clip space,
+// so their triangles are discarded.
+static const auto shader_vertex_render_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec4 aPositionAge;
+layout (location = 1) in vec4 aVelocityLifetime;
+out vec2 vCorner;
+out float vLife;
+uniform mat4 view_projection;
+uniform vec3 camera_right;
+uniform vec3 camera_up;
+uniform float size;
+const vec2 corners[6] = vec2[6](
+    vec2(-0.5, -0.5),
+    vec2(0.5, -0.5),
+    vec2(-0.5, 0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5),
+    vec2(0.5, -0.5)
+);
+void main()
+{
+    vLife = aPositionAge.w / aVelocityLifetime.w;
+    vCorner = corners[gl_VertexID];
+    if (vLife < 0.0)
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+    vec3 position = aPositionAge.xyz + (camera_right * vCorner.x + camera_up * vCorner.y) * size;
+    gl_Position = view_projection * vec4(position, 1.0);
+}
+)SHADER_SOURCE";
+
+// Round soft particle that fades from yellow to red over its life.
+static const auto shader_fragment_render_source = R"SHADER_SOURCE(#version 330 core
+in vec2 vCorner;
+in float vLife;
+out vec4 FragColor;
+void main()
+{
+    float r = length(vCorner) * 2.0;
+    if (r > 1.0)
+    {
+        discard;
+    }
+    float intensity = (1.0 - r) * (1.0 - vLife) * 0.5;
+    vec3 color = mix(vec3(1.0, 0.9, 0.3), vec3(1.0, 0.2, 0.05), vLife);
+    FragColor = vec4(color * intensity, 1.0);
+}
+)SHADER_SOURCE";
+
+void Particles::init()
+{
+    glGenBuffers(2, vbos);
+    glGenVertexArrays(2, vaos_simulate);
+    glGenVertexArrays(2, vaos_render);
+    for (std::size_t i = 0; i != 2; ++i)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
+
+        glBindVertexArray(vaos_simulate[i]);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), reinterpret_cast<void*>(offsetof(Particle, position_age)));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), reinterpret_cast<void*>(offsetof(Particle, velocity_lifetime)));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(vaos_render[i]);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), reinterpret_cast<void*>(offsetof(Particle, position_age)));
+        glEnableVertexAttribArray(0);
+        glVertexAttribDivisor(0, 1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), reinterpret_cast<void*>(offsetof(Particle, velocity_lifetime)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+    }
+
+    const char* const varyings[2] = { "outPositionAge", "outVelocityLifetime" };
+    shader_program_simulate = create_program_transform_feedback(shader_vertex_simulate_source, varyings, 2, "particles simulate program");
+    shader_program_render = create_program(shader_vertex_render_source, shader_fragment_render_source, "particles render program");
+
+    seed = 0;
+    gpu_timer_simulate.init();
+    gpu_timer_render.init();
+
+    generate(count_initial);
+}
+
+void Particles::destroy()
+{
+    gpu_timer_render.destroy();
+    gpu_timer_simulate.destroy();
+    glDeleteProgram(shader_program_render);
+    glDeleteProgram(shader_program_simulate);
+    glDeleteVertexArrays(2, vaos_render);
+    glDeleteVertexArrays(2, vaos_simulate);
+    glDeleteBuffers(2, vbos);
+}
+
+void Particles::generate(const std::size_t count_new)
+{
+    count = count_new;
+    current = 0;
+
+    // Particles are born one after another, so that the fountain flows steadily from the start.
+    // Lifetimes are random, so that they don't die in waves.
+    std::mt19937 random{ 42 };
+    std::uniform_real_distribution<float> lifetime_distribution{ 1.5f, 2.5f };
+    std::vector<Particle> particles(count);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const auto lifetime = lifetime_distribution(random);
+        const auto birth = -2.5f * static_cast<float>(i) / static_cast<float>(count);
+        particles[i] = Particle{
+            .position_age = glm::vec4{ 0.0f, 0.0f, 0.0f, birth },
+            .velocity_lifetime = glm::vec4{ 0.0f, 0.0f, 0.0f, lifetime },
+        };
+    }
+    // Both buffers are written by GPU every frame, GL_DYNAMIC_COPY hints that.
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(Particle), particles.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(Particle), nullptr, GL_DYNAMIC_COPY);
+}
+
+void Particles::simulate(const float time_delta_s)
+{
+    // A long frame (for example, while the window is dragged) would throw particles far away.
+    const auto time_delta = std::min(time_delta_s, 0.05f);
+    const auto next = 1 - current;
+    ++seed;
+
+    gpu_timer_simulate.begin();
+    use_program(shader_program_simulate);
+    glUniform1f(glGetUniformLocation(shader_program_simulate, "time_delta"), time_delta);
+    glUniform1ui(glGetUniformLocation(shader_program_simulate, "seed"), seed * 2654435761u);
+    glUniform3f(glGetUniformLocation(shader_program_simulate, "emitter"), 0.0f, -1.0f, -3.0f);
+    glUniform3f(glGetUniformLocation(shader_program_simulate, "gravity"), 0.0f, -3.0f, 0.0f);
+
+    bind_vertex_array(vaos_simulate[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbos[next]);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    draw_arrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    gpu_timer_simulate.end();
+
+    current = next;
+}
+
+void Particles::render(const glm::mat4& view, const glm::mat4& projection)
+{
+    const auto view_projection = projection * view;
+    // Rows of the view matrix are camera's right, up and back vectors in world space.
+    const glm::vec3 camera_right{ view[0][0], view[1][0], view[2][0] };
+    const glm::vec3 camera_up{ view[0][1], view[1][1], view[2][1] };
+
+    gpu_timer_render.begin();
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    use_program(shader_program_render);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_render, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    glUniform3fv(glGetUniformLocation(shader_program_render, "camera_right"), 1, glm::value_ptr(camera_right));
+    glUniform3fv(glGetUniformLocation(shader_program_render, "camera_up"), 1, glm::value_ptr(camera_up));
+    glUniform1f(glGetUniformLocation(shader_program_render, "size"), 0.02f);
+    bind_vertex_array(vaos_render[current]);
+    draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(count));
+
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    gpu_timer_render.end();
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+// State of one particle. It lives only on GPU, this struct just describes the layout.
+struct Particle
+{
+    // xyz is the position in world space, w is the age in seconds.
+    // Negative age means the particle is not born yet.
+    glm::vec4 position_age;
+    // xyz is the velocity, w is the lifetime in seconds.
+    glm::vec4 velocity_lifetime;
+};
+
+// A fountain of particles that is simulated and rendered entirely on GPU.
+//
+// Simulation is done with transform feedback: a vertex shader is run once per particle
+// (as if particles were points), it reads the state of the particle from one buffer,
+// integrates it, and the output is captured into another buffer. Rasterization is disabled.
+// Next frame, the buffers are swapped (so-called ping-pong).
+// This way, the state never travels between CPU and GPU.
+//
+// Particles are rendered as camera-facing quads (billboards) with one instanced draw call.
+// Each instance is a particle, and 6 vertices of the instance are the corners of the quad,
+// calculated from gl_VertexID. The quad is spanned by right and up vectors of the camera,
+// so it always faces the viewer.
+// Blending is additive, so the order of particles doesn't matter.
+struct Particles
+{
+    static constexpr std::size_t count_max{ std::size_t{ 1 } << 22 };
+    static constexpr std::size_t count_initial{ std::size_t{ 1 } << 20 };
+
+    std::size_t count;
+
+    // Ping-pong buffers with particle states, current is the index of the latest one.
+    unsigned vbos[2];
+    std::size_t current;
+    // vaos_simulate[i] reads vbos[i] per vertex, vaos_render[i] reads vbos[i] per instance.
+    unsigned vaos_simulate[2], vaos_render[2];
+
+    unsigned shader_program_simulate, shader_program_render;
+
+    // Changes every frame, so that respawned particles get different random velocities.
+    unsigned seed;
+
+    GpuTimer gpu_timer_simulate, gpu_timer_render;
+
+    void init();
+    void destroy();
+
+    // Recreates the buffers for count particles, all of them not born yet.
+    void generate(std::size_t count);
+
+    void simulate(float time_delta_s);
+    void render(const glm::mat4& view, const glm::mat4& projection);
+
+    // Size of both buffers.
+    std::size_t gpu_memory_bytes() const
+    {
+        return 2 * count * sizeof(Particle);
+    }
+};
@@ -0,0 +1,194 @@
+﻿#include "PrototypeGroups.hpp"
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Quads are (+-0.5, +-0.5, 0), as in the main scene.
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (std140) uniform Members
+{
+    mat4 member_models[8];
+    vec4 member_colors[8];
+};
+uniform samplerBuffer group_models;
+uniform mat4 view_projection;
+uniform int group_first;
+uniform int member_first;
+out vec3 vColor;
+const vec2 corners[6] = vec2[6](
+    vec2(-0.5, -0.5),
+    vec2(0.5, -0.5),
+    vec2(-0.5, 0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5),
+    vec2(0.5, -0.5)
+);
+void main()
+{
+    int member = member_first + gl_VertexID / 6;
+    // A matrix takes 4 texels, a column per texel.
+    int texel = (group_first + gl_InstanceID) * 4;
+    mat4 group_model = mat4(
+        texelFetch(group_models, texel),
+        texelFetch(group_models, texel + 1),
+        texelFetch(group_models, texel + 2),
+        texelFetch(group_models, texel + 3));
+    gl_Position = view_projection * group_model * member_models[member] * vec4(corners[gl_VertexID % 6], 0.0, 1.0);
+    vColor = member_colors[member].rgb;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// The uniform block is always bound to this binding point.
+static constexpr unsigned members_binding{ 0 };
+
+void PrototypeGroups::init()
+{
+    // Groups are turned randomly around the vertical axis, and sorted by prototype.
+    std::mt19937 random{ 11 };
+    std::uniform_real_distribution<float> angle{ 0.0f, glm::radians(360.0f) };
+    std::vector<glm::mat4> groups[prototypes_count];
+    const auto offset = -0.5f * group_spacing * static_cast<float>(groups_per_side - 1);
+    for (std::size_t z = 0; z != groups_per_side; ++z)
+    {
+        for (std::size_t x = 0; x != groups_per_side; ++x)
+        {
+            const glm::vec3 position{
+                offset + group_spacing * static_cast<float>(x),
+                groups_height,
+                offset + group_spacing * static_cast<float>(z),
+            };
+            auto model = glm::translate(glm::mat4{ 1.0f }, position);
+            model = glm::rotate(model, angle(random), { 0.0f, 1.0f, 0.0f });
+            groups[(x + z) % prototypes_count].push_back(model);
+        }
+    }
+    std::vector<glm::mat4> instances;
+    instances.reserve(groups_count);
+    for (std::size_t p = 0; p != prototypes_count; ++p)
+    {
+        prototype_groups_first[p] = instances.size();
+        prototype_groups_count[p] = groups[p].size();
+        instances.insert(instances.end(), groups[p].begin(), groups[p].end());
+    }
+
+    // Colors of the quads of the main scene.
+    members = { };
+    const auto first_triplet = members_first[static_cast<std::size_t>(Prototype::triplet_corner)];
+    members.colors[first_triplet + 0] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    members.colors[first_triplet + 1] = { 1.0f, 0.0f, 0.0f, 1.0f };
+    members.colors[first_triplet + 2] = { 0.0f, 1.0f, 0.0f, 1.0f };
+    const auto first_pair = members_first[static_cast<std::size_t>(Prototype::pair_rig)];
+    members.colors[first_pair + 0] = { 1.0f, 0.0f, 0.0f, 1.0f };
+    members.colors[first_pair + 1] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+    glGenVertexArrays(1, &vao);
+
+    glGenBuffers(1, &tbo_groups);
+    glBindBuffer(GL_TEXTURE_BUFFER, tbo_groups);
+    glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(glm::mat4), instances.data(), GL_STATIC_DRAW);
+    glGenTextures(1, &texture_groups);
+    glBindTexture(GL_TEXTURE_BUFFER, texture_groups);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, tbo_groups);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenBuffers(1, &ubo_members);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo_members);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(MembersBlock), &members, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    shader_program = create_program(shader_vertex_source, shader_fragment_source, "prototype groups program");
+    glUniformBlockBinding(shader_program, glGetUniformBlockIndex(shader_program, "Members"), members_binding);
+    gpu_timer.init();
+
+    const float angles[2] = { 0.0f, 0.0f };
+    update(angles, 0.0f);
+}
+
+void PrototypeGroups::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &ubo_members);
+    glDeleteTextures(1, &texture_groups);
+    glDeleteBuffers(1, &tbo_groups);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void PrototypeGroups::update(const float pair_angles[2], const float triplet_angle)
+{
+    // The triplet forms a corner of a cube centered at the origin of the group,
+    // and turns around the vertical axis as a whole.
+    constexpr float triplet_rotation_angles[3] = {
+        glm::radians(-90.0f),
+        glm::radians(90.0f),
+        0.0f,
+    };
+    constexpr glm::vec3 triplet_rotation_axes[3] = {
+        { 1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f },
+    };
+    const auto first_triplet = members_first[static_cast<std::size_t>(Prototype::triplet_corner)];
+    const auto triplet_base = glm::rotate(glm::mat4{ 1.0f }, triplet_angle, { 0.0f, 1.0f, 0.0f });
+    for (std::size_t i = 0; i != 3; ++i)
+    {
+        auto model = glm::rotate(triplet_base, triplet_rotation_angles[i], triplet_rotation_axes[i]);
+        members.models[first_triplet + i] = glm::translate(model, { 0.0f, 0.0f, 0.5f });
+    }
+
+    // The second quad of the pair is attached to the edge of the first one, see the main scene.
+    // The pair is shifted to have the shared edge at the origin of the group.
+    constexpr glm::vec3 pair_translations[2] = {
+        { -0.5f, 0.0f, 0.0f },
+        { 1.0f, 0.0f, 0.0f },
+    };
+    constexpr glm::vec3 pair_rotation_axes[2] = {
+        { 0.0f, 0.0f, 1.0f },
+        { 1.0f, 0.0f, 0.0f },
+    };
+    const auto first_pair = members_first[static_cast<std::size_t>(Prototype::pair_rig)];
+    auto model = glm::mat4{ 1.0f };
+    for (std::size_t i = 0; i != 2; ++i)
+    {
+        model = glm::translate(model, pair_translations[i]);
+        model = glm::rotate(model, pair_angles[i], pair_rotation_axes[i]);
+        members.models[first_pair + i] = model;
+    }
+
+    // Only matrices change, colors are uploaded once in init().
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo_members);
+    buffer_sub_data(GL_UNIFORM_BUFFER, offsetof(MembersBlock, models), sizeof(members.models), members.models);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void PrototypeGroups::render(const glm::mat4& view_projection)
+{
+    gpu_timer.begin();
+    use_program(shader_program);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    glUniform1i(glGetUniformLocation(shader_program, "group_models"), 0);
+    bind_texture_buffer(GL_TEXTURE0, texture_groups);
+    glBindBufferBase(GL_UNIFORM_BUFFER, members_binding, ubo_members);
+    bind_vertex_array(vao);
+    for (std::size_t p = 0; p != prototypes_count; ++p)
+    {
+        glUniform1i(glGetUniformLocation(shader_program, "group_first"), static_cast<GLint>(prototype_groups_first[p]));
+        glUniform1i(glGetUniformLocation(shader_program, "member_first"), static_cast<GLint>(members_first[p]));
+        draw_arrays_instanced(GL_TRIANGLES, 0, static_cast<GLsizei>(6 * members_count[p]), static_cast<GLsizei>(prototype_groups_count[p]));
+    }
+    gpu_timer.end();
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+// Groups of quads that repeat across the scene (the triplet corner and the pair rig), instanced as a whole.
+//
+// Flattening every group into per-quad instances would store a matrix per quad. Instead, a group instance
+// stores one matrix, and members of a prototype store their local matrices once, in a uniform block.
+// The vertex shader composes them: the group matrix is fetched from a buffer texture by gl_InstanceID,
+// and the member matrix from the uniform block by gl_VertexID / 6. So, instance data takes
+// groups × 1 matrix instead of groups × members, and animating members of a prototype updates only
+// its few matrices, no matter how many groups there are.
+// Instances are sorted by prototype, so each prototype is one instanced draw call.
+struct PrototypeGroups
+{
+    enum struct Prototype
+    {
+        triplet_corner,
+        pair_rig,
+        count,
+    };
+    static constexpr std::size_t prototypes_count{ static_cast<std::size_t>(Prototype::count) };
+
+    // Members of prototype p are members_first[p], ..., members_first[p] + members_count[p] - 1.
+    static constexpr std::size_t members_first[prototypes_count] = { 0, 3 };
+    static constexpr std::size_t members_count[prototypes_count] = { 3, 2 };
+    static constexpr std::size_t members_max{ 8 };
+
+    // Groups stand on a square grid under the rest of the scene, prototypes alternate as on a checkerboard.
+    static constexpr std::size_t groups_per_side{ 64 };
+    static constexpr std::size_t groups_count{ groups_per_side * groups_per_side };
+    static constexpr float group_spacing{ 3.0f };
+    static constexpr float groups_height{ -2.0f };
+
+    // Layout of the uniform block (std140), matrices of all members and then their colors.
+    struct MembersBlock
+    {
+        glm::mat4 models[members_max];
+        glm::vec4 colors[members_max];
+    };
+
+    MembersBlock members;
+    // Instances of prototype p are prototype_groups_first[p], ..., prototype_groups_first[p] + prototype_groups_count[p] - 1.
+    std::size_t prototype_groups_first[prototypes_count];
+    std::size_t prototype_groups_count[prototypes_count];
+
+    // Vertices are generated in the shader, but a vertex array has to be bound to draw.
+    unsigned vao;
+    unsigned tbo_groups, texture_groups;
+    unsigned ubo_members;
+    unsigned shader_program;
+
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Poses members the same way as the animated pair and triplet of the main scene.
+    void update(const float pair_angles[2], float triplet_angle);
+    void render(const glm::mat4& view_projection);
+
+    std::size_t quads_count() const
+    {
+        std::size_t count = 0;
+        for (std::size_t p = 0; p != prototypes_count; ++p)
+        {
+            count += prototype_groups_count[p] * members_count[p];
+        }
+        return count;
+    }
+
+    std::size_t instance_bytes() const
+    {
+        return groups_count * sizeof(glm::mat4);
+    }
+
+    // What instance data would take if every member was an instance of its own.
+    std::size_t flattened_bytes() const
+    {
+        return quads_count() * sizeof(glm::mat4);
+    }
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return instance_bytes() + sizeof(MembersBlock);
+    }
+};
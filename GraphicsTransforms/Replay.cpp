@@ -0,0 +1,236 @@
+﻿#include "Replay.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <string>
+
+// Presses the key at the frame and releases it at the next one (like a short tap on the keyboard).
+static void tap(ReplayScenario& scenario, const std::uint32_t frame, const int key)
+{
+    scenario.events.push_back({ frame, key, true });
+    scenario.events.push_back({ frame + 1, key, false });
+}
+
+// Keeps the key pressed from the first frame till the last one (excluding it).
+static void hold(ReplayScenario& scenario, const std::uint32_t first, const std::uint32_t last, const int key)
+{
+    scenario.events.push_back({ first, key, true });
+    scenario.events.push_back({ last, key, false });
+}
+
+// Enables view and projection of the first camera and hides the white quad in front of it,
+// so that the scene is seen through a real camera.
+static void setup_camera(ReplayScenario& scenario)
+{
+    tap(scenario, 1, GLFW_KEY_C);
+    tap(scenario, 3, GLFW_KEY_B);
+    tap(scenario, 5, GLFW_KEY_R);
+}
+
+// Events are added per key, so they are sorted by frame once the scenario is complete.
+// Sorting is stable, so a release and a press of the same key at the same frame stay in order.
+static ReplayScenario& finish(ReplayScenario& scenario)
+{
+    std::stable_sort(scenario.events.begin(), scenario.events.end(),
+        [](const ReplayKeyEvent& lhs, const ReplayKeyEvent& rhs) { return lhs.frame < rhs.frame; });
+    return scenario;
+}
+
+static ReplayScenario make_scenario_scene()
+{
+    ReplayScenario scenario{ "scene", 900, { } };
+    setup_camera(scenario);
+    // Both animations, the corner of the Rubik's cube, pyramids and frustums of the cameras.
+    tap(scenario, 7, GLFW_KEY_I);
+    tap(scenario, 9, GLFW_KEY_K);
+    tap(scenario, 11, GLFW_KEY_L);
+    tap(scenario, 13, GLFW_KEY_M);
+    tap(scenario, 15, GLFW_KEY_COMMA);
+    hold(scenario, 30, 300, GLFW_KEY_S);
+    hold(scenario, 300, 500, GLFW_KEY_A);
+    hold(scenario, 500, 700, GLFW_KEY_W);
+    hold(scenario, 700, 880, GLFW_KEY_D);
+    return finish(scenario);
+}
+
+static ReplayScenario make_scenario_transparency()
+{
+    ReplayScenario scenario{ "transparency", 900, { } };
+    setup_camera(scenario);
+    // Weighted blended OIT while flying back and to the side.
+    tap(scenario, 7, GLFW_KEY_3);
+    hold(scenario, 20, 200, GLFW_KEY_S);
+    hold(scenario, 200, 300, GLFW_KEY_A);
+    // Sorting, with the order changing a bit every frame, then a lot at once.
+    tap(scenario, 300, GLFW_KEY_4);
+    hold(scenario, 310, 500, GLFW_KEY_D);
+    hold(scenario, 500, 600, GLFW_KEY_W);
+    tap(scenario, 600, GLFW_KEY_1);
+    // Bounds of culled quads and frozen culling.
+    tap(scenario, 650, GLFW_KEY_7);
+    tap(scenario, 700, GLFW_KEY_8);
+    hold(scenario, 700, 880, GLFW_KEY_S);
+    return finish(scenario);
+}
+
+static ReplayScenario make_scenario_particles()
+{
+    ReplayScenario scenario{ "particles", 600, { } };
+    setup_camera(scenario);
+    tap(scenario, 7, GLFW_KEY_6);
+    hold(scenario, 20, 300, GLFW_KEY_S);
+    hold(scenario, 300, 580, GLFW_KEY_D);
+    return finish(scenario);
+}
+
+static ReplayScenario make_scenario_everything()
+{
+    ReplayScenario scenario{ "everything", 900, { } };
+    setup_camera(scenario);
+    tap(scenario, 7, GLFW_KEY_I);
+    tap(scenario, 9, GLFW_KEY_K);
+    tap(scenario, 11, GLFW_KEY_L);
+    tap(scenario, 13, GLFW_KEY_3);
+    tap(scenario, 15, GLFW_KEY_4);
+    tap(scenario, 17, GLFW_KEY_6);
+    tap(scenario, 19, GLFW_KEY_9);
+    hold(scenario, 30, 400, GLFW_KEY_S);
+    tap(scenario, 400, GLFW_KEY_7);
+    hold(scenario, 400, 700, GLFW_KEY_A);
+    hold(scenario, 700, 880, GLFW_KEY_W);
+    return finish(scenario);
+}
+
+static const ReplayScenario replay_scenarios[] = {
+    make_scenario_scene(),
+    make_scenario_transparency(),
+    make_scenario_particles(),
+    make_scenario_everything(),
+};
+
+const ReplayScenario* find_replay_scenario(const std::string_view name)
+{
+    for (const auto& scenario : replay_scenarios)
+    {
+        if (name == scenario.name)
+        {
+            return &scenario;
+        }
+    }
+    return nullptr;
+}
+
+const char* replay_scenario_names()
+{
+    // The list of scenarios above is the only one: tools and the build ask the executable for it (--list-replays).
+    static const auto names = []()
+        {
+            std::string names;
+            for (const auto& scenario : replay_scenarios)
+            {
+                names += names.empty() ? "" : " ";
+                names += scenario.name;
+            }
+            return names;
+        }();
+    return names.c_str();
+}
+
+void ReplayPlayer::start(const ReplayScenario& s)
+{
+    scenario = &s;
+    frame = 0;
+    std::fill(std::begin(keys), std::end(keys), false);
+    event_next = 0;
+}
+
+void ReplayPlayer::advance()
+{
+    const auto& events = scenario->events;
+    while (event_next != events.size() && events[event_next].frame <= frame)
+    {
+        keys[events[event_next].key] = events[event_next].press;
+        ++event_next;
+    }
+    ++frame;
+}
+
+bool ReplayPlayer::any_key_pressed() const
+{
+    return std::find(std::begin(keys), std::end(keys), true) != std::end(keys);
+}
+
+std::uint32_t ReplayPlayer::frames_without_events() const
+{
+    const auto& events = scenario->events;
+    if (event_next == events.size())
+    {
+        return std::numeric_limits<std::uint32_t>::max() - frame;
+    }
+    return events[event_next].frame > frame ? events[event_next].frame - frame : 0;
+}
+
+void FastForward::start(const double duration_s)
+{
+    frames_target = static_cast<std::uint64_t>(std::max(duration_s, 0.0) / static_cast<double>(replay_time_step_s) + 0.5);
+    frames = 0;
+    steps = 0;
+    frames_jumped = 0;
+    time_start = std::chrono::steady_clock::now();
+}
+
+void FastForward::advance(const std::uint64_t frames_count)
+{
+    frames += frames_count;
+    ++steps;
+    frames_jumped += frames_count - 1;
+}
+
+void FastForward::report() const
+{
+    const auto elapsed_s = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count(), 1e-9);
+    const auto simulated_s = static_cast<double>(frames) * static_cast<double>(replay_time_step_s);
+    std::cout << "Fast-forward: " << simulated_s << " s (" << frames << " frames) in " << steps << " steps"
+        << " (" << frames_jumped << " frames jumped over), " << elapsed_s << " s"
+        << ", " << static_cast<double>(steps) / elapsed_s << " steps/s"
+        << ", " << simulated_s / elapsed_s << "x real time" << std::endl;
+}
+
+ReplayReport summarize_replay(const std::vector<double>& cpu_ms)
+{
+    ReplayReport report{ };
+    if (cpu_ms.size() <= replay_warmup_frames)
+    {
+        return report;
+    }
+    std::vector<double> sorted(cpu_ms.begin() + replay_warmup_frames, cpu_ms.end());
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&sorted](const double p)
+        {
+            return sorted[static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5)];
+        };
+    report.frames_count = sorted.size();
+    report.cpu_ms_mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size());
+    report.cpu_ms_p50 = percentile(0.5);
+    report.cpu_ms_p95 = percentile(0.95);
+    report.cpu_ms_p99 = percentile(0.99);
+    report.cpu_ms_max = sorted.back();
+    return report;
+}
+
+bool write_replay_report(const char* const path, const char* const scenario_name, const ReplayReport& report)
+{
+    const auto file = std::fopen(path, "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::fprintf(file, "scenario=%s\nframes=%zu\ncpu_ms_mean=%.6f\ncpu_ms_p50=%.6f\ncpu_ms_p95=%.6f\ncpu_ms_p99=%.6f\ncpu_ms_max=%.6f\n",
+        scenario_name, report.frames_count, report.cpu_ms_mean, report.cpu_ms_p50, report.cpu_ms_p95, report.cpu_ms_p99, report.cpu_ms_max);
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <string_view>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+// A key goes down (press) or up (release) at the start of a frame.
+struct ReplayKeyEvent
+{
+    std::uint32_t frame;
+    int key;
+    bool press;
+};
+
+// A scripted session: which keys are pressed on which frames.
+// Replays run with a fixed time step and ignore the mouse, so that every run renders exactly the same frames,
+// which makes them suitable for benchmarks and for training profile-guided optimization.
+struct ReplayScenario
+{
+    const char* name;
+    std::uint32_t frames_count;
+    // Sorted by frame.
+    std::vector<ReplayKeyEvent> events;
+};
+
+// Time step of replays, as if they ran at 60 fps.
+inline constexpr float replay_time_step_s{ 1.0f / 60.0f };
+// The first frames are slower (drivers compile shaders lazily, buffers are allocated),
+// so they aren't included into reports.
+inline constexpr std::size_t replay_warmup_frames{ 30 };
+
+// Returns the scenario with the given name or nullptr.
+const ReplayScenario* find_replay_scenario(std::string_view name);
+// Returns names of all scenarios, separated by spaces.
+const char* replay_scenario_names();
+
+// Feeds key states of a scenario frame by frame.
+struct ReplayPlayer
+{
+    const ReplayScenario* scenario;
+    // Number of frames played so far.
+    std::uint32_t frame;
+
+    void start(const ReplayScenario& s);
+    // Applies the events of the next frame. Called at the start of every frame.
+    void advance();
+    bool finished() const
+    {
+        return frame >= scenario->frames_count;
+    }
+    bool key_pressed(const int key) const
+    {
+        return key >= 0 && key <= GLFW_KEY_LAST && keys[key];
+    }
+    bool any_key_pressed() const;
+    // Count of the next frames that have no events (practically unlimited once events are over).
+    std::uint32_t frames_without_events() const;
+    // Skips frames without applying anything. They must have no events.
+    void skip(const std::uint32_t frames_count)
+    {
+        frame += frames_count;
+    }
+
+private:
+    bool keys[GLFW_KEY_LAST + 1];
+    std::size_t event_next;
+};
+
+// Summary of CPU time of replayed frames (without warm-up frames).
+struct ReplayReport
+{
+    std::size_t frames_count;
+    double cpu_ms_mean;
+    double cpu_ms_p50;
+    double cpu_ms_p95;
+    double cpu_ms_p99;
+    double cpu_ms_max;
+};
+
+// Simulation-only fast-forward: the first frames of a session are simulated with the replay time step
+// as fast as possible, and aren't rendered. It reaches a late frame of a session, or soak-tests hours of animations.
+// When nothing in the scene has to be stepped frame by frame, the following frames (till the next replay event)
+// are jumped over at once, otherwise each frame is a step.
+struct FastForward
+{
+    // Frames to simulate, and frames simulated so far.
+    std::uint64_t frames_target;
+    std::uint64_t frames;
+    // Steps that simulated them, and frames that were jumped over (not stepped).
+    std::uint64_t steps;
+    std::uint64_t frames_jumped;
+    std::chrono::steady_clock::time_point time_start;
+
+    void start(double duration_s);
+    bool active() const
+    {
+        return frames < frames_target;
+    }
+    std::uint64_t frames_remaining() const
+    {
+        return frames_target - frames;
+    }
+    // Counts a step that simulated frames_count frames.
+    void advance(std::uint64_t frames_count);
+    // Prints simulated time, steps per second and how much faster than real time it ran.
+    void report() const;
+};
+
+ReplayReport summarize_replay(const std::vector<double>& cpu_ms);
+// Writes the report as "key=value" lines, which the benchmark script parses.
+bool write_replay_report(const char* path, const char* scenario_name, const ReplayReport& report);
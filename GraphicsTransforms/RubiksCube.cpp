@@ -0,0 +1,286 @@
+﻿#include "RubiksCube.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <initializer_list>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Effect of a move on slots: slot i of the result takes the cubie from slot from[i]
+// and adds orientation[i] to its orientation (modulo 3 for corners, 2 for edges).
+struct CubeMoveTable
+{
+    std::uint8_t corner_from[CubeState::corners_count];
+    std::uint8_t corner_orientation[CubeState::corners_count];
+    std::uint8_t edge_from[CubeState::edges_count];
+    std::uint8_t edge_orientation[CubeState::edges_count];
+};
+
+enum : std::uint8_t { URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB };
+enum : std::uint8_t { UR, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR };
+
+// Quarter turns of the faces, clockwise (from Kociemba's definition of the cube).
+static constexpr CubeMoveTable cube_face_turns[6] = {
+    // U
+    {
+        { UBR, URF, UFL, ULB, DFR, DLF, DBL, DRB },
+        { 0, 0, 0, 0, 0, 0, 0, 0 },
+        { UB, UR, UF, UL, DR, DF, DL, DB, FR, FL, BL, BR },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    },
+    // R
+    {
+        { DFR, UFL, ULB, URF, DRB, DLF, DBL, UBR },
+        { 2, 0, 0, 1, 1, 0, 0, 2 },
+        { FR, UF, UL, UB, BR, DF, DL, DB, DR, FL, BL, UR },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    },
+    // F
+    {
+        { UFL, DLF, ULB, UBR, URF, DFR, DBL, DRB },
+        { 1, 2, 0, 0, 2, 1, 0, 0 },
+        { UR, FL, UL, UB, DR, FR, DL, DB, UF, DF, BL, BR },
+        { 0, 1, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0 },
+    },
+    // D
+    {
+        { URF, UFL, ULB, UBR, DLF, DBL, DRB, DFR },
+        { 0, 0, 0, 0, 0, 0, 0, 0 },
+        { UR, UF, UL, UB, DF, DL, DB, DR, FR, FL, BL, BR },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    },
+    // L
+    {
+        { URF, ULB, DBL, UBR, DFR, UFL, DLF, DRB },
+        { 0, 1, 2, 0, 0, 2, 1, 0 },
+        { UR, UF, BL, UB, DR, DF, FL, DB, FR, UL, DL, BR },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    },
+    // B
+    {
+        { URF, UFL, UBR, DRB, DFR, DLF, ULB, DBL },
+        { 0, 0, 1, 2, 0, 0, 2, 1 },
+        { UR, UF, UL, BR, DR, DF, DL, BL, FR, FL, UB, DB },
+        { 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1 },
+    },
+};
+
+// Composition of moves: applying a and then b.
+static constexpr CubeMoveTable compose(const CubeMoveTable& a, const CubeMoveTable& b)
+{
+    CubeMoveTable result{ };
+    for (std::size_t i = 0; i != CubeState::corners_count; ++i)
+    {
+        result.corner_from[i] = a.corner_from[b.corner_from[i]];
+        result.corner_orientation[i] = static_cast<std::uint8_t>((a.corner_orientation[b.corner_from[i]] + b.corner_orientation[i]) % 3);
+    }
+    for (std::size_t i = 0; i != CubeState::edges_count; ++i)
+    {
+        result.edge_from[i] = a.edge_from[b.edge_from[i]];
+        result.edge_orientation[i] = static_cast<std::uint8_t>((a.edge_orientation[b.edge_from[i]] + b.edge_orientation[i]) % 2);
+    }
+    return result;
+}
+
+// All 18 moves are computed at compile time from the quarter turns.
+static constexpr auto cube_move_tables = []()
+    {
+        std::array<CubeMoveTable, cube_moves_count> tables{ };
+        for (std::size_t face = 0; face != 6; ++face)
+        {
+            tables[3 * face] = cube_face_turns[face];
+            tables[3 * face + 1] = compose(tables[3 * face], cube_face_turns[face]);
+            tables[3 * face + 2] = compose(tables[3 * face + 1], cube_face_turns[face]);
+        }
+        return tables;
+    }();
+
+// New byte of a corner slot for a byte of the source slot (index) and the added orientation (row).
+// Orientation is in bits 4..5, so a byte is less than 64.
+static constexpr auto corner_twist_table = []()
+    {
+        std::array<std::array<std::uint8_t, 64>, 3> table{ };
+        for (std::size_t twist = 0; twist != 3; ++twist)
+        {
+            for (std::size_t byte = 0; byte != 64; ++byte)
+            {
+                const auto orientation = ((byte >> 4) + twist) % 3;
+                table[twist][byte] = static_cast<std::uint8_t>((byte & 0x0f) | (orientation << 4));
+            }
+        }
+        return table;
+    }();
+
+CubeState CubeState::solved()
+{
+    CubeState state{ 0, 0, 0 };
+    for (std::size_t i = 0; i != corners_count; ++i)
+    {
+        state.corners |= std::uint64_t{ i } << (8 * i);
+    }
+    for (std::size_t i = 0; i != edges_count; ++i)
+    {
+        if (i < 8)
+        {
+            state.edges_low |= std::uint64_t{ i } << (8 * i);
+        }
+        else
+        {
+            state.edges_high |= static_cast<std::uint32_t>(i << (8 * (i - 8)));
+        }
+    }
+    return state;
+}
+
+const char* cube_move_name(const std::size_t move)
+{
+    static constexpr const char* names[cube_moves_count] = {
+        "U", "U2", "U'", "R", "R2", "R'", "F", "F2", "F'",
+        "D", "D2", "D'", "L", "L2", "L'", "B", "B2", "B'",
+    };
+    return names[move];
+}
+
+CubeState cube_apply_move(const CubeState& state, const std::size_t move)
+{
+    const auto& table = cube_move_tables[move];
+    // On little-endian machines, byte i of the integer is slot i, so slots are unpacked and packed with memcpy,
+    // and each slot of the result is 2 table lookups and a store.
+    static_assert(std::endian::native == std::endian::little);
+    std::uint8_t corners[CubeState::corners_count];
+    std::uint8_t edges[CubeState::edges_count];
+    std::memcpy(corners, &state.corners, 8);
+    std::memcpy(edges, &state.edges_low, 8);
+    std::memcpy(edges + 8, &state.edges_high, 4);
+    std::uint8_t corners_result[CubeState::corners_count];
+    std::uint8_t edges_result[CubeState::edges_count];
+    for (std::size_t i = 0; i != CubeState::corners_count; ++i)
+    {
+        corners_result[i] = corner_twist_table[table.corner_orientation[i]][corners[table.corner_from[i]]];
+    }
+    // Flipping an edge is XOR of its orientation bit.
+    for (std::size_t i = 0; i != CubeState::edges_count; ++i)
+    {
+        edges_result[i] = static_cast<std::uint8_t>(edges[table.edge_from[i]] ^ (table.edge_orientation[i] << 4));
+    }
+    CubeState result;
+    std::memcpy(&result.corners, corners_result, 8);
+    std::memcpy(&result.edges_low, edges_result, 8);
+    std::memcpy(&result.edges_high, edges_result + 8, 4);
+    return result;
+}
+
+// Facelets of every corner slot, clockwise starting from the U or D facelet.
+static constexpr std::uint8_t corner_facelets[CubeState::corners_count][3] = {
+    { 8, 9, 20 }, { 6, 18, 38 }, { 0, 36, 47 }, { 2, 45, 11 },
+    { 29, 26, 15 }, { 27, 44, 24 }, { 33, 53, 42 }, { 35, 17, 51 },
+};
+// Facelets of every edge slot, starting from the U/D facelet (or F/B for the middle layer).
+static constexpr std::uint8_t edge_facelets[CubeState::edges_count][2] = {
+    { 5, 10 }, { 7, 19 }, { 3, 37 }, { 1, 46 }, { 32, 16 }, { 28, 25 },
+    { 30, 43 }, { 34, 52 }, { 23, 12 }, { 21, 41 }, { 50, 39 }, { 48, 14 },
+};
+// Colors of every corner and edge cubie in the same order as their facelets.
+static constexpr CubeFace corner_colors[CubeState::corners_count][3] = {
+    { CubeFace::up, CubeFace::right, CubeFace::front },
+    { CubeFace::up, CubeFace::front, CubeFace::left },
+    { CubeFace::up, CubeFace::left, CubeFace::back },
+    { CubeFace::up, CubeFace::back, CubeFace::right },
+    { CubeFace::down, CubeFace::front, CubeFace::right },
+    { CubeFace::down, CubeFace::left, CubeFace::front },
+    { CubeFace::down, CubeFace::back, CubeFace::left },
+    { CubeFace::down, CubeFace::right, CubeFace::back },
+};
+static constexpr CubeFace edge_colors[CubeState::edges_count][2] = {
+    { CubeFace::up, CubeFace::right },
+    { CubeFace::up, CubeFace::front },
+    { CubeFace::up, CubeFace::left },
+    { CubeFace::up, CubeFace::back },
+    { CubeFace::down, CubeFace::right },
+    { CubeFace::down, CubeFace::front },
+    { CubeFace::down, CubeFace::left },
+    { CubeFace::down, CubeFace::back },
+    { CubeFace::front, CubeFace::right },
+    { CubeFace::front, CubeFace::left },
+    { CubeFace::back, CubeFace::left },
+    { CubeFace::back, CubeFace::right },
+};
+
+void cube_facelets(const CubeState& state, CubeFace facelets[cube_facelets_count])
+{
+    for (std::size_t face = 0; face != 6; ++face)
+    {
+        facelets[9 * face + 4] = static_cast<CubeFace>(face);
+    }
+    for (std::size_t slot = 0; slot != CubeState::corners_count; ++slot)
+    {
+        const auto byte = state.corner(slot);
+        const auto cubie = byte & 0x0f;
+        const auto orientation = byte >> 4;
+        for (std::size_t n = 0; n != 3; ++n)
+        {
+            facelets[corner_facelets[slot][(n + orientation) % 3]] = corner_colors[cubie][n];
+        }
+    }
+    for (std::size_t slot = 0; slot != CubeState::edges_count; ++slot)
+    {
+        const auto byte = state.edge(slot);
+        const auto cubie = byte & 0x0f;
+        const auto orientation = byte >> 4;
+        for (std::size_t n = 0; n != 2; ++n)
+        {
+            facelets[edge_facelets[slot][(n + orientation) % 2]] = edge_colors[cubie][n];
+        }
+    }
+}
+
+void cube_benchmark()
+{
+    enum : std::size_t { U = 0, R = 3, F = 6, D = 9, L = 12, B = 15 };
+    const auto apply = [](CubeState state, std::initializer_list<std::size_t> moves, const std::size_t repeat)
+        {
+            for (std::size_t i = 0; i != repeat; ++i)
+            {
+                for (const auto move : moves)
+                {
+                    state = cube_apply_move(state, move);
+                }
+            }
+            return state;
+        };
+    const auto solved = CubeState::solved();
+    // R U R' U' has order 6, R U has order 105, and every face turn has order 4.
+    const auto check_sexy = apply(solved, { R, U, R + 2, U + 2 }, 6) == solved;
+    const auto check_ru = apply(solved, { R, U }, 105) == solved && apply(solved, { R, U }, 35) != solved;
+    auto check_faces = true;
+    for (std::size_t face = 0; face != 6; ++face)
+    {
+        check_faces = check_faces && apply(solved, { 3 * face }, 4) == solved && apply(solved, { 3 * face + 1 }, 2) == solved;
+    }
+    std::cout << "Cube engine checks: " << (check_sexy && check_ru && check_faces ? "passed" : "FAILED") << std::endl;
+
+    // Moves are generated beforehand, so that the random number generator isn't measured.
+    std::mt19937 random{ 42 };
+    std::uniform_int_distribution<std::size_t> move_distribution{ 0, cube_moves_count - 1 };
+    std::vector<std::uint8_t> moves(1 << 16);
+    for (auto& move : moves)
+    {
+        move = static_cast<std::uint8_t>(move_distribution(random));
+    }
+    constexpr std::size_t moves_total{ std::size_t{ 1 } << 26 };
+    auto state = solved;
+    const auto time_start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != moves_total; ++i)
+    {
+        state = cube_apply_move(state, moves[i & (moves.size() - 1)]);
+    }
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+    // The state is printed, so that the compiler can't throw the loop away.
+    std::cout << "Cube engine: " << moves_total << " moves in " << seconds << " s, "
+        << static_cast<double>(moves_total) / seconds / 1e6 << " M moves/s (state " << std::hex << state.corners << std::dec << ")" << std::endl;
+}
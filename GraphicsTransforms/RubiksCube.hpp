@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// State of the Rubik's cube on the level of cubies (small cubes), as in Kociemba's two-phase algorithm.
+//
+// Centers never move, so the state is defined by 8 corners and 12 edges.
+// Each corner/edge slot holds some cubie with some orientation:
+// a corner can be twisted 3 ways, an edge can be flipped 2 ways.
+// Every slot is packed into a byte: bits 0..3 are the index of the cubie, bits 4..5 are its orientation.
+// So, all corners fit into one 64-bit integer, and edges into a 64-bit and a 32-bit one.
+//
+// Slots and cubies are named after the faces they touch:
+// corners URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB,
+// edges UR, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR,
+// where U is up (+y), R is right (+x), F is front (+z), D is down, L is left, B is back.
+// The solved cube has cubie i in slot i with orientation 0.
+struct CubeState
+{
+    static constexpr std::size_t corners_count{ 8 };
+    static constexpr std::size_t edges_count{ 12 };
+
+    // Slots 0..7.
+    std::uint64_t corners;
+    // Edge slots 0..7.
+    std::uint64_t edges_low;
+    // Edge slots 8..11.
+    std::uint32_t edges_high;
+
+    static CubeState solved();
+
+    bool operator==(const CubeState&) const = default;
+
+    std::uint8_t corner(const std::size_t slot) const
+    {
+        return static_cast<std::uint8_t>(corners >> (8 * slot));
+    }
+    std::uint8_t edge(const std::size_t slot) const
+    {
+        return slot < 8
+            ? static_cast<std::uint8_t>(edges_low >> (8 * slot))
+            : static_cast<std::uint8_t>(edges_high >> (8 * (slot - 8)));
+    }
+};
+
+// Faces in the order of Kociemba's notation. Also used as sticker colors.
+enum struct CubeFace : std::uint8_t
+{
+    up,
+    right,
+    front,
+    down,
+    left,
+    back,
+};
+
+// Moves are clockwise turns of a face layer (looking at the face) by 90, 180 or 270 degrees:
+// U, U2, U', R, R2, R', F, F2, F', D, D2, D', L, L2, L', B, B2, B'.
+// Move m turns face m / 3 by m % 3 + 1 quarter turns.
+inline constexpr std::size_t cube_moves_count{ 18 };
+
+inline CubeFace cube_move_face(const std::size_t move)
+{
+    return static_cast<CubeFace>(move / 3);
+}
+
+inline int cube_move_quarter_turns(const std::size_t move)
+{
+    return static_cast<int>(move % 3) + 1;
+}
+
+// Move that undoes the given one.
+inline std::size_t cube_move_inverse(const std::size_t move)
+{
+    return move - move % 3 + (2 - move % 3);
+}
+
+// Returns the name of the move ("R2", "U'", ...).
+const char* cube_move_name(std::size_t move);
+
+// Applies the move with precomputed tables: every slot of the result is a lookup of the source slot
+// and a lookup of the new orientation, without branches.
+CubeState cube_apply_move(const CubeState& state, std::size_t move);
+
+// Facelets in Kociemba's order: 9 stickers of U (row by row, looking at the face), then R, F, D, L, B.
+// Looking at a face from outside, rows go from top to bottom and columns go from left to right,
+// where top of the side faces is U, top of U is B, and top of D is F.
+inline constexpr std::size_t cube_facelets_count{ 54 };
+
+// Colors of all stickers (which face's color each sticker has).
+void cube_facelets(const CubeState& state, CubeFace facelets[cube_facelets_count]);
+
+// Applies random moves and measures how many moves per second the engine does.
+// Prints the result, and checks the engine on known identities.
+void cube_benchmark();
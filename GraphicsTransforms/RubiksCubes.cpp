@@ -0,0 +1,357 @@
+﻿#include "RubiksCubes.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+// A sticker is a quad on the plane of its face. It's rotated with its layer (Rodrigues' rotation formula),
+// scaled from the cube space and moved to the cube. Faces are shaded by a fixed light, so that they are distinguishable.
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aCubePosition;
+layout (location = 1) in vec4 aColor;
+layout (location = 2) in vec3 aStickerPosition;
+layout (location = 3) in float aFace;
+layout (location = 4) in vec4 aTurnAxis;
+out vec3 vColor;
+uniform mat4 view_projection;
+uniform float cubie_size;
+uniform float turn_progress;
+const vec3 normals[6] = vec3[6](
+    vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, 1.0),
+    vec3(0.0, -1.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 0.0, -1.0)
+);
+const vec3 tangents[6] = vec3[6](
+    vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, -1.0), vec3(1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(-1.0, 0.0, 0.0)
+);
+const vec2 corners[6] = vec2[6](
+    vec2(-0.45, -0.45),
+    vec2(0.45, -0.45),
+    vec2(-0.45, 0.45),
+    vec2(0.45, 0.45),
+    vec2(-0.45, 0.45),
+    vec2(0.45, -0.45)
+);
+vec3 rotate(vec3 v, vec3 k, float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    return v * c + cross(k, v) * s + k * dot(k, v) * (1.0 - c);
+}
+void main()
+{
+    int face = int(aFace);
+    vec3 normal = normals[face];
+    vec3 tangent = tangents[face];
+    vec3 bitangent = cross(normal, tangent);
+    vec3 position = aStickerPosition + tangent * corners[gl_VertexID].x + bitangent * corners[gl_VertexID].y;
+    float angle = turn_progress * aTurnAxis.w * 1.5707963;
+    position = rotate(position, aTurnAxis.xyz, angle);
+    normal = rotate(normal, aTurnAxis.xyz, angle);
+    gl_Position = view_projection * vec4(aCubePosition + position * cubie_size, 1.0);
+    float light = 0.55 + 0.45 * max(dot(normal, normalize(vec3(0.4, 0.8, 0.6))), 0.0);
+    vColor = aColor.rgb * light;
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// Colors of faces in the order of CubeFace: white up, red right, green front, yellow down, orange left, blue back.
+static const glm::vec3 face_colors[6] = {
+    { 1.0f, 1.0f, 1.0f },
+    { 0.8f, 0.05f, 0.05f },
+    { 0.0f, 0.6f, 0.2f },
+    { 1.0f, 0.85f, 0.0f },
+    { 1.0f, 0.45f, 0.0f },
+    { 0.0f, 0.25f, 0.8f },
+};
+
+static const glm::vec3 face_normals[6] = {
+    { 0.0f, 1.0f, 0.0f },
+    { 1.0f, 0.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f },
+    { 0.0f, -1.0f, 0.0f },
+    { -1.0f, 0.0f, 0.0f },
+    { 0.0f, 0.0f, -1.0f },
+};
+
+// Center of the facelet in the cube space (see cube_facelets for the order of facelets).
+static glm::vec3 facelet_position(const std::size_t facelet)
+{
+    const auto face = facelet / 9;
+    const auto row = static_cast<float>(facelet % 9 / 3);
+    const auto column = static_cast<float>(facelet % 3);
+    switch (static_cast<CubeFace>(face))
+    {
+    case CubeFace::up:
+        return { column - 1.0f, 1.5f, row - 1.0f };
+    case CubeFace::right:
+        return { 1.5f, 1.0f - row, 1.0f - column };
+    case CubeFace::front:
+        return { column - 1.0f, 1.0f - row, 1.5f };
+    case CubeFace::down:
+        return { column - 1.0f, -1.5f, 1.0f - row };
+    case CubeFace::left:
+        return { -1.5f, 1.0f - row, column - 1.0f };
+    case CubeFace::back:
+        return { 1.0f - column, 1.0f - row, -1.5f };
+    }
+    return { };
+}
+
+// xorshift32 is enough to pick moves.
+static std::uint32_t next_random(std::uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+void RubiksCubes::init(const std::size_t count_initial)
+{
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo_instances);
+    glBindVertexArray(vao);
+
+    // All attributes are taken from vbo_instances once per instance, corners of the quad are calculated from gl_VertexID.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CubeSticker), reinterpret_cast<void*>(offsetof(CubeSticker, cube_position)));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CubeSticker), reinterpret_cast<void*>(offsetof(CubeSticker, color)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(CubeSticker), reinterpret_cast<void*>(offsetof(CubeSticker, sticker_position)));
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(CubeSticker), reinterpret_cast<void*>(offsetof(CubeSticker, face)));
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(CubeSticker), reinterpret_cast<void*>(offsetof(CubeSticker, turn_axis)));
+    for (unsigned i = 0; i != 5; ++i)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    shader_program = create_program(shader_vertex_source, shader_fragment_source, "rubik's cubes program");
+    gpu_timer.init();
+
+    random_state = 2463534242u;
+    turn_progress = 0.0f;
+    solver = nullptr;
+    // turns() awaits turn(), which awaits a tween or a wait.
+    scheduler.init(3);
+    generate(count_initial);
+}
+
+void RubiksCubes::destroy()
+{
+    if (solving.valid())
+    {
+        solving.wait();
+    }
+    scheduler.destroy();
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &vbo_instances);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void RubiksCubes::generate(const std::size_t count)
+{
+    auto side = static_cast<std::size_t>(std::sqrt(static_cast<double>(count)));
+    side = side == 0 ? 1 : side;
+    states.assign(side * side, CubeState::solved());
+    moves.assign(states.size(), 0);
+    stickers.resize(states.size() * cube_facelets_count);
+
+    // Cubes are placed in a square grid on XZ plane, in front of the initial position of the first camera.
+    const auto spacing = 2.0f * cube_size;
+    const auto offset = -0.5f * spacing * static_cast<float>(side - 1);
+    for (std::size_t i = 0; i != states.size(); ++i)
+    {
+        for (std::size_t j = 0; j != 25; ++j)
+        {
+            states[i] = cube_apply_move(states[i], next_random(random_state) % cube_moves_count);
+        }
+        const glm::vec3 cube_position{
+            offset + spacing * static_cast<float>(i % side),
+            0.0f,
+            offset + spacing * static_cast<float>(i / side) - 6.0f,
+        };
+        for (std::size_t facelet = 0; facelet != cube_facelets_count; ++facelet)
+        {
+            auto& sticker = stickers[i * cube_facelets_count + facelet];
+            sticker.cube_position = cube_position;
+            sticker.sticker_position = facelet_position(facelet);
+            sticker.face = static_cast<float>(facelet / 9);
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    glBufferData(GL_ARRAY_BUFFER, stickers.size() * sizeof(CubeSticker), nullptr, GL_DYNAMIC_DRAW);
+    restart();
+}
+
+void RubiksCubes::set_solver(const CubeSolver* solver_new)
+{
+    // The batch may use the old solver.
+    if (solving.valid())
+    {
+        solving.wait();
+    }
+    solver = solver_new;
+    restart();
+}
+
+void RubiksCubes::restart()
+{
+    if (solving.valid())
+    {
+        solving.wait();
+    }
+    scheduler.destroy();
+    // A turn that was interrupted is dropped, its move isn't applied.
+    turn_progress = 0.0f;
+    moves.assign(states.size(), no_move);
+    update_stickers();
+    scheduler.spawn(turns());
+}
+
+void RubiksCubes::pick_random_moves()
+{
+    for (auto& move : moves)
+    {
+        move = static_cast<std::uint8_t>(next_random(random_state) % cube_moves_count);
+    }
+}
+
+void RubiksCubes::finish_turns()
+{
+    for (std::size_t i = 0; i != states.size(); ++i)
+    {
+        if (moves[i] != no_move)
+        {
+            states[i] = cube_apply_move(states[i], moves[i]);
+        }
+    }
+}
+
+void RubiksCubes::update_stickers()
+{
+    CubeFace facelets[cube_facelets_count];
+    for (std::size_t i = 0; i != states.size(); ++i)
+    {
+        cube_facelets(states[i], facelets);
+        const auto turning = moves[i] != no_move;
+        const auto face = turning ? static_cast<std::size_t>(cube_move_face(moves[i])) : 0;
+        // 3 quarter turns end where one turn back does, so a prime move is animated as -90 degrees, the short way.
+        const auto quarter_turns_count = turning ? cube_move_quarter_turns(moves[i]) : 0;
+        const auto quarter_turns = quarter_turns_count == 3 ? -1.0f : static_cast<float>(quarter_turns_count);
+        // Clockwise looking at the face is anti-clockwise around the face normal, hence the minus.
+        const auto normal = face_normals[face];
+        for (std::size_t facelet = 0; facelet != cube_facelets_count; ++facelet)
+        {
+            auto& sticker = stickers[i * cube_facelets_count + facelet];
+            sticker.color = pack_color(face_colors[static_cast<std::size_t>(facelets[facelet])]);
+            // Stickers of the layer are on the face itself (1.5 along the normal) or on the sides of the layer (1).
+            const auto in_layer = glm::dot(sticker.sticker_position, normal) > 0.5f;
+            sticker.turn_axis = glm::vec4{ -normal, in_layer ? quarter_turns : 0.0f };
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    buffer_sub_data(GL_ARRAY_BUFFER, 0, stickers.size() * sizeof(CubeSticker), stickers.data());
+}
+
+AnimationScript RubiksCubes::turn()
+{
+    update_stickers();
+    co_await tween(turn_progress, 1.0f, turn_duration_s);
+    finish_turns();
+    turn_progress = 0.0f;
+    // Stickers show the state before the turn, until the next turn uploads them.
+    // So, the pause between turns is before the next turn, not here.
+}
+
+AnimationScript RubiksCubes::turns()
+{
+    for (;;)
+    {
+        if (solver == nullptr)
+        {
+            pick_random_moves();
+            co_await wait(0.1f);
+            co_await turn();
+            continue;
+        }
+
+        for (std::size_t i = 0; i != scramble_length; ++i)
+        {
+            pick_random_moves();
+            co_await turn();
+        }
+        moves.assign(states.size(), no_move);
+        update_stickers();
+
+        // The batch reads states and writes solutions, which don't change until it's done.
+        solutions.resize(states.size());
+        solving = std::async(std::launch::async, [this]()
+            {
+                const auto time_start = std::chrono::steady_clock::now();
+                solver->solve_batch(states.data(), states.size(), solutions.data());
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+            });
+        while (solving.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+        {
+            co_await next_frame();
+        }
+        const auto seconds = solving.get();
+        std::size_t length_max = 0;
+        std::size_t length_total = 0;
+        for (const auto& solution : solutions)
+        {
+            length_max = std::max<std::size_t>(length_max, solution.length);
+            length_total += solution.length;
+        }
+        std::cout << "Rubik's cubes: solved " << solutions.size() << " cubes in " << 1000.0 * seconds << " ms, "
+            << static_cast<double>(solutions.size()) / seconds << " solves/s, average length "
+            << static_cast<double>(length_total) / static_cast<double>(solutions.size()) << " moves" << std::endl;
+
+        // Cubes with shorter solutions stop and wait for others.
+        for (std::size_t step = 0; step != length_max; ++step)
+        {
+            for (std::size_t i = 0; i != states.size(); ++i)
+            {
+                moves[i] = step < solutions[i].length ? solutions[i].moves[step] : no_move;
+            }
+            co_await wait(0.1f);
+            co_await turn();
+        }
+        moves.assign(states.size(), no_move);
+        update_stickers();
+        co_await wait(1.0f);
+    }
+}
+
+void RubiksCubes::update(const float time_delta_s)
+{
+    scheduler.update(time_delta_s);
+}
+
+void RubiksCubes::render(const glm::mat4& view_projection)
+{
+    gpu_timer.begin();
+    use_program(shader_program);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    glUniform1f(glGetUniformLocation(shader_program, "cubie_size"), cube_size / 3.0f);
+    glUniform1f(glGetUniformLocation(shader_program, "turn_progress"), turn_progress);
+    bind_vertex_array(vao);
+    draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(stickers.size()));
+    gpu_timer.end();
+}
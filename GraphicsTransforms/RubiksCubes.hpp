@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Animation.hpp"
+#include "CubeSolver.hpp"
+#include "GlUtils.hpp"
+#include "RubiksCube.hpp"
+
+// Data of one sticker. It's uploaded to GPU as is,
+// so the layout has to match vertex attributes set in RubiksCubes::init.
+struct CubeSticker
+{
+    // Center of the cube in world space.
+    glm::vec3 cube_position;
+    std::uint32_t color;
+    // Center of the sticker in the cube space, where cubies are 1 unit large and the cube is centered at the origin.
+    glm::vec3 sticker_position;
+    // CubeFace the sticker is on (it gives the normal and the plane of the quad).
+    float face;
+    // xyz is the axis the sticker rotates around while its layer turns (clockwise looking at the face is a positive angle),
+    // w is the count of quarter turns for stickers of the turning layer and 0 for other stickers.
+    glm::vec4 turn_axis;
+};
+
+// A field of Rubik's cubes, each with its own CubeState, all of them turning a layer at the same time.
+//
+// All stickers of all cubes are rendered with one instanced draw call.
+// A turn is animated like the corner of the Rubik's cube in the triplet demo, but on GPU:
+// stickers of the turning layer are rotated around the axis of the face in the vertex shader,
+// and the angle is a uniform. So, the instance buffer changes only when a turn starts, not every frame.
+// When the turn ends, the move is applied to the state, and the stickers are recolored from its facelets.
+//
+// With a solver, cubes are scrambled, then all of them are solved by a batch on worker threads
+// (cubes wait without blocking frames), and solutions are played as turns.
+struct RubiksCubes
+{
+    static constexpr std::size_t count_max{ std::size_t{ 1 } << 12 };
+    static constexpr float cube_size{ 0.75f };
+    static constexpr float turn_duration_s{ 0.3f };
+    static constexpr std::size_t scramble_length{ 20 };
+    // A cube that doesn't turn, when its solution is shorter than others.
+    static constexpr std::uint8_t no_move{ 0xff };
+
+    std::vector<CubeState> states;
+    // The move every cube is turning now.
+    std::vector<std::uint8_t> moves;
+    std::vector<CubeSticker> stickers;
+
+    // Random layers are turned without a solver.
+    const CubeSolver* solver;
+    std::vector<CubeSolution> solutions;
+    // Seconds the batch took.
+    std::future<double> solving;
+
+    // Turning angle of the current moves as a fraction of the full turn (0..1).
+    float turn_progress;
+    AnimationScheduler scheduler;
+
+    unsigned vbo_instances, vao;
+    unsigned shader_program;
+
+    GpuTimer gpu_timer;
+
+    // count is rounded down to a square, since cubes are placed in a square grid.
+    void init(std::size_t count);
+    void destroy();
+
+    // Changes the count of cubes, each starting from a random scramble.
+    void generate(std::size_t count);
+    // Switches between random turns and scramble-solve cycles (solver can be nullptr). The solver has to be ready.
+    void set_solver(const CubeSolver* solver);
+
+    void update(float time_delta_s);
+    void render(const glm::mat4& view_projection);
+
+    std::size_t count() const
+    {
+        return states.size();
+    }
+    std::size_t gpu_memory_bytes() const
+    {
+        return stickers.size() * sizeof(CubeSticker);
+    }
+
+private:
+    // Turns layers one after another, forever.
+    AnimationScript turns();
+    // Turns layers of all cubes by the moves.
+    AnimationScript turn();
+    // Starts turns() from the beginning. Waits for the batch of solves, which reads states.
+    void restart();
+    // Picks random moves for all cubes.
+    void pick_random_moves();
+    // Applies the moves to the states.
+    void finish_turns();
+    void update_stickers();
+
+    std::uint32_t random_state;
+};
@@ -0,0 +1,125 @@
+﻿#include "ScriptedQuads.hpp"
+
+#include <cstddef>
+#include <chrono>
+#include <cmath>
+
+#include <glm/gtc/type_ptr.hpp>
+
+// The quad lies on the floor (XZ plane) and flips around its X axis.
+// Its color depends on the position in the grid, and the back side is darker.
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aAngleLift;
+out vec3 vColor;
+uniform mat4 view_projection;
+uniform vec3 origin;
+uniform int side;
+uniform float spacing;
+void main()
+{
+    int column = gl_InstanceID % side;
+    int row = gl_InstanceID / side;
+    float c = cos(aAngleLift.x);
+    float s = sin(aAngleLift.x);
+    vec3 local = vec3(aPos.x, 0.0, -aPos.y) * (0.8 * spacing);
+    local = vec3(local.x, local.y * c - local.z * s, local.y * s + local.z * c);
+    vec3 position = origin + vec3(float(column) * spacing, aAngleLift.y, float(row) * spacing) + local;
+    gl_Position = view_projection * vec4(position, 1.0);
+    vec2 uv = vec2(column, row) / float(side - 1);
+    vColor = vec3(uv.x, 0.4 + 0.6 * uv.y, 1.0 - uv.x) * (c >= 0.0 ? 1.0 : 0.4);
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vColor, 1.0);
+}
+)SHADER_SOURCE";
+
+// The whole life of a quad. Note that it reads as a plain sequence of steps.
+static AnimationScript quad_script(ScriptedQuad& quad, const float delay_s)
+{
+    constexpr auto pi = 3.14159265f;
+    co_await wait(delay_s);
+    for (;;)
+    {
+        co_await tween(quad.angle, quad.angle + pi, 0.5f);
+        // Keep the angle small, so that it doesn't lose precision over time.
+        quad.angle = std::fmod(quad.angle, 2.0f * pi);
+        co_await wait(0.5f);
+        co_await tween(quad.lift, 0.3f, 0.2f);
+        co_await tween(quad.lift, 0.0f, 0.2f);
+        co_await wait(1.0f);
+    }
+}
+
+void ScriptedQuads::init(const unsigned vbo_quad)
+{
+    quads.assign(count, ScriptedQuad{ 0.0f, 0.0f });
+    // Each quad has its script and at most one child tween at a time.
+    scheduler.init(2 * count);
+    for (std::size_t row = 0; row != side; ++row)
+    {
+        for (std::size_t column = 0; column != side; ++column)
+        {
+            const auto center = static_cast<float>(side - 1) * 0.5f;
+            const auto distance = std::hypot(static_cast<float>(column) - center, static_cast<float>(row) - center);
+            scheduler.spawn(quad_script(quads[row * side + column], 0.05f * distance));
+        }
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo_instances);
+    glBindVertexArray(vao);
+
+    // Attribute 0 is a vertex of the quad, as in vao_quad.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_quad);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+    glEnableVertexAttribArray(0);
+
+    // Attribute 1 is the animated state, once per instance.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(ScriptedQuad), nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ScriptedQuad), nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    shader_program = create_program(shader_vertex_source, shader_fragment_source, "scripted quads program");
+
+    update_cpu_ms = 0.0;
+}
+
+void ScriptedQuads::destroy()
+{
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &vbo_instances);
+    glDeleteVertexArrays(1, &vao);
+    scheduler.destroy();
+}
+
+void ScriptedQuads::update(const float time_delta_s)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+    scheduler.update(time_delta_s);
+    update_cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+}
+
+void ScriptedQuads::render(const glm::mat4& view_projection)
+{
+    use_program(shader_program);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    const auto origin = -0.5f * spacing * static_cast<float>(side - 1);
+    glUniform3f(glGetUniformLocation(shader_program, "origin"), origin, -2.0f, origin - 4.0f);
+    glUniform1i(glGetUniformLocation(shader_program, "side"), static_cast<int>(side));
+    glUniform1f(glGetUniformLocation(shader_program, "spacing"), spacing);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    buffer_sub_data(GL_ARRAY_BUFFER, 0, count * sizeof(ScriptedQuad), quads.data());
+
+    bind_vertex_array(vao);
+    draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(count));
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Animation.hpp"
+#include "GlUtils.hpp"
+
+// Animated state of one quad. It's uploaded to GPU as is,
+// so the layout has to match vertex attributes set in ScriptedQuads::init.
+struct ScriptedQuad
+{
+    // Angle in radians of the flip around the quad's X axis.
+    float angle;
+    // Height above the floor.
+    float lift;
+};
+
+// A floor of quads, each of them animated by its own script (flip, pause, jump, pause, repeat).
+// Scripts start with a delay that grows with the distance from the center, so flips spread in waves.
+// It's a stress test of AnimationScheduler: thousands of scripts, each awaiting child tweens.
+//
+// Quads are rendered with one instanced draw call. Grid coordinates of a quad are calculated
+// from gl_InstanceID, so only the animated state is uploaded every frame.
+struct ScriptedQuads
+{
+    static constexpr std::size_t side{ 64 };
+    static constexpr std::size_t count{ side * side };
+    static constexpr float spacing{ 0.25f };
+
+    std::vector<ScriptedQuad> quads;
+    AnimationScheduler scheduler;
+
+    unsigned vbo_instances, vao;
+    unsigned shader_program;
+
+    // CPU time of the last update.
+    double update_cpu_ms;
+
+    void init(unsigned vbo_quad);
+    void destroy();
+
+    void update(float time_delta_s);
+    void render(const glm::mat4& view_projection);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return count * sizeof(ScriptedQuad);
+    }
+};
@@ -0,0 +1,291 @@
+﻿#include "Shadows.hpp"
+
+#include <cstddef>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Frustum.hpp"
+
+static const auto shader_vertex_casters_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPosition;
+uniform mat4 model_light_view_projection;
+void main()
+{
+    gl_Position = model_light_view_projection * vec4(aPosition, 1.0);
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_casters_source = R"SHADER_SOURCE(#version 330 core
+void main()
+{
+}
+)SHADER_SOURCE";
+
+static const auto shader_vertex_receivers_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec4 aColor;
+out vec3 vColor;
+out vec3 vNormal;
+out vec4 vLightPosition;
+uniform mat4 view_projection;
+uniform mat4 light_view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(aPosition, 1.0);
+    vColor = aColor.rgb;
+    vNormal = aNormal;
+    vLightPosition = light_view_projection * vec4(aPosition, 1.0);
+}
+)SHADER_SOURCE";
+
+// Comparison with linear filtering gives 2x2 PCF for free, and 4 such taps soften the edge more.
+static const auto shader_fragment_receivers_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vColor;
+in vec3 vNormal;
+in vec4 vLightPosition;
+out vec4 FragColor;
+uniform sampler2DShadow shadow_map;
+uniform vec3 light_direction;
+uniform float texel_size;
+void main()
+{
+    vec3 coordinates = vLightPosition.xyz / vLightPosition.w * 0.5 + 0.5;
+    float lit = 1.0;
+    if (all(greaterThan(coordinates, vec3(0.0))) && all(lessThan(coordinates, vec3(1.0))))
+    {
+        lit = 0.0;
+        for (int i = 0; i != 4; ++i)
+        {
+            vec2 offset = (vec2(i & 1, i >> 1) - 0.5) * texel_size;
+            lit += 0.25 * texture(shadow_map, vec3(coordinates.xy + offset, coordinates.z));
+        }
+    }
+    float diffuse = max(dot(normalize(vNormal), -light_direction), 0.0);
+    FragColor = vec4(vColor * (0.3 + 0.7 * diffuse * lit), 1.0);
+}
+)SHADER_SOURCE";
+
+// Creates a depth texture for the comparison in shaders and a framebuffer with it.
+static void create_depth_target(unsigned& texture, unsigned& framebuffer)
+{
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, Shadows::map_size, Shadows::map_size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Error: shadow map framebuffer is incomplete" << std::endl;
+        std::exit(1);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Shadows::init()
+{
+    std::vector<ShadowVertex> vertices;
+    const auto push_face = [&vertices](const glm::vec3& corner, const glm::vec3& u, const glm::vec3& v, const std::uint32_t color)
+        {
+            const auto normal = glm::normalize(glm::cross(u, v));
+            const glm::vec3 positions[6] = { corner, corner + u, corner + v, corner + u + v, corner + v, corner + u };
+            for (const auto& position : positions)
+            {
+                vertices.push_back({ position, normal, color });
+            }
+        };
+
+    push_face({ -ground_half_size, ground_height, ground_half_size }, { 2.0f * ground_half_size, 0.0f, 0.0f },
+        { 0.0f, 0.0f, -2.0f * ground_half_size }, pack_color({ 0.45f, 0.5f, 0.4f }));
+    ground_vertices_count = vertices.size();
+
+    // Pillars of random heights stand on a grid, except for the middle, where the animated quads are.
+    std::mt19937 random{ 3 };
+    std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+    const auto spacing = 2.0f * ground_half_size / static_cast<float>(pillars_per_side);
+    for (std::size_t z = 0; z != pillars_per_side; ++z)
+    {
+        for (std::size_t x = 0; x != pillars_per_side; ++x)
+        {
+            const glm::vec2 center{
+                -ground_half_size + spacing * (static_cast<float>(x) + 0.5f),
+                -ground_half_size + spacing * (static_cast<float>(z) + 0.5f),
+            };
+            const auto height = 0.5f + 2.5f * unit(random);
+            if (glm::length(center) < 3.0f)
+            {
+                continue;
+            }
+            const auto color = pack_color(glm::vec3{ 0.8f, 0.75f, 0.7f } * (0.8f + 0.2f * unit(random)));
+            const glm::vec3 min{ center.x - 0.2f, ground_height, center.y - 0.2f };
+            const glm::vec3 x_side{ 0.4f, 0.0f, 0.0f };
+            const glm::vec3 y_side{ 0.0f, height, 0.0f };
+            const glm::vec3 z_side{ 0.0f, 0.0f, 0.4f };
+            push_face(min + y_side, z_side, x_side, color);
+            push_face(min, x_side, y_side, color);
+            push_face(min + z_side + x_side, -x_side, y_side, color);
+            push_face(min + z_side, -z_side, y_side, color);
+            push_face(min + x_side, z_side, y_side, color);
+        }
+    }
+    pillars_vertices_count = vertices.size() - ground_vertices_count;
+
+    // The quad of the main scene, for dynamic casters.
+    push_face({ -0.5f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, 0);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ShadowVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ShadowVertex), reinterpret_cast<void*>(offsetof(ShadowVertex, position)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShadowVertex), reinterpret_cast<void*>(offsetof(ShadowVertex, normal)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ShadowVertex), reinterpret_cast<void*>(offsetof(ShadowVertex, color)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+
+    create_depth_target(texture_static, fbo_static);
+    create_depth_target(texture_frame, fbo_frame);
+
+    shader_program_casters = create_program(shader_vertex_casters_source, shader_fragment_casters_source, "shadow casters program");
+    shader_program_receivers = create_program(shader_vertex_receivers_source, shader_fragment_receivers_source, "shadow receivers program");
+    gpu_timer.init();
+
+    light_direction = glm::normalize(glm::vec3{ -0.4f, -1.0f, -0.3f });
+    light_center = glm::vec3{ 0.0f };
+    light_radius = 0.0f;
+    light_view_projection = glm::mat4{ 1.0f };
+    static_valid = false;
+    cache_enable = true;
+    static_rendered = false;
+    dynamic_casters_drawn = 0;
+}
+
+void Shadows::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program_receivers);
+    glDeleteProgram(shader_program_casters);
+    glDeleteFramebuffers(1, &fbo_frame);
+    glDeleteTextures(1, &texture_frame);
+    glDeleteFramebuffers(1, &fbo_static);
+    glDeleteTextures(1, &texture_static);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+}
+
+bool Shadows::fit(const glm::mat4& view_projection)
+{
+    glm::vec3 corners[8];
+    calculate_frustum_corners(view_projection, corners);
+    // Shadows further than shadow_distance aren't needed, so far corners are pulled towards near ones.
+    for (std::size_t i = 0; i != 4; ++i)
+    {
+        const auto edge = corners[i + 4] - corners[i];
+        const auto length = glm::length(edge);
+        if (length > shadow_distance)
+        {
+            corners[i + 4] = corners[i] + edge * (shadow_distance / length);
+        }
+    }
+    auto center = glm::vec3{ 0.0f };
+    for (const auto& corner : corners)
+    {
+        center += corner / 8.0f;
+    }
+    auto radius = 0.0f;
+    for (const auto& corner : corners)
+    {
+        radius = std::max(radius, glm::distance(corner, center));
+    }
+
+    // The cached box is kept while the sphere is inside of it and isn't much smaller than it
+    // (after switching to a camera with a shorter range, the map would waste resolution).
+    const auto inside = glm::distance(center, light_center) + radius <= light_radius && light_radius <= radius * cache_margin * cache_margin;
+    if (static_valid && inside)
+    {
+        return false;
+    }
+    light_center = center;
+    light_radius = radius * cache_margin;
+    const auto up_hint = std::abs(light_direction.y) > 0.99f ? glm::vec3{ 0.0f, 0.0f, 1.0f } : glm::vec3{ 0.0f, 1.0f, 0.0f };
+    const auto view = glm::lookAt(center - light_direction * (light_radius + caster_margin), center, up_hint);
+    const auto projection = glm::ortho(-light_radius, light_radius, -light_radius, light_radius, 0.0f, 2.0f * light_radius + caster_margin);
+    light_view_projection = projection * view;
+    return true;
+}
+
+void Shadows::render(const glm::mat4& view_projection)
+{
+    gpu_timer.begin();
+    const auto moved = fit(view_projection);
+    static_rendered = moved || !static_valid || !cache_enable;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    glViewport(0, 0, map_size, map_size);
+    // Slope-scaled bias against shadow acne.
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    use_program(shader_program_casters);
+    const auto location_mvp = glGetUniformLocation(shader_program_casters, "model_light_view_projection");
+    bind_vertex_array(vao);
+    constexpr float depth_far{ 1.0f };
+
+    if (static_rendered)
+    {
+        bind_framebuffer(GL_FRAMEBUFFER, fbo_static);
+        glClearBufferfv(GL_DEPTH, 0, &depth_far);
+        glUniformMatrix4fv(location_mvp, 1, GL_FALSE, glm::value_ptr(light_view_projection));
+        draw_arrays(GL_TRIANGLES, static_cast<GLint>(ground_vertices_count), static_cast<GLsizei>(pillars_vertices_count));
+        static_valid = true;
+    }
+
+    // The static layer is the starting point of the frame map, and dynamic casters are depth tested against it.
+    bind_framebuffer(GL_READ_FRAMEBUFFER, fbo_static);
+    bind_framebuffer(GL_DRAW_FRAMEBUFFER, fbo_frame);
+    glBlitFramebuffer(0, 0, map_size, map_size, 0, 0, map_size, map_size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    const auto quad_first = static_cast<GLint>(ground_vertices_count + pillars_vertices_count);
+    for (const auto& model : dynamic_casters)
+    {
+        const auto mvp = light_view_projection * model;
+        glUniformMatrix4fv(location_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+        draw_arrays(GL_TRIANGLES, quad_first, 6);
+    }
+    dynamic_casters_drawn = dynamic_casters.size();
+    dynamic_casters.clear();
+    glDisable(GL_POLYGON_OFFSET_FILL);
+
+    bind_framebuffer(GL_FRAMEBUFFER, static_cast<unsigned>(framebuffer));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    use_program(shader_program_receivers);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_receivers, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_receivers, "light_view_projection"), 1, GL_FALSE, glm::value_ptr(light_view_projection));
+    glUniform3fv(glGetUniformLocation(shader_program_receivers, "light_direction"), 1, glm::value_ptr(light_direction));
+    glUniform1f(glGetUniformLocation(shader_program_receivers, "texel_size"), 1.0f / static_cast<float>(map_size));
+    glUniform1i(glGetUniformLocation(shader_program_receivers, "shadow_map"), 0);
+    bind_texture(GL_TEXTURE0, texture_frame);
+    draw_arrays(GL_TRIANGLES, 0, static_cast<GLsizei>(ground_vertices_count + pillars_vertices_count));
+    gpu_timer.end();
+}
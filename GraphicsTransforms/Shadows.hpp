@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+struct ShadowVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    std::uint32_t color;
+};
+
+// A directional shadow map with a cached layer of static casters.
+//
+// The light frustum is an orthographic box around the bounding sphere of the camera frustum
+// (corners are found with calculate_frustum_corners, and the far plane is pulled in to shadow_distance).
+// The sphere is enlarged by cache_margin, so the box stays in place while the camera moves or turns a little,
+// and static casters (a field of pillars on the ground) are rendered into the static map only when the box moves
+// or invalidate() is called. Every frame, the static map is copied into the frame map (a depth blit,
+// much cheaper than drawing the casters), and only dynamic casters (the animated pair and triplet of quads)
+// are rendered on top of it. The ground and the pillars receive shadows with 2x2 PCF.
+struct Shadows
+{
+    static constexpr int map_size{ 2048 };
+    static constexpr float shadow_distance{ 20.0f };
+    static constexpr float cache_margin{ 1.5f };
+    // Casters this far towards the light outside of the box still cast shadows into it.
+    static constexpr float caster_margin{ 20.0f };
+    static constexpr std::size_t pillars_per_side{ 16 };
+    static constexpr float ground_half_size{ 20.0f };
+    static constexpr float ground_height{ -1.0f };
+
+    glm::vec3 light_direction;
+    // Box of the cached static map.
+    glm::vec3 light_center;
+    float light_radius;
+    glm::mat4 light_view_projection;
+    bool static_valid;
+    // Disabling the cache re-renders static casters every frame, for comparison.
+    bool cache_enable;
+
+    // Model matrices of quads collected during the frame, cleared by render().
+    std::vector<glm::mat4> dynamic_casters;
+
+    unsigned vbo, vao;
+    std::size_t ground_vertices_count;
+    std::size_t pillars_vertices_count;
+    unsigned texture_static, fbo_static;
+    unsigned texture_frame, fbo_frame;
+    unsigned shader_program_casters, shader_program_receivers;
+
+    // The latest frame.
+    bool static_rendered;
+    std::size_t dynamic_casters_drawn;
+
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Static casters have changed, so the static map has to be rendered again.
+    void invalidate()
+    {
+        static_valid = false;
+    }
+
+    void add_dynamic_caster(const glm::mat4& model)
+    {
+        dynamic_casters.push_back(model);
+    }
+
+    // Fits the light to the camera, updates the maps and draws the receivers.
+    void render(const glm::mat4& view_projection);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return 2 * map_size * map_size * sizeof(std::uint32_t) + (ground_vertices_count + pillars_vertices_count + 6) * sizeof(ShadowVertex);
+    }
+
+private:
+    // Returns whether the box of the light moved.
+    bool fit(const glm::mat4& view_projection);
+};
@@ -0,0 +1,133 @@
+﻿#include "SharedMemory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool SharedMemory::create(const char* const name_new, const std::size_t size_new)
+{
+    close();
+#if defined(_WIN32)
+    // Windows removes the mapping when the last handle is closed, so there is nothing to replace.
+    const auto size_64 = static_cast<std::uint64_t>(size_new);
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(size_64 >> 32), static_cast<DWORD>(size_64 & 0xFFFFFFFFu), name_new);
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+    const auto view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size_new);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+#else
+    shm_unlink(name_new);
+    const auto descriptor = shm_open(name_new, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    // A new object is empty, and ftruncate fills it with zeros.
+    if (ftruncate(descriptor, static_cast<off_t>(size_new)) != 0)
+    {
+        ::close(descriptor);
+        shm_unlink(name_new);
+        return false;
+    }
+    const auto view = mmap(nullptr, size_new, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (view == MAP_FAILED)
+    {
+        shm_unlink(name_new);
+        return false;
+    }
+#endif
+    data = static_cast<std::byte*>(view);
+    size = size_new;
+    name = name_new;
+    owner = true;
+    return true;
+}
+
+bool SharedMemory::open(const char* const name_existing)
+{
+    close();
+#if defined(_WIN32)
+    mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name_existing);
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+    const auto view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+    // The size of the mapping isn't stored anywhere else, the view covers it rounded up to pages.
+    MEMORY_BASIC_INFORMATION info{ };
+    VirtualQuery(view, &info, sizeof(info));
+    size = info.RegionSize;
+#else
+    const auto descriptor = shm_open(name_existing, O_RDWR, 0600);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    struct stat object_stat{ };
+    if (fstat(descriptor, &object_stat) != 0 || object_stat.st_size <= 0)
+    {
+        ::close(descriptor);
+        return false;
+    }
+    size = static_cast<std::size_t>(object_stat.st_size);
+    const auto view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (view == MAP_FAILED)
+    {
+        size = 0;
+        return false;
+    }
+#endif
+    data = static_cast<std::byte*>(view);
+    name = name_existing;
+    owner = false;
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    munmap(data, size);
+    if (owner)
+    {
+        shm_unlink(name.c_str());
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    name.clear();
+    owner = false;
+}
@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Memory shared between processes: one process creates it under a name, and others open it by that name.
+// On POSIX systems it's a shm_open object, on Windows a named file mapping backed by the paging file.
+// Names start with '/' and have no other slashes (for example "/GraphicsTransforms-link").
+// Processes forked after create share the mapping without opening it.
+struct SharedMemory
+{
+    std::byte* data{ nullptr };
+    std::size_t size{ 0 };
+
+    // Creates zero-filled memory of size bytes, replacing memory left under the same name by a crashed process.
+    // Returns false if it can't be created.
+    bool create(const char* name, std::size_t size);
+    // Opens memory created by another process. Returns false if it doesn't exist.
+    bool open(const char* name);
+    // Unmaps the memory, and removes the name if this process created it
+    // (processes that still have it open keep their mapping). Does nothing if the memory isn't open.
+    void close();
+
+    bool is_open() const
+    {
+        return data != nullptr;
+    }
+
+private:
+    std::string name;
+    bool owner{ false };
+#if defined(_WIN32)
+    void* mapping{ nullptr };
+#endif
+};
@@ -0,0 +1,206 @@
+﻿#include "SnapshotRing.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Lengths of runs are written as LEB128 varints: 7 bits per byte, the high bit means "more bytes follow".
+static std::uint8_t* write_varint(std::uint8_t* p, std::size_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = static_cast<std::uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = static_cast<std::uint8_t>(value);
+    return p;
+}
+
+static std::size_t read_varint(const std::uint8_t*& p)
+{
+    std::size_t value = 0;
+    int shift = 0;
+    while (*p & 0x80)
+    {
+        value |= static_cast<std::size_t>(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= static_cast<std::size_t>(*p++) << shift;
+    return value;
+}
+
+static std::size_t varint_size(std::size_t value)
+{
+    std::size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void SnapshotRing::init(const std::size_t size, const std::size_t keyframe_interval_frames, const std::size_t budget,
+    const std::size_t snapshot_bytes_expected)
+{
+    snapshot_size = size;
+    keyframe_interval = keyframe_interval_frames;
+    budget_bytes = budget;
+    frame_first = 0;
+    bytes_used = 0;
+    records_first = 0;
+    records_count = 0;
+    since_keyframe = 0;
+    // Every run of literals but the first one follows a run of at least one zero byte,
+    // and only the last run of literals may be empty, so there are at most size / 2 + 2 pairs of runs.
+    delta_bytes_max = size + (size / 2 + 2) * 2 * varint_size(size);
+
+    const auto records_capacity = budget / (sizeof(Record) + snapshot_bytes_expected);
+    records.assign(records_capacity, Record{ });
+    arena.assign(budget - records_capacity * sizeof(Record), 0);
+    // A keyframe and a delta must fit, otherwise there is no history at all.
+    assert(records_capacity >= 2 && arena.size() >= size + delta_bytes_max && arena.size() <= UINT32_MAX);
+}
+
+std::size_t SnapshotRing::keyframe_of(const std::size_t i) const
+{
+    auto k = i;
+    while (!record(k).keyframe)
+    {
+        assert(k != 0);
+        --k;
+    }
+    return k;
+}
+
+bool SnapshotRing::find_space(const std::size_t bytes_count, std::size_t& offset) const
+{
+    if (records_count == 0)
+    {
+        offset = 0;
+        return bytes_count <= arena.size();
+    }
+    // Snapshots occupy [tail, head) of the arena, wrapping around its end if head <= tail.
+    const auto tail = std::size_t{ record(0).offset };
+    const auto& newest = record(records_count - 1);
+    const auto head = std::size_t{ newest.offset } + newest.size;
+    if (tail < head)
+    {
+        if (head + bytes_count <= arena.size())
+        {
+            offset = head;
+            return true;
+        }
+        offset = 0;
+        return bytes_count <= tail;
+    }
+    offset = head;
+    return head + bytes_count <= tail;
+}
+
+void SnapshotRing::push(const void* const data)
+{
+    const auto bytes = static_cast<const std::uint8_t*>(data);
+    auto keyframe = records_count == 0 || since_keyframe == keyframe_interval;
+    std::size_t offset = 0;
+    while (records_count == records.size() || !find_space(keyframe ? snapshot_size : delta_bytes_max, offset))
+    {
+        // If only the newest group is left, a new group is started, so that the whole old one can be dropped.
+        if (!keyframe && keyframe_of(records_count - 1) == 0)
+        {
+            keyframe = true;
+        }
+        else
+        {
+            drop_oldest_group();
+        }
+    }
+
+    const auto out = arena.data() + offset;
+    auto end = out;
+    if (keyframe)
+    {
+        std::memcpy(out, bytes, snapshot_size);
+        end += snapshot_size;
+        since_keyframe = 1;
+    }
+    else
+    {
+        // The keyframe isn't overwritten, since space was found outside of all snapshots.
+        const auto keyframe_bytes = arena.data() + record(keyframe_of(records_count - 1)).offset;
+        // (zero run length, literal run length, literal bytes)...
+        // Literals are XORed bytes, decoding XORs them with the keyframe again.
+        std::size_t i = 0;
+        while (i != snapshot_size)
+        {
+            const auto zeros_start = i;
+            while (i != snapshot_size && bytes[i] == keyframe_bytes[i])
+            {
+                ++i;
+            }
+            const auto literals_start = i;
+            while (i != snapshot_size && bytes[i] != keyframe_bytes[i])
+            {
+                ++i;
+            }
+            end = write_varint(end, literals_start - zeros_start);
+            end = write_varint(end, i - literals_start);
+            for (auto j = literals_start; j != i; ++j)
+            {
+                *end++ = bytes[j] ^ keyframe_bytes[j];
+            }
+        }
+        ++since_keyframe;
+    }
+    const auto size = static_cast<std::size_t>(end - out);
+    assert(size <= (keyframe ? snapshot_size : delta_bytes_max));
+    records[(records_first + records_count) % records.size()] = Record{ .offset = static_cast<std::uint32_t>(offset),
+        .size = static_cast<std::uint32_t>(size), .keyframe = keyframe ? 1u : 0u };
+    ++records_count;
+    bytes_used += size;
+}
+
+void SnapshotRing::drop_oldest_group()
+{
+    do
+    {
+        bytes_used -= record(0).size;
+        records_first = (records_first + 1) % records.size();
+        --records_count;
+        ++frame_first;
+    } while (records_count != 0 && !record(0).keyframe);
+}
+
+void SnapshotRing::get(const std::size_t i, void* const data) const
+{
+    const auto out = static_cast<std::uint8_t*>(data);
+    std::memcpy(out, arena.data() + record(keyframe_of(i)).offset, snapshot_size);
+    const auto& delta = record(i);
+    if (delta.keyframe)
+    {
+        return;
+    }
+    const auto* p = arena.data() + delta.offset;
+    const auto end = p + delta.size;
+    std::size_t offset = 0;
+    while (p != end)
+    {
+        offset += read_varint(p);
+        const auto literals_count = read_varint(p);
+        for (std::size_t j = 0; j != literals_count; ++j, ++offset)
+        {
+            out[offset] ^= *p++;
+        }
+    }
+}
+
+void SnapshotRing::truncate(const std::size_t i)
+{
+    while (records_count > i + 1)
+    {
+        bytes_used -= record(records_count - 1).size;
+        --records_count;
+    }
+    since_keyframe = records_count - keyframe_of(records_count - 1);
+}
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// History of snapshots of a fixed size (raw bytes of a trivially copyable struct),
+// kept within a memory budget by dropping the oldest snapshots.
+// Every keyframe_interval-th snapshot is a keyframe, stored as is.
+// Other snapshots store only how they differ from their keyframe: the XOR with the keyframe
+// is mostly zeros (few things change between frames), so it's encoded as
+// runs of zero bytes followed by runs of literal bytes.
+// Snapshots are dropped by whole keyframe groups, so the oldest snapshot is always a keyframe.
+// All memory is allocated by init and split between an arena of encoded bytes and a ring of records
+// of snapshots, so push doesn't allocate. The arena is a circular buffer too, but a snapshot is never split:
+// if it doesn't fit before the end of the arena, it's written from the beginning.
+struct SnapshotRing
+{
+    std::size_t snapshot_size;
+    std::size_t keyframe_interval;
+    // Memory of the arena and the records together.
+    std::size_t budget_bytes;
+
+    // Frame number of the first snapshot.
+    std::uint64_t frame_first;
+    // Encoded bytes of all snapshots (without records).
+    std::size_t bytes_used;
+
+    // snapshot_bytes_expected is the expected size of an encoded snapshot,
+    // the budget is split between the arena and the records so that both run out at about the same time.
+    void init(std::size_t size, std::size_t keyframe_interval_frames, std::size_t budget, std::size_t snapshot_bytes_expected);
+
+    std::size_t count() const
+    {
+        return records_count;
+    }
+    // Raw size of all snapshots, for comparison with bytes_used.
+    std::size_t bytes_raw() const
+    {
+        return records_count * snapshot_size;
+    }
+
+    // Appends a snapshot of the next frame. data points to snapshot_size bytes.
+    void push(const void* data);
+    // Decodes the i-th snapshot (0 is the oldest) into data.
+    void get(std::size_t i, void* data) const;
+    // Forgets snapshots newer than the i-th one, so that the history continues from it.
+    void truncate(std::size_t i);
+
+private:
+    struct Record
+    {
+        std::uint32_t offset;
+        std::uint32_t size : 31;
+        std::uint32_t keyframe : 1;
+    };
+    std::vector<std::uint8_t> arena;
+    std::vector<Record> records;
+    // Index of the oldest snapshot in records.
+    std::size_t records_first;
+    std::size_t records_count;
+    // Snapshots since the last keyframe, including it.
+    std::size_t since_keyframe;
+    // The largest possible delta, space for it is found before encoding right into the arena.
+    std::size_t delta_bytes_max;
+
+    const Record& record(std::size_t i) const
+    {
+        return records[(records_first + i) % records.size()];
+    }
+    std::size_t keyframe_of(std::size_t i) const;
+    // Returns false if there are no free bytes_count contiguous bytes in the arena.
+    bool find_space(std::size_t bytes_count, std::size_t& offset) const;
+    void drop_oldest_group();
+};
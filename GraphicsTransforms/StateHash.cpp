@@ -0,0 +1,204 @@
+﻿#include "StateHash.hpp"
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <bit>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+static constexpr auto file_header = "state-hash 1 float-bits-dropped %u\n";
+static_assert(state_hash_subsystems_count == 3, "the file has a column per subsystem");
+
+const char* state_hash_subsystem_name(const StateHashSubsystem subsystem)
+{
+    switch (subsystem)
+    {
+    case StateHashSubsystem::cameras:
+        return "cameras";
+    case StateHashSubsystem::world:
+        return "world";
+    case StateHashSubsystem::visibility:
+        return "visibility";
+    case StateHashSubsystem::count:
+        break;
+    }
+    return "unknown";
+}
+
+void StateHasher::add_float(const float v)
+{
+    if (v != v)
+    {
+        add_word(0x7fc00000);
+        return;
+    }
+    if (v == 0.0f)
+    {
+        add_word(0);
+        return;
+    }
+    auto bits = std::bit_cast<std::uint32_t>(v);
+    if (float_bits_dropped != 0)
+    {
+        // Round to nearest: a carry out of the mantissa correctly goes into the exponent.
+        const auto mask = (std::uint32_t{ 1 } << float_bits_dropped) - 1;
+        bits = (bits + (mask >> 1) + 1) & ~mask;
+    }
+    add_word(bits);
+}
+
+void StateHasher::add_floats(const float* const values, const std::size_t count)
+{
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        add_float(values[i]);
+    }
+}
+
+void StateHasher::add_mat4(const glm::mat4& m)
+{
+    add_floats(glm::value_ptr(m), 16);
+}
+
+void StateHasher::add_bytes(const std::uint8_t* const bytes, const std::size_t count)
+{
+    // 4 bytes per word in a fixed order, the tail is padded with zeros.
+    for (std::size_t i = 0; i < count; i += 4)
+    {
+        std::uint32_t word = 0;
+        for (std::size_t j = 0; j != 4 && i + j != count; ++j)
+        {
+            word |= std::uint32_t{ bytes[i + j] } << (8 * j);
+        }
+        add_word(word);
+    }
+    add_u64(count);
+}
+
+bool StateHashLog::open(const char* const path, const char* const reference_path, const unsigned float_bits_dropped_)
+{
+    float_bits_dropped = float_bits_dropped_;
+    if (float_bits_dropped > 22)
+    {
+        std::cout << "State hash: at most 22 bits of mantissas can be dropped" << std::endl;
+        return false;
+    }
+    if (reference_path != nullptr)
+    {
+        const auto input = std::fopen(reference_path, "r");
+        if (input == nullptr)
+        {
+            std::cout << "State hash: can't read " << reference_path << std::endl;
+            return false;
+        }
+        unsigned reference_bits_dropped = 0;
+        if (std::fscanf(input, file_header, &reference_bits_dropped) != 1 || reference_bits_dropped != float_bits_dropped)
+        {
+            std::cout << "State hash: " << reference_path << " isn't a state hash file with " << float_bits_dropped
+                << " float bits dropped" << std::endl;
+            std::fclose(input);
+            return false;
+        }
+        FrameStateHashes hashes{ };
+        while (std::fscanf(input, "%" SCNu64 " %" SCNx64 " %" SCNx64 " %" SCNx64, &hashes.frame, &hashes.hashes[0], &hashes.hashes[1], &hashes.hashes[2])
+            == 1 + state_hash_subsystems_count)
+        {
+            reference.push_back(hashes);
+        }
+        // Frames after a malformed line aren't compared, which would look like a shorter run otherwise.
+        if (!std::feof(input))
+        {
+            std::cout << "State hash: stopped reading " << reference_path << " at a malformed line after "
+                << reference.size() << " frames" << std::endl;
+        }
+        std::fclose(input);
+        reference_loaded = true;
+        std::cout << "State hash: comparing with " << reference.size() << " frames of " << reference_path << std::endl;
+    }
+    if (path != nullptr)
+    {
+        file = std::fopen(path, "w");
+        if (file == nullptr)
+        {
+            std::cout << "State hash: can't write " << path << std::endl;
+            return false;
+        }
+        std::fprintf(file, file_header, float_bits_dropped);
+    }
+    return true;
+}
+
+void StateHashLog::add(const FrameStateHashes& hashes)
+{
+    if (file != nullptr)
+    {
+        std::fprintf(file, "%" PRIu64 " %016" PRIx64 " %016" PRIx64 " %016" PRIx64 "\n", hashes.frame, hashes.hashes[0], hashes.hashes[1], hashes.hashes[2]);
+    }
+    // Both runs go through frames in order, so the reference is walked once.
+    while (reference_next != reference.size() && reference[reference_next].frame < hashes.frame)
+    {
+        ++reference_next;
+    }
+    if (reference_next == reference.size() || reference[reference_next].frame != hashes.frame)
+    {
+        return;
+    }
+    const auto& expected = reference[reference_next];
+    ++frames_compared;
+    unsigned mask = 0;
+    for (std::size_t i = 0; i != state_hash_subsystems_count; ++i)
+    {
+        mask |= (hashes.hashes[i] != expected.hashes[i] ? 1u : 0u) << i;
+    }
+    if (mask == 0)
+    {
+        return;
+    }
+    if (frames_divergent == 0)
+    {
+        divergence_first_frame = hashes.frame;
+        divergence_first_mask = mask;
+        std::cout << "State hash: frame " << hashes.frame << " diverges from the reference in";
+        for (std::size_t i = 0; i != state_hash_subsystems_count; ++i)
+        {
+            if ((mask >> i) & 1)
+            {
+                std::cout << ' ' << state_hash_subsystem_name(static_cast<StateHashSubsystem>(i));
+            }
+        }
+        std::cout << std::endl;
+    }
+    ++frames_divergent;
+}
+
+void StateHashLog::close()
+{
+    if (file != nullptr)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
+    if (!reference_loaded)
+    {
+        return;
+    }
+    std::cout << "State hash: " << frames_compared << " frames compared, " << frames_divergent << " divergent";
+    if (frames_divergent != 0)
+    {
+        std::cout << ", the first is frame " << divergence_first_frame << " (";
+        auto separator = "";
+        for (std::size_t i = 0; i != state_hash_subsystems_count; ++i)
+        {
+            if ((divergence_first_mask >> i) & 1)
+            {
+                std::cout << separator << state_hash_subsystem_name(static_cast<StateHashSubsystem>(i));
+                separator = ", ";
+            }
+        }
+        std::cout << ")";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Hashes of the state of every frame, to check that results stay the same when work moves to other threads,
+// or the code is built with other instruction sets, optimizations or compilers.
+// A run writes a hash per subsystem per frame into a text file, and another run compares its hashes with that file
+// and reports the first frame and subsystem that diverge. Runs are comparable frame by frame when they replay
+// the same scenario (with a fixed time step).
+
+// Parts of the state that are hashed separately, so that a divergence points at one of them.
+enum struct StateHashSubsystem
+{
+    // View and projection matrices of all cameras.
+    cameras,
+    // Transforms of objects: animation angles of quads, positions of translucent quads, angles and lifts
+    // of scripted quads, the turn of the NxN cube, members of prototype groups, states of Rubik's cubes
+    // and live link objects.
+    world,
+    // Results of culling and selection: visible translucent quads (and masks of views), visible blocks of terrain
+    // levels, clusters drawn as impostors and buildings of the city.
+    visibility,
+    count,
+};
+
+inline constexpr std::size_t state_hash_subsystems_count{ static_cast<std::size_t>(StateHashSubsystem::count) };
+
+const char* state_hash_subsystem_name(StateHashSubsystem subsystem);
+
+// 64-bit FNV-1a over 32-bit words. Values are added one by one, never as raw memory of structs,
+// so padding and the byte order of the machine don't change the hash.
+struct StateHasher
+{
+    // Low bits of mantissas that are rounded off before floats are hashed (0 hashes them bitwise).
+    // It makes hashes tolerate the last bits of difference, e.g. of fused multiply-add, unless a value is right
+    // at the boundary of rounding.
+    unsigned float_bits_dropped{ 0 };
+    std::uint64_t value{ 0xcbf29ce484222325 };
+
+    void add_word(const std::uint32_t word)
+    {
+        value = (value ^ word) * 0x100000001b3;
+    }
+    void add_u64(const std::uint64_t v)
+    {
+        add_word(static_cast<std::uint32_t>(v));
+        add_word(static_cast<std::uint32_t>(v >> 32));
+    }
+    void add_bool(const bool v)
+    {
+        add_word(v ? 1 : 0);
+    }
+    // -0 is hashed as 0, and all NaNs are hashed as one.
+    void add_float(float v);
+    void add_floats(const float* values, std::size_t count);
+    void add_mat4(const glm::mat4& m);
+    void add_bytes(const std::uint8_t* bytes, std::size_t count);
+};
+
+// Hashes of one frame.
+struct FrameStateHashes
+{
+    std::uint64_t frame;
+    std::uint64_t hashes[state_hash_subsystems_count];
+};
+
+// Writes hashes of frames into a file, and/or compares them with a file written by another run.
+// The file has a line per frame: the frame number and hashes of subsystems in hexadecimal.
+struct StateHashLog
+{
+    unsigned float_bits_dropped;
+
+    // Opens the file to write (if path isn't nullptr) and reads the reference (if reference_path isn't nullptr).
+    // The reference has to be written with the same float_bits_dropped. Prints errors and returns false on failure.
+    bool open(const char* path, const char* reference_path, unsigned float_bits_dropped);
+    bool active() const
+    {
+        return file != nullptr || reference_loaded;
+    }
+    // Writes and compares hashes of a frame. Frames that aren't in the reference aren't compared.
+    void add(const FrameStateHashes& hashes);
+    // Prints how many frames were compared and the first divergence, and closes the file.
+    void close();
+
+private:
+    std::FILE* file{ nullptr };
+    bool reference_loaded{ false };
+    std::vector<FrameStateHashes> reference;
+    std::size_t reference_next{ 0 };
+    std::size_t frames_compared{ 0 };
+    std::size_t frames_divergent{ 0 };
+    std::uint64_t divergence_first_frame{ 0 };
+    // Subsystems that diverged at the first divergent frame, a bit per subsystem.
+    unsigned divergence_first_mask{ 0 };
+};
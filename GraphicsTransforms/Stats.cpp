@@ -0,0 +1,91 @@
+﻿#include "Stats.hpp"
+
+#include <cstddef>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+const char* render_pass_name(const RenderPass pass)
+{
+    switch (pass)
+    {
+    case RenderPass::scene:
+        return "scene";
+    case RenderPass::rubiks_cubes:
+        return "rubiks cubes";
+    case RenderPass::cube_nxn:
+        return "nxn cube";
+    case RenderPass::terrain:
+        return "terrain";
+    case RenderPass::impostors:
+        return "impostors";
+    case RenderPass::prototype_groups:
+        return "prototype groups";
+    case RenderPass::city:
+        return "city";
+    case RenderPass::shadows:
+        return "shadows";
+    case RenderPass::visibility_buffer:
+        return "visibility buffer";
+    case RenderPass::live_link:
+        return "live link";
+    case RenderPass::particles_simulate:
+        return "particles simulate";
+    case RenderPass::particles_render:
+        return "particles render";
+    case RenderPass::transparency:
+        return "transparency";
+    case RenderPass::debug_draw:
+        return "debug draw";
+    case RenderPass::hud:
+        return "hud";
+    case RenderPass::count:
+        break;
+    }
+    return "unknown";
+}
+
+std::size_t process_memory_bytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{ };
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info{ };
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+    {
+        return 0;
+    }
+    return info.resident_size;
+#else
+    // The second number in /proc/self/statm is the resident set size in pages.
+    const auto file = std::fopen("/proc/self/statm", "r");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+    unsigned long pages_total = 0;
+    unsigned long pages_resident = 0;
+    const auto read = std::fscanf(file, "%lu %lu", &pages_total, &pages_resident);
+    std::fclose(file);
+    if (read != 2)
+    {
+        return 0;
+    }
+    return static_cast<std::size_t>(pages_resident) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
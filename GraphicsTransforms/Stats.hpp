@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include <cstddef>
+
+// Parts of a frame GPU time of which is measured separately.
+// GPU timers can't be nested, so the passes don't overlap, and their sum is GPU time of the whole frame.
+enum struct RenderPass
+{
+    // Opaque quads, animations and camera pyramids.
+    scene,
+    rubiks_cubes,
+    cube_nxn,
+    terrain,
+    impostors,
+    prototype_groups,
+    city,
+    shadows,
+    visibility_buffer,
+    live_link,
+    particles_simulate,
+    particles_render,
+    transparency,
+    debug_draw,
+    hud,
+    count,
+};
+
+// Returns a human-readable name of the pass.
+const char* render_pass_name(RenderPass pass);
+
+// Returns how much physical memory the process occupies (resident set size on Linux and macOS,
+// working set size on Windows), or 0 if it's unknown.
+std::size_t process_memory_bytes();
+
+// Everything the main loop knows about the cost of one frame.
+// It's filled right before the HUD is rendered, so the HUD's own cost is the one of the previous frame,
+// and so are GPU times (a timer is read a few frames later, see GpuTimer).
+struct FrameStats
+{
+    // Time between the starts of this and the previous frame, i.e. including waiting for vsync.
+    double frame_ms;
+    // Time from the start of the frame till the HUD (CPU work of the frame, without the swap).
+    double cpu_ms;
+    // Zero for passes that are disabled.
+    double pass_gpu_ms[static_cast<std::size_t>(RenderPass::count)];
+
+    // See GlCounters.
+    std::size_t draw_calls;
+    std::size_t state_changes;
+    std::size_t buffer_uploads;
+    std::size_t bytes_uploaded;
+
+    // Translucent quads that passed/failed frustum culling.
+    std::size_t objects_visible;
+    std::size_t objects_culled;
+
+    // Memory the OS gave the process (resident set / working set).
+    std::size_t memory_process_bytes;
+    // Buffers and textures created by the subsystems (estimated from their sizes,
+    // the driver may allocate more).
+    std::size_t memory_gpu_bytes;
+
+    // Frames submitted by CPU that GPU hasn't finished yet (see GpuFrameQueue).
+    std::size_t gpu_frames_in_flight;
+    // Batches of the live link waiting in its ring at the start of the frame (zero if the link is closed).
+    std::size_t live_link_batches_queued;
+
+    // Cost of the HUD itself during the previous frame.
+    double hud_cpu_ms;
+
+    double gpu_ms() const
+    {
+        auto sum = 0.0;
+        for (const auto ms : pass_gpu_ms)
+        {
+            sum += ms;
+        }
+        return sum;
+    }
+};
@@ -0,0 +1,404 @@
+﻿#include "Terrain.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Frustum.hpp"
+
+// Heights are read with texelFetch, so the texture is never filtered and wraps by the mask.
+// Near the outer edge of the level the height is blended into the height of the coarser level:
+// the coarser grid has vertices only at even coordinates, and between them it's a straight line
+// along the edge or the diagonal of its quad, which is the average of the 2 neighbours.
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in uvec2 aGrid;
+out vec3 vNormal;
+out float vHeight;
+uniform mat4 view_projection;
+uniform sampler2DArray heightmap;
+uniform int level;
+uniform int texture_mask;
+uniform float spacing;
+uniform ivec2 grid_origin;
+uniform vec2 camera_xz;
+uniform float level_half_size;
+float height_at(ivec2 g)
+{
+    return texelFetch(heightmap, ivec3(g & texture_mask, level), 0).r;
+}
+void main()
+{
+    ivec2 g = ivec2(aGrid) + grid_origin;
+    vec2 position = vec2(g) * spacing;
+    ivec2 odd = g & 1;
+    ivec2 neighbour = ivec2(odd.x, -odd.y);
+    float height = height_at(g);
+    float height_coarse = 0.5 * (height_at(g - neighbour) + height_at(g + neighbour));
+    vec2 distance = abs(position - camera_xz) / level_half_size;
+    float blend = clamp((max(distance.x, distance.y) - 0.7) / 0.25, 0.0, 1.0);
+    height = mix(height, height_coarse, blend);
+
+    float dx = height_at(g + ivec2(1, 0)) - height_at(g - ivec2(1, 0));
+    float dz = height_at(g + ivec2(0, 1)) - height_at(g - ivec2(0, 1));
+    vNormal = normalize(vec3(-dx, 2.0 * spacing, -dz));
+    vHeight = height;
+    gl_Position = view_projection * vec4(position.x, height, position.y, 1.0);
+}
+)SHADER_SOURCE";
+
+// Grass on slopes and in valleys, rock on steep slopes, snow on peaks.
+static const auto shader_fragment_source = R"SHADER_SOURCE(#version 330 core
+in vec3 vNormal;
+in float vHeight;
+out vec4 FragColor;
+uniform float height_base;
+uniform float height_amplitude;
+void main()
+{
+    vec3 normal = normalize(vNormal);
+    float altitude = (vHeight - height_base) / height_amplitude;
+    vec3 color = mix(vec3(0.2, 0.45, 0.15), vec3(0.45, 0.4, 0.35), smoothstep(0.75, 0.6, normal.y));
+    color = mix(color, vec3(0.95), smoothstep(0.45, 0.6, altitude) * smoothstep(0.5, 0.8, normal.y));
+    float light = 0.3 + 0.7 * max(dot(normal, normalize(vec3(0.4, 0.8, 0.6))), 0.0);
+    FragColor = vec4(color * light, 1.0);
+}
+)SHADER_SOURCE";
+
+// Random value in [0, 1] of a lattice point.
+static float lattice_value(const int x, const int z)
+{
+    auto hash = static_cast<std::uint32_t>(x) * 0x8da6b343u ^ static_cast<std::uint32_t>(z) * 0xd8163841u;
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    return static_cast<float>(hash & 0xffffu) / 65535.0f;
+}
+
+// Value noise: smoothly interpolated random values of the integer lattice.
+static float value_noise(const float x, const float z)
+{
+    const auto x0 = std::floor(x);
+    const auto z0 = std::floor(z);
+    const auto ix = static_cast<int>(x0);
+    const auto iz = static_cast<int>(z0);
+    const auto tx = x - x0;
+    const auto tz = z - z0;
+    const auto sx = tx * tx * (3.0f - 2.0f * tx);
+    const auto sz = tz * tz * (3.0f - 2.0f * tz);
+    const auto a = lattice_value(ix, iz) + (lattice_value(ix + 1, iz) - lattice_value(ix, iz)) * sx;
+    const auto b = lattice_value(ix, iz + 1) + (lattice_value(ix + 1, iz + 1) - lattice_value(ix, iz + 1)) * sx;
+    return a + (b - a) * sz;
+}
+
+// Sum of octaves of noise from hills of 32 units to bumps of half a unit, scaled into the height range.
+static float terrain_height(const float x, const float z)
+{
+    constexpr int octaves{ 7 };
+    auto frequency = 1.0f / 32.0f;
+    auto amplitude = 0.5f;
+    auto sum = 0.0f;
+    auto amplitude_sum = 0.0f;
+    for (int i = 0; i != octaves; ++i)
+    {
+        sum += amplitude * value_noise(x * frequency, z * frequency);
+        amplitude_sum += amplitude;
+        frequency *= 2.0f;
+        amplitude *= 0.5f;
+    }
+    return Terrain::height_base + Terrain::height_amplitude * (2.0f * sum / amplitude_sum - 1.0f);
+}
+
+static float level_spacing(const std::size_t level)
+{
+    return Terrain::spacing_finest * static_cast<float>(1 << level);
+}
+
+// Index of the variant of the ring for the offset of the hole, see Terrain.
+static std::size_t ring_variant(const glm::ivec2& hole_offset)
+{
+    return static_cast<std::size_t>((hole_offset.x + 1) * 3 + hole_offset.y + 1);
+}
+
+static constexpr std::size_t variant_full{ Terrain::variants_count - 1 };
+
+// Maps an integer to [0, texture_size) the same way as the mask in the shader (also for negative integers).
+static int wrap(const int value)
+{
+    return value & (Terrain::texture_size - 1);
+}
+
+void Terrain::init()
+{
+    static_assert((texture_size & (texture_size - 1)) == 0, "texture_size has to be a power of 2");
+    static_assert(grid_quads % (2 * blocks_per_side) == 0 && grid_quads + 3 <= texture_size);
+
+    constexpr int vertices_per_side{ grid_quads + 1 };
+    std::vector<std::uint16_t> grid;
+    grid.reserve(vertices_per_side * vertices_per_side * 2);
+    for (int z = 0; z != vertices_per_side; ++z)
+    {
+        for (int x = 0; x != vertices_per_side; ++x)
+        {
+            grid.push_back(static_cast<std::uint16_t>(x));
+            grid.push_back(static_cast<std::uint16_t>(z));
+        }
+    }
+
+    // Indices are grouped by variant, then by block, so that each block is a range,
+    // and neighbouring visible blocks of a level merge into one draw call.
+    constexpr int block_quads{ grid_quads / blocks_per_side };
+    constexpr int hole_quads{ grid_quads / 2 };
+    std::vector<std::uint16_t> indices;
+    for (std::size_t variant = 0; variant != variants_count; ++variant)
+    {
+        const auto hole = variant != variant_full;
+        const glm::ivec2 hole_min{
+            grid_quads / 4 + static_cast<int>(variant / 3) - 1,
+            grid_quads / 4 + static_cast<int>(variant % 3) - 1,
+        };
+        for (std::size_t block = 0; block != blocks_count; ++block)
+        {
+            block_first[variant][block] = static_cast<std::uint32_t>(indices.size());
+            const auto block_x = static_cast<int>(block % blocks_per_side) * block_quads;
+            const auto block_z = static_cast<int>(block / blocks_per_side) * block_quads;
+            for (int z = block_z; z != block_z + block_quads; ++z)
+            {
+                for (int x = block_x; x != block_x + block_quads; ++x)
+                {
+                    if (hole && x >= hole_min.x && x < hole_min.x + hole_quads && z >= hole_min.y && z < hole_min.y + hole_quads)
+                    {
+                        continue;
+                    }
+                    // Counter-clockwise looking from above.
+                    const auto v00 = static_cast<std::uint16_t>(z * vertices_per_side + x);
+                    const auto v10 = static_cast<std::uint16_t>(v00 + 1);
+                    const auto v01 = static_cast<std::uint16_t>(v00 + vertices_per_side);
+                    const auto v11 = static_cast<std::uint16_t>(v01 + 1);
+                    indices.insert(indices.end(), { v00, v01, v10, v10, v01, v11 });
+                }
+            }
+            // Along the outer edge, every second vertex is in the middle of an edge of the coarser level.
+            // Even though heights there are blended to lie on that edge, rasterization of such T-junctions
+            // leaves pixel-sized cracks. Triangles of zero area between each 3 vertices of the edge fill them.
+            const auto vertex = [](const int x, const int z)
+                {
+                    return static_cast<std::uint16_t>(z * vertices_per_side + x);
+                };
+            for (int i = 0; i != block_quads; i += 2)
+            {
+                if (block_z == 0)
+                {
+                    indices.insert(indices.end(), { vertex(block_x + i, 0), vertex(block_x + i + 1, 0), vertex(block_x + i + 2, 0) });
+                }
+                if (block_z + block_quads == grid_quads)
+                {
+                    indices.insert(indices.end(), { vertex(block_x + i, grid_quads), vertex(block_x + i + 1, grid_quads), vertex(block_x + i + 2, grid_quads) });
+                }
+                if (block_x == 0)
+                {
+                    indices.insert(indices.end(), { vertex(0, block_z + i), vertex(0, block_z + i + 1), vertex(0, block_z + i + 2) });
+                }
+                if (block_x + block_quads == grid_quads)
+                {
+                    indices.insert(indices.end(), { vertex(grid_quads, block_z + i), vertex(grid_quads, block_z + i + 1), vertex(grid_quads, block_z + i + 2) });
+                }
+            }
+            block_count[variant][block] = static_cast<std::uint32_t>(indices.size()) - block_first[variant][block];
+        }
+    }
+    indices_count = indices.size();
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo_grid);
+    glGenBuffers(1, &ibo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_grid);
+    glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(std::uint16_t), grid.data(), GL_STATIC_DRAW);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_SHORT, 2 * sizeof(std::uint16_t), nullptr);
+    glEnableVertexAttribArray(0);
+    // The element array buffer binding is a part of the vertex array.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(std::uint16_t), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    glGenTextures(1, &texture_heightmap);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_heightmap);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, texture_size, texture_size, static_cast<GLsizei>(levels_count), 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+
+    shader_program = create_program(shader_vertex_source, shader_fragment_source, "terrain program");
+    gpu_timer.init();
+
+    texture_valid = false;
+    camera_xz = { };
+    for (auto& blocks : blocks_visible)
+    {
+        blocks = 0;
+    }
+    blocks_drawn = 0;
+    triangles_drawn = 0;
+    texels_uploaded = 0;
+}
+
+void Terrain::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program);
+    glDeleteTextures(1, &texture_heightmap);
+    glDeleteBuffers(1, &ibo);
+    glDeleteBuffers(1, &vbo_grid);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void Terrain::upload_column(const std::size_t level, const int x)
+{
+    // Texel z of the column holds the world row of the window that wraps to it.
+    float heights[texture_size];
+    const auto spacing = level_spacing(level);
+    const auto origin_z = texture_origins[level].y;
+    for (int i = 0; i != texture_size; ++i)
+    {
+        const auto z = origin_z + wrap(i - origin_z);
+        heights[i] = terrain_height(static_cast<float>(x) * spacing, static_cast<float>(z) * spacing);
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, wrap(x), 0, static_cast<GLint>(level), 1, texture_size, 1, GL_RED, GL_FLOAT, heights);
+    texels_uploaded += texture_size;
+}
+
+void Terrain::upload_row(const std::size_t level, const int z)
+{
+    float heights[texture_size];
+    const auto spacing = level_spacing(level);
+    const auto origin_x = texture_origins[level].x;
+    for (int i = 0; i != texture_size; ++i)
+    {
+        const auto x = origin_x + wrap(i - origin_x);
+        heights[i] = terrain_height(static_cast<float>(x) * spacing, static_cast<float>(z) * spacing);
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, wrap(z), static_cast<GLint>(level), texture_size, 1, 1, GL_RED, GL_FLOAT, heights);
+    texels_uploaded += texture_size;
+}
+
+void Terrain::update(const glm::vec3& camera_position)
+{
+    texels_uploaded = 0;
+    camera_xz = { camera_position.x, camera_position.z };
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_heightmap);
+    for (std::size_t level = 0; level != levels_count; ++level)
+    {
+        // Centers snap to even vertices of the level, which are vertices of the coarser level.
+        const auto spacing_double = 2.0f * level_spacing(level);
+        centers[level] = 2 * glm::ivec2{
+            static_cast<int>(std::floor(camera_position.x / spacing_double + 0.5f)),
+            static_cast<int>(std::floor(camera_position.z / spacing_double + 0.5f)),
+        };
+        const auto origin = centers[level] - texture_size / 2;
+        const auto origin_old = texture_origins[level];
+        texture_origins[level] = origin;
+        if (!texture_valid || std::abs(origin.x - origin_old.x) >= texture_size || std::abs(origin.y - origin_old.y) >= texture_size)
+        {
+            for (int z = origin.y; z != origin.y + texture_size; ++z)
+            {
+                upload_row(level, z);
+            }
+            continue;
+        }
+        // Columns that entered the window, then rows (their corner is uploaded twice, it's only a few texels).
+        for (int x = origin.x; x != origin.x + texture_size; ++x)
+        {
+            if (x < origin_old.x || x >= origin_old.x + texture_size)
+            {
+                upload_column(level, x);
+            }
+        }
+        for (int z = origin.y; z != origin.y + texture_size; ++z)
+        {
+            if (z < origin_old.y || z >= origin_old.y + texture_size)
+            {
+                upload_row(level, z);
+            }
+        }
+    }
+    texture_valid = true;
+}
+
+void Terrain::render(const glm::mat4& view_projection)
+{
+    gpu_timer.begin();
+    use_program(shader_program);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    glUniform1i(glGetUniformLocation(shader_program, "heightmap"), 0);
+    glUniform1i(glGetUniformLocation(shader_program, "texture_mask"), texture_size - 1);
+    glUniform1f(glGetUniformLocation(shader_program, "height_base"), height_base);
+    glUniform1f(glGetUniformLocation(shader_program, "height_amplitude"), height_amplitude);
+    bind_texture_array(GL_TEXTURE0, texture_heightmap);
+    bind_vertex_array(vao);
+
+    const auto frustum = calculate_frustum(view_projection);
+    blocks_drawn = 0;
+    triangles_drawn = 0;
+    for (std::size_t level = 0; level != levels_count; ++level)
+    {
+        const auto spacing = level_spacing(level);
+        const auto grid_origin = centers[level] - grid_quads / 2;
+        const auto variant = level == 0 ? variant_full : ring_variant(centers[level - 1] / 2 - centers[level]);
+        glUniform1i(glGetUniformLocation(shader_program, "level"), static_cast<GLint>(level));
+        glUniform1f(glGetUniformLocation(shader_program, "spacing"), spacing);
+        glUniform2i(glGetUniformLocation(shader_program, "grid_origin"), grid_origin.x, grid_origin.y);
+        glUniform2f(glGetUniformLocation(shader_program, "camera_xz"), camera_xz.x, camera_xz.y);
+        glUniform1f(glGetUniformLocation(shader_program, "level_half_size"), 0.5f * static_cast<float>(grid_quads) * spacing);
+        blocks_visible[level] = 0;
+
+        // Visible blocks that follow each other in the index buffer are drawn at once.
+        std::uint32_t run_first = 0;
+        std::uint32_t run_count = 0;
+        const auto flush = [&run_first, &run_count]()
+            {
+                if (run_count != 0)
+                {
+                    draw_elements(GL_TRIANGLES, static_cast<GLsizei>(run_count), GL_UNSIGNED_SHORT, run_first * sizeof(std::uint16_t));
+                }
+                run_count = 0;
+            };
+        constexpr int block_quads{ grid_quads / blocks_per_side };
+        for (std::size_t block = 0; block != blocks_count; ++block)
+        {
+            const auto count = block_count[variant][block];
+            // Blocks inside the hole are empty.
+            if (count == 0)
+            {
+                continue;
+            }
+            const auto block_origin = grid_origin + block_quads * glm::ivec2{
+                static_cast<int>(block % blocks_per_side),
+                static_cast<int>(block / blocks_per_side),
+            };
+            const auto min = glm::vec2{ block_origin } * spacing;
+            const auto max = glm::vec2{ block_origin + block_quads } * spacing;
+            const auto visible = frustum_intersects_box(frustum,
+                { min.x, height_base - height_amplitude, min.y },
+                { max.x, height_base + height_amplitude, max.y });
+            if (!visible)
+            {
+                flush();
+                continue;
+            }
+            blocks_visible[level] |= 1u << block;
+            if (run_count == 0)
+            {
+                run_first = block_first[variant][block];
+            }
+            run_count += count;
+            ++blocks_drawn;
+            triangles_drawn += count / 3;
+        }
+        flush();
+    }
+    gpu_timer.end();
+}
@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+// Endless terrain around the active camera as a geometry clipmap (Losasso and Hoppe).
+//
+// The terrain is a stack of levels, nested square grids of the same count of quads centered on the camera,
+// where every next level has quads 2 times larger. The finest level is a full grid, others are rings
+// with a hole for the finer level. So, distant terrain has as many triangles as nearby one, and the cost
+// doesn't depend on how large the world is.
+//
+// Centers of levels snap to their grids (to every second vertex, so that a finer level always lies on
+// lines of the coarser one), and the hole of a ring is off the center by -1, 0 or 1 quads.
+// All 9 variants of rings, plus the full grid, are prebuilt in one index buffer over one vertex buffer of the grid.
+// Near the outer edge of a level, heights are blended into heights of the coarser level, so that there are no cracks.
+//
+// Heights of each level are in a layer of a texture array that wraps around (toroidal addressing):
+// a vertex with world grid coordinates g reads the texel g mod texture_size. When the camera moves,
+// only the rows and columns that enter the level are generated and uploaded, the rest stays in place.
+// Heights come from a procedural function here, it stands in for streaming a heightmap from disk.
+//
+// Levels are split into 4x4 blocks, and blocks outside of the frustum aren't drawn.
+struct Terrain
+{
+    static constexpr std::size_t levels_count{ 6 };
+    // Quads along the side of a level. The hole is half of it, and a block is a quarter of it.
+    static constexpr int grid_quads{ 120 };
+    static constexpr int blocks_per_side{ 4 };
+    static constexpr std::size_t blocks_count{ blocks_per_side * blocks_per_side };
+    static_assert(blocks_count <= 32);
+    // The grid plus a texel on each side for normals has to fit into the texture.
+    static constexpr int texture_size{ 128 };
+    static constexpr float spacing_finest{ 1.0f / 16.0f };
+    // Heights are in [height_base - height_amplitude, height_base + height_amplitude], below the rest of the scene.
+    static constexpr float height_base{ -5.0f };
+    static constexpr float height_amplitude{ 3.0f };
+    // 9 offsets of the hole and the full grid.
+    static constexpr std::size_t variants_count{ 10 };
+
+    // Center of each level in units of its spacing (always even), and the first texel of its window in the texture.
+    glm::ivec2 centers[levels_count];
+    glm::ivec2 texture_origins[levels_count];
+    bool texture_valid;
+    // Blending into coarser levels depends on the distance to the camera.
+    glm::vec2 camera_xz;
+
+    unsigned vbo_grid, ibo, vao;
+    unsigned texture_heightmap;
+    unsigned shader_program;
+    // Ranges of the index buffer (in indices) of each block of each variant.
+    std::uint32_t block_first[variants_count][blocks_count];
+    std::uint32_t block_count[variants_count][blocks_count];
+    std::size_t indices_count;
+
+    // The latest frame. Bit b of blocks_visible[level] is set if block b of the level passed frustum culling.
+    std::uint32_t blocks_visible[levels_count];
+    std::size_t blocks_drawn;
+    std::size_t triangles_drawn;
+    std::size_t texels_uploaded;
+
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Moves levels to the camera and uploads heights that came into view.
+    void update(const glm::vec3& camera_position);
+    void render(const glm::mat4& view_projection);
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return (grid_quads + 1) * (grid_quads + 1) * 2 * sizeof(std::uint16_t) + indices_count * sizeof(std::uint16_t)
+            + levels_count * texture_size * texture_size * sizeof(float);
+    }
+
+private:
+    // Generates and uploads heights of a column (x is fixed) or a row (z is fixed) of the window of the level.
+    void upload_column(std::size_t level, int x);
+    void upload_row(std::size_t level, int z);
+};
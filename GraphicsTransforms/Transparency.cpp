@@ -0,0 +1,574 @@
+﻿#include "Transparency.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Frustum.hpp"
+
+// Vertex shader for instanced quads.
+// aPos is a vertex of the quad (the same for all instances),
+// aPositionScale and aColor change once per instance (see glVertexAttribDivisor in init).
+// For perspective projection, w coordinate in clip space is the distance from the camera plane
+// (for orthographic projection it's always 1). It's used by the weighted blended OIT.
+static const auto shader_vertex_instanced_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aPositionScale;
+layout (location = 2) in vec4 aColor;
+out vec4 vColor;
+out float vDepth;
+uniform mat4 view_projection;
+void main()
+{
+    gl_Position = view_projection * vec4(aPositionScale.xyz + aPos * aPositionScale.w, 1.0);
+    vColor = aColor;
+    vDepth = gl_Position.w;
+}
+)SHADER_SOURCE";
+
+// Fragment shader for the sorted mode, blending is done by the fixed-function
+// pipeline with glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA).
+static const auto shader_fragment_blend_source = R"SHADER_SOURCE(#version 330 core
+in vec4 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vColor;
+}
+)SHADER_SOURCE";
+
+// Fragment shader for the accumulation pass of the weighted blended OIT.
+// The weight function is one of the proposed by McGuire and Bavoil in
+// "Weighted Blended Order-Independent Transparency" (2013), closer fragments get bigger weights.
+// It uses the distance from the camera and not gl_FragCoord.z, because the latter is close to 1
+// for most of the perspective frustum, which makes weights of all fragments hit the upper bound,
+// and the sums overflow half floats when many quads overlap.
+//
+// Ideally, accumulation and revealage targets would use different blend functions,
+// but OpenGL 3.3 has one blend state for all draw buffers (glBlendFunci appeared in 4.0).
+// So, both targets use
+// glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA)
+// that is, color channels are summed, and alpha channel is multiplied by (1 - alpha).
+// The accumulation target (RGBA16F) receives the weighted premultiplied color in rgb channels,
+// and alpha in the alpha channel, so its alpha ends up being the product of (1 - alpha).
+// That's the revealage, stored in the alpha channel of the accumulation target.
+// The revealage target (R16F) has no alpha channel, so its red channel sums alpha * weight,
+// which is needed to normalize the accumulated color.
+static const auto shader_fragment_accumulate_source = R"SHADER_SOURCE(#version 330 core
+in vec4 vColor;
+in float vDepth;
+layout (location = 0) out vec4 Accumulation;
+layout (location = 1) out float Revealage;
+void main()
+{
+    float a = vColor.a;
+    float weight = clamp(10.0 / (1e-5 + pow(vDepth / 5.0, 2.0) + pow(vDepth / 200.0, 6.0)), 1e-2, 3e2);
+    Accumulation = vec4(vColor.rgb * a * weight, a);
+    Revealage = a * weight;
+}
+)SHADER_SOURCE";
+
+// Vertex shader of the full-screen triangle.
+// gl_VertexID is 0, 1, 2, which gives (-1, -1), (3, -1), (-1, 3) in clip space.
+// This triangle covers the whole screen, the parts outside are clipped.
+static const auto shader_vertex_fullscreen_source = R"SHADER_SOURCE(#version 330 core
+void main()
+{
+    vec2 pos = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);
+    gl_Position = vec4(pos, 0.0, 1.0);
+}
+)SHADER_SOURCE";
+
+// Fragment shader of the composite pass.
+// The output alpha is the revealage, and the blend function is
+// glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA)
+// so the result is average_color * (1 - revealage) + background * revealage.
+static const auto shader_fragment_composite_source = R"SHADER_SOURCE(#version 330 core
+uniform sampler2D accumulation;
+uniform sampler2D revealage;
+out vec4 FragColor;
+void main()
+{
+    ivec2 coords = ivec2(gl_FragCoord.xy);
+    vec4 accumulated = texelFetch(accumulation, coords, 0);
+    float reveal = accumulated.a;
+    // Nothing was rendered there, keep the background.
+    if (reveal == 1.0)
+    {
+        discard;
+    }
+    float weights = texelFetch(revealage, coords, 0).r;
+    FragColor = vec4(accumulated.rgb / max(weights, 1e-5), reveal);
+}
+)SHADER_SOURCE";
+
+// Quads are placed in a box in front of the first camera's initial position.
+static constexpr glm::vec3 box_min{ -3.0f, -2.0f, -8.0f };
+static constexpr glm::vec3 box_max{ 3.0f, 2.0f, -1.0f };
+
+void TranslucentQuads::init(const unsigned vbo_quad)
+{
+    mode = TransparencyMode::weighted_blended;
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo_instances);
+    glBindVertexArray(vao);
+
+    // Attribute 0 is a vertex of the quad, as in vao_quad.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_quad);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+    glEnableVertexAttribArray(0);
+
+    // Attributes 1 and 2 are taken from vbo_instances.
+    // glVertexAttribDivisor(i, 1) means that attribute i advances once per instance, not per vertex.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TranslucentQuadInstance), reinterpret_cast<void*>(offsetof(TranslucentQuadInstance, position_scale)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(TranslucentQuadInstance), reinterpret_cast<void*>(offsetof(TranslucentQuadInstance, color)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glGenVertexArrays(1, &vao_empty);
+
+    shader_program_blend = create_program(shader_vertex_instanced_source, shader_fragment_blend_source, "translucent blend program");
+    shader_program_accumulate = create_program(shader_vertex_instanced_source, shader_fragment_accumulate_source, "translucent accumulate program");
+    shader_program_composite = create_program(shader_vertex_fullscreen_source, shader_fragment_composite_source, "translucent composite program");
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &texture_accumulation);
+    glGenTextures(1, &texture_revealage);
+    glGenRenderbuffers(1, &rbo_depth);
+    glGenFramebuffers(1, &fbo_compare);
+    glGenTextures(1, &texture_compare);
+    glGenRenderbuffers(1, &rbo_compare_depth);
+    fbo_width = 0;
+    fbo_height = 0;
+
+    cpu_ms = 0.0;
+    gpu_timer.init();
+    uploaded_bytes = 0;
+    uploaded_ranges = 0;
+    move_random.seed(7);
+    instances_dirty.clear();
+
+    generate(count_initial);
+}
+
+void TranslucentQuads::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteRenderbuffers(1, &rbo_compare_depth);
+    glDeleteTextures(1, &texture_compare);
+    glDeleteFramebuffers(1, &fbo_compare);
+    glDeleteRenderbuffers(1, &rbo_depth);
+    glDeleteTextures(1, &texture_revealage);
+    glDeleteTextures(1, &texture_accumulation);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteProgram(shader_program_composite);
+    glDeleteProgram(shader_program_accumulate);
+    glDeleteProgram(shader_program_blend);
+    glDeleteVertexArrays(1, &vao_empty);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo_instances);
+}
+
+void TranslucentQuads::generate(const std::size_t count)
+{
+    // The denser the field, the smaller the quads, so that they overlap roughly the same amount.
+    const auto box_size = box_max - box_min;
+    const auto size = 2.0f * std::cbrt(box_size.x * box_size.y * box_size.z / static_cast<float>(count));
+
+    // Fixed seed makes the field the same on every run.
+    std::mt19937 random{ 42 };
+    std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+    instances.resize(count);
+    for (auto& instance : instances)
+    {
+        const glm::vec3 position = box_min + box_size * glm::vec3{ unit(random), unit(random), unit(random) };
+        instance.position_scale = glm::vec4{ position, size * (0.5f + unit(random)) };
+        instance.color = glm::vec4{ unit(random), unit(random), unit(random), 0.2f + 0.5f * unit(random) };
+    }
+    instances_sorted.resize(count);
+    instances_sorted_count = 0;
+    visible.assign(count, 1);
+    visible_count = count;
+    depths.resize(count);
+    depth_sorter.reset(count);
+    instances_dirty.mark_all();
+}
+
+void TranslucentQuads::move(const std::size_t count)
+{
+    constexpr std::size_t group_size{ 4 };
+    constexpr float step{ 0.02f };
+    const auto quads_count = instances.size();
+    if (quads_count < group_size)
+    {
+        return;
+    }
+    std::uniform_int_distribution<std::size_t> group_first{ 0, quads_count - group_size };
+    std::uniform_real_distribution<float> offset{ -step, step };
+    for (std::size_t moved = 0; moved < count; moved += group_size)
+    {
+        const auto first = group_first(move_random);
+        for (auto i = first; i != first + group_size; ++i)
+        {
+            auto& position_scale = instances[i].position_scale;
+            const auto position = glm::clamp(glm::vec3{ position_scale } + glm::vec3{ offset(move_random), offset(move_random), offset(move_random) }, box_min, box_max);
+            position_scale = glm::vec4{ position, position_scale.w };
+            instances_dirty.mark(i);
+        }
+    }
+}
+
+void TranslucentQuads::resize_targets(const int width, const int height)
+{
+    if (width == fbo_width && height == fbo_height)
+    {
+        return;
+    }
+    fbo_width = width;
+    fbo_height = height;
+
+    // Half floats are needed, because the accumulated values are way outside of [0, 1].
+    glBindTexture(GL_TEXTURE_2D, texture_accumulation);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, texture_revealage);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_accumulation, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texture_revealage, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo_depth);
+    constexpr GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, draw_buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Error: transparency framebuffer is incomplete" << std::endl;
+        std::exit(1);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture_compare);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_compare_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_compare);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_compare, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo_compare_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Error: transparency compare framebuffer is incomplete" << std::endl;
+        std::exit(1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void TranslucentQuads::cull(const glm::mat4& view_projection)
+{
+    // It's the case of one view, so rendering and the comparison of culling (F12) use the same kernel.
+    cull_views(&view_projection, 1);
+    const auto count = instances.size();
+    std::size_t visible_count_new = 0;
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const auto is_visible = static_cast<std::uint8_t>(view_masks[i] & 1);
+        visible[i] = is_visible;
+        visible_count_new += is_visible;
+    }
+    visible_count = visible_count_new;
+}
+
+void TranslucentQuads::cull_views(const glm::mat4* const view_projections, const std::size_t count)
+{
+    Frustum frustums[multi_view_frustums_max];
+    const auto views_count = std::min(count, multi_view_frustums_max);
+    for (std::size_t v = 0; v != views_count; ++v)
+    {
+        frustums[v] = calculate_frustum(view_projections[v]);
+    }
+    view_masks.resize(instances.size());
+    if (instances.empty())
+    {
+        return;
+    }
+    cull_spheres_multi_view(frustums, views_count, &instances.data()->position_scale, sizeof(TranslucentQuadInstance),
+        bounding_radius_scale, instances.size(), view_masks.data());
+}
+
+void TranslucentQuads::compare_culling(const glm::mat4& view, const glm::mat4& projection)
+{
+    const auto count = instances.size();
+    std::vector<std::uint64_t> view_masks_separate(count);
+    std::vector<glm::mat4> view_projections;
+    std::vector<Frustum> frustums;
+
+    // The best of a few runs, to hide noise.
+    constexpr std::size_t runs_count{ 5 };
+    const auto measure = [](const auto& function)
+        {
+            auto best_ms = 1e30;
+            for (std::size_t run = 0; run != runs_count; ++run)
+            {
+                const auto time_start = std::chrono::steady_clock::now();
+                function();
+                const auto time_end = std::chrono::steady_clock::now();
+                best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(time_end - time_start).count());
+            }
+            return best_ms;
+        };
+
+    std::cout << "Multi-view culling of " << count << " quads:" << std::endl;
+    for (std::size_t views_count = 1; views_count <= multi_view_frustums_max; views_count *= 2)
+    {
+        // Views are the camera turned around its vertical axis, like a ring of cameras at the same place.
+        view_projections.clear();
+        frustums.clear();
+        for (std::size_t v = 0; v != views_count; ++v)
+        {
+            const auto angle = glm::two_pi<float>() * static_cast<float>(v) / static_cast<float>(views_count);
+            view_projections.push_back(projection * glm::rotate(glm::mat4{ 1.0f }, angle, glm::vec3{ 0.0f, 1.0f, 0.0f }) * view);
+            frustums.push_back(calculate_frustum(view_projections.back()));
+        }
+
+        const auto separate_ms = measure([&]()
+            {
+                std::fill(view_masks_separate.begin(), view_masks_separate.end(), 0);
+                for (std::size_t v = 0; v != views_count; ++v)
+                {
+                    for (std::size_t i = 0; i != count; ++i)
+                    {
+                        const auto& instance = instances[i];
+                        const auto is_visible = frustum_intersects_sphere(frustums[v], glm::vec3{ instance.position_scale }, bounding_radius(instance));
+                        view_masks_separate[i] |= static_cast<std::uint64_t>(is_visible) << v;
+                    }
+                }
+            });
+        const auto single_pass_ms = measure([&]()
+            {
+                cull_views(view_projections.data(), views_count);
+            });
+
+        std::size_t visible_sum = 0;
+        std::size_t mismatches = 0;
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            visible_sum += static_cast<std::size_t>(std::popcount(view_masks[i]));
+            mismatches += view_masks[i] != view_masks_separate[i];
+        }
+        const auto bounds_bytes = count * sizeof(TranslucentQuadInstance);
+        std::cout << "  " << views_count << " views: view by view " << separate_ms << " ms (" << views_count * bounds_bytes / 1024 << " KB read)"
+            << ", one pass " << single_pass_ms << " ms (" << bounds_bytes / 1024 << " KB read)"
+            << ", " << visible_sum / views_count << " visible per view, " << mismatches << " mismatches" << std::endl;
+    }
+}
+
+void TranslucentQuads::sort(const glm::mat4& view)
+{
+    // The third row of the view matrix gives z coordinate in view space.
+    // The camera looks towards -z, so the farthest quads have the lowest z.
+    // All quads are sorted, not only visible ones, so that the order stays coherent
+    // when quads enter and leave the frustum.
+    const glm::vec4 view_z_row{ view[0][2], view[1][2], view[2][2], view[3][2] };
+    const auto count = instances.size();
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        depths[i] = glm::dot(view_z_row, glm::vec4{ glm::vec3{ instances[i].position_scale }, 1.0f });
+    }
+    depth_sorter.sort(depths.data());
+    const auto& order = depth_sorter.order;
+    std::size_t sorted_count = 0;
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const auto index = order[i];
+        if (visible[index])
+        {
+            instances_sorted[sorted_count++] = instances[index];
+        }
+    }
+    instances_sorted_count = sorted_count;
+}
+
+void TranslucentQuads::render_sorted(const glm::mat4& view_projection)
+{
+    // The buffer is reloaded every frame, GL_STREAM_DRAW hints that.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    buffer_data(GL_ARRAY_BUFFER, instances_sorted_count * sizeof(TranslucentQuadInstance), instances_sorted.data(), GL_STREAM_DRAW);
+    uploaded_bytes = instances_sorted_count * sizeof(TranslucentQuadInstance);
+    uploaded_ranges = 1;
+    // The order in the buffer is valid only for this frame.
+    instances_dirty.mark_all();
+
+    // Translucent quads are tested against the depth buffer, but don't write to it,
+    // otherwise a quad would hide the quads behind it.
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    use_program(shader_program_blend);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_blend, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    bind_vertex_array(vao);
+    draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(instances_sorted_count));
+
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
+
+void TranslucentQuads::render_weighted_blended(const glm::mat4& view_projection, const int width, const int height, const unsigned framebuffer)
+{
+    // The order doesn't matter, so only the quads that changed are reloaded.
+    // Usually few quads move in a frame, and their runs are much smaller than the whole buffer.
+    uploaded_bytes = 0;
+    uploaded_ranges = 0;
+    if (instances_dirty.all)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+        buffer_data(GL_ARRAY_BUFFER, instances.size() * sizeof(TranslucentQuadInstance), instances.data(), GL_DYNAMIC_DRAW);
+        uploaded_bytes = instances.size() * sizeof(TranslucentQuadInstance);
+        uploaded_ranges = 1;
+    }
+    else if (!instances_dirty.empty())
+    {
+        instances_dirty.coalesce(instances.size(), dirty_gap_max);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+        for (const auto& range : instances_dirty.ranges)
+        {
+            buffer_sub_data(GL_ARRAY_BUFFER, range.first * sizeof(TranslucentQuadInstance), range.count * sizeof(TranslucentQuadInstance), instances.data() + range.first);
+            uploaded_bytes += range.count * sizeof(TranslucentQuadInstance);
+        }
+        uploaded_ranges = instances_dirty.ranges.size();
+    }
+    instances_dirty.clear();
+
+    resize_targets(width, height);
+
+    // Copy depth of the opaque scene, so that opaque objects hide translucent quads behind them.
+    bind_framebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    bind_framebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    // Accumulation starts from zero color, and revealage starts from 1 (everything behind is visible).
+    bind_framebuffer(GL_FRAMEBUFFER, fbo);
+    constexpr float accumulation_clear[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    constexpr float revealage_clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, accumulation_clear);
+    glClearBufferfv(GL_COLOR, 1, revealage_clear);
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+    use_program(shader_program_accumulate);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_accumulate, "view_projection"), 1, GL_FALSE, glm::value_ptr(view_projection));
+    bind_vertex_array(vao);
+    draw_arrays_instanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(instances.size()));
+
+    // Composite the result over the opaque scene.
+    // Depth test is not needed, it was already done in the accumulation pass.
+    bind_framebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+    use_program(shader_program_composite);
+    bind_texture(GL_TEXTURE0, texture_accumulation);
+    bind_texture(GL_TEXTURE1, texture_revealage);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shader_program_composite, "accumulation"), 0);
+    glUniform1i(glGetUniformLocation(shader_program_composite, "revealage"), 1);
+    bind_vertex_array(vao_empty);
+    draw_arrays(GL_TRIANGLES, 0, 3);
+
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
+
+void TranslucentQuads::render(const glm::mat4& view, const glm::mat4& projection, const int width, const int height, const unsigned framebuffer)
+{
+    const auto view_projection = projection * view;
+    const auto time_start = std::chrono::steady_clock::now();
+    gpu_timer.begin();
+    switch (mode)
+    {
+    case TransparencyMode::weighted_blended:
+        render_weighted_blended(view_projection, width, height, framebuffer);
+        break;
+    case TransparencyMode::sorted:
+        sort(view);
+        render_sorted(view_projection);
+        break;
+    }
+    gpu_timer.end();
+    const auto time_end = std::chrono::steady_clock::now();
+    cpu_ms = std::chrono::duration<double, std::milli>(time_end - time_start).count();
+}
+
+std::size_t TranslucentQuads::gpu_memory_bytes() const
+{
+    // RGBA16F + R16F + D24S8 for OIT, and RGBA8 + D24S8 for the comparison.
+    const auto pixels_count = static_cast<std::size_t>(fbo_width) * fbo_height;
+    return instances.size() * sizeof(TranslucentQuadInstance) + pixels_count * (8 + 2 + 4 + 4 + 4);
+}
+
+void TranslucentQuads::compare_quality(const glm::mat4& view, const glm::mat4& projection, const int width, const int height)
+{
+    resize_targets(width, height);
+
+    const auto pixels_count = static_cast<std::size_t>(width) * height;
+    std::vector<unsigned char> pixels_sorted(pixels_count * 4);
+    std::vector<unsigned char> pixels_weighted_blended(pixels_count * 4);
+
+    // Both modes have to render the same set of quads.
+    cull(projection * view);
+
+    const auto mode_saved = mode;
+    const auto render_to = [&](const TransparencyMode m, std::vector<unsigned char>& pixels)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo_compare);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            mode = m;
+            render(view, projection, width, height, fbo_compare);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo_compare);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        };
+    render_to(TransparencyMode::sorted, pixels_sorted);
+    render_to(TransparencyMode::weighted_blended, pixels_weighted_blended);
+    mode = mode_saved;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Root mean square error and maximum error over rgb channels, in [0, 255].
+    double error_squared_sum = 0.0;
+    int error_max = 0;
+    std::size_t pixels_different = 0;
+    for (std::size_t i = 0; i != pixels_count; ++i)
+    {
+        auto pixel_different = false;
+        for (std::size_t c = 0; c != 3; ++c)
+        {
+            const auto error = std::abs(static_cast<int>(pixels_sorted[4 * i + c]) - static_cast<int>(pixels_weighted_blended[4 * i + c]));
+            error_squared_sum += static_cast<double>(error) * error;
+            error_max = std::max(error_max, error);
+            pixel_different = pixel_different || error > 2;
+        }
+        pixels_different += pixel_different;
+    }
+    const auto rmse = std::sqrt(error_squared_sum / static_cast<double>(pixels_count * 3));
+    std::cout << "Transparency quality (weighted blended vs sorted, " << instances.size() << " quads): "
+        << "RMSE " << rmse << ", max error " << error_max << ", "
+        << 100.0 * static_cast<double>(pixels_different) / static_cast<double>(pixels_count) << "% pixels differ by more than 2"
+        << std::endl;
+}
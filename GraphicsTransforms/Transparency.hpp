@@ -0,0 +1,148 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "DepthSort.hpp"
+#include "DirtyRanges.hpp"
+#include "GlUtils.hpp"
+
+// Data of one translucent quad. It's uploaded to GPU as is,
+// so the layout has to match vertex attributes set in TranslucentQuads::init.
+struct TranslucentQuadInstance
+{
+    // xyz is the center of the quad in world space, w is its size.
+    glm::vec4 position_scale;
+    // Color of the quad, alpha is its opacity (not premultiplied).
+    glm::vec4 color;
+};
+
+// There are 2 ways to render translucent quads.
+enum struct TransparencyMode
+{
+    // Weighted blended order-independent transparency (OIT).
+    // Quads are rendered in arbitrary order with one instanced draw call into 2 targets:
+    // 1. Accumulation - sum of colors premultiplied by alpha and by a weight,
+    //    that depends on the depth (closer quads get bigger weights).
+    // 2. Revealage - product of (1 - alpha), that is, how much of the background is still visible.
+    // Then a full-screen composite pass divides the accumulated color by the sum of weights and
+    // blends it over the opaque scene using revealage.
+    // The result is an approximation, but it doesn't require sorting.
+    weighted_blended,
+    // Classical alpha blending. Quads are sorted on CPU from the farthest to the closest,
+    // and then rendered in this order with one instanced draw call.
+    // The result is exact, but sorting has to be done every frame
+    // (DepthSorter makes it cheaper by reusing the order of the previous frame).
+    sorted,
+};
+
+// A field of instanced translucent quads (useful to see how transparency scales with the count).
+struct TranslucentQuads
+{
+    // The maximum count of quads, and how many quads are generated on init.
+    static constexpr std::size_t count_max{ std::size_t{ 1 } << 22 };
+    static constexpr std::size_t count_initial{ std::size_t{ 1 } << 16 };
+    // Dirty runs closer than this count of quads (256 bytes) are uploaded as one.
+    static constexpr std::size_t dirty_gap_max{ 8 };
+
+    std::vector<TranslucentQuadInstance> instances;
+    // Copy of visible instances, sorted from the farthest to the closest (used by TransparencyMode::sorted).
+    std::vector<TranslucentQuadInstance> instances_sorted;
+    std::size_t instances_sorted_count;
+    // Result of the last frustum culling: visible[i] is 1 if the instance i intersects the frustum.
+    // TransparencyMode::sorted renders only visible quads. TransparencyMode::weighted_blended renders
+    // all of them, because its instance buffer is static, and GPU clips invisible quads anyway.
+    std::vector<std::uint8_t> visible;
+    std::size_t visible_count;
+    // Result of the last culling against several views: bit v of view_masks[i] is set if the instance i
+    // intersects the frustum of the view v.
+    std::vector<std::uint64_t> view_masks;
+    // Depths of instances in view space.
+    std::vector<float> depths;
+    DepthSorter depth_sorter;
+
+    TransparencyMode mode;
+
+    // Instance buffer and vertex array that takes vertices from vbo_quad and per-instance data from vbo_instances.
+    unsigned vbo_instances, vao;
+    // Quads that changed since vbo_instances was loaded. All of them are dirty after the count change,
+    // or when the buffer holds the sorted copy.
+    DirtyRanges instances_dirty;
+    // Bytes and calls uploaded into vbo_instances during the last render.
+    std::size_t uploaded_bytes;
+    std::size_t uploaded_ranges;
+
+    // Random numbers for move.
+    std::mt19937 move_random;
+
+    // Shader program for TransparencyMode::sorted.
+    unsigned shader_program_blend;
+    // Shader programs for TransparencyMode::weighted_blended.
+    unsigned shader_program_accumulate, shader_program_composite;
+    // The composite pass draws a full-screen triangle, the vertices of which are calculated in the shader.
+    // Still, OpenGL core profile requires some vertex array object to be bound.
+    unsigned vao_empty;
+
+    // Framebuffer with accumulation and revealage targets, and a depth buffer
+    // that's a copy of the opaque scene's depth buffer.
+    unsigned fbo, texture_accumulation, texture_revealage, rbo_depth;
+    int fbo_width, fbo_height;
+
+    // Offscreen framebuffer used to compare quality of the modes.
+    unsigned fbo_compare, texture_compare, rbo_compare_depth;
+
+    // Time spent on CPU (sorting and uploading) and on GPU during the last render.
+    double cpu_ms;
+    GpuTimer gpu_timer;
+
+    // vbo_quad contains 6 vertices of a quad, 3 floats each.
+    void init(unsigned vbo_quad);
+    void destroy();
+
+    // Regenerates count quads with random positions, sizes and colors.
+    void generate(std::size_t count);
+
+    // Moves count random quads a bit (in groups of neighbours in the array, like objects spawned together),
+    // while the rest of the field stays. Moved quads are marked dirty.
+    void move(std::size_t count);
+
+    // Returns the radius of the bounding sphere of the instance.
+    // The quad is 1x1 before scaling, so the radius is half of its diagonal.
+    static constexpr float bounding_radius_scale{ 0.70710678f };
+    static float bounding_radius(const TranslucentQuadInstance& instance)
+    {
+        return instance.position_scale.w * bounding_radius_scale;
+    }
+
+    // Tests bounding spheres of quads against the frustum with cull_views and fills visible.
+    void cull(const glm::mat4& view_projection);
+
+    // Tests bounding spheres of quads against up to multi_view_frustums_max frustums in one pass and fills view_masks.
+    void cull_views(const glm::mat4* view_projections, std::size_t count);
+
+    // Culls quads against a growing count of views around the camera, both view by view and in one pass,
+    // and prints time of both ways.
+    void compare_culling(const glm::mat4& view, const glm::mat4& projection);
+
+    // Renders quads over the opaque scene that's already in framebuffer
+    // (0 is the window, otherwise it has to have a depth buffer of type GL_DEPTH24_STENCIL8).
+    void render(const glm::mat4& view, const glm::mat4& projection, int width, int height, unsigned framebuffer);
+
+    // Renders quads over black background in both modes and prints the difference between them.
+    // The sorted mode is the reference, since it produces the exact result.
+    // Quads are culled with the given matrices, so cull() has to be called again before the next render.
+    void compare_quality(const glm::mat4& view, const glm::mat4& projection, int width, int height);
+
+    // Size of the instance buffer and the render targets.
+    std::size_t gpu_memory_bytes() const;
+
+private:
+    void resize_targets(int width, int height);
+    void sort(const glm::mat4& view);
+    void render_sorted(const glm::mat4& view_projection);
+    void render_weighted_blended(const glm::mat4& view_projection, int width, int height, unsigned framebuffer);
+};
@@ -0,0 +1,428 @@
+﻿#include "VisibilityBuffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Shared by the forward fragment shader and the resolve pass, so both paths produce the same image.
+// Everything is in view space.
+static const auto shader_shading_source = R"SHADER_SOURCE(
+vec3 shade(vec3 position, vec3 normal)
+{
+    vec3 albedo = 0.5 + 0.5 * sin(position * 3.0 + vec3(0.0, 2.0, 4.0));
+    vec3 color = 0.05 * albedo;
+    vec3 view_direction = normalize(-position);
+    for (int i = 0; i != 16; ++i)
+    {
+        float angle = float(i) * 0.3927;
+        vec3 light_position = vec3(4.0 * cos(angle), 3.0 * sin(2.0 * angle), -4.0 - 2.0 * sin(angle));
+        vec3 light_color = 0.5 + 0.5 * cos(vec3(angle, angle + 2.0, angle + 4.0));
+        vec3 to_light = light_position - position;
+        float distance_squared = dot(to_light, to_light);
+        vec3 light_direction = to_light * inversesqrt(distance_squared);
+        float diffuse = max(dot(normal, light_direction), 0.0);
+        float specular = pow(max(dot(normal, normalize(light_direction + view_direction)), 0.0), 32.0);
+        color += light_color * (albedo * diffuse + specular) * 4.0 / (1.0 + distance_squared);
+    }
+    return color;
+}
+)SHADER_SOURCE";
+
+// An instance is an offset (xyz) and a scale (w) in view space.
+static const auto shader_vertex_source = R"SHADER_SOURCE(#version 330 core
+layout (location = 0) in vec4 aPosition;
+layout (location = 1) in vec4 aNormal;
+layout (location = 2) in vec4 aInstance;
+out vec3 vPosition;
+out vec3 vNormal;
+flat out uint vInstance;
+uniform mat4 projection;
+void main()
+{
+    vPosition = aInstance.xyz + aInstance.w * aPosition.xyz;
+    vNormal = aNormal.xyz;
+    vInstance = uint(gl_InstanceID);
+    gl_Position = projection * vec4(vPosition, 1.0);
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_forward_source = R"SHADER_SOURCE(
+in vec3 vPosition;
+in vec3 vNormal;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(shade(vPosition, normalize(vNormal)), 1.0);
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_ids_source = R"SHADER_SOURCE(#version 330 core
+flat in uint vInstance;
+out uvec2 Ids;
+void main()
+{
+    Ids = uvec2(vInstance + 1u, uint(gl_PrimitiveID));
+}
+)SHADER_SOURCE";
+
+// A triangle that covers the whole viewport.
+static const auto shader_vertex_resolve_source = R"SHADER_SOURCE(#version 330 core
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+)SHADER_SOURCE";
+
+static const auto shader_fragment_resolve_source = R"SHADER_SOURCE(
+out vec4 FragColor;
+uniform usampler2D ids;
+uniform samplerBuffer vertices;
+uniform usamplerBuffer indices;
+uniform samplerBuffer instances;
+uniform mat4 projection;
+uniform vec4 viewport;
+float cross2(vec2 a, vec2 b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+void main()
+{
+    uvec2 id = texelFetch(ids, ivec2(gl_FragCoord.xy - viewport.xy), 0).xy;
+    if (id.x == 0u)
+    {
+        discard;
+    }
+    vec4 instance = texelFetch(instances, int(id.x) - 1);
+    vec3 positions[3];
+    vec3 normals[3];
+    vec4 clip[3];
+    for (int i = 0; i != 3; ++i)
+    {
+        int index = int(texelFetch(indices, int(id.y) * 3 + i).x);
+        positions[i] = instance.xyz + instance.w * texelFetch(vertices, index * 2).xyz;
+        normals[i] = texelFetch(vertices, index * 2 + 1).xyz;
+        clip[i] = projection * vec4(positions[i], 1.0);
+    }
+    // Barycentrics of the pixel center in screen space, then corrected for perspective by 1 / w.
+    vec2 pixel = (gl_FragCoord.xy - viewport.xy) / viewport.zw * 2.0 - 1.0;
+    vec2 s0 = clip[0].xy / clip[0].w;
+    vec2 s1 = clip[1].xy / clip[1].w;
+    vec2 s2 = clip[2].xy / clip[2].w;
+    float area = cross2(s1 - s0, s2 - s0);
+    float b1 = cross2(pixel - s0, s2 - s0) / area;
+    float b2 = cross2(s1 - s0, pixel - s0) / area;
+    vec3 weights = vec3(1.0 - b1 - b2, b1, b2) / vec3(clip[0].w, clip[1].w, clip[2].w);
+    weights /= weights.x + weights.y + weights.z;
+    vec3 position = weights.x * positions[0] + weights.y * positions[1] + weights.z * positions[2];
+    vec3 normal = normalize(weights.x * normals[0] + weights.y * normals[1] + weights.z * normals[2]);
+    // The depth is written, so that the rest of the scene is depth tested against the stack as usual.
+    vec4 position_clip = projection * vec4(position, 1.0);
+    gl_FragDepth = position_clip.z / position_clip.w * 0.5 + 0.5;
+    FragColor = vec4(shade(position, normal), 1.0);
+}
+)SHADER_SOURCE";
+
+void VisibilityBuffer::init()
+{
+    // A sphere with bumps, a ring of vertices per latitude (poles are rings of the same vertex).
+    std::vector<VisibilityBufferVertex> vertices;
+    const auto surface = [](const float theta, const float phi)
+        {
+            const auto radius = 1.0f + 0.12f * std::sin(7.0f * theta) * std::sin(5.0f * phi);
+            return radius * glm::vec3{ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+        };
+    constexpr auto pi = glm::pi<float>();
+    for (int ring = 0; ring <= mesh_rings; ++ring)
+    {
+        for (int segment = 0; segment <= mesh_segments; ++segment)
+        {
+            const auto theta = pi * static_cast<float>(ring) / static_cast<float>(mesh_rings);
+            const auto phi = 2.0f * pi * static_cast<float>(segment) / static_cast<float>(mesh_segments);
+            // The normal is from the derivatives of the surface, near the poles it's the direction from the center.
+            constexpr float step{ 1e-3f };
+            const auto position = surface(theta, phi);
+            auto normal = glm::cross(surface(theta, phi + step) - position, surface(theta + step, phi) - position);
+            normal = glm::length(normal) > 1e-9f ? glm::normalize(normal) : glm::normalize(position);
+            vertices.push_back({ glm::vec4{ position, 1.0f }, glm::vec4{ normal, 0.0f } });
+        }
+    }
+    std::vector<unsigned> indices;
+    for (int ring = 0; ring != mesh_rings; ++ring)
+    {
+        for (int segment = 0; segment != mesh_segments; ++segment)
+        {
+            const auto a = static_cast<unsigned>(ring * (mesh_segments + 1) + segment);
+            const auto b = a + static_cast<unsigned>(mesh_segments + 1);
+            indices.insert(indices.end(), { a, a + 1, b, b, a + 1, b + 1 });
+        }
+    }
+    vertices_count = vertices.size();
+    indices_count = indices.size();
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo_vertices);
+    glGenBuffers(1, &ibo);
+    glGenBuffers(1, &vbo_instances);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VisibilityBufferVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(VisibilityBufferVertex), reinterpret_cast<void*>(offsetof(VisibilityBufferVertex, position)));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VisibilityBufferVertex), reinterpret_cast<void*>(offsetof(VisibilityBufferVertex, normal)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    glBufferData(GL_ARRAY_BUFFER, instances_max * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), nullptr);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glGenVertexArrays(1, &vao_empty);
+
+    const auto create_buffer_texture = [](unsigned& texture, const GLenum format, const unsigned buffer)
+        {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        };
+    create_buffer_texture(texture_vertices, GL_RGBA32F, vbo_vertices);
+    create_buffer_texture(texture_indices, GL_R32UI, ibo);
+    create_buffer_texture(texture_instances, GL_RGBA32F, vbo_instances);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    texture_ids = 0;
+    rbo_depth = 0;
+    fbo = 0;
+    target_width = 0;
+    target_height = 0;
+
+    const auto shader_fragment_forward = std::string{ "#version 330 core\n" } + shader_shading_source + shader_fragment_forward_source;
+    const auto shader_fragment_resolve = std::string{ "#version 330 core\n" } + shader_shading_source + shader_fragment_resolve_source;
+    shader_program_forward = create_program(shader_vertex_source, shader_fragment_forward.c_str(), "forward program");
+    shader_program_ids = create_program(shader_vertex_source, shader_fragment_ids_source, "visibility buffer program");
+    shader_program_resolve = create_program(shader_vertex_resolve_source, shader_fragment_resolve.c_str(), "visibility buffer resolve program");
+    gpu_timer.init();
+
+    path = ShadingPath::forward;
+    layers = 4;
+    placed_projection = glm::mat4{ 0.0f };
+    placed_layers = 0;
+}
+
+void VisibilityBuffer::destroy()
+{
+    gpu_timer.destroy();
+    glDeleteProgram(shader_program_resolve);
+    glDeleteProgram(shader_program_ids);
+    glDeleteProgram(shader_program_forward);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo_depth);
+    glDeleteTextures(1, &texture_ids);
+    glDeleteTextures(1, &texture_instances);
+    glDeleteTextures(1, &texture_indices);
+    glDeleteTextures(1, &texture_vertices);
+    glDeleteVertexArrays(1, &vao_empty);
+    glDeleteBuffers(1, &vbo_instances);
+    glDeleteBuffers(1, &ibo);
+    glDeleteBuffers(1, &vbo_vertices);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void VisibilityBuffer::place_instances(const glm::mat4& projection)
+{
+    // Half size of the view at a distance: it grows with the distance for perspective projections,
+    // and is constant for orthographic ones (the last row of those is (0, 0, 0, 1)).
+    const auto orthographic = projection[3][3] == 1.0f;
+    const auto half_size = [&projection, orthographic](const float distance)
+        {
+            const auto scale = orthographic ? 1.0f : distance;
+            return glm::vec2{ scale / projection[0][0], scale / projection[1][1] };
+        };
+    // Layers go from far to near, which is the worst order for forward shading.
+    std::vector<glm::vec4> instances;
+    instances.reserve(layers * grid_columns * grid_rows);
+    for (auto layer = layers; layer-- != 0;)
+    {
+        const auto distance = layer_depth_first + layer_spacing * static_cast<float>(layer);
+        const auto half = half_size(distance);
+        const glm::vec2 cell{ 2.0f * half.x / static_cast<float>(grid_columns), 2.0f * half.y / static_cast<float>(grid_rows) };
+        // Spheres are a bit larger than cells, so that they cover the view without gaps.
+        const auto scale = 0.75f * std::max(cell.x, cell.y);
+        for (std::size_t row = 0; row != grid_rows; ++row)
+        {
+            for (std::size_t column = 0; column != grid_columns; ++column)
+            {
+                instances.push_back({
+                    -half.x + cell.x * (static_cast<float>(column) + 0.5f),
+                    -half.y + cell.y * (static_cast<float>(row) + 0.5f),
+                    -distance,
+                    scale,
+                });
+            }
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+    buffer_sub_data(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::vec4), instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    placed_projection = projection;
+    placed_layers = layers;
+}
+
+void VisibilityBuffer::resize_target(const int width, const int height)
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo_depth);
+    glDeleteTextures(1, &texture_ids);
+
+    glGenTextures(1, &texture_ids);
+    glBindTexture(GL_TEXTURE_2D, texture_ids);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, width, height, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenRenderbuffers(1, &rbo_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_ids, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Error: visibility buffer framebuffer is incomplete" << std::endl;
+        std::exit(1);
+    }
+    target_width = width;
+    target_height = height;
+}
+
+void VisibilityBuffer::render(const glm::mat4& projection)
+{
+    gpu_timer.begin();
+    if (projection != placed_projection || layers != placed_layers)
+    {
+        place_instances(projection);
+    }
+    const auto instances_count = static_cast<GLsizei>(layers * grid_columns * grid_rows);
+
+    if (path == ShadingPath::forward)
+    {
+        use_program(shader_program_forward);
+        glUniformMatrix4fv(glGetUniformLocation(shader_program_forward, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        bind_vertex_array(vao);
+        draw_elements_instanced(GL_TRIANGLES, static_cast<GLsizei>(indices_count), GL_UNSIGNED_INT, 0, instances_count);
+        gpu_timer.end();
+        return;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    if (viewport[2] != target_width || viewport[3] != target_height)
+    {
+        resize_target(viewport[2], viewport[3]);
+    }
+
+    bind_framebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, target_width, target_height);
+    constexpr GLuint background[4] = { 0, 0, 0, 0 };
+    constexpr float depth_far{ 1.0f };
+    glClearBufferuiv(GL_COLOR, 0, background);
+    glClearBufferfv(GL_DEPTH, 0, &depth_far);
+    use_program(shader_program_ids);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_ids, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    bind_vertex_array(vao);
+    draw_elements_instanced(GL_TRIANGLES, static_cast<GLsizei>(indices_count), GL_UNSIGNED_INT, 0, instances_count);
+
+    bind_framebuffer(GL_FRAMEBUFFER, static_cast<unsigned>(framebuffer));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    use_program(shader_program_resolve);
+    glUniformMatrix4fv(glGetUniformLocation(shader_program_resolve, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform4f(glGetUniformLocation(shader_program_resolve, "viewport"), static_cast<float>(viewport[0]), static_cast<float>(viewport[1]),
+        static_cast<float>(viewport[2]), static_cast<float>(viewport[3]));
+    glUniform1i(glGetUniformLocation(shader_program_resolve, "ids"), 0);
+    glUniform1i(glGetUniformLocation(shader_program_resolve, "vertices"), 1);
+    glUniform1i(glGetUniformLocation(shader_program_resolve, "indices"), 2);
+    glUniform1i(glGetUniformLocation(shader_program_resolve, "instances"), 3);
+    bind_texture(GL_TEXTURE0, texture_ids);
+    bind_texture_buffer(GL_TEXTURE1, texture_vertices);
+    bind_texture_buffer(GL_TEXTURE2, texture_indices);
+    bind_texture_buffer(GL_TEXTURE3, texture_instances);
+    glActiveTexture(GL_TEXTURE0);
+    bind_vertex_array(vao_empty);
+    draw_arrays(GL_TRIANGLES, 0, 3);
+    gpu_timer.end();
+}
+
+void visibility_buffer_benchmark()
+{
+    constexpr int width{ 1280 };
+    constexpr int height{ 720 };
+    constexpr std::size_t frames_count{ 20 };
+
+    unsigned texture_color, rbo_depth, fbo;
+    glGenTextures(1, &texture_color);
+    glBindTexture(GL_TEXTURE_2D, texture_color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenRenderbuffers(1, &rbo_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo_depth);
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+
+    VisibilityBuffer visibility_buffer;
+    visibility_buffer.init();
+    const auto projection = glm::perspective(glm::radians(45.0f), static_cast<float>(width) / static_cast<float>(height), 0.1f, 100.0f);
+
+    // glFinish waits until GPU has executed everything, so wall time of the frames is GPU time.
+    const auto measure = [&](const ShadingPath path)
+        {
+            visibility_buffer.path = path;
+            const auto frame = [&]()
+                {
+                    bind_framebuffer(GL_FRAMEBUFFER, fbo);
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    visibility_buffer.render(projection);
+                };
+            frame();
+            glFinish();
+            const auto time_start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i != frames_count; ++i)
+            {
+                frame();
+            }
+            glFinish();
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / static_cast<double>(frames_count);
+        };
+
+    std::cout << "Visibility buffer benchmark, " << width << 'x' << height << ", ms per frame:" << std::endl;
+    for (std::size_t layers = 1; layers <= VisibilityBuffer::layers_max; layers *= 2)
+    {
+        visibility_buffer.layers = layers;
+        const auto forward_ms = measure(ShadingPath::forward);
+        const auto visibility_buffer_ms = measure(ShadingPath::visibility_buffer);
+        std::cout << "  " << layers << " layers (" << visibility_buffer.triangles_drawn() << " triangles)"
+            << ": forward " << forward_ms << ", visibility buffer " << visibility_buffer_ms
+            << " (" << forward_ms / visibility_buffer_ms << "x)" << std::endl;
+    }
+
+    visibility_buffer.destroy();
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo_depth);
+    glDeleteTextures(1, &texture_color);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
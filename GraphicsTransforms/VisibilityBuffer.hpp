@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "GlUtils.hpp"
+
+// Both attributes are vec4, so that the vertex buffer is also a buffer texture of RGBA32F.
+struct VisibilityBufferVertex
+{
+    glm::vec4 position;
+    glm::vec4 normal;
+};
+
+enum struct ShadingPath
+{
+    forward,
+    visibility_buffer,
+};
+
+// A stack of layers of high-polygon meshes in front of the camera, shaded either forward or through a visibility buffer.
+//
+// Forward: every fragment that passes the depth test is shaded, so when meshes come from far to near
+// (the order is arbitrary for imported meshes), a pixel covered by n layers is shaded n times.
+// Visibility buffer: a thin pass writes only the instance and the triangle of each pixel into an integer target
+// (its fragment shader does nothing else), then a full-screen resolve pass fetches the 3 vertices of that triangle
+// from buffer textures, reconstructs perspective-correct barycentrics of the pixel center, interpolates
+// the position and the normal, and shades each pixel exactly once.
+// Shading is deliberately heavy (16 point lights), like materials of real scenes, so that the cost of overdraw shows.
+//
+// The stack is placed in view space, so its depth complexity is the same wherever the camera looks:
+// each layer is a grid of meshes that covers the whole view at its depth.
+struct VisibilityBuffer
+{
+    static constexpr int mesh_segments{ 64 };
+    static constexpr int mesh_rings{ 32 };
+    static constexpr std::size_t grid_columns{ 6 };
+    static constexpr std::size_t grid_rows{ 4 };
+    static constexpr std::size_t layers_max{ 16 };
+    static constexpr std::size_t instances_max{ layers_max * grid_columns * grid_rows };
+    static constexpr float layer_depth_first{ 2.0f };
+    static constexpr float layer_spacing{ 0.4f };
+
+    ShadingPath path;
+    std::size_t layers;
+
+    std::size_t indices_count;
+    std::size_t vertices_count;
+    unsigned vbo_vertices, ibo, vbo_instances, vao;
+    // The same buffers for the resolve pass.
+    unsigned texture_vertices, texture_indices, texture_instances;
+    // The visibility buffer: instance + 1 (0 is the background) and the triangle of each pixel.
+    unsigned texture_ids, rbo_depth, fbo;
+    int target_width, target_height;
+    unsigned vao_empty;
+    unsigned shader_program_forward, shader_program_ids, shader_program_resolve;
+
+    // Instances are placed for this projection and count of layers.
+    glm::mat4 placed_projection;
+    std::size_t placed_layers;
+
+    GpuTimer gpu_timer;
+
+    void init();
+    void destroy();
+
+    // Renders into the bound framebuffer, over its viewport.
+    void render(const glm::mat4& projection);
+
+    std::size_t triangles_drawn() const
+    {
+        return layers * grid_columns * grid_rows * indices_count / 3;
+    }
+
+    std::size_t gpu_memory_bytes() const
+    {
+        return vertices_count * sizeof(VisibilityBufferVertex) + indices_count * sizeof(unsigned)
+            + instances_max * sizeof(glm::vec4) + static_cast<std::size_t>(target_width) * static_cast<std::size_t>(target_height) * (8 + 4);
+    }
+
+private:
+    void place_instances(const glm::mat4& projection);
+    void resize_target(int width, int height);
+};
+
+// Renders the stack offscreen with a growing count of layers with both paths and prints time of a frame.
+// Requires a current OpenGL context.
+void visibility_buffer_benchmark();
@@ -0,0 +1,70 @@
+"""Compares frame CPU time of two builds of GraphicsTransforms on replay scenarios.
+
+Each executable plays every scenario several times in a hidden window (runs alternate between
+the executables, so that both see the same thermal and background conditions),
+and the median of the runs is reported as a markdown table.
+Scenarios are the ones the candidate lists with --list-replays, unless they are given.
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+METRICS = ["cpu_ms_mean", "cpu_ms_p50", "cpu_ms_p95", "cpu_ms_p99"]
+
+
+def list_replays(executable):
+    result = subprocess.run([executable, "--list-replays"], check=True, capture_output=True, text=True)
+    return result.stdout.split()
+
+
+def run_replay(executable, scenario, report_path):
+    subprocess.run([executable, "--headless", "--replay", scenario, "--report", report_path],
+                   check=True, stdout=subprocess.DEVNULL)
+    report = {}
+    with open(report_path) as file:
+        for line in file:
+            key, _, value = line.strip().partition("=")
+            report[key] = value
+    return {metric: float(report[metric]) for metric in METRICS}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--baseline", required=True, help="executable built without PGO")
+    parser.add_argument("--candidate", required=True, help="executable built with PGO")
+    parser.add_argument("--scenarios", nargs="+", help="scenarios to play (all of them if omitted)")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--output", help="markdown file for the report (stdout only if omitted)")
+    args = parser.parse_args()
+    scenarios = args.scenarios or list_replays(args.candidate)
+
+    lines = [
+        "| scenario | metric | baseline ms | PGO ms | speedup |",
+        "|---|---|---:|---:|---:|",
+    ]
+    with tempfile.TemporaryDirectory() as directory:
+        report_path = os.path.join(directory, "report.txt")
+        for scenario in scenarios:
+            runs = {"baseline": [], "candidate": []}
+            for _ in range(args.runs):
+                runs["baseline"].append(run_replay(args.baseline, scenario, report_path))
+                runs["candidate"].append(run_replay(args.candidate, scenario, report_path))
+            for metric in METRICS:
+                baseline = statistics.median(run[metric] for run in runs["baseline"])
+                candidate = statistics.median(run[metric] for run in runs["candidate"])
+                speedup = baseline / candidate if candidate > 0.0 else float("nan")
+                lines.append(f"| {scenario} | {metric[len('cpu_ms_'):]} | {baseline:.3f} | {candidate:.3f} | {speedup:.2f}x |")
+
+    text = "\n".join(["# PGO benchmark", "", f"Median of {args.runs} runs per build.", ""] + lines) + "\n"
+    sys.stdout.write(text)
+    if args.output:
+        with open(args.output, "w") as file:
+            file.write(text)
+
+
+if __name__ == "__main__":
+    main()
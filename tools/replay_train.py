@@ -0,0 +1,22 @@
+"""Plays every replay scenario of GraphicsTransforms in a hidden window.
+
+Used to train profile-guided optimization: an instrumented build writes profiles of the runs.
+Scenarios are the ones the executable lists with --list-replays.
+"""
+
+import subprocess
+import sys
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(f"Usage: {sys.argv[0]} <executable>")
+    executable = sys.argv[1]
+    result = subprocess.run([executable, "--list-replays"], check=True, capture_output=True, text=True)
+    for scenario in result.stdout.split():
+        print(f"Replay {scenario}", flush=True)
+        subprocess.run([executable, "--headless", "--replay", scenario], check=True)
+
+
+if __name__ == "__main__":
+    main()